@@ -19,6 +19,8 @@
 #include <android/binder_ibinder_platform.h>
 #include <utils/SystemClock.h>
 
+#include <cstring>
+
 #include <Utils.h>
 
 #include "core-impl/Module.h"
@@ -91,13 +93,7 @@ std::string StreamWorkerCommonLogic::init() {
     if (sizeof(DataBufferElement) != mDataMQ->getQuantumSize()) {
         return "Unexpected Data MQ quantum size: " + std::to_string(mDataMQ->getQuantumSize());
     }
-    mDataBufferSize = mDataMQ->getQuantumCount() * mDataMQ->getQuantumSize();
-    mDataBuffer.reset(new (std::nothrow) DataBufferElement[mDataBufferSize]);
-    if (mDataBuffer == nullptr) {
-        return "Failed to allocate data buffer for element count " +
-               std::to_string(mDataMQ->getQuantumCount()) +
-               ", size in bytes: " + std::to_string(mDataBufferSize);
-    }
+    mBounceBuffer.resize(mFrameSize);
     if (::android::status_t status = mDriver->init(); status != STATUS_OK) {
         return "Failed to initialize the driver: " + std::to_string(status);
     }
@@ -123,6 +119,54 @@ void StreamWorkerCommonLogic::populateReplyWrongState(
     reply->status = STATUS_INVALID_OPERATION;
 }
 
+::android::status_t StreamWorkerCommonLogic::transferRegions(
+        const StreamContext::DataMQ::MemTransaction& tx, size_t byteCount, bool isInput,
+        size_t* actualFrameCount, int32_t* latencyMs) {
+    const auto& first = tx.getFirstRegion();
+    const auto& second = tx.getSecondRegion();
+    const size_t frameCount = byteCount / mFrameSize;
+    *actualFrameCount = 0;
+    while (*actualFrameCount < frameCount) {
+        const size_t offset = *actualFrameCount * mFrameSize;
+        size_t chunkFrameCount = frameCount - *actualFrameCount;
+        void* buffer = nullptr;
+        size_t splitHeadByteCount = 0;
+        if (offset < first.getLength()) {
+            if (const size_t firstFrameCount = (first.getLength() - offset) / mFrameSize;
+                firstFrameCount > 0) {
+                chunkFrameCount = std::min(chunkFrameCount, firstFrameCount);
+                buffer = first.getAddress() + offset;
+            } else {
+                // The frame is split by the end of the MQ, transfer it via the bounce buffer.
+                splitHeadByteCount = first.getLength() - offset;
+                chunkFrameCount = 1;
+                buffer = mBounceBuffer.data();
+                if (!isInput) {
+                    memcpy(mBounceBuffer.data(), first.getAddress() + offset, splitHeadByteCount);
+                    memcpy(mBounceBuffer.data() + splitHeadByteCount, second.getAddress(),
+                           mFrameSize - splitHeadByteCount);
+                }
+            }
+        } else {
+            buffer = second.getAddress() + (offset - first.getLength());
+        }
+        size_t chunkActualFrameCount = 0;
+        if (::android::status_t status =
+                    mDriver->transfer(buffer, chunkFrameCount, &chunkActualFrameCount, latencyMs);
+            status != ::android::OK) {
+            return status;
+        }
+        if (splitHeadByteCount > 0 && isInput && chunkActualFrameCount > 0) {
+            memcpy(first.getAddress() + offset, mBounceBuffer.data(), splitHeadByteCount);
+            memcpy(second.getAddress(), mBounceBuffer.data() + splitHeadByteCount,
+                   mFrameSize - splitHeadByteCount);
+        }
+        *actualFrameCount += chunkActualFrameCount;
+        if (chunkActualFrameCount < chunkFrameCount) break;  // Short transfer.
+    }
+    return ::android::OK;
+}
+
 const std::string StreamInWorkerLogic::kThreadName = "reader";
 
 StreamInWorkerLogic::Status StreamInWorkerLogic::cycle() {
@@ -272,26 +316,39 @@ StreamInWorkerLogic::Status StreamInWorkerLogic::cycle() {
 }
 
 bool StreamInWorkerLogic::read(size_t clientSize, StreamDescriptor::Reply* reply) {
-    const size_t byteCount = std::min({clientSize, mDataMQ->availableToWrite(), mDataBufferSize});
+    const size_t byteCount = std::min(clientSize, mDataMQ->availableToWrite());
     const bool isConnected = mIsConnected;
     size_t actualFrameCount = 0;
     bool fatal = false;
     int32_t latency = Module::kLatencyMs;
+    // The driver produces data directly into the free space of the MQ.
+    StreamContext::DataMQ::MemTransaction tx;
+    if (byteCount > 0 && !mDataMQ->beginWrite(byteCount, &tx)) {
+        LOG(WARNING) << __func__ << ": getting " << byteCount
+                     << " bytes of space in data MQ failed";
+        reply->status = STATUS_NOT_ENOUGH_DATA;
+        reply->latencyMs = latency;
+        return true;
+    }
     if (isConnected) {
-        if (::android::status_t status = mDriver->transfer(
-                    mDataBuffer.get(), byteCount / mFrameSize, &actualFrameCount, &latency);
+        if (::android::status_t status =
+                    transferRegions(tx, byteCount, true /*isInput*/, &actualFrameCount, &latency);
             status != ::android::OK) {
             fatal = true;
             LOG(ERROR) << __func__ << ": read failed: " << status;
         }
     } else {
         usleep(3000);  // Simulate blocking transfer delay.
-        for (size_t i = 0; i < byteCount; ++i) mDataBuffer[i] = 0;
         actualFrameCount = byteCount / mFrameSize;
+        size_t zeroByteCount = actualFrameCount * mFrameSize;
+        for (const auto& region : {tx.getFirstRegion(), tx.getSecondRegion()}) {
+            const size_t regionByteCount = std::min(region.getLength(), zeroByteCount);
+            if (regionByteCount > 0) memset(region.getAddress(), 0, regionByteCount);
+            zeroByteCount -= regionByteCount;
+        }
     }
     const size_t actualByteCount = actualFrameCount * mFrameSize;
-    if (bool success =
-                actualByteCount > 0 ? mDataMQ->write(&mDataBuffer[0], actualByteCount) : true;
+    if (bool success = actualByteCount > 0 ? mDataMQ->commitWrite(actualByteCount) : true;
         success) {
         LOG(VERBOSE) << __func__ << ": writing of " << actualByteCount << " bytes into data MQ"
                      << " succeeded; connected? " << isConnected;
@@ -528,12 +585,14 @@ bool StreamOutWorkerLogic::write(size_t clientSize, StreamDescriptor::Reply* rep
     const size_t readByteCount = mDataMQ->availableToRead();
     bool fatal = false;
     int32_t latency = Module::kLatencyMs;
-    if (bool success = readByteCount > 0 ? mDataMQ->read(&mDataBuffer[0], readByteCount) : true) {
+    // The driver consumes data directly from the MQ, it is released after the transfer.
+    StreamContext::DataMQ::MemTransaction tx;
+    if (bool success = readByteCount > 0 ? mDataMQ->beginRead(readByteCount, &tx) : true) {
         const bool isConnected = mIsConnected;
         LOG(VERBOSE) << __func__ << ": reading of " << readByteCount << " bytes from data MQ"
                      << " succeeded; connected? " << isConnected;
         // Amount of data that the HAL module is going to actually use.
-        size_t byteCount = std::min({clientSize, readByteCount, mDataBufferSize});
+        size_t byteCount = std::min(clientSize, readByteCount);
         if (byteCount >= mFrameSize && mForceTransientBurst) {
             // In order to prevent the state machine from going to ACTIVE state,
             // simulate partial write.
@@ -541,8 +600,9 @@ bool StreamOutWorkerLogic::write(size_t clientSize, StreamDescriptor::Reply* rep
         }
         size_t actualFrameCount = 0;
         if (isConnected) {
-            if (::android::status_t status = mDriver->transfer(
-                        mDataBuffer.get(), byteCount / mFrameSize, &actualFrameCount, &latency);
+            if (::android::status_t status =
+                        transferRegions(tx, byteCount, false /*isInput*/, &actualFrameCount,
+                                        &latency);
                 status != ::android::OK) {
                 fatal = true;
                 LOG(ERROR) << __func__ << ": write failed: " << status;
@@ -553,7 +613,12 @@ bool StreamOutWorkerLogic::write(size_t clientSize, StreamDescriptor::Reply* rep
             }
             actualFrameCount = byteCount / mFrameSize;
         }
+        // Only the data that has been transferred is released, the rest stays in the MQ.
         const size_t actualByteCount = actualFrameCount * mFrameSize;
+        if (actualByteCount > 0 && !mDataMQ->commitRead(actualByteCount)) {
+            LOG(WARNING) << __func__ << ": releasing of " << actualByteCount
+                         << " bytes in data MQ failed";
+        }
         // Frames are consumed and counted regardless of the connection status.
         reply->fmqByteCount += actualByteCount;
         mFrameCount += actualFrameCount;
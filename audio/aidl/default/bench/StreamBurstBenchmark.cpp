@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the throughput of 'burst' commands of the stream workers. The benchmark acts as the
+// client: it exchanges the data through the data MQ and waits for the reply to each burst, while
+// the worker thread transfers the data to / from a driver which does not do any I/O.
+
+#include <memory>
+#include <vector>
+
+#include <aidl/android/media/audio/common/AudioChannelLayout.h>
+#include <aidl/android/media/audio/common/AudioFormatDescription.h>
+#include <aidl/android/media/audio/common/AudioFormatType.h>
+#include <aidl/android/media/audio/common/PcmType.h>
+#include <aidl/android/media/audio/common/Void.h>
+#include <benchmark/benchmark.h>
+
+#include "core-impl/Module.h"
+#include "core-impl/Stream.h"
+
+namespace aidl::android::hardware::audio::core {
+namespace {
+
+using ::aidl::android::media::audio::common::AudioChannelLayout;
+using ::aidl::android::media::audio::common::AudioDevice;
+using ::aidl::android::media::audio::common::AudioFormatDescription;
+using ::aidl::android::media::audio::common::AudioFormatType;
+using ::aidl::android::media::audio::common::PcmType;
+using ::aidl::android::media::audio::common::Void;
+
+// Not a multiple of the burst sizes, so that bursts regularly wrap around the end of the MQ.
+constexpr size_t kBufferSizeFrames = 4000;
+constexpr size_t kFrameSizeBytes = 4;  // Stereo PCM 16-bit.
+
+class NullDriver : public DriverInterface {
+  public:
+    ::android::status_t init() override { return ::android::OK; }
+    ::android::status_t setConnectedDevices(const std::vector<AudioDevice>&) override {
+        return ::android::OK;
+    }
+    ::android::status_t drain(StreamDescriptor::DrainMode) override { return ::android::OK; }
+    ::android::status_t flush() override { return ::android::OK; }
+    ::android::status_t pause() override { return ::android::OK; }
+    ::android::status_t transfer(void* buffer, size_t frameCount, size_t* actualFrameCount,
+                                 int32_t* latencyMs) override {
+        benchmark::DoNotOptimize(buffer);
+        benchmark::ClobberMemory();
+        *actualFrameCount = frameCount;
+        *latencyMs = Module::kLatencyMs;
+        return ::android::OK;
+    }
+    ::android::status_t standby() override { return ::android::OK; }
+};
+
+StreamContext makeContext() {
+    AudioFormatDescription format;
+    format.type = AudioFormatType::PCM;
+    format.pcm = PcmType::INT_16_BIT;
+    return StreamContext(
+            std::make_unique<StreamContext::CommandMQ>(1, true /*configureEventFlagWord*/),
+            std::make_unique<StreamContext::ReplyMQ>(1, true /*configureEventFlagWord*/), format,
+            AudioChannelLayout::make<AudioChannelLayout::Tag::layoutMask>(
+                    AudioChannelLayout::LAYOUT_STEREO),
+            48000, std::make_unique<StreamContext::DataMQ>(kFrameSizeBytes * kBufferSizeFrames),
+            nullptr, nullptr, {});
+}
+
+bool sendCommand(const StreamContext& context, const StreamDescriptor::Command& command,
+                 StreamDescriptor::Reply* reply) {
+    return context.getCommandMQ()->writeBlocking(&command, 1) &&
+           context.getReplyMQ()->readBlocking(reply, 1) && reply->status == STATUS_OK;
+}
+
+// Runs the worker for 'context' until the end of the benchmark.
+template <class Worker>
+class WorkerRunner {
+  public:
+    explicit WorkerRunner(const StreamContext& context)
+        : mContext(context), mWorker(context, &mDriver) {
+        mWorker.setIsConnected(true);
+        StreamDescriptor::Reply reply;
+        mStarted = mWorker.start() &&
+                   sendCommand(context,
+                               StreamDescriptor::Command::make<
+                                       StreamDescriptor::Command::Tag::start>(Void{}),
+                               &reply);
+    }
+    ~WorkerRunner() {
+        auto exit =
+                StreamDescriptor::Command::make<StreamDescriptor::Command::Tag::halReservedExit>(
+                        mContext.getInternalCommandCookie());
+        mContext.getCommandMQ()->writeBlocking(&exit, 1);
+        mWorker.stop();
+    }
+    bool isStarted() const { return mStarted; }
+
+  private:
+    const StreamContext& mContext;
+    NullDriver mDriver;
+    Worker mWorker;
+    bool mStarted = false;
+};
+
+}  // namespace
+
+static void BM_StreamOutBurst(benchmark::State& state) {
+    const size_t burstBytes = state.range(0) * kFrameSizeBytes;
+    StreamContext context = makeContext();
+    WorkerRunner<StreamOutWorker> runner(context);
+    if (!runner.isStarted()) {
+        state.SkipWithError("failed to start the worker");
+        return;
+    }
+    const std::vector<int8_t> data(burstBytes);
+    StreamDescriptor::Reply reply;
+    for (auto _ : state) {
+        if (!context.getDataMQ()->write(data.data(), burstBytes) ||
+            !sendCommand(context,
+                         StreamDescriptor::Command::make<StreamDescriptor::Command::Tag::burst>(
+                                 burstBytes),
+                         &reply)) {
+            state.SkipWithError("burst failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * burstBytes);
+}
+BENCHMARK(BM_StreamOutBurst)->ArgName("frames")->Arg(192)->Arg(960)->Arg(3840);
+
+static void BM_StreamInBurst(benchmark::State& state) {
+    const size_t burstBytes = state.range(0) * kFrameSizeBytes;
+    StreamContext context = makeContext();
+    WorkerRunner<StreamInWorker> runner(context);
+    if (!runner.isStarted()) {
+        state.SkipWithError("failed to start the worker");
+        return;
+    }
+    std::vector<int8_t> data(burstBytes);
+    StreamDescriptor::Reply reply;
+    for (auto _ : state) {
+        if (!sendCommand(context,
+                         StreamDescriptor::Command::make<StreamDescriptor::Command::Tag::burst>(
+                                 burstBytes),
+                         &reply) ||
+            !context.getDataMQ()->read(data.data(), reply.fmqByteCount)) {
+            state.SkipWithError("burst failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * burstBytes);
+}
+BENCHMARK(BM_StreamInBurst)->ArgName("frames")->Arg(192)->Arg(960)->Arg(3840);
+
+}  // namespace aidl::android::hardware::audio::core
+
+BENCHMARK_MAIN();
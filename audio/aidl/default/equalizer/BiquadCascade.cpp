@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "BiquadCascade.h"
+
+namespace aidl::android::hardware::audio::effect {
+
+namespace {
+
+// Keeps the filter frequency below Nyquist, e.g. for the highest band at low sample rates.
+float clampFrequency(float sampleRate, float frequencyHz) {
+    return std::clamp(frequencyHz, 1.f, 0.45f * sampleRate);
+}
+
+BiquadCascade::Coefficients normalize(double b0, double b1, double b2, double a0, double a1,
+                                      double a2) {
+    return {.b0 = static_cast<float>(b0 / a0),
+            .b1 = static_cast<float>(b1 / a0),
+            .b2 = static_cast<float>(b2 / a0),
+            .a1 = static_cast<float>(a1 / a0),
+            .a2 = static_cast<float>(a2 / a0)};
+}
+
+}  // namespace
+
+BiquadCascade::Coefficients BiquadCascade::peaking(float sampleRate, float centerHz, float q,
+                                                   float gainDb) {
+    const double a = std::pow(10., gainDb / 40.);
+    const double w0 = 2. * M_PI * clampFrequency(sampleRate, centerHz) / sampleRate;
+    const double cosW0 = std::cos(w0);
+    const double alpha = std::sin(w0) / (2. * q);
+    return normalize(1. + alpha * a, -2. * cosW0, 1. - alpha * a, 1. + alpha / a, -2. * cosW0,
+                     1. - alpha / a);
+}
+
+BiquadCascade::Coefficients BiquadCascade::lowShelf(float sampleRate, float cornerHz, float q,
+                                                    float gainDb) {
+    const double a = std::pow(10., gainDb / 40.);
+    const double w0 = 2. * M_PI * clampFrequency(sampleRate, cornerHz) / sampleRate;
+    const double cosW0 = std::cos(w0);
+    const double twoSqrtAAlpha = 2. * std::sqrt(a) * std::sin(w0) / (2. * q);
+    return normalize(a * ((a + 1.) - (a - 1.) * cosW0 + twoSqrtAAlpha),
+                     2. * a * ((a - 1.) - (a + 1.) * cosW0),
+                     a * ((a + 1.) - (a - 1.) * cosW0 - twoSqrtAAlpha),
+                     (a + 1.) + (a - 1.) * cosW0 + twoSqrtAAlpha,
+                     -2. * ((a - 1.) + (a + 1.) * cosW0),
+                     (a + 1.) + (a - 1.) * cosW0 - twoSqrtAAlpha);
+}
+
+BiquadCascade::Coefficients BiquadCascade::highShelf(float sampleRate, float cornerHz, float q,
+                                                     float gainDb) {
+    const double a = std::pow(10., gainDb / 40.);
+    const double w0 = 2. * M_PI * clampFrequency(sampleRate, cornerHz) / sampleRate;
+    const double cosW0 = std::cos(w0);
+    const double twoSqrtAAlpha = 2. * std::sqrt(a) * std::sin(w0) / (2. * q);
+    return normalize(a * ((a + 1.) + (a - 1.) * cosW0 + twoSqrtAAlpha),
+                     -2. * a * ((a - 1.) + (a + 1.) * cosW0),
+                     a * ((a + 1.) + (a - 1.) * cosW0 - twoSqrtAAlpha),
+                     (a + 1.) - (a - 1.) * cosW0 + twoSqrtAAlpha,
+                     2. * ((a - 1.) - (a + 1.) * cosW0),
+                     (a + 1.) - (a - 1.) * cosW0 - twoSqrtAAlpha);
+}
+
+BiquadCascade::BiquadCascade(size_t channelCount, size_t stageCount)
+    : mChannelCount(channelCount),
+      mStageCount(std::min(stageCount, kMaxStageCount)),
+      mState((channelCount + kChannelsPerVector - 1) / kChannelsPerVector * mStageCount) {
+    reset();
+}
+
+void BiquadCascade::setCoefficients(const std::array<Coefficients, kMaxStageCount>& coefficients,
+                                    bool immediate) {
+    mTargetCoefficients = coefficients;
+    if (immediate) {
+        mCoefficients = coefficients;
+        mRampFramesLeft = 0;
+        return;
+    }
+    // Start from where the filters are now, even if the previous ramp did not finish.
+    for (size_t stage = 0; stage < mStageCount; ++stage) {
+        const Coefficients& from = mCoefficients[stage];
+        const Coefficients& to = coefficients[stage];
+        mRampSteps[stage] = {.b0 = (to.b0 - from.b0) / kRampFrames,
+                             .b1 = (to.b1 - from.b1) / kRampFrames,
+                             .b2 = (to.b2 - from.b2) / kRampFrames,
+                             .a1 = (to.a1 - from.a1) / kRampFrames,
+                             .a2 = (to.a2 - from.a2) / kRampFrames};
+    }
+    mRampFramesLeft = kRampFrames;
+}
+
+void BiquadCascade::reset() {
+    std::fill(mState.begin(), mState.end(), StageState{});
+}
+
+void BiquadCascade::process(const float* in, float* out, size_t frameCount) {
+    if (frameCount == 0 || mChannelCount == 0 || mStageCount == 0) return;
+    std::array<Coefficients, kMaxStageCount> coefficients;
+    for (size_t group = 0; group * kChannelsPerVector < mChannelCount; ++group) {
+        // Every group starts from the same coefficients and follows the same ramp.
+        coefficients = mCoefficients;
+        switch (std::min(kChannelsPerVector, mChannelCount - group * kChannelsPerVector)) {
+            case 1:
+                processGroup<1>(group, in, out, frameCount, &coefficients);
+                break;
+            case 2:
+                processGroup<2>(group, in, out, frameCount, &coefficients);
+                break;
+            case 3:
+                processGroup<3>(group, in, out, frameCount, &coefficients);
+                break;
+            default:
+                processGroup<4>(group, in, out, frameCount, &coefficients);
+                break;
+        }
+    }
+    if (mRampFramesLeft > 0) {
+        mCoefficients = coefficients;
+        mRampFramesLeft -= std::min(mRampFramesLeft, frameCount);
+    }
+}
+
+template <size_t kLanes>
+void BiquadCascade::processGroup(size_t group, const float* in, float* out, size_t frameCount,
+                                 std::array<Coefficients, kMaxStageCount>* coefficients) {
+    static_assert(kLanes <= kChannelsPerVector);
+    // Keep the state in locals, so that it is not reloaded after each store to 'out'.
+    std::array<StageState, kMaxStageCount> state;
+    std::copy_n(&mState[group * mStageCount], mStageCount, state.begin());
+    std::array<Coefficients, kMaxStageCount>& c = *coefficients;
+    size_t rampFramesLeft = mRampFramesLeft;
+
+    const size_t firstChannel = group * kChannelsPerVector;
+    for (size_t frame = 0; frame < frameCount; ++frame) {
+        if (rampFramesLeft > 0) {
+            if (--rampFramesLeft == 0) {
+                c = mTargetCoefficients;
+            } else {
+                for (size_t stage = 0; stage < mStageCount; ++stage) {
+                    c[stage].b0 += mRampSteps[stage].b0;
+                    c[stage].b1 += mRampSteps[stage].b1;
+                    c[stage].b2 += mRampSteps[stage].b2;
+                    c[stage].a1 += mRampSteps[stage].a1;
+                    c[stage].a2 += mRampSteps[stage].a2;
+                }
+            }
+        }
+        const size_t first = frame * mChannelCount + firstChannel;
+        FloatVector x = {};
+        for (size_t lane = 0; lane < kLanes; ++lane) x[lane] = in[first + lane];
+        for (size_t stage = 0; stage < mStageCount; ++stage) {
+            StageState& s = state[stage];
+            const FloatVector y = c[stage].b0 * x + s.s1;
+            s.s1 = c[stage].b1 * x - c[stage].a1 * y + s.s2;
+            s.s2 = c[stage].b2 * x - c[stage].a2 * y;
+            x = y;
+        }
+        for (size_t lane = 0; lane < kLanes; ++lane) out[first + lane] = x[lane];
+    }
+
+    std::copy_n(state.begin(), mStageCount, &mState[group * mStageCount]);
+}
+
+}  // namespace aidl::android::hardware::audio::effect
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace aidl::android::hardware::audio::effect {
+
+/**
+ * A cascade of biquad filters processing interleaved float samples.
+ *
+ * The channels are filtered in parallel, up to kChannelsPerVector channels in the lanes of one
+ * SIMD vector. The vector type is a compiler vector extension, which is lowered to NEON or SSE.
+ * Coefficient changes are ramped linearly over kRampFrames to avoid zipper noise. The stability
+ * region of a biquad is convex, thus the ramp between two stable filters is stable.
+ */
+class BiquadCascade {
+  public:
+    // Normalized coefficients of a transposed direct form II biquad, a0 is 1.
+    struct Coefficients {
+        float b0 = 1.f;
+        float b1 = 0.f;
+        float b2 = 0.f;
+        float a1 = 0.f;
+        float a2 = 0.f;
+    };
+
+    static constexpr size_t kChannelsPerVector = 4;
+    static constexpr size_t kMaxStageCount = 8;
+    static constexpr size_t kRampFrames = 256;
+
+    // Filters from the Audio EQ Cookbook by Robert Bristow-Johnson.
+    static Coefficients peaking(float sampleRate, float centerHz, float q, float gainDb);
+    static Coefficients lowShelf(float sampleRate, float cornerHz, float q, float gainDb);
+    static Coefficients highShelf(float sampleRate, float cornerHz, float q, float gainDb);
+
+    BiquadCascade(size_t channelCount, size_t stageCount);
+
+    size_t getChannelCount() const { return mChannelCount; }
+    size_t getStageCount() const { return mStageCount; }
+
+    // Sets new coefficients for all the stages. Unless 'immediate' is set, the filters move
+    // from the current coefficients to the new ones over kRampFrames.
+    void setCoefficients(const std::array<Coefficients, kMaxStageCount>& coefficients,
+                         bool immediate = false);
+    // Clears the filter state, for example after a flush of the stream.
+    void reset();
+    // 'in' and 'out' may point to the same buffer.
+    void process(const float* in, float* out, size_t frameCount);
+
+  private:
+    typedef float FloatVector __attribute__((vector_size(kChannelsPerVector * sizeof(float))));
+    struct StageState {
+        FloatVector s1;
+        FloatVector s2;
+    };
+
+    template <size_t kLanes>
+    void processGroup(size_t group, const float* in, float* out, size_t frameCount,
+                      std::array<Coefficients, kMaxStageCount>* coefficients);
+
+    const size_t mChannelCount;
+    const size_t mStageCount;
+    std::array<Coefficients, kMaxStageCount> mCoefficients;
+    std::array<Coefficients, kMaxStageCount> mTargetCoefficients;
+    std::array<Coefficients, kMaxStageCount> mRampSteps;
+    size_t mRampFramesLeft = 0;
+    // State of each stage for each group of kChannelsPerVector channels, group major.
+    std::vector<StageState> mState;
+};
+
+}  // namespace aidl::android::hardware::audio::effect
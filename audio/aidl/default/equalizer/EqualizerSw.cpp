@@ -209,14 +209,61 @@ RetCode EqualizerSw::releaseContext() {
     return RetCode::SUCCESS;
 }
 
+ndk::ScopedAStatus EqualizerSw::commandImpl(CommandId command) {
+    RETURN_IF_ASTATUS_NOT_OK(EffectImpl::commandImpl(command), "commandImplFailed");
+    // The worker thread is stopped after STOP and RESET, the audio of the next START is not
+    // a continuation of the previous one.
+    if (command == CommandId::STOP || command == CommandId::RESET) {
+        mContext->resetFilters();
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
 // Processing method running in EffectWorker thread.
 IEffect::Status EqualizerSw::effectProcessImpl(float* in, float* out, int samples) {
-    // TODO: get data buffer and process.
-    LOG(DEBUG) << __func__ << " in " << in << " out " << out << " samples " << samples;
-    for (int i = 0; i < samples; i++) {
-        *out++ = *in++;
+    if (!mContext) {
+        LOG(ERROR) << __func__ << " nullContext";
+        return {STATUS_INVALID_OPERATION, 0, 0};
     }
+    mContext->process(in, out, samples);
     return {STATUS_OK, samples, samples};
 }
 
+std::array<BiquadCascade::Coefficients, BiquadCascade::kMaxStageCount>
+EqualizerSwContext::computeCoefficients() {
+    std::array<BiquadCascade::Coefficients, BiquadCascade::kMaxStageCount> coefficients;
+    for (int band = 0; band < kMaxBandNumber; band++) {
+        const float frequency = kPresetsFrequencies[band];
+        const float gainDb = mBandLevels[band] / 100.f;
+        if (band == 0) {
+            coefficients[band] = BiquadCascade::lowShelf(mSampleRate, frequency, kShelfQ, gainDb);
+        } else if (band == kMaxBandNumber - 1) {
+            coefficients[band] = BiquadCascade::highShelf(mSampleRate, frequency, kShelfQ, gainDb);
+        } else {
+            coefficients[band] = BiquadCascade::peaking(mSampleRate, frequency, kPeakingQ, gainDb);
+        }
+    }
+    return coefficients;
+}
+
+void EqualizerSwContext::updateCoefficients() {
+    auto coefficients = computeCoefficients();
+    std::lock_guard lg(mCoefficientsLock);
+    mPendingCoefficients = coefficients;
+    mCoefficientsChanged = true;
+}
+
+void EqualizerSwContext::process(float* in, float* out, int samples) {
+    if (mInputFrameSize != mOutputFrameSize) {
+        // The filters need the same channels on both sides, pass the audio through.
+        std::copy(in, in + samples, out);
+        return;
+    }
+    if (mCoefficientsChanged.exchange(false)) {
+        std::lock_guard lg(mCoefficientsLock);
+        mCascade.setCoefficients(mPendingCoefficients);
+    }
+    mCascade.process(in, out, samples / mCascade.getChannelCount());
+}
+
 }  // namespace aidl::android::hardware::audio::effect
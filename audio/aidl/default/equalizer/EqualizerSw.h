@@ -17,10 +17,15 @@
 #pragma once
 
 #include <aidl/android/hardware/audio/effect/BnEffect.h>
+#include <android-base/thread_annotations.h>
 #include <fmq/AidlMessageQueue.h>
+#include <array>
+#include <atomic>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 
+#include "BiquadCascade.h"
 #include "effect-impl/EffectImpl.h"
 
 namespace aidl::android::hardware::audio::effect {
@@ -28,8 +33,11 @@ namespace aidl::android::hardware::audio::effect {
 class EqualizerSwContext final : public EffectContext {
   public:
     EqualizerSwContext(int statusDepth, const Parameter::Common& common)
-        : EffectContext(statusDepth, common) {
+        : EffectContext(statusDepth, common),
+          mSampleRate(common.input.base.sampleRate),
+          mCascade(mInputFrameSize / sizeof(float), kMaxBandNumber) {
         LOG(DEBUG) << __func__;
+        mCascade.setCoefficients(computeCoefficients(), true /* immediate */);
     }
 
     RetCode setEqPreset(const int& presetIdx) {
@@ -56,6 +64,7 @@ class EqualizerSwContext final : public EffectContext {
                 mBandLevels[it.index] = it.levelMb;
             }
         }
+        updateCoefficients();
         return ret;
     }
 
@@ -74,14 +83,33 @@ class EqualizerSwContext final : public EffectContext {
     static const int kMaxPresetNumber = 10;
     static const int kCustomPreset = -1;
 
+    // Called on the effect worker thread.
+    void process(float* in, float* out, int samples);
+    // Clears the filter state. Only called while the effect worker thread is stopped.
+    void resetFilters() { mCascade.reset(); }
+
   private:
+    // The lowest and highest bands are shelves, the others are peaking filters.
+    static constexpr float kShelfQ = 0.707f;
+    static constexpr float kPeakingQ = 1.f;
+
     static constexpr std::array<uint16_t, kMaxBandNumber> kPresetsFrequencies = {60, 230, 910, 3600,
                                                                                  14000};
     // preset band level
     int mPreset = kCustomPreset;
     int32_t mBandLevels[kMaxBandNumber] = {3, 0, 0, 0, 3};
 
-    // Add equalizer specific context for processing here
+    std::array<BiquadCascade::Coefficients, BiquadCascade::kMaxStageCount> computeCoefficients();
+    // Passes new coefficients to the worker thread, which ramps to them at the next process().
+    void updateCoefficients();
+
+    const float mSampleRate;
+    // Only used on the worker thread.
+    BiquadCascade mCascade;
+    std::mutex mCoefficientsLock;
+    std::array<BiquadCascade::Coefficients, BiquadCascade::kMaxStageCount> mPendingCoefficients
+            GUARDED_BY(mCoefficientsLock);
+    std::atomic<bool> mCoefficientsChanged = false;
 };
 
 class EqualizerSw final : public EffectImpl {
@@ -104,6 +132,7 @@ class EqualizerSw final : public EffectImpl {
     std::shared_ptr<EffectContext> createContext(const Parameter::Common& common) override;
     std::shared_ptr<EffectContext> getContext() override;
     RetCode releaseContext() override;
+    ndk::ScopedAStatus commandImpl(CommandId command) override;
 
     IEffect::Status effectProcessImpl(float* in, float* out, int samples) override;
     std::string getEffectName() override { return kEffectName; }
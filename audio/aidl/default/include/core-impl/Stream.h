@@ -23,6 +23,7 @@
 #include <memory>
 #include <optional>
 #include <variant>
+#include <vector>
 
 #include <StreamWorker.h>
 #include <aidl/android/hardware/audio/common/SinkMetadata.h>
@@ -166,6 +167,11 @@ struct DriverInterface {
     virtual ::android::status_t drain(StreamDescriptor::DrainMode mode) = 0;
     virtual ::android::status_t flush() = 0;
     virtual ::android::status_t pause() = 0;
+    // 'buffer' points directly into the data MQ: the driver consumes data from it for output
+    // streams and produces data into it for input streams. When the burst wraps around the end
+    // of the MQ, the driver is called once for each contiguous region. A frame that is split by
+    // the end of the MQ is passed in a separate one frame buffer, thus a burst can result in up
+    // to three calls. The buffer must not be accessed after returning.
     virtual ::android::status_t transfer(void* buffer, size_t frameCount, size_t* actualFrameCount,
                                          int32_t* latencyMs) = 0;
     virtual ::android::status_t standby() = 0;
@@ -201,6 +207,9 @@ class StreamWorkerCommonLogic : public ::android::hardware::audio::common::Strea
         mState = state;
         mTransientStateStart = std::chrono::steady_clock::now();
     }
+    ::android::status_t transferRegions(const StreamContext::DataMQ::MemTransaction& tx,
+                                        size_t byteCount, bool isInput,
+                                        size_t* actualFrameCount, int32_t* latencyMs);
 
     DriverInterface* const mDriver;
     // Atomic fields are used both by the main and worker threads.
@@ -218,11 +227,9 @@ class StreamWorkerCommonLogic : public ::android::hardware::audio::common::Strea
     std::chrono::time_point<std::chrono::steady_clock> mTransientStateStart;
     const bool mForceTransientBurst;
     const bool mForceSynchronousDrain;
-    // We use an array and the "size" field instead of a vector to be able to detect
-    // memory allocation issues.
-    std::unique_ptr<DataBufferElement[]> mDataBuffer;
-    size_t mDataBufferSize;
     long mFrameCount = 0;
+    // Holds a frame that is split by the end of the data MQ during the transfer.
+    std::vector<DataBufferElement> mBounceBuffer;
 };
 
 // This interface is used to decouple stream implementations from a concrete StreamWorker
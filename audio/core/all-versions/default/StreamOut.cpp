@@ -59,12 +59,7 @@ class WriteThread : public Thread {
           mCommandMQ(commandMQ),
           mDataMQ(dataMQ),
           mStatusMQ(statusMQ),
-          mEfGroup(efGroup),
-          mBuffer(nullptr) {}
-    bool init() {
-        mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
-        return mBuffer != nullptr;
-    }
+          mEfGroup(efGroup) {}
     virtual ~WriteThread() {}
 
    private:
@@ -74,7 +69,6 @@ class WriteThread : public Thread {
     StreamOut::DataMQ* mDataMQ;
     StreamOut::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
-    std::unique_ptr<uint8_t[]> mBuffer;
     IStreamOut::WriteStatus mStatus;
 
     bool threadLoop() override;
@@ -88,14 +82,30 @@ void WriteThread::doWrite() {
     const size_t availToRead = mDataMQ->availableToRead();
     mStatus.retval = Result::OK;
     mStatus.reply.written = 0;
-    if (mDataMQ->read(&mBuffer[0], availToRead)) {
-        ssize_t writeResult = mStream->write(mStream, &mBuffer[0], availToRead);
-        if (writeResult >= 0) {
-            mStatus.reply.written = writeResult;
-        } else {
-            mStatus.retval = Stream::analyzeStatus("write", writeResult);
+    StreamOut::DataMQ::MemTransaction tx;
+    if (!mDataMQ->beginRead(availToRead, &tx)) {
+        return;
+    }
+    // The HAL writes straight from the queue. If the data wraps around the end of the
+    // queue, it is written in two parts.
+    for (const auto& region : {tx.getFirstRegion(), tx.getSecondRegion()}) {
+        if (region.getLength() == 0) {
+            continue;
+        }
+        ssize_t writeResult = mStream->write(mStream, region.getAddress(), region.getLength());
+        if (writeResult < 0) {
+            if (mStatus.reply.written == 0) {
+                mStatus.retval = Stream::analyzeStatus("write", writeResult);
+            }
+            break;
+        }
+        mStatus.reply.written += writeResult;
+        if (static_cast<size_t>(writeResult) < region.getLength()) {
+            break;
         }
     }
+    // Like a plain read, this consumes all the data even if the HAL took less of it.
+    mDataMQ->commitRead(availToRead);
 }
 
 void WriteThread::doGetPresentationPosition() {
@@ -405,11 +415,6 @@ Return<void> StreamOut::prepareForWriting(uint32_t frameSize, uint32_t framesCou
     auto tempWriteThread =
             sp<WriteThread>::make(&mStopWriteThread, mStream, tempCommandMQ.get(), tempDataMQ.get(),
                                   tempStatusMQ.get(), tempElfGroup.get());
-    if (!tempWriteThread->init()) {
-        ALOGW("failed to start writer thread: %s", strerror(-status));
-        sendError(Result::INVALID_ARGUMENTS);
-        return Void();
-    }
     status = tempWriteThread->run("writer", PRIORITY_URGENT_AUDIO);
     if (status != OK) {
         ALOGW("failed to start writer thread: %s", strerror(-status));
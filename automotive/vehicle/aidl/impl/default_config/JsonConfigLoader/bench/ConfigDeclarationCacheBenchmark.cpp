@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ConfigDeclarationCache.h>
+#include <JsonConfigLoader.h>
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+std::string getDefaultPropertiesPath() {
+    return android::base::GetExecutableDirectory() + "/DefaultProperties.json";
+}
+
+}  // namespace
+
+// The startup cost without the config cache: parsing the JSON config file.
+static void BM_loadFromJson(benchmark::State& state) {
+    std::string configPath = getDefaultPropertiesPath();
+    for (auto _ : state) {
+        JsonConfigLoader loader;
+        auto result = loader.loadPropConfig(configPath);
+        if (!result.ok()) {
+            state.SkipWithError(result.error().message().c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_loadFromJson);
+
+// The startup cost with a valid config cache: hashing the JSON config file and loading the
+// cache.
+static void BM_loadFromCache(benchmark::State& state) {
+    std::string configPath = getDefaultPropertiesPath();
+    android::base::TemporaryDir tempDir;
+    ConfigDeclarationCache cache(std::string(tempDir.path) + "/cache.bin");
+    JsonConfigLoader loader;
+    auto configs = loader.loadPropConfig(configPath);
+    auto contentHash = ConfigDeclarationCache::computeContentHash({configPath});
+    if (!configs.ok() || !contentHash.ok() || !cache.store(configs.value(), *contentHash).ok()) {
+        state.SkipWithError("failed to generate config cache");
+        return;
+    }
+
+    for (auto _ : state) {
+        auto hash = ConfigDeclarationCache::computeContentHash({configPath});
+        auto result = cache.load(*hash);
+        if (!result.ok()) {
+            state.SkipWithError(result.error().message().c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_loadFromCache);
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_aidl_impl_default_config_JsonConfigLoader_include_ConfigDeclarationCache_H_
+#define android_hardware_automotive_vehicle_aidl_impl_default_config_JsonConfigLoader_include_ConfigDeclarationCache_H_
+
+#include <ConfigDeclaration.h>
+
+#include <android-base/result.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+// Serializes the parsed config declarations into a compact binary form, tagged with the content
+// hash of the JSON files they were parsed from.
+std::string serializeConfigDeclarations(
+        const std::unordered_map<int32_t, ConfigDeclaration>& configsByPropId,
+        uint64_t contentHash);
+
+// Deserializes the config declarations from the binary form produced by
+// {@code serializeConfigDeclarations}. Returns an error if the data is truncated, corrupted,
+// written by a different format version or tagged with a content hash other than the expected
+// one.
+android::base::Result<std::unordered_map<int32_t, ConfigDeclaration>> deserializeConfigDeclarations(
+        const void* data, size_t size, uint64_t expectedContentHash);
+
+// A cache of the config declarations parsed from a set of JSON config files, stored in a binary
+// file so that the JSON parsing could be skipped on the next startup.
+//
+// The cache is keyed by a hash of the config file paths and contents and of the vendor build
+// fingerprint, so it is invalidated by any change to the config files, an override being enabled,
+// or an OTA that changes the VHAL without changing the config files.
+class ConfigDeclarationCache final {
+  public:
+    explicit ConfigDeclarationCache(std::string cacheFilePath);
+
+    // Computes the content hash for the given config files, in the given order, and the
+    // ro.vendor.build.fingerprint of the running build. Returns an error if any file could not be
+    // read.
+    static android::base::Result<uint64_t> computeContentHash(
+            const std::vector<std::string>& configFilePaths);
+
+    // Same as above, with the given build fingerprint.
+    static android::base::Result<uint64_t> computeContentHash(
+            const std::vector<std::string>& configFilePaths, const std::string& buildFingerprint);
+
+    // Loads the config declarations from the cache file. Returns an error if the cache file does
+    // not exist, is invalid or was generated for a different content hash.
+    android::base::Result<std::unordered_map<int32_t, ConfigDeclaration>> load(
+            uint64_t contentHash) const;
+
+    // Stores the config declarations to the cache file, replacing the existing one atomically.
+    android::base::Result<void> store(
+            const std::unordered_map<int32_t, ConfigDeclaration>& configsByPropId,
+            uint64_t contentHash) const;
+
+  private:
+    const std::string mCacheFilePath;
+};
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_aidl_impl_default_config_JsonConfigLoader_include_ConfigDeclarationCache_H_
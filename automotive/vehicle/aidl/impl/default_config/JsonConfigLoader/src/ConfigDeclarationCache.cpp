@@ -0,0 +1,399 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ConfigDeclarationCache.h>
+
+#include <android-base/file.h>
+#include <android-base/properties.h>
+#include <android-base/unique_fd.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::vehicle::RawPropValues;
+using ::aidl::android::hardware::automotive::vehicle::VehicleAreaConfig;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropConfig;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyAccess;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyChangeMode;
+using ::android::base::Error;
+using ::android::base::Result;
+using ::android::base::unique_fd;
+
+constexpr uint32_t CACHE_MAGIC = 0x43434856;  // "VHCC"
+// Must be bumped whenever the serialized layout or the JSON parsing logic changes, so that caches
+// generated by an older VHAL are not used.
+constexpr uint32_t CACHE_FORMAT_VERSION = 1;
+constexpr char BUILD_FINGERPRINT_PROPERTY[] = "ro.vendor.build.fingerprint";
+
+#ifdef ENABLE_VEHICLE_HAL_TEST_PROPERTIES
+// The same JSON files parse differently with test properties enabled.
+constexpr uint64_t CONTENT_HASH_SALT = 1;
+#else
+constexpr uint64_t CONTENT_HASH_SALT = 0;
+#endif  // ENABLE_VEHICLE_HAL_TEST_PROPERTIES
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t contentHash;
+    uint64_t payloadSize;
+    uint64_t payloadHash;
+};
+
+// 64-bit FNV-1a.
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+class Writer final {
+  public:
+    template <class T>
+    void write(T value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        mBuffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <class T>
+    void writeArray(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write<uint32_t>(values.size());
+        mBuffer.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    void writeString(const std::string& value) {
+        write<uint32_t>(value.size());
+        mBuffer.append(value);
+    }
+
+    void writeRawPropValues(const RawPropValues& values) {
+        writeArray(values.int32Values);
+        writeArray(values.floatValues);
+        writeArray(values.int64Values);
+        writeArray(values.byteValues);
+        writeString(values.stringValue);
+    }
+
+    void writeAreaConfig(const VehicleAreaConfig& areaConfig) {
+        write(areaConfig.areaId);
+        write(areaConfig.minInt32Value);
+        write(areaConfig.maxInt32Value);
+        write(areaConfig.minInt64Value);
+        write(areaConfig.maxInt64Value);
+        write(areaConfig.minFloatValue);
+        write(areaConfig.maxFloatValue);
+        write<uint8_t>(areaConfig.supportedEnumValues.has_value());
+        if (areaConfig.supportedEnumValues.has_value()) {
+            writeArray(*areaConfig.supportedEnumValues);
+        }
+    }
+
+    void writeConfigDeclaration(const ConfigDeclaration& configDeclaration) {
+        const VehiclePropConfig& config = configDeclaration.config;
+        write(config.prop);
+        write(static_cast<int32_t>(config.access));
+        write(static_cast<int32_t>(config.changeMode));
+        write<uint32_t>(config.areaConfigs.size());
+        for (const auto& areaConfig : config.areaConfigs) {
+            writeAreaConfig(areaConfig);
+        }
+        writeArray(config.configArray);
+        writeString(config.configString);
+        write(config.minSampleRate);
+        write(config.maxSampleRate);
+
+        writeRawPropValues(configDeclaration.initialValue);
+        write<uint32_t>(configDeclaration.initialAreaValues.size());
+        for (const auto& [areaId, values] : configDeclaration.initialAreaValues) {
+            write(areaId);
+            writeRawPropValues(values);
+        }
+    }
+
+    std::string& buffer() { return mBuffer; }
+
+  private:
+    std::string mBuffer;
+};
+
+// Reads from a bounded buffer, every read fails instead of going out of bound.
+class Reader final {
+  public:
+    Reader(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+    template <class T>
+    bool read(T* value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (!ensureAvailable(sizeof(T))) {
+            return false;
+        }
+        memcpy(value, mData + mOffset, sizeof(T));
+        mOffset += sizeof(T);
+        return true;
+    }
+
+    template <class T>
+    bool readArray(std::vector<T>* values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        uint32_t count;
+        if (!read(&count) || !ensureAvailable(static_cast<size_t>(count) * sizeof(T))) {
+            return false;
+        }
+        values->resize(count);
+        if (count > 0) {
+            memcpy(values->data(), mData + mOffset, count * sizeof(T));
+            mOffset += count * sizeof(T);
+        }
+        return true;
+    }
+
+    bool readString(std::string* value) {
+        uint32_t size;
+        if (!read(&size) || !ensureAvailable(size)) {
+            return false;
+        }
+        value->assign(reinterpret_cast<const char*>(mData + mOffset), size);
+        mOffset += size;
+        return true;
+    }
+
+    bool readRawPropValues(RawPropValues* values) {
+        return readArray(&values->int32Values) && readArray(&values->floatValues) &&
+               readArray(&values->int64Values) && readArray(&values->byteValues) &&
+               readString(&values->stringValue);
+    }
+
+    bool readAreaConfig(VehicleAreaConfig* areaConfig) {
+        uint8_t hasSupportedEnumValues;
+        if (!read(&areaConfig->areaId) || !read(&areaConfig->minInt32Value) ||
+            !read(&areaConfig->maxInt32Value) || !read(&areaConfig->minInt64Value) ||
+            !read(&areaConfig->maxInt64Value) || !read(&areaConfig->minFloatValue) ||
+            !read(&areaConfig->maxFloatValue) || !read(&hasSupportedEnumValues)) {
+            return false;
+        }
+        if (hasSupportedEnumValues) {
+            areaConfig->supportedEnumValues.emplace();
+            return readArray(&*areaConfig->supportedEnumValues);
+        }
+        return true;
+    }
+
+    bool readConfigDeclaration(ConfigDeclaration* configDeclaration) {
+        VehiclePropConfig& config = configDeclaration->config;
+        int32_t access;
+        int32_t changeMode;
+        uint32_t areaConfigCount;
+        if (!read(&config.prop) || !read(&access) || !read(&changeMode) ||
+            !read(&areaConfigCount)) {
+            return false;
+        }
+        config.access = static_cast<VehiclePropertyAccess>(access);
+        config.changeMode = static_cast<VehiclePropertyChangeMode>(changeMode);
+        for (uint32_t i = 0; i < areaConfigCount; i++) {
+            if (!readAreaConfig(&config.areaConfigs.emplace_back())) {
+                return false;
+            }
+        }
+        if (!readArray(&config.configArray) || !readString(&config.configString) ||
+            !read(&config.minSampleRate) || !read(&config.maxSampleRate)) {
+            return false;
+        }
+
+        uint32_t areaValueCount;
+        if (!readRawPropValues(&configDeclaration->initialValue) || !read(&areaValueCount)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < areaValueCount; i++) {
+            int32_t areaId;
+            if (!read(&areaId) ||
+                !readRawPropValues(&configDeclaration->initialAreaValues[areaId])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool atEnd() const { return mOffset == mSize; }
+
+  private:
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mOffset = 0;
+
+    bool ensureAvailable(size_t size) const { return size <= mSize - mOffset; }
+};
+
+}  // namespace
+
+std::string serializeConfigDeclarations(
+        const std::unordered_map<int32_t, ConfigDeclaration>& configsByPropId,
+        uint64_t contentHash) {
+    Writer writer;
+    // Reserved for the header, filled in once the payload is complete.
+    writer.buffer().resize(sizeof(CacheHeader));
+    writer.write<uint32_t>(configsByPropId.size());
+    for (const auto& [_, configDeclaration] : configsByPropId) {
+        writer.writeConfigDeclaration(configDeclaration);
+    }
+
+    std::string& buffer = writer.buffer();
+    size_t payloadSize = buffer.size() - sizeof(CacheHeader);
+    CacheHeader header = {
+            .magic = CACHE_MAGIC,
+            .version = CACHE_FORMAT_VERSION,
+            .contentHash = contentHash,
+            .payloadSize = payloadSize,
+            .payloadHash = fnv1a(buffer.data() + sizeof(CacheHeader), payloadSize),
+    };
+    memcpy(buffer.data(), &header, sizeof(CacheHeader));
+    return std::move(buffer);
+}
+
+Result<std::unordered_map<int32_t, ConfigDeclaration>> deserializeConfigDeclarations(
+        const void* data, size_t size, uint64_t expectedContentHash) {
+    CacheHeader header;
+    if (size < sizeof(CacheHeader)) {
+        return Error() << "config cache is truncated";
+    }
+    memcpy(&header, data, sizeof(CacheHeader));
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_FORMAT_VERSION) {
+        return Error() << "config cache has an unsupported format";
+    }
+    if (header.contentHash != expectedContentHash) {
+        return Error() << "config cache is stale";
+    }
+    const uint8_t* payload = reinterpret_cast<const uint8_t*>(data) + sizeof(CacheHeader);
+    size_t payloadSize = size - sizeof(CacheHeader);
+    if (header.payloadSize != payloadSize || header.payloadHash != fnv1a(payload, payloadSize)) {
+        return Error() << "config cache is corrupted";
+    }
+
+    Reader reader(payload, payloadSize);
+    uint32_t count;
+    if (!reader.read(&count)) {
+        return Error() << "config cache is corrupted";
+    }
+    std::unordered_map<int32_t, ConfigDeclaration> configsByPropId;
+    configsByPropId.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        ConfigDeclaration configDeclaration;
+        if (!reader.readConfigDeclaration(&configDeclaration)) {
+            return Error() << "config cache is corrupted";
+        }
+        int32_t propId = configDeclaration.config.prop;
+        configsByPropId[propId] = std::move(configDeclaration);
+    }
+    if (!reader.atEnd()) {
+        return Error() << "config cache has trailing data";
+    }
+    return configsByPropId;
+}
+
+ConfigDeclarationCache::ConfigDeclarationCache(std::string cacheFilePath)
+    : mCacheFilePath(std::move(cacheFilePath)) {}
+
+Result<uint64_t> ConfigDeclarationCache::computeContentHash(
+        const std::vector<std::string>& configFilePaths) {
+    return computeContentHash(configFilePaths,
+                              android::base::GetProperty(BUILD_FINGERPRINT_PROPERTY, ""));
+}
+
+Result<uint64_t> ConfigDeclarationCache::computeContentHash(
+        const std::vector<std::string>& configFilePaths, const std::string& buildFingerprint) {
+    uint64_t hash = fnv1a(&CONTENT_HASH_SALT, sizeof(CONTENT_HASH_SALT));
+    hash = fnv1a(&CACHE_FORMAT_VERSION, sizeof(CACHE_FORMAT_VERSION), hash);
+    // A new build might parse the same JSON files differently without bumping the format version.
+    uint64_t fingerprintSize = buildFingerprint.size();
+    hash = fnv1a(&fingerprintSize, sizeof(fingerprintSize), hash);
+    hash = fnv1a(buildFingerprint.data(), buildFingerprint.size(), hash);
+    std::string content;
+    for (const auto& path : configFilePaths) {
+        if (!android::base::ReadFileToString(path, &content)) {
+            return Error() << "failed to read config file: " << path;
+        }
+        // Include the sizes so that moving bytes between the path and the content, or between
+        // two files, changes the hash.
+        uint64_t pathSize = path.size();
+        uint64_t contentSize = content.size();
+        hash = fnv1a(&pathSize, sizeof(pathSize), hash);
+        hash = fnv1a(path.data(), path.size(), hash);
+        hash = fnv1a(&contentSize, sizeof(contentSize), hash);
+        hash = fnv1a(content.data(), content.size(), hash);
+    }
+    return hash;
+}
+
+Result<std::unordered_map<int32_t, ConfigDeclaration>> ConfigDeclarationCache::load(
+        uint64_t contentHash) const {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(mCacheFilePath.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd.get() < 0) {
+        return Error() << "failed to open config cache: " << mCacheFilePath;
+    }
+    struct stat st;
+    if (fstat(fd.get(), &st) != 0) {
+        return Error() << "failed to stat config cache: " << mCacheFilePath;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        return Error() << "config cache is empty: " << mCacheFilePath;
+    }
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    if (data == MAP_FAILED) {
+        return Error() << "failed to map config cache: " << mCacheFilePath;
+    }
+    auto result = deserializeConfigDeclarations(data, size, contentHash);
+    munmap(data, size);
+    return result;
+}
+
+Result<void> ConfigDeclarationCache::store(
+        const std::unordered_map<int32_t, ConfigDeclaration>& configsByPropId,
+        uint64_t contentHash) const {
+    std::string tmpPath = mCacheFilePath + ".tmp";
+    if (!android::base::WriteStringToFile(serializeConfigDeclarations(configsByPropId, contentHash),
+                                          tmpPath)) {
+        return Error() << "failed to write config cache: " << tmpPath;
+    }
+    if (rename(tmpPath.c_str(), mCacheFilePath.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        return Error() << "failed to rename config cache to: " << mCacheFilePath;
+    }
+    return {};
+}
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
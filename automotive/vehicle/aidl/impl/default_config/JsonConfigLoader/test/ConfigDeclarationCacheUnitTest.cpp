@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ConfigDeclarationCache.h>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <unordered_map>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+using ::aidl::android::hardware::automotive::vehicle::RawPropValues;
+using ::aidl::android::hardware::automotive::vehicle::VehicleAreaConfig;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropConfig;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyAccess;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyChangeMode;
+using ::android::base::TemporaryDir;
+using ::android::base::WriteStringToFile;
+
+constexpr uint64_t kContentHash = 0x1234;
+
+class ConfigDeclarationCacheUnitTest : public ::testing::Test {
+  protected:
+    void SetUp() override { mCachePath = std::string(mTempDir.path) + "/cache.bin"; }
+
+    static std::unordered_map<int32_t, ConfigDeclaration> createConfigs() {
+        ConfigDeclaration global = {
+                .config =
+                        {
+                                .prop = 1,
+                                .access = VehiclePropertyAccess::READ,
+                                .changeMode = VehiclePropertyChangeMode::CONTINUOUS,
+                                .configArray = {1, 2, 3},
+                                .configString = "config",
+                                .minSampleRate = 1.0f,
+                                .maxSampleRate = 10.0f,
+                        },
+                .initialValue =
+                        {
+                                .int32Values = {1},
+                                .floatValues = {2.0f},
+                                .int64Values = {3},
+                                .byteValues = {4, 5},
+                                .stringValue = "value",
+                        },
+        };
+        ConfigDeclaration zoned = {
+                .config =
+                        {
+                                .prop = 2,
+                                .access = VehiclePropertyAccess::READ_WRITE,
+                                .changeMode = VehiclePropertyChangeMode::ON_CHANGE,
+                                .areaConfigs =
+                                        {
+                                                {
+                                                        .areaId = 1,
+                                                        .minInt32Value = -1,
+                                                        .maxInt32Value = 1,
+                                                },
+                                                {
+                                                        .areaId = 2,
+                                                        .minFloatValue = -2.0f,
+                                                        .maxFloatValue = 2.0f,
+                                                        .supportedEnumValues =
+                                                                std::vector<int64_t>{1, 2},
+                                                },
+                                        },
+                        },
+                .initialAreaValues =
+                        {
+                                {1, RawPropValues{.int32Values = {1}}},
+                                {2, RawPropValues{.floatValues = {2.0f}}},
+                        },
+        };
+        return {{1, global}, {2, zoned}};
+    }
+
+    TemporaryDir mTempDir;
+    std::string mCachePath;
+};
+
+TEST_F(ConfigDeclarationCacheUnitTest, testSerializeDeserialize) {
+    auto configs = createConfigs();
+    std::string data = serializeConfigDeclarations(configs, kContentHash);
+
+    auto result = deserializeConfigDeclarations(data.data(), data.size(), kContentHash);
+
+    ASSERT_TRUE(result.ok()) << result.error().message();
+    ASSERT_EQ(result.value(), configs);
+}
+
+TEST_F(ConfigDeclarationCacheUnitTest, testSerializeDeserializeEmpty) {
+    std::string data = serializeConfigDeclarations({}, kContentHash);
+
+    auto result = deserializeConfigDeclarations(data.data(), data.size(), kContentHash);
+
+    ASSERT_TRUE(result.ok()) << result.error().message();
+    ASSERT_TRUE(result.value().empty());
+}
+
+TEST_F(ConfigDeclarationCacheUnitTest, testDeserializeStaleContentHash) {
+    std::string data = serializeConfigDeclarations(createConfigs(), kContentHash);
+
+    ASSERT_FALSE(deserializeConfigDeclarations(data.data(), data.size(), kContentHash + 1).ok());
+}
+
+TEST_F(ConfigDeclarationCacheUnitTest, testDeserializeTruncated) {
+    std::string data = serializeConfigDeclarations(createConfigs(), kContentHash);
+
+    for (size_t size : {size_t(0), size_t(8), data.size() - 1}) {
+        ASSERT_FALSE(deserializeConfigDeclarations(data.data(), size, kContentHash).ok())
+                << "truncated data of size: " << size << " must cause error";
+    }
+}
+
+TEST_F(ConfigDeclarationCacheUnitTest, testDeserializeCorrupted) {
+    std::string data = serializeConfigDeclarations(createConfigs(), kContentHash);
+    data[data.size() - 1] ^= 0xff;
+
+    ASSERT_FALSE(deserializeConfigDeclarations(data.data(), data.size(), kContentHash).ok());
+}
+
+TEST_F(ConfigDeclarationCacheUnitTest, testStoreLoad) {
+    ConfigDeclarationCache cache(mCachePath);
+    auto configs = createConfigs();
+
+    ASSERT_TRUE(cache.store(configs, kContentHash).ok());
+    auto result = cache.load(kContentHash);
+
+    ASSERT_TRUE(result.ok()) << result.error().message();
+    ASSERT_EQ(result.value(), configs);
+}
+
+TEST_F(ConfigDeclarationCacheUnitTest, testLoadNoCacheFile) {
+    ConfigDeclarationCache cache(mCachePath);
+
+    ASSERT_FALSE(cache.load(kContentHash).ok());
+}
+
+TEST_F(ConfigDeclarationCacheUnitTest, testLoadStale) {
+    ConfigDeclarationCache cache(mCachePath);
+
+    ASSERT_TRUE(cache.store(createConfigs(), kContentHash).ok());
+
+    ASSERT_FALSE(cache.load(kContentHash + 1).ok());
+}
+
+TEST_F(ConfigDeclarationCacheUnitTest, testComputeContentHash) {
+    std::string configPath1 = std::string(mTempDir.path) + "/config1.json";
+    std::string configPath2 = std::string(mTempDir.path) + "/config2.json";
+    ASSERT_TRUE(WriteStringToFile("{\"properties\": []}", configPath1));
+    ASSERT_TRUE(WriteStringToFile("{\"properties\": []}", configPath2));
+
+    auto hash1 = ConfigDeclarationCache::computeContentHash({configPath1});
+    auto hash12 = ConfigDeclarationCache::computeContentHash({configPath1, configPath2});
+    auto hash21 = ConfigDeclarationCache::computeContentHash({configPath2, configPath1});
+
+    ASSERT_TRUE(hash1.ok());
+    ASSERT_TRUE(hash12.ok());
+    ASSERT_TRUE(hash21.ok());
+    ASSERT_EQ(hash1.value(), ConfigDeclarationCache::computeContentHash({configPath1}).value());
+    ASSERT_NE(hash1.value(), hash12.value());
+    ASSERT_NE(hash12.value(), hash21.value()) << "the order of the config files matters";
+
+    ASSERT_TRUE(WriteStringToFile("{\"properties\": [{\"property\": 1}]}", configPath1));
+
+    ASSERT_NE(hash1.value(), ConfigDeclarationCache::computeContentHash({configPath1}).value());
+}
+
+TEST_F(ConfigDeclarationCacheUnitTest, testComputeContentHashBuildFingerprint) {
+    std::string configPath = std::string(mTempDir.path) + "/config.json";
+    ASSERT_TRUE(WriteStringToFile("{\"properties\": []}", configPath));
+
+    auto hash1 = ConfigDeclarationCache::computeContentHash({configPath}, "vendor/build/1");
+    auto hash2 = ConfigDeclarationCache::computeContentHash({configPath}, "vendor/build/2");
+
+    ASSERT_TRUE(hash1.ok());
+    ASSERT_TRUE(hash2.ok());
+    ASSERT_NE(hash1.value(), hash2.value()) << "an OTA must invalidate the cache";
+}
+
+TEST_F(ConfigDeclarationCacheUnitTest, testComputeContentHashMissingFile) {
+    ASSERT_FALSE(ConfigDeclarationCache::computeContentHash(
+                         {std::string(mTempDir.path) + "/not_exist.json"})
+                         .ok());
+}
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
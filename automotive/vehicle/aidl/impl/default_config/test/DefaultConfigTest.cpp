@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <ConfigDeclarationCache.h>
 #include <JsonConfigLoader.h>
 #include <VehicleUtils.h>
 #include <android-base/file.h>
@@ -63,6 +64,20 @@ TEST(DefaultConfigTest, TestloadDefaultProperties) {
     ASSERT_TRUE(result.ok()) << result.error().message();
 }
 
+TEST(DefaultConfigTest, TestConfigCacheForDefaultProperties) {
+    JsonConfigLoader loader;
+    auto result = loadConfig(loader, kDefaultPropertiesConfigFile);
+
+    ASSERT_TRUE(result.ok()) << result.error().message();
+
+    std::string data = serializeConfigDeclarations(result.value(), /*contentHash=*/1);
+    auto cachedResult = deserializeConfigDeclarations(data.data(), data.size(),
+                                                      /*expectedContentHash=*/1);
+
+    ASSERT_TRUE(cachedResult.ok()) << cachedResult.error().message();
+    ASSERT_EQ(cachedResult.value(), result.value());
+}
+
 #ifdef ENABLE_VEHICLE_HAL_TEST_PROPERTIES
 
 TEST(DefaultConfigTest, TestloadTestProperties) {
@@ -53,6 +53,11 @@ class FakeVehicleHardware : public IVehicleHardware {
     FakeVehicleHardware(std::string defaultConfigDir, std::string overrideConfigDir,
                         bool forceOverride);
 
+    // If configCachePath is not empty, the config declarations parsed from the JSON config files
+    // are cached in this file and reused on the next startup if the config files do not change.
+    FakeVehicleHardware(std::string defaultConfigDir, std::string overrideConfigDir,
+                        bool forceOverride, std::string configCachePath);
+
     ~FakeVehicleHardware();
 
     // Get all the property configs.
@@ -159,6 +164,7 @@ class FakeVehicleHardware : public IVehicleHardware {
     const std::string mDefaultConfigDir;
     const std::string mOverrideConfigDir;
     const bool mForceOverride;
+    const std::string mConfigCachePath;
     bool mAddExtraTestVendorConfigs;
 
     // Only used during initialization.
@@ -170,10 +176,12 @@ class FakeVehicleHardware : public IVehicleHardware {
     // The callback that would be called when a vehicle property value change happens.
     void onValueChangeCallback(
             const aidl::android::hardware::automotive::vehicle::VehiclePropValue& value);
-    // Load the config files in format '*.json' from the directory and parse the config files
-    // into a map from property ID to ConfigDeclarations.
-    void loadPropConfigsFromDir(const std::string& dirPath,
-                                std::unordered_map<int32_t, ConfigDeclaration>* configs);
+    // Lists the config files in format '*.json' in the directory, sorted by name.
+    static std::vector<std::string> listConfigFilesInDir(const std::string& dirPath);
+    // Parses the config files in order into a map from property ID to ConfigDeclarations, configs
+    // in the latter files override the former ones.
+    void loadPropConfigsFromFiles(const std::vector<std::string>& filePaths,
+                                  std::unordered_map<int32_t, ConfigDeclaration>* configs);
     // Function to be called when a value change event comes from vehicle bus. In our fake
     // implementation, this function is only called during "--inject-event" dump command.
     void eventFromVehicleBus(
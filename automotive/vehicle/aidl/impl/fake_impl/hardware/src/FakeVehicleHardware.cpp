@@ -20,6 +20,7 @@
 
 #include "FakeVehicleHardware.h"
 
+#include <ConfigDeclarationCache.h>
 #include <FakeObd2Frame.h>
 #include <JsonFakeValueGenerator.h>
 #include <LinearFakeValueGenerator.h>
@@ -39,7 +40,9 @@
 #include <dirent.h>
 #include <inttypes.h>
 #include <sys/types.h>
+#include <algorithm>
 #include <fstream>
+#include <optional>
 #include <regex>
 #include <unordered_set>
 #include <vector>
@@ -102,6 +105,11 @@ constexpr char OVERRIDE_CONFIG_DIR[] = "/vendor/etc/automotive/vhaloverride/";
 // If OVERRIDE_PROPERTY is set, we will use the configuration files from OVERRIDE_CONFIG_DIR to
 // overwrite the default configs.
 constexpr char OVERRIDE_PROPERTY[] = "persist.vendor.vhal_init_value_override";
+// The file to cache the parsed configuration files in, so that parsing the JSON files could be
+// skipped on the next startup. The cache is regenerated whenever the configuration files change.
+// Not set by default: the file must be readable and writable when the VHAL starts, which rules out
+// /data for the default service started with the early_hal class.
+constexpr char CONFIG_CACHE_PATH_PROPERTY[] = "ro.vendor.vhal.config_cache_path";
 constexpr char POWER_STATE_REQ_CONFIG_PROPERTY[] = "ro.vendor.fake_vhal.ap_power_state_req.config";
 // The value to be returned if VENDOR_PROPERTY_ID is set as the property
 constexpr int VENDOR_ERROR_CODE = 0x00ab0005;
@@ -234,10 +242,17 @@ void FakeVehicleHardware::storePropInitialValue(const ConfigDeclaration& config)
 }
 
 FakeVehicleHardware::FakeVehicleHardware()
-    : FakeVehicleHardware(DEFAULT_CONFIG_DIR, OVERRIDE_CONFIG_DIR, false) {}
+    : FakeVehicleHardware(DEFAULT_CONFIG_DIR, OVERRIDE_CONFIG_DIR, false,
+                          android::base::GetProperty(CONFIG_CACHE_PATH_PROPERTY, "")) {}
 
 FakeVehicleHardware::FakeVehicleHardware(std::string defaultConfigDir,
                                          std::string overrideConfigDir, bool forceOverride)
+    : FakeVehicleHardware(std::move(defaultConfigDir), std::move(overrideConfigDir),
+                          forceOverride, /*configCachePath=*/"") {}
+
+FakeVehicleHardware::FakeVehicleHardware(std::string defaultConfigDir,
+                                         std::string overrideConfigDir, bool forceOverride,
+                                         std::string configCachePath)
     : mValuePool(std::make_unique<VehiclePropValuePool>()),
       mServerSidePropStore(new VehiclePropertyStore(mValuePool)),
       mFakeObd2Frame(new obd2frame::FakeObd2Frame(mServerSidePropStore)),
@@ -249,7 +264,8 @@ FakeVehicleHardware::FakeVehicleHardware(std::string defaultConfigDir,
       mPendingSetValueRequests(this),
       mDefaultConfigDir(defaultConfigDir),
       mOverrideConfigDir(overrideConfigDir),
-      mForceOverride(forceOverride) {
+      mForceOverride(forceOverride),
+      mConfigCachePath(std::move(configCachePath)) {
     init();
 }
 
@@ -260,11 +276,37 @@ FakeVehicleHardware::~FakeVehicleHardware() {
 }
 
 std::unordered_map<int32_t, ConfigDeclaration> FakeVehicleHardware::loadConfigDeclarations() {
-    std::unordered_map<int32_t, ConfigDeclaration> configsByPropId;
-    loadPropConfigsFromDir(mDefaultConfigDir, &configsByPropId);
+    std::vector<std::string> filePaths = listConfigFilesInDir(mDefaultConfigDir);
     if (mForceOverride ||
         android::base::GetBoolProperty(OVERRIDE_PROPERTY, /*default_value=*/false)) {
-        loadPropConfigsFromDir(mOverrideConfigDir, &configsByPropId);
+        std::vector<std::string> overrideFilePaths = listConfigFilesInDir(mOverrideConfigDir);
+        filePaths.insert(filePaths.end(), overrideFilePaths.begin(), overrideFilePaths.end());
+    }
+
+    std::optional<uint64_t> contentHash;
+    if (!mConfigCachePath.empty()) {
+        if (auto hashResult = ConfigDeclarationCache::computeContentHash(filePaths);
+            hashResult.ok()) {
+            contentHash = hashResult.value();
+            auto cacheResult = ConfigDeclarationCache(mConfigCachePath).load(*contentHash);
+            if (cacheResult.ok()) {
+                ALOGI("loaded properties from config cache %s", mConfigCachePath.c_str());
+                return std::move(cacheResult.value());
+            }
+            ALOGI("config cache not used: %s", cacheResult.error().message().c_str());
+        } else {
+            ALOGE("failed to hash config files: %s", hashResult.error().message().c_str());
+        }
+    }
+
+    std::unordered_map<int32_t, ConfigDeclaration> configsByPropId;
+    loadPropConfigsFromFiles(filePaths, &configsByPropId);
+    if (contentHash.has_value()) {
+        if (auto result = ConfigDeclarationCache(mConfigCachePath).store(configsByPropId,
+                                                                         *contentHash);
+            !result.ok()) {
+            ALOGW("failed to store config cache: %s", result.error().message().c_str());
+        }
     }
     return configsByPropId;
 }
@@ -962,7 +1004,7 @@ DumpResult FakeVehicleHardware::dump(const std::vector<std::string>& options) {
     if (options.size() == 0) {
         // We only want caller to dump default state when there is no options.
         result.callerShouldDumpState = true;
-        result.buffer = dumpAllProperties();
+        result.buffer = dumpAllProperties() + mValuePool->dump();
         return result;
     }
     std::string option = options[0];
@@ -1864,30 +1906,39 @@ void FakeVehicleHardware::onValueChangeCallback(const VehiclePropValue& value) {
     (*mOnPropertyChangeCallback)(std::move(updatedValues));
 }
 
-void FakeVehicleHardware::loadPropConfigsFromDir(
-        const std::string& dirPath,
-        std::unordered_map<int32_t, ConfigDeclaration>* configsByPropId) {
-    ALOGI("loading properties from %s", dirPath.c_str());
+std::vector<std::string> FakeVehicleHardware::listConfigFilesInDir(const std::string& dirPath) {
+    std::vector<std::string> filePaths;
     if (auto dir = opendir(dirPath.c_str()); dir != NULL) {
         std::regex regJson(".*[.]json", std::regex::icase);
         while (auto f = readdir(dir)) {
             if (!std::regex_match(f->d_name, regJson)) {
                 continue;
             }
-            std::string filePath = dirPath + "/" + std::string(f->d_name);
-            ALOGI("loading properties from %s", filePath.c_str());
-            auto result = mLoader.loadPropConfig(filePath);
-            if (!result.ok()) {
-                ALOGE("failed to load config file: %s, error: %s", filePath.c_str(),
-                      result.error().message().c_str());
-                continue;
-            }
-            for (auto& [propId, configDeclaration] : result.value()) {
-                (*configsByPropId)[propId] = std::move(configDeclaration);
-            }
+            filePaths.push_back(dirPath + "/" + std::string(f->d_name));
         }
         closedir(dir);
     }
+    // Sorted so that the content hash for the config cache does not depend on the directory
+    // order.
+    std::sort(filePaths.begin(), filePaths.end());
+    return filePaths;
+}
+
+void FakeVehicleHardware::loadPropConfigsFromFiles(
+        const std::vector<std::string>& filePaths,
+        std::unordered_map<int32_t, ConfigDeclaration>* configsByPropId) {
+    for (const auto& filePath : filePaths) {
+        ALOGI("loading properties from %s", filePath.c_str());
+        auto result = mLoader.loadPropConfig(filePath);
+        if (!result.ok()) {
+            ALOGE("failed to load config file: %s, error: %s", filePath.c_str(),
+                  result.error().message().c_str());
+            continue;
+        }
+        for (auto& [propId, configDeclaration] : result.value()) {
+            (*configsByPropId)[propId] = std::move(configDeclaration);
+        }
+    }
 }
 
 Result<float> FakeVehicleHardware::safelyParseFloat(int index, const std::string& s) {
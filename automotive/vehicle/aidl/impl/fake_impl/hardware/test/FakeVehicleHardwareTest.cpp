@@ -31,6 +31,7 @@
 #include <utils/SystemClock.h>
 
 #include <inttypes.h>
+#include <unistd.h>
 #include <chrono>
 #include <condition_variable>
 #include <unordered_map>
@@ -406,6 +407,24 @@ TEST_F(FakeVehicleHardwareTest, testGetAllPropertyConfigs) {
     ASSERT_EQ(configs.size(), helper.loadConfigDeclarations().size());
 }
 
+TEST_F(FakeVehicleHardwareTest, testLoadConfigDeclarationsFromCache) {
+    android::base::TemporaryDir tempDir;
+    std::string cachePath = std::string(tempDir.path) + "/config_cache.bin";
+    FakeVehicleHardwareTestHelper helper(getHardware());
+    auto expectedConfigs = helper.loadConfigDeclarations();
+
+    // The first hardware parses the JSON files and generates the cache, the second one loads
+    // from the cache.
+    for (int i = 0; i < 2; i++) {
+        FakeVehicleHardware hardware(android::base::GetExecutableDirectory(),
+                                     /*overrideConfigDir=*/"", /*forceOverride=*/false, cachePath);
+
+        ASSERT_TRUE(access(cachePath.c_str(), F_OK) == 0) << "config cache must be generated";
+        ASSERT_EQ(FakeVehicleHardwareTestHelper(&hardware).loadConfigDeclarations(),
+                  expectedConfigs);
+    }
+}
+
 TEST_F(FakeVehicleHardwareTest, testGetDefaultValues) {
     std::vector<GetValueRequest> getValueRequests;
     std::vector<GetValueResult> expectedGetValueResults;
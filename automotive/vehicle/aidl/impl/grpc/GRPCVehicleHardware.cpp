@@ -21,7 +21,9 @@
 #include <android-base/logging.h>
 #include <grpc++/grpc++.h>
 
+#include <algorithm>
 #include <cstdlib>
+#include <future>
 #include <mutex>
 #include <shared_mutex>
 #include <utility>
@@ -33,6 +35,49 @@ static std::shared_ptr<::grpc::ChannelCredentials> getChannelCredentials() {
     return ::grpc::InsecureChannelCredentials();
 }
 
+static std::vector<aidlvhal::GetValueResult> toAidlGetValueResults(
+        const proto::GetValueResults& protoResults) {
+    std::vector<aidlvhal::GetValueResult> results;
+    results.reserve(protoResults.results_size());
+    for (const auto& protoResult : protoResults.results()) {
+        auto& result = results.emplace_back();
+        result.requestId = protoResult.request_id();
+        result.status = static_cast<aidlvhal::StatusCode>(protoResult.status());
+        if (protoResult.has_value()) {
+            aidlvhal::VehiclePropValue value;
+            proto_msg_converter::protoToAidl(protoResult.value(), &value);
+            result.prop = std::move(value);
+        }
+    }
+    return results;
+}
+
+static std::vector<aidlvhal::SetValueResult> toAidlSetValueResults(
+        const proto::SetValueResults& protoResults) {
+    std::vector<aidlvhal::SetValueResult> results;
+    results.reserve(protoResults.results_size());
+    for (const auto& protoResult : protoResults.results()) {
+        auto& result = results.emplace_back();
+        result.requestId = protoResult.request_id();
+        result.status = static_cast<aidlvhal::StatusCode>(protoResult.status());
+        // TODO(chenhaosjtuacm): call on-set-error callback.
+    }
+    return results;
+}
+
+template <class ResultType>
+static std::vector<ResultType> toErrorResults(const proto::VehiclePropValueRequests& requests,
+                                              aidlvhal::StatusCode status) {
+    std::vector<ResultType> results;
+    results.reserve(requests.requests_size());
+    for (const auto& request : requests.requests()) {
+        auto& result = results.emplace_back();
+        result.requestId = request.request_id();
+        result.status = status;
+    }
+    return results;
+}
+
 GRPCVehicleHardware::GRPCVehicleHardware(std::string service_addr)
     : mServiceAddr(std::move(service_addr)),
       mGrpcChannel(::grpc::CreateChannel(mServiceAddr, getChannelCredentials())),
@@ -43,9 +88,28 @@ GRPCVehicleHardware::~GRPCVehicleHardware() {
     {
         std::lock_guard lck(mShutdownMutex);
         mShuttingDownFlag.store(true);
+        if (mValueStreamContext) {
+            mValueStreamContext->TryCancel();
+        }
+    }
+    {
+        // Fails the pending get/set calls, which also unblocks ResyncValues in the polling
+        // thread.
+        std::lock_guard lck(mGetSetValuesStreamMutex);
+        if (mGetSetValuesStreamContext) {
+            mGetSetValuesStreamContext->TryCancel();
+        }
     }
     mShutdownCV.notify_all();
+    mGetSetValuesStreamCV.notify_all();
+    mGetSetValuesTimeoutCV.notify_all();
     mValuePollingThread.join();
+    if (mGetSetValuesStreamReadThread.joinable()) {
+        mGetSetValuesStreamReadThread.join();
+    }
+    if (mGetSetValuesTimeoutThread.joinable()) {
+        mGetSetValuesTimeoutThread.join();
+    }
 }
 
 std::vector<aidlvhal::VehiclePropConfig> GRPCVehicleHardware::getAllPropertyConfigs() const {
@@ -69,67 +133,257 @@ std::vector<aidlvhal::VehiclePropConfig> GRPCVehicleHardware::getAllPropertyConf
 aidlvhal::StatusCode GRPCVehicleHardware::setValues(
         std::shared_ptr<const SetValuesCallback> callback,
         const std::vector<aidlvhal::SetValueRequest>& requests) {
-    ::grpc::ClientContext context;
-    proto::VehiclePropValueRequests protoRequests;
-    proto::SetValueResults protoResults;
+    proto::GetSetValuesStreamRequest streamRequest;
+    auto& protoRequests = *streamRequest.mutable_set_requests();
     for (const auto& request : requests) {
         auto& protoRequest = *protoRequests.add_requests();
         protoRequest.set_request_id(request.requestId);
         proto_msg_converter::aidlToProto(request.value, protoRequest.mutable_value());
     }
-    // TODO(chenhaosjtuacm): Make it Async.
-    auto grpc_status = mGrpcStub->SetValues(&context, protoRequests, &protoResults);
-    if (!grpc_status.ok()) {
-        LOG(ERROR) << __func__ << ": GRPC SetValues Failed: " << grpc_status.error_message();
-        {
-            std::shared_lock lck(mCallbackMutex);
-            // TODO(chenhaosjtuacm): call on-set-error callback.
-        }
-        return aidlvhal::StatusCode::INTERNAL_ERROR;
-    }
-    std::vector<aidlvhal::SetValueResult> results;
-    for (const auto& protoResult : protoResults.results()) {
-        auto& result = results.emplace_back();
-        result.requestId = protoResult.request_id();
-        result.status = static_cast<aidlvhal::StatusCode>(protoResult.status());
-        // TODO(chenhaosjtuacm): call on-set-error callback.
+    if (SendOnGetSetValuesStream(&streamRequest, {.setCallback = callback})) {
+        return aidlvhal::StatusCode::OK;
     }
-    (*callback)(std::move(results));
-
-    return aidlvhal::StatusCode::OK;
+    return SetValuesUnary(streamRequest.set_requests(), *callback);
 }
 
 aidlvhal::StatusCode GRPCVehicleHardware::getValues(
         std::shared_ptr<const GetValuesCallback> callback,
         const std::vector<aidlvhal::GetValueRequest>& requests) const {
-    ::grpc::ClientContext context;
-    proto::VehiclePropValueRequests protoRequests;
-    proto::GetValueResults protoResults;
+    proto::GetSetValuesStreamRequest streamRequest;
+    auto& protoRequests = *streamRequest.mutable_get_requests();
     for (const auto& request : requests) {
         auto& protoRequest = *protoRequests.add_requests();
         protoRequest.set_request_id(request.requestId);
         proto_msg_converter::aidlToProto(request.prop, protoRequest.mutable_value());
     }
-    // TODO(chenhaosjtuacm): Make it Async.
+    if (SendOnGetSetValuesStream(&streamRequest, {.getCallback = callback})) {
+        return aidlvhal::StatusCode::OK;
+    }
+    return GetValuesUnary(streamRequest.get_requests(), *callback);
+}
+
+aidlvhal::StatusCode GRPCVehicleHardware::SetValuesUnary(
+        const proto::VehiclePropValueRequests& protoRequests,
+        const SetValuesCallback& callback) const {
+    ::grpc::ClientContext context;
+    context.set_deadline(std::chrono::system_clock::now() + kGetSetValuesTimeout);
+    proto::SetValueResults protoResults;
+    auto grpc_status = mGrpcStub->SetValues(&context, protoRequests, &protoResults);
+    if (!grpc_status.ok()) {
+        LOG(ERROR) << __func__ << ": GRPC SetValues Failed: " << grpc_status.error_message();
+        // TODO(chenhaosjtuacm): call on-set-error callback.
+        return aidlvhal::StatusCode::INTERNAL_ERROR;
+    }
+    callback(toAidlSetValueResults(protoResults));
+    return aidlvhal::StatusCode::OK;
+}
+
+aidlvhal::StatusCode GRPCVehicleHardware::GetValuesUnary(
+        const proto::VehiclePropValueRequests& protoRequests,
+        const GetValuesCallback& callback) const {
+    ::grpc::ClientContext context;
+    context.set_deadline(std::chrono::system_clock::now() + kGetSetValuesTimeout);
+    proto::GetValueResults protoResults;
     auto grpc_status = mGrpcStub->GetValues(&context, protoRequests, &protoResults);
     if (!grpc_status.ok()) {
         LOG(ERROR) << __func__ << ": GRPC GetValues Failed: " << grpc_status.error_message();
         return aidlvhal::StatusCode::INTERNAL_ERROR;
     }
-    std::vector<aidlvhal::GetValueResult> results;
-    for (const auto& protoResult : protoResults.results()) {
-        auto& result = results.emplace_back();
-        result.requestId = protoResult.request_id();
-        result.status = static_cast<aidlvhal::StatusCode>(protoResult.status());
-        if (protoResult.has_value()) {
-            aidlvhal::VehiclePropValue value;
-            proto_msg_converter::protoToAidl(protoResult.value(), &value);
-            result.prop = std::move(value);
+    callback(toAidlGetValueResults(protoResults));
+    return aidlvhal::StatusCode::OK;
+}
+
+bool GRPCVehicleHardware::SendOnGetSetValuesStream(proto::GetSetValuesStreamRequest* request,
+                                                   PendingCall call) const {
+    int64_t callId;
+    {
+        std::unique_lock lck(mGetSetValuesStreamMutex);
+        if (!mGetSetValuesStream && !StartGetSetValuesStreamLocked(&lck)) {
+            return false;
         }
+        callId = mNextCallId++;
+        request->set_call_id(callId);
+        // Registered before writing so that the reader thread always finds the call, the request
+        // is kept in case the call has to be retried with the unary RPC.
+        auto& pendingCall = mPendingCalls[callId];
+        pendingCall = std::move(call);
+        pendingCall.deadline = std::chrono::steady_clock::now() + kGetSetValuesTimeout;
+        pendingCall.request = *request;
+        mGetSetValuesTimeoutCV.notify_one();
     }
-    (*callback)(std::move(results));
+    {
+        // Not under mGetSetValuesStreamMutex: while flow control blocks the write, the reader
+        // thread must still be able to dispatch the responses, or the server stops reading.
+        std::lock_guard writeLck(mGetSetValuesStreamWriteMutex);
+        if (mGetSetValuesStreamWriter != nullptr && mGetSetValuesStreamWriter->Write(*request)) {
+            return true;
+        }
+    }
+    // The stream is broken, the reader thread will clean it up once it notices.
+    std::lock_guard lck(mGetSetValuesStreamMutex);
+    if (mPendingCalls.erase(callId) == 0) {
+        // The reader or the timeout thread already completed the call.
+        return true;
+    }
+    LOG(ERROR) << __func__ << ": GRPC GetSetValuesStream write failed, falling back to unary RPC";
+    return false;
+}
 
-    return aidlvhal::StatusCode::OK;
+bool GRPCVehicleHardware::StartGetSetValuesStreamLocked(std::unique_lock<std::mutex>* lck) const {
+    if (mGetSetValuesStreamUnsupported || mGetSetValuesStreamStarting ||
+        mShuttingDownFlag.load()) {
+        return false;
+    }
+    // Creating the stream might block on the connection, the other calls use the unary RPCs
+    // meanwhile. The context is published first so that the destructor could cancel it.
+    mGetSetValuesStreamStarting = true;
+    mGetSetValuesStreamContext = std::make_unique<::grpc::ClientContext>();
+    ::grpc::ClientContext* context = mGetSetValuesStreamContext.get();
+    lck->unlock();
+    auto stream = mGrpcStub->GetSetValuesStream(context);
+    lck->lock();
+    mGetSetValuesStreamStarting = false;
+    if (mShuttingDownFlag.load()) {
+        mGetSetValuesStreamContext.reset();
+        return false;
+    }
+    mGetSetValuesStream = std::move(stream);
+    {
+        std::lock_guard writeLck(mGetSetValuesStreamWriteMutex);
+        mGetSetValuesStreamWriter = mGetSetValuesStream.get();
+    }
+    if (!mGetSetValuesStreamReadThread.joinable()) {
+        mGetSetValuesStreamReadThread = std::thread([this] { GetSetValuesStreamReadLoop(); });
+    }
+    if (!mGetSetValuesTimeoutThread.joinable()) {
+        mGetSetValuesTimeoutThread = std::thread([this] { GetSetValuesTimeoutLoop(); });
+    }
+    mGetSetValuesStreamCV.notify_all();
+    return true;
+}
+
+void GRPCVehicleHardware::GetSetValuesStreamReadLoop() const {
+    proto::GetSetValuesStreamResponse response;
+    while (true) {
+        ::grpc::ClientReaderWriter<proto::GetSetValuesStreamRequest,
+                                   proto::GetSetValuesStreamResponse>* stream;
+        {
+            std::unique_lock lck(mGetSetValuesStreamMutex);
+            mGetSetValuesStreamCV.wait(lck, [this] {
+                return mShuttingDownFlag.load() || mGetSetValuesStream != nullptr;
+            });
+            if (!mGetSetValuesStream) {
+                return;
+            }
+            stream = mGetSetValuesStream.get();
+        }
+
+        while (stream->Read(&response)) {
+            PendingCall call;
+            {
+                std::lock_guard lck(mGetSetValuesStreamMutex);
+                auto it = mPendingCalls.find(response.call_id());
+                if (it == mPendingCalls.end()) {
+                    LOG(WARNING) << __func__ << ": unknown or timed out call ID: "
+                                 << response.call_id();
+                    continue;
+                }
+                call = std::move(it->second);
+                mPendingCalls.erase(it);
+            }
+            if (response.has_get_results() && call.getCallback) {
+                (*call.getCallback)(toAidlGetValueResults(response.get_results()));
+            } else if (response.has_set_results() && call.setCallback) {
+                (*call.setCallback)(toAidlSetValueResults(response.set_results()));
+            } else {
+                LOG(ERROR) << __func__
+                           << ": results do not match the request for call ID: "
+                           << response.call_id();
+                FinishPendingCalls({{response.call_id(), std::move(call)}},
+                                   /*retryWithUnary=*/false, aidlvhal::StatusCode::INTERNAL_ERROR);
+            }
+        }
+
+        ::grpc::Status grpc_status;
+        {
+            std::lock_guard writeLck(mGetSetValuesStreamWriteMutex);
+            // Read has returned false so the status is already received. No request is written
+            // to the stream once the writer is cleared.
+            mGetSetValuesStreamWriter = nullptr;
+            grpc_status = stream->Finish();
+        }
+        std::map<int64_t, PendingCall> pendingCalls;
+        bool unsupported = false;
+        {
+            std::lock_guard lck(mGetSetValuesStreamMutex);
+            if (grpc_status.error_code() == ::grpc::StatusCode::UNIMPLEMENTED) {
+                LOG(WARNING) << __func__
+                             << ": GetSetValuesStream is not supported by the server, using "
+                                "unary RPCs";
+                mGetSetValuesStreamUnsupported = true;
+                unsupported = true;
+            } else if (!mShuttingDownFlag.load()) {
+                LOG(ERROR) << __func__ << ": GRPC GetSetValuesStream ended: "
+                           << grpc_status.error_message();
+            }
+            pendingCalls.swap(mPendingCalls);
+            mGetSetValuesStream.reset();
+            mGetSetValuesStreamContext.reset();
+        }
+        FinishPendingCalls(std::move(pendingCalls), /*retryWithUnary=*/unsupported,
+                           aidlvhal::StatusCode::INTERNAL_ERROR);
+    }
+}
+
+void GRPCVehicleHardware::GetSetValuesTimeoutLoop() const {
+    std::unique_lock lck(mGetSetValuesStreamMutex);
+    while (!mShuttingDownFlag.load()) {
+        if (mPendingCalls.empty()) {
+            mGetSetValuesTimeoutCV.wait(
+                    lck, [this] { return mShuttingDownFlag.load() || !mPendingCalls.empty(); });
+            continue;
+        }
+        // Every call has the same timeout, so the oldest call has the earliest deadline.
+        auto deadline = mPendingCalls.begin()->second.deadline;
+        if (std::chrono::steady_clock::now() < deadline) {
+            mGetSetValuesTimeoutCV.wait_until(lck, deadline);
+            continue;
+        }
+        std::map<int64_t, PendingCall> expiredCalls;
+        auto now = std::chrono::steady_clock::now();
+        while (!mPendingCalls.empty() && mPendingCalls.begin()->second.deadline <= now) {
+            expiredCalls.insert(mPendingCalls.extract(mPendingCalls.begin()));
+        }
+        lck.unlock();
+        LOG(ERROR) << __func__ << ": " << expiredCalls.size()
+                   << " GetSetValuesStream calls timed out";
+        FinishPendingCalls(std::move(expiredCalls), /*retryWithUnary=*/false,
+                           aidlvhal::StatusCode::TRY_AGAIN);
+        lck.lock();
+    }
+}
+
+void GRPCVehicleHardware::FinishPendingCalls(std::map<int64_t, PendingCall> calls,
+                                             bool retryWithUnary,
+                                             aidlvhal::StatusCode errorStatus) const {
+    for (auto& [_, call] : calls) {
+        const auto& request = call.request;
+        if (call.getCallback) {
+            if (retryWithUnary && GetValuesUnary(request.get_requests(), *call.getCallback) ==
+                                          aidlvhal::StatusCode::OK) {
+                continue;
+            }
+            (*call.getCallback)(toErrorResults<aidlvhal::GetValueResult>(request.get_requests(),
+                                                                         errorStatus));
+        } else if (call.setCallback) {
+            if (retryWithUnary && SetValuesUnary(request.set_requests(), *call.setCallback) ==
+                                          aidlvhal::StatusCode::OK) {
+                continue;
+            }
+            (*call.setCallback)(toErrorResults<aidlvhal::SetValueResult>(request.set_requests(),
+                                                                         errorStatus));
+        }
+    }
 }
 
 void GRPCVehicleHardware::registerOnPropertyChangeEvent(
@@ -203,46 +457,128 @@ bool GRPCVehicleHardware::waitForConnected(std::chrono::milliseconds waitTime) {
 }
 
 void GRPCVehicleHardware::ValuePollingLoop() {
+    auto backoff = std::chrono::duration_cast<std::chrono::milliseconds>(kInitialReconnectBackoff);
+    bool needResync = false;
+    // Reused across messages and reconnections so that protobuf could reuse its allocations.
+    proto::VehiclePropValues protoValues;
     while (!mShuttingDownFlag.load()) {
         ::grpc::ClientContext context;
-
-        bool rpc_stopped{false};
-        std::thread shuttingdown_watcher([this, &rpc_stopped, &context]() {
-            std::unique_lock<std::mutex> lck(mShutdownMutex);
-            mShutdownCV.wait(lck, [this, &rpc_stopped]() {
-                return rpc_stopped || mShuttingDownFlag.load();
-            });
-            context.TryCancel();
-        });
+        {
+            std::lock_guard lck(mShutdownMutex);
+            if (mShuttingDownFlag.load()) {
+                break;
+            }
+            // The destructor cancels the stream through this context, so we do not need a
+            // watcher thread for every connection.
+            mValueStreamContext = &context;
+        }
 
         auto value_stream =
                 mGrpcStub->StartPropertyValuesStream(&context, ::google::protobuf::Empty());
         LOG(INFO) << __func__ << ": GRPC Value Streaming Started";
-        proto::VehiclePropValues protoValues;
+        if (needResync &&
+            mGrpcChannel->GetState(/*try_to_connect=*/false) == GRPC_CHANNEL_READY) {
+            ResyncValues();
+            needResync = false;
+        }
+        bool receivedValues = false;
         while (!mShuttingDownFlag.load() && value_stream->Read(&protoValues)) {
-            std::vector<aidlvhal::VehiclePropValue> values;
-            for (const auto protoValue : protoValues.values()) {
-                values.push_back(aidlvhal::VehiclePropValue());
-                proto_msg_converter::protoToAidl(protoValue, &values.back());
+            if (needResync) {
+                ResyncValues();
+                needResync = false;
+            }
+            receivedValues = true;
+            std::vector<aidlvhal::VehiclePropValue> values(protoValues.values_size());
+            for (int i = 0; i < protoValues.values_size(); i++) {
+                proto_msg_converter::protoToAidl(protoValues.values(i), &values[i]);
             }
             std::shared_lock lck(mCallbackMutex);
             if (mOnPropChange) {
-                (*mOnPropChange)(values);
+                (*mOnPropChange)(std::move(values));
             }
         }
 
         {
             std::lock_guard lck(mShutdownMutex);
-            rpc_stopped = true;
+            mValueStreamContext = nullptr;
         }
-        mShutdownCV.notify_all();
-        shuttingdown_watcher.join();
-
         auto grpc_status = value_stream->Finish();
+        if (mShuttingDownFlag.load()) {
+            break;
+        }
         // never reach here until connection lost
-        LOG(ERROR) << __func__ << ": GRPC Value Streaming Failed: " << grpc_status.error_message();
+        LOG(ERROR) << __func__ << ": GRPC Value Streaming Failed: " << grpc_status.error_message()
+                   << ", reconnecting in " << backoff.count() << "ms";
+        needResync = true;
+        if (receivedValues) {
+            backoff = kInitialReconnectBackoff;
+        }
+
+        // try to reconnect after the backoff, unless shutting down.
+        {
+            std::unique_lock lck(mShutdownMutex);
+            if (mShutdownCV.wait_for(lck, backoff, [this] { return mShuttingDownFlag.load(); })) {
+                break;
+            }
+        }
+        backoff = std::min(backoff * 2,
+                           std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   kMaxReconnectBackoff));
+    }
+}
+
+void GRPCVehicleHardware::ResyncValues() {
+    std::vector<aidlvhal::GetValueRequest> requests;
+    int64_t requestId = 0;
+    for (const auto& config : getAllPropertyConfigs()) {
+        if (config.access == aidlvhal::VehiclePropertyAccess::WRITE) {
+            continue;
+        }
+        if (config.areaConfigs.empty()) {
+            requests.push_back({.requestId = requestId++, .prop = {.prop = config.prop}});
+            continue;
+        }
+        for (const auto& areaConfig : config.areaConfigs) {
+            requests.push_back({.requestId = requestId++,
+                                .prop = {.areaId = areaConfig.areaId, .prop = config.prop}});
+        }
+    }
+    if (requests.empty()) {
+        return;
+    }
 
-        // try to reconnect
+    // The results might be delivered from the GetSetValuesStream reader thread. The callback is
+    // always invoked exactly once if getValues returns OK, pending calls are failed on shutdown or
+    // after kGetSetValuesTimeout.
+    auto promise = std::make_shared<std::promise<std::vector<aidlvhal::VehiclePropValue>>>();
+    auto future = promise->get_future();
+    auto status = getValues(std::make_shared<const GetValuesCallback>(
+                                    [promise](std::vector<aidlvhal::GetValueResult> results) {
+                                        std::vector<aidlvhal::VehiclePropValue> values;
+                                        for (auto& result : results) {
+                                            if (result.status == aidlvhal::StatusCode::OK &&
+                                                result.prop) {
+                                                values.push_back(std::move(*result.prop));
+                                            }
+                                        }
+                                        promise->set_value(std::move(values));
+                                    }),
+                            requests);
+    if (status != aidlvhal::StatusCode::OK) {
+        LOG(ERROR) << __func__ << ": failed to get the current values after reconnection";
+        return;
+    }
+    // Pending calls are completed after kGetSetValuesTimeout, the bounded wait is only a
+    // safeguard.
+    if (future.wait_for(2 * kGetSetValuesTimeout) != std::future_status::ready) {
+        LOG(ERROR) << __func__ << ": timed out getting the current values after reconnection";
+        return;
+    }
+    auto values = future.get();
+    LOG(INFO) << __func__ << ": resynced " << values.size() << " values after reconnection";
+    std::shared_lock lck(mCallbackMutex);
+    if (mOnPropChange && !values.empty()) {
+        (*mOnPropChange)(std::move(values));
     }
 }
 
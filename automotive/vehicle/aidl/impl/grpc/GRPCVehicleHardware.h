@@ -27,6 +27,7 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <map>
 #include <memory>
 #include <shared_mutex>
 #include <string>
@@ -81,8 +82,59 @@ class GRPCVehicleHardware : public IVehicleHardware {
     bool waitForConnected(std::chrono::milliseconds waitTime);
 
   private:
+    // The delay before the first reconnect attempt, doubled after every attempt that fails
+    // without receiving any value, up to kMaxReconnectBackoff.
+    static constexpr auto kInitialReconnectBackoff = std::chrono::milliseconds(100);
+    static constexpr auto kMaxReconnectBackoff = std::chrono::seconds(5);
+    // The max time to wait for the results of a get/set call, after which the call is completed
+    // with TRY_AGAIN results.
+    static constexpr auto kGetSetValuesTimeout = std::chrono::seconds(5);
+
     void ValuePollingLoop();
 
+    // Gets the current values for all the readable properties and delivers them as property
+    // change events, so that clients catch up with the changes missed while disconnected.
+    void ResyncValues();
+
+    // A get or set call waiting for its results on the GetSetValuesStream.
+    struct PendingCall {
+        std::chrono::steady_clock::time_point deadline;
+        proto::GetSetValuesStreamRequest request;
+        std::shared_ptr<const GetValuesCallback> getCallback;
+        std::shared_ptr<const SetValuesCallback> setCallback;
+    };
+
+    aidlvhal::StatusCode GetValuesUnary(const proto::VehiclePropValueRequests& protoRequests,
+                                        const GetValuesCallback& callback) const;
+    aidlvhal::StatusCode SetValuesUnary(const proto::VehiclePropValueRequests& protoRequests,
+                                        const SetValuesCallback& callback) const;
+
+    // Sends the request through the long-lived GetSetValuesStream, starting the stream if
+    // needed. On success, the results are delivered through the callback of the pending call.
+    // Returns false if the stream is not available, in which case the caller should fall back to
+    // the unary RPC with the request.
+    bool SendOnGetSetValuesStream(proto::GetSetValuesStreamRequest* request,
+                                  PendingCall call) const;
+
+    // Starts the GetSetValuesStream, and the reader and timeout threads if they are not running
+    // yet. Must be called with mGetSetValuesStreamMutex held, which is released while the stream
+    // is being created. Returns false without waiting if another thread is creating the stream.
+    bool StartGetSetValuesStreamLocked(std::unique_lock<std::mutex>* lck) const;
+
+    // Waits for a GetSetValuesStream to be started, dispatches its results to the pending calls
+    // by call ID until it ends, and repeats until shutting down.
+    void GetSetValuesStreamReadLoop() const;
+
+    // Completes the pending calls that reached their deadline with TRY_AGAIN results, until
+    // shutting down.
+    void GetSetValuesTimeoutLoop() const;
+
+    // Completes the calls left pending when the stream ended or timed out. If the server does not
+    // implement the stream, the calls are retried with the unary RPCs since the server never
+    // handled them, otherwise they are failed with errorStatus results.
+    void FinishPendingCalls(std::map<int64_t, PendingCall> calls, bool retryWithUnary,
+                            aidlvhal::StatusCode errorStatus) const;
+
     std::string mServiceAddr;
     std::shared_ptr<::grpc::Channel> mGrpcChannel;
     std::unique_ptr<proto::VehicleServer::Stub> mGrpcStub;
@@ -95,6 +147,37 @@ class GRPCVehicleHardware : public IVehicleHardware {
     std::mutex mShutdownMutex;
     std::condition_variable mShutdownCV;
     std::atomic<bool> mShuttingDownFlag{false};
+    // The context for the ongoing value stream, cancelled on shutdown. Guarded by
+    // mShutdownMutex.
+    ::grpc::ClientContext* mValueStreamContext{nullptr};
+
+    // The GetSetValuesStream is started on the first get/set call and restarted on the next call
+    // after it is lost. The fields below are guarded by mGetSetValuesStreamMutex, unless noted.
+    mutable std::mutex mGetSetValuesStreamMutex;
+    mutable std::unique_ptr<::grpc::ClientContext> mGetSetValuesStreamContext;
+    mutable std::unique_ptr<::grpc::ClientReaderWriter<proto::GetSetValuesStreamRequest,
+                                                       proto::GetSetValuesStreamResponse>>
+            mGetSetValuesStream;
+    mutable std::condition_variable mGetSetValuesStreamCV;
+    // Serializes the writes to the stream. mGetSetValuesStreamMutex is never taken while holding
+    // it, so that a write blocked by flow control doesn't stop the reader thread.
+    mutable std::mutex mGetSetValuesStreamWriteMutex;
+    // The stream the requests are written to, cleared by the reader thread before finishing the
+    // stream. Guarded by mGetSetValuesStreamWriteMutex.
+    mutable ::grpc::ClientReaderWriter<proto::GetSetValuesStreamRequest,
+                                       proto::GetSetValuesStreamResponse>*
+            mGetSetValuesStreamWriter{nullptr};
+    mutable std::thread mGetSetValuesStreamReadThread;
+    // Notified when a call is added to mPendingCalls and on shutdown.
+    mutable std::condition_variable mGetSetValuesTimeoutCV;
+    mutable std::thread mGetSetValuesTimeoutThread;
+    // Set while a thread is creating the stream without holding the lock.
+    mutable bool mGetSetValuesStreamStarting{false};
+    // Set if the server does not implement GetSetValuesStream.
+    mutable bool mGetSetValuesStreamUnsupported{false};
+    mutable int64_t mNextCallId{0};
+    // Ordered by call ID, which is also the order of the deadlines.
+    mutable std::map<int64_t, PendingCall> mPendingCalls;
 };
 
 }  // namespace android::hardware::automotive::vehicle::virtualization
@@ -195,6 +195,52 @@ GrpcVehicleProxyServer::GrpcVehicleProxyServer(std::string serverAddr,
     return ::grpc::Status(::grpc::StatusCode::ABORTED, "Connection lost.");
 }
 
+::grpc::Status GrpcVehicleProxyServer::GetSetValuesStream(
+        ::grpc::ServerContext* context,
+        ::grpc::ServerReaderWriter<proto::GetSetValuesStreamResponse,
+                                   proto::GetSetValuesStreamRequest>* stream) {
+    proto::GetSetValuesStreamRequest request;
+    proto::GetSetValuesStreamResponse response;
+    while (stream->Read(&request)) {
+        response.Clear();
+        response.set_call_id(request.call_id());
+        switch (request.requests_case()) {
+            case proto::GetSetValuesStreamRequest::kGetRequests: {
+                auto* results = response.mutable_get_results();
+                if (!GetValues(context, &request.get_requests(), results).ok()) {
+                    // Every request must be answered, otherwise the client waits forever.
+                    results->Clear();
+                    for (const auto& protoRequest : request.get_requests().requests()) {
+                        auto& protoResult = *results->add_results();
+                        protoResult.set_request_id(protoRequest.request_id());
+                        protoResult.set_status(proto::StatusCode::INTERNAL_ERROR);
+                    }
+                }
+                break;
+            }
+            case proto::GetSetValuesStreamRequest::kSetRequests: {
+                auto* results = response.mutable_set_results();
+                if (!SetValues(context, &request.set_requests(), results).ok()) {
+                    results->Clear();
+                    for (const auto& protoRequest : request.set_requests().requests()) {
+                        auto& protoResult = *results->add_results();
+                        protoResult.set_request_id(protoRequest.request_id());
+                        protoResult.set_status(proto::StatusCode::INTERNAL_ERROR);
+                    }
+                }
+                break;
+            }
+            default:
+                LOG(ERROR) << __func__ << ": empty request, call ID: " << request.call_id();
+                continue;
+        }
+        if (!stream->Write(response)) {
+            return ::grpc::Status(::grpc::StatusCode::ABORTED, "Connection lost.");
+        }
+    }
+    return ::grpc::Status::OK;
+}
+
 void GrpcVehicleProxyServer::OnVehiclePropChange(
         const std::vector<aidlvhal::VehiclePropValue>& values) {
     std::unordered_set<uint64_t> brokenConn;
@@ -67,6 +67,11 @@ class GrpcVehicleProxyServer : public proto::VehicleServer::Service {
             ::grpc::ServerContext* context, const ::google::protobuf::Empty* request,
             ::grpc::ServerWriter<proto::VehiclePropValues>* stream) override;
 
+    ::grpc::Status GetSetValuesStream(
+            ::grpc::ServerContext* context,
+            ::grpc::ServerReaderWriter<proto::GetSetValuesStreamResponse,
+                                       proto::GetSetValuesStreamRequest>* stream) override;
+
     GrpcVehicleProxyServer& Start();
 
     GrpcVehicleProxyServer& Shutdown();
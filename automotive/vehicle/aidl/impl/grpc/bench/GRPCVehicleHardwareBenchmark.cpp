@@ -0,0 +1,277 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "GRPCVehicleHardware.h"
+#include "GRPCVehicleProxyServer.h"
+#include "IVehicleHardware.h"
+#include "VehicleServer.grpc.pb.h"
+#include "VehicleServer.pb.h"
+
+#include <benchmark/benchmark.h>
+#include <grpc++/grpc++.h>
+#include <utils/SystemClock.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android::hardware::automotive::vehicle::virtualization {
+
+namespace {
+
+const std::string kLoopbackServerAddr = "127.0.0.1:54322";
+constexpr int32_t kTestProp = 0x21400001;
+constexpr auto kMaxWaitTime = std::chrono::seconds(5);
+
+// A vehicle hardware that generates property change events on demand and answers get/set
+// requests immediately.
+class EventSourceHardware : public IVehicleHardware {
+  public:
+    void registerOnPropertyChangeEvent(
+            std::unique_ptr<const PropertyChangeCallback> callback) override {
+        mOnProp = std::move(callback);
+    }
+
+    void onPropertyEvent(std::vector<aidlvhal::VehiclePropValue> values) {
+        if (mOnProp) {
+            (*mOnProp)(std::move(values));
+        }
+    }
+
+    std::vector<aidlvhal::VehiclePropConfig> getAllPropertyConfigs() const override { return {}; }
+
+    aidlvhal::StatusCode setValues(
+            std::shared_ptr<const SetValuesCallback> callback,
+            const std::vector<aidlvhal::SetValueRequest>& requests) override {
+        std::vector<aidlvhal::SetValueResult> results;
+        for (const auto& request : requests) {
+            results.push_back({.requestId = request.requestId, .status = aidlvhal::StatusCode::OK});
+        }
+        (*callback)(std::move(results));
+        return aidlvhal::StatusCode::OK;
+    }
+
+    aidlvhal::StatusCode getValues(
+            std::shared_ptr<const GetValuesCallback> callback,
+            const std::vector<aidlvhal::GetValueRequest>& requests) const override {
+        std::vector<aidlvhal::GetValueResult> results;
+        for (const auto& request : requests) {
+            results.push_back({.requestId = request.requestId,
+                               .status = aidlvhal::StatusCode::OK,
+                               .prop = request.prop});
+        }
+        (*callback)(std::move(results));
+        return aidlvhal::StatusCode::OK;
+    }
+
+    DumpResult dump(const std::vector<std::string>& options) override { return {}; }
+
+    aidlvhal::StatusCode checkHealth() override { return aidlvhal::StatusCode::OK; }
+
+    void registerOnPropertySetErrorEvent(
+            std::unique_ptr<const PropertySetErrorCallback> callback) override {}
+
+  private:
+    std::unique_ptr<const PropertyChangeCallback> mOnProp;
+};
+
+// Counts the values received by the client hardware.
+class EventSink {
+  public:
+    void onValues(const std::vector<aidlvhal::VehiclePropValue>& values) {
+        int64_t now = uptimeNanos();
+        {
+            std::lock_guard lck(mMutex);
+            mReceivedCount += values.size();
+            if (!values.empty()) {
+                mLastLatencyInNano = now - values.back().timestamp;
+            }
+        }
+        mCV.notify_all();
+    }
+
+    // Waits until at least count values are received in total, returns the latency of the last
+    // received value.
+    std::optional<int64_t> waitFor(size_t count) {
+        std::unique_lock lck(mMutex);
+        if (!mCV.wait_for(lck, kMaxWaitTime, [this, count] { return mReceivedCount >= count; })) {
+            return std::nullopt;
+        }
+        return mLastLatencyInNano;
+    }
+
+    size_t getReceivedCount() {
+        std::lock_guard lck(mMutex);
+        return mReceivedCount;
+    }
+
+  private:
+    std::mutex mMutex;
+    std::condition_variable mCV;
+    size_t mReceivedCount = 0;
+    int64_t mLastLatencyInNano = 0;
+};
+
+std::vector<aidlvhal::VehiclePropValue> createValues(size_t count) {
+    std::vector<aidlvhal::VehiclePropValue> values(count);
+    for (auto& value : values) {
+        value.prop = kTestProp;
+        value.value.floatValues = {1.0f};
+    }
+    return values;
+}
+
+}  // namespace
+
+// A GRPCVehicleHardware client streaming events from a GrpcVehicleProxyServer over loopback.
+class GRPCVehicleHardwareBenchmark : public benchmark::Fixture {
+  public:
+    void SetUp(const benchmark::State& state) override {
+        auto hardware = std::make_unique<EventSourceHardware>();
+        mSource = hardware.get();
+        mServer = std::make_unique<GrpcVehicleProxyServer>(kLoopbackServerAddr,
+                                                           std::move(hardware));
+        mServer->Start();
+
+        mSink = std::make_shared<EventSink>();
+        mClient = std::make_unique<GRPCVehicleHardware>(kLoopbackServerAddr);
+        mClient->registerOnPropertyChangeEvent(
+                std::make_unique<const IVehicleHardware::PropertyChangeCallback>(
+                        [sink = mSink](const auto& values) { sink->onValues(values); }));
+        mClient->waitForConnected(kMaxWaitTime);
+
+        // Events sent before the value stream is registered on the server are dropped, keep
+        // probing until one arrives.
+        auto startTime = std::chrono::steady_clock::now();
+        while (mSink->getReceivedCount() == 0 &&
+               std::chrono::steady_clock::now() - startTime < kMaxWaitTime) {
+            mSource->onPropertyEvent(createValues(1));
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    void TearDown(const benchmark::State& state) override {
+        mClient.reset();
+        mServer->Shutdown().Wait();
+        mServer.reset();
+    }
+
+  protected:
+    EventSourceHardware* mSource;
+    std::unique_ptr<GrpcVehicleProxyServer> mServer;
+    std::unique_ptr<GRPCVehicleHardware> mClient;
+    std::shared_ptr<EventSink> mSink;
+};
+
+// The time from an event being generated on the server side until it is delivered to the client
+// callback.
+BENCHMARK_DEFINE_F(GRPCVehicleHardwareBenchmark, BM_eventLatency)(benchmark::State& state) {
+    size_t expectedCount = mSink->getReceivedCount();
+    for (auto _ : state) {
+        auto values = createValues(1);
+        values[0].timestamp = uptimeNanos();
+        mSource->onPropertyEvent(std::move(values));
+        expectedCount++;
+        auto latency = mSink->waitFor(expectedCount);
+        if (!latency.has_value()) {
+            state.SkipWithError("event not delivered");
+            break;
+        }
+        state.SetIterationTime(static_cast<double>(*latency) / 1e9);
+    }
+}
+BENCHMARK_REGISTER_F(GRPCVehicleHardwareBenchmark, BM_eventLatency)->UseManualTime();
+
+// Streams batches of {@code state.range(0)} values and waits for all of them to be delivered.
+BENCHMARK_DEFINE_F(GRPCVehicleHardwareBenchmark, BM_eventThroughput)(benchmark::State& state) {
+    size_t batchSize = state.range(0);
+    size_t expectedCount = mSink->getReceivedCount();
+    for (auto _ : state) {
+        for (size_t i = 0; i < 100; i++) {
+            mSource->onPropertyEvent(createValues(batchSize));
+        }
+        expectedCount += 100 * batchSize;
+        if (!mSink->waitFor(expectedCount).has_value()) {
+            state.SkipWithError("events not delivered");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 100 * batchSize);
+}
+BENCHMARK_REGISTER_F(GRPCVehicleHardwareBenchmark, BM_eventThroughput)->Range(1, 256);
+
+// Issues {@code state.range(0)} getValues calls through the client hardware without waiting for
+// the previous results, so they are pipelined on the GetSetValuesStream.
+BENCHMARK_DEFINE_F(GRPCVehicleHardwareBenchmark, BM_getValuesPipelined)(benchmark::State& state) {
+    int inFlightCount = state.range(0);
+    std::mutex mutex;
+    std::condition_variable cv;
+    int completedCount = 0;
+    auto callback = std::make_shared<const IVehicleHardware::GetValuesCallback>(
+            [&mutex, &cv, &completedCount](std::vector<aidlvhal::GetValueResult>) {
+                {
+                    std::lock_guard lck(mutex);
+                    completedCount++;
+                }
+                cv.notify_all();
+            });
+    std::vector<aidlvhal::GetValueRequest> requests = {{.prop = {.prop = kTestProp}}};
+    for (auto _ : state) {
+        for (int i = 0; i < inFlightCount; i++) {
+            requests[0].requestId = i;
+            mClient->getValues(callback, requests);
+        }
+        std::unique_lock lck(mutex);
+        if (!cv.wait_for(lck, kMaxWaitTime, [&completedCount, inFlightCount] {
+                return completedCount >= inFlightCount;
+            })) {
+            state.SkipWithError("results not delivered");
+            break;
+        }
+        completedCount = 0;
+    }
+    state.SetItemsProcessed(state.iterations() * inFlightCount);
+}
+BENCHMARK_REGISTER_F(GRPCVehicleHardwareBenchmark, BM_getValuesPipelined)->Range(1, 64);
+
+// The baseline for BM_getValuesPipelined: the same calls as blocking unary GetValues RPCs.
+BENCHMARK_DEFINE_F(GRPCVehicleHardwareBenchmark, BM_getValuesUnary)(benchmark::State& state) {
+    int callCount = state.range(0);
+    auto stub = proto::VehicleServer::NewStub(
+            ::grpc::CreateChannel(kLoopbackServerAddr, ::grpc::InsecureChannelCredentials()));
+    proto::VehiclePropValueRequests requests;
+    requests.add_requests()->mutable_value()->set_prop(kTestProp);
+    proto::GetValueResults results;
+    for (auto _ : state) {
+        for (int i = 0; i < callCount; i++) {
+            ::grpc::ClientContext context;
+            requests.mutable_requests(0)->set_request_id(i);
+            if (!stub->GetValues(&context, requests, &results).ok()) {
+                state.SkipWithError("GetValues failed");
+                return;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * callCount);
+}
+BENCHMARK_REGISTER_F(GRPCVehicleHardwareBenchmark, BM_getValuesUnary)->Range(1, 64);
+
+}  // namespace android::hardware::automotive::vehicle::virtualization
+
+BENCHMARK_MAIN();
@@ -21,6 +21,7 @@
 #include <gtest/gtest.h>
 
 #include <chrono>
+#include <future>
 #include <memory>
 #include <string>
 
@@ -58,6 +59,109 @@ class FakeVehicleServer : public proto::VehicleServer::Service {
     }
 };
 
+// A fake server with one property, whose current value is only available through GetValues.
+class FakeVehicleServerWithProperty : public FakeVehicleServer {
+  public:
+    static constexpr int32_t kTestProp = 0x21400001;
+
+    ::grpc::Status GetAllPropertyConfig(
+            ::grpc::ServerContext* context, const ::google::protobuf::Empty* request,
+            ::grpc::ServerWriter<proto::VehiclePropConfig>* stream) override {
+        proto::VehiclePropConfig protoConfig;
+        protoConfig.set_prop(kTestProp);
+        stream->Write(protoConfig);
+        return ::grpc::Status::OK;
+    }
+
+    ::grpc::Status GetValues(::grpc::ServerContext* context,
+                             const proto::VehiclePropValueRequests* requests,
+                             proto::GetValueResults* results) override {
+        for (const auto& request : requests->requests()) {
+            auto* result = results->add_results();
+            result->set_request_id(request.request_id());
+            result->set_status(proto::StatusCode::OK);
+            result->mutable_value()->set_prop(request.value().prop());
+            result->mutable_value()->add_int32_values(1);
+        }
+        return ::grpc::Status::OK;
+    }
+};
+
+// A fake server that accepts get/set calls on the GetSetValuesStream but never answers them.
+class FakeVehicleServerNotAnswering : public FakeVehicleServer {
+  public:
+    ::grpc::Status GetSetValuesStream(
+            ::grpc::ServerContext* context,
+            ::grpc::ServerReaderWriter<proto::GetSetValuesStreamResponse,
+                                       proto::GetSetValuesStreamRequest>* stream) override {
+        proto::GetSetValuesStreamRequest request;
+        while (stream->Read(&request))
+            ;
+        return ::grpc::Status::OK;
+    }
+};
+
+TEST(GRPCVehicleHardwareUnitTest, GetValuesTimeout) {
+    auto fakeServer = std::make_unique<FakeVehicleServerNotAnswering>();
+    ::grpc::ServerBuilder builder;
+    builder.RegisterService(fakeServer.get());
+    builder.AddListeningPort(kFakeServerAddr, ::grpc::InsecureServerCredentials());
+    auto grpcServer = builder.BuildAndStart();
+
+    auto vehicleHardware = std::make_unique<GRPCVehicleHardware>(kFakeServerAddr);
+    auto promise = std::make_shared<std::promise<std::vector<aidlvhal::GetValueResult>>>();
+    auto future = promise->get_future();
+    auto status = vehicleHardware->getValues(
+            std::make_shared<const IVehicleHardware::GetValuesCallback>(
+                    [promise](std::vector<aidlvhal::GetValueResult> results) {
+                        promise->set_value(std::move(results));
+                    }),
+            {{.requestId = 1, .prop = {.prop = FakeVehicleServerWithProperty::kTestProp}}});
+    ASSERT_EQ(status, aidlvhal::StatusCode::OK);
+
+    // The call must be completed even though the server never answers.
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    auto results = future.get();
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(results[0].requestId, 1);
+    EXPECT_EQ(results[0].status, aidlvhal::StatusCode::TRY_AGAIN);
+
+    vehicleHardware.reset();
+    grpcServer->Shutdown();
+    grpcServer->Wait();
+}
+
+TEST(GRPCVehicleHardwareUnitTest, ResyncAfterReconnect) {
+    auto resynced = std::make_shared<std::atomic<bool>>(false);
+    auto vehicleHardware = std::make_unique<GRPCVehicleHardware>(kFakeServerAddr);
+    vehicleHardware->registerOnPropertyChangeEvent(
+            std::make_unique<const IVehicleHardware::PropertyChangeCallback>(
+                    [resynced](const auto& values) {
+                        for (const auto& value : values) {
+                            if (value.prop == FakeVehicleServerWithProperty::kTestProp) {
+                                resynced->store(true);
+                            }
+                        }
+                    }));
+
+    auto fakeServer = std::make_unique<FakeVehicleServerWithProperty>();
+    ::grpc::ServerBuilder builder;
+    builder.RegisterService(fakeServer.get());
+    builder.AddListeningPort(kFakeServerAddr, ::grpc::InsecureServerCredentials());
+    auto grpcServer = builder.BuildAndStart();
+
+    // The fake server disconnects after every update, the current values must be fetched after
+    // reconnecting.
+    constexpr auto kMaxWaitTime = std::chrono::seconds(5);
+    auto startTime = std::chrono::steady_clock::now();
+    while (!resynced->load() && std::chrono::steady_clock::now() - startTime < kMaxWaitTime)
+        ;
+
+    grpcServer->Shutdown();
+    grpcServer->Wait();
+    EXPECT_TRUE(resynced->load());
+}
+
 TEST(GRPCVehicleHardwareUnitTest, Reconnect) {
     auto receivedUpdate = std::make_shared<std::atomic<int>>(0);
     auto vehicleHardware = std::make_unique<GRPCVehicleHardware>(kFakeServerAddr);
@@ -22,11 +22,15 @@
 #include <grpc++/grpc++.h>
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 
 namespace android::hardware::automotive::vehicle::virtualization {
 
@@ -46,26 +50,45 @@ class VehicleHardwareForTest : public IVehicleHardware {
         }
     }
 
-    // Functions that we do not care.
-    std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropConfig>
-    getAllPropertyConfigs() const override {
-        return {};
-    }
-
+    // Succeeds all the set requests.
     aidl::android::hardware::automotive::vehicle::StatusCode setValues(
             std::shared_ptr<const SetValuesCallback> callback,
             const std::vector<aidl::android::hardware::automotive::vehicle::SetValueRequest>&
                     requests) override {
+        std::vector<aidl::android::hardware::automotive::vehicle::SetValueResult> results;
+        for (const auto& request : requests) {
+            results.push_back({
+                    .requestId = request.requestId,
+                    .status = aidl::android::hardware::automotive::vehicle::StatusCode::OK,
+            });
+        }
+        (*callback)(std::move(results));
         return aidl::android::hardware::automotive::vehicle::StatusCode::OK;
     }
 
+    // Echoes the requested property as the value.
     aidl::android::hardware::automotive::vehicle::StatusCode getValues(
             std::shared_ptr<const GetValuesCallback> callback,
             const std::vector<aidl::android::hardware::automotive::vehicle::GetValueRequest>&
                     requests) const override {
+        std::vector<aidl::android::hardware::automotive::vehicle::GetValueResult> results;
+        for (const auto& request : requests) {
+            results.push_back({
+                    .requestId = request.requestId,
+                    .status = aidl::android::hardware::automotive::vehicle::StatusCode::OK,
+                    .prop = request.prop,
+            });
+        }
+        (*callback)(std::move(results));
         return aidl::android::hardware::automotive::vehicle::StatusCode::OK;
     }
 
+    // Functions that we do not care.
+    std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropConfig>
+    getAllPropertyConfigs() const override {
+        return {};
+    }
+
     DumpResult dump(const std::vector<std::string>& options) override { return {}; }
 
     aidl::android::hardware::automotive::vehicle::StatusCode checkHealth() override {
@@ -144,4 +167,88 @@ TEST(GRPCVehicleProxyServerUnitTest, ClientConnectDisconnect) {
     vehicleServer->Shutdown().Wait();
 }
 
+TEST(GRPCVehicleProxyServerUnitTest, PipelinedGetSetValues) {
+    using ::aidl::android::hardware::automotive::vehicle::GetValueRequest;
+    using ::aidl::android::hardware::automotive::vehicle::GetValueResult;
+    using ::aidl::android::hardware::automotive::vehicle::SetValueRequest;
+    using ::aidl::android::hardware::automotive::vehicle::SetValueResult;
+    using ::aidl::android::hardware::automotive::vehicle::StatusCode;
+
+    auto vehicleServer = std::make_unique<GrpcVehicleProxyServer>(
+            kFakeServerAddr, std::make_unique<VehicleHardwareForTest>());
+    vehicleServer->Start();
+
+    constexpr auto kWaitForConnectionMaxTime = std::chrono::seconds(5);
+    constexpr auto kWaitForResultsMaxTime = std::chrono::seconds(10);
+    constexpr int kThreadCount = 4;
+    constexpr int kCallsPerThread = 100;
+
+    auto vehicleHardware = std::make_unique<GRPCVehicleHardware>(kFakeServerAddr);
+    ASSERT_TRUE(vehicleHardware->waitForConnected(kWaitForConnectionMaxTime));
+
+    std::mutex lock;
+    std::condition_variable cv;
+    int completedCalls = 0;
+    std::atomic<int> mismatchedResults = 0;
+    auto onCallCompleted = [&lock, &cv, &completedCalls] {
+        std::lock_guard<std::mutex> lockGuard(lock);
+        completedCalls++;
+        cv.notify_all();
+    };
+
+    // Every thread issues its calls without waiting for the previous results, so that many calls
+    // are in flight on the stream at the same time.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreadCount; t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < kCallsPerThread; i++) {
+                int64_t requestId = t * kCallsPerThread + i;
+                int32_t propId = static_cast<int32_t>(requestId) + 1;
+                if (i % 2 == 0) {
+                    auto callback = std::make_shared<const IVehicleHardware::GetValuesCallback>(
+                            [&, requestId, propId](std::vector<GetValueResult> results) {
+                                if (results.size() != 1 || results[0].requestId != requestId ||
+                                    results[0].status != StatusCode::OK || !results[0].prop ||
+                                    results[0].prop->prop != propId) {
+                                    mismatchedResults++;
+                                }
+                                onCallCompleted();
+                            });
+                    EXPECT_EQ(vehicleHardware->getValues(
+                                      callback, {GetValueRequest{.requestId = requestId,
+                                                                 .prop = {.prop = propId}}}),
+                              StatusCode::OK);
+                } else {
+                    auto callback = std::make_shared<const IVehicleHardware::SetValuesCallback>(
+                            [&, requestId](std::vector<SetValueResult> results) {
+                                if (results.size() != 1 || results[0].requestId != requestId ||
+                                    results[0].status != StatusCode::OK) {
+                                    mismatchedResults++;
+                                }
+                                onCallCompleted();
+                            });
+                    EXPECT_EQ(vehicleHardware->setValues(
+                                      callback, {SetValueRequest{.requestId = requestId,
+                                                                 .value = {.prop = propId}}}),
+                              StatusCode::OK);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    {
+        std::unique_lock<std::mutex> uniqueLock(lock);
+        EXPECT_TRUE(cv.wait_for(uniqueLock, kWaitForResultsMaxTime, [&completedCalls] {
+            return completedCalls == kThreadCount * kCallsPerThread;
+        }));
+    }
+    EXPECT_EQ(mismatchedResults, 0);
+
+    vehicleHardware.reset();
+    vehicleServer->Shutdown().Wait();
+}
+
 }  // namespace android::hardware::automotive::vehicle::virtualization
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <RecurrentTimer.h>
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+// Intervals from 10ms to 1s, similar to continuous properties subscribed at different rates.
+int64_t testInterval(size_t i) {
+    return 10'000'000 + static_cast<int64_t>(i % 100) * 10'000'000;
+}
+
+std::vector<std::shared_ptr<RecurrentTimer::Callback>> createCallbacks(size_t count) {
+    std::vector<std::shared_ptr<RecurrentTimer::Callback>> callbacks;
+    for (size_t i = 0; i < count; i++) {
+        callbacks.push_back(std::make_shared<RecurrentTimer::Callback>([] {}));
+    }
+    return callbacks;
+}
+
+}  // namespace
+
+// Registers and unregisters one callback while {@code state.range(0)} other callbacks are
+// running.
+static void BM_registerUnregisterWithActiveTimers(benchmark::State& state) {
+    RecurrentTimer timer;
+    auto activeCallbacks = createCallbacks(state.range(0));
+    for (size_t i = 0; i < activeCallbacks.size(); i++) {
+        timer.registerTimerCallback(testInterval(i), activeCallbacks[i]);
+    }
+    auto callback = std::make_shared<RecurrentTimer::Callback>([] {});
+    size_t i = 0;
+
+    for (auto _ : state) {
+        timer.registerTimerCallback(testInterval(i++), callback);
+        timer.unregisterTimerCallback(callback);
+    }
+
+    for (const auto& activeCallback : activeCallbacks) {
+        timer.unregisterTimerCallback(activeCallback);
+    }
+}
+BENCHMARK(BM_registerUnregisterWithActiveTimers)->Range(1024, 16384);
+
+// Re-registers every callback with a new interval, like a client changing the sample rate of all
+// its subscriptions.
+static void BM_updateIntervals(benchmark::State& state) {
+    RecurrentTimer timer;
+    auto callbacks = createCallbacks(state.range(0));
+    for (size_t i = 0; i < callbacks.size(); i++) {
+        timer.registerTimerCallback(testInterval(i), callbacks[i]);
+    }
+    size_t round = 0;
+
+    for (auto _ : state) {
+        round++;
+        for (size_t i = 0; i < callbacks.size(); i++) {
+            timer.registerTimerCallback(testInterval(i + round), callbacks[i]);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * callbacks.size());
+
+    for (const auto& callback : callbacks) {
+        timer.unregisterTimerCallback(callback);
+    }
+}
+BENCHMARK(BM_updateIntervals)->Range(1024, 16384);
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
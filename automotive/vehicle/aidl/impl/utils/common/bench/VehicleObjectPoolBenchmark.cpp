@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <VehicleHalTypes.h>
+#include <VehicleObjectPool.h>
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyType;
+
+std::shared_ptr<VehiclePropValuePool> gValuePool;
+
+}  // namespace
+
+// A pool shared by all the benchmark threads.
+class VehicleObjectPoolBenchmark : public benchmark::Fixture {
+  public:
+    void SetUp(const benchmark::State& state) override {
+        if (state.thread_index() == 0) {
+            gValuePool = std::make_shared<VehiclePropValuePool>();
+        }
+    }
+
+    void TearDown(const benchmark::State& state) override {
+        if (state.thread_index() == 0) {
+            gValuePool.reset();
+        }
+    }
+};
+
+// Obtains and immediately recycles one value, like reading a property.
+BENCHMARK_DEFINE_F(VehicleObjectPoolBenchmark, BM_obtainRecycle)(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(gValuePool->obtainFloat(1.0f));
+    }
+}
+BENCHMARK_REGISTER_F(VehicleObjectPoolBenchmark, BM_obtainRecycle)->ThreadRange(1, 16);
+
+// Obtains a burst of values before recycling them, like a batch of property events.
+BENCHMARK_DEFINE_F(VehicleObjectPoolBenchmark, BM_obtainRecycleBurst)(benchmark::State& state) {
+    std::vector<VehiclePropValuePool::RecyclableType> values;
+    values.reserve(64);
+    for (auto _ : state) {
+        for (size_t i = 0; i < 64; i++) {
+            values.push_back(gValuePool->obtain(VehiclePropertyType::INT32_VEC, i % 4 + 1));
+        }
+        values.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * 64);
+}
+BENCHMARK_REGISTER_F(VehicleObjectPoolBenchmark, BM_obtainRecycleBurst)->ThreadRange(1, 16);
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
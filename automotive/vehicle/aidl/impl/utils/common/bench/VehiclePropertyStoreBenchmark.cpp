@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <VehicleHalTypes.h>
+#include <VehiclePropertyStore.h>
+#include <VehicleUtils.h>
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropConfig;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
+
+constexpr int32_t kPropCount = 64;
+
+// VehiclePropertyGroup:VENDOR,VehicleArea:GLOBAL,VehiclePropertyType:INT32
+int32_t testProp(int32_t i) {
+    return 0x21400000 + i;
+}
+
+// A store shared by all the benchmark threads.
+class VehiclePropertyStoreBenchmark : public benchmark::Fixture {
+  public:
+    void SetUp(const benchmark::State& state) override {
+        if (state.thread_index() != 0) {
+            return;
+        }
+        mValuePool = std::make_shared<VehiclePropValuePool>();
+        mStore = std::make_unique<VehiclePropertyStore>(mValuePool);
+        for (int32_t i = 0; i < kPropCount; i++) {
+            mStore->registerProperty(VehiclePropConfig{.prop = testProp(i)});
+            (void)mStore->writeValue(mValuePool->obtain(VehiclePropValue{
+                    .prop = testProp(i),
+                    .value.int32Values = {i},
+            }));
+        }
+        mStore->setOnValueChangeCallback([](const VehiclePropValue&) {});
+    }
+
+    void TearDown(const benchmark::State& state) override {
+        if (state.thread_index() != 0) {
+            return;
+        }
+        mStore.reset();
+        mValuePool.reset();
+    }
+
+  protected:
+    std::shared_ptr<VehiclePropValuePool> mValuePool;
+    std::unique_ptr<VehiclePropertyStore> mStore;
+};
+
+// Every thread reads its own property.
+BENCHMARK_DEFINE_F(VehiclePropertyStoreBenchmark, BM_readValueDifferentProperties)
+(benchmark::State& state) {
+    int32_t propId = testProp(state.thread_index() % kPropCount);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(mStore->readValue(propId));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// All the threads read the same property.
+BENCHMARK_DEFINE_F(VehiclePropertyStoreBenchmark, BM_readValueSameProperty)
+(benchmark::State& state) {
+    int32_t propId = testProp(0);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(mStore->readValue(propId));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Half of the threads write their own property while the other half read other properties, which
+// mimics binder getValues threads running alongside the value generators.
+BENCHMARK_DEFINE_F(VehiclePropertyStoreBenchmark, BM_mixedReadWrite)
+(benchmark::State& state) {
+    int32_t propId = testProp(state.thread_index() % kPropCount);
+    bool isWriter = (state.thread_index() % 2 == 0);
+    int64_t timestamp = 0;
+    for (auto _ : state) {
+        if (isWriter) {
+            (void)mStore->writeValue(mValuePool->obtain(VehiclePropValue{
+                    .timestamp = ++timestamp,
+                    .prop = propId,
+                    .value.int32Values = {static_cast<int32_t>(timestamp)},
+            }));
+        } else {
+            benchmark::DoNotOptimize(mStore->readValue(propId));
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_REGISTER_F(VehiclePropertyStoreBenchmark, BM_readValueDifferentProperties)
+        ->ThreadRange(1, 16)
+        ->UseRealTime();
+BENCHMARK_REGISTER_F(VehiclePropertyStoreBenchmark, BM_readValueSameProperty)
+        ->ThreadRange(1, 16)
+        ->UseRealTime();
+BENCHMARK_REGISTER_F(VehiclePropertyStoreBenchmark, BM_mixedReadWrite)
+        ->ThreadRange(2, 16)
+        ->UseRealTime();
+
+}  // namespace
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -19,9 +19,12 @@
 
 #include <android-base/thread_annotations.h>
 
+#include <array>
+#include <condition_variable>
+#include <functional>
+#include <list>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <unordered_map>
 #include <vector>
@@ -32,6 +35,12 @@ namespace automotive {
 namespace vehicle {
 
 // A thread-safe recurrent timer.
+//
+// Callbacks are kept in a hashed timing wheel with {@code WHEEL_SIZE} slots of
+// {@code TICK_IN_NANO} each, so registering and unregistering a callback takes constant time.
+// Callbacks due in the same tick are collected and run together. A callback might be delayed by
+// up to one tick, but the delay never accumulates since the next run is always scheduled one
+// interval after the previous scheduled time.
 class RecurrentTimer final {
   public:
     // The class for the function that would be called recurrently.
@@ -52,40 +61,55 @@ class RecurrentTimer final {
     // friend class for unit testing.
     friend class RecurrentTimerTest;
 
+    // 1ms
+    static constexpr int64_t TICK_IN_NANO = 1'000'000;
+    // Must be a power of 2.
+    static constexpr size_t WHEEL_SIZE = 1024;
+    static constexpr size_t BITMAP_WORD_COUNT = WHEEL_SIZE / 64;
+
     struct CallbackInfo {
         std::shared_ptr<Callback> callback;
         int64_t interval;
+        // The exact scheduled time for the next run.
         int64_t nextTime;
-        // A flag to indicate whether this CallbackInfo is already outdated and should be ignored.
-        // The reason we need this flag is because we cannot easily remove an element from a heap.
-        bool outdated = false;
-
-        static bool cmp(const std::unique_ptr<CallbackInfo>& lhs,
-                        const std::unique_ptr<CallbackInfo>& rhs);
+        // The tick in which the next run happens.
+        int64_t nextTick;
+        // The position of this CallbackInfo in mSlots.
+        std::list<CallbackInfo*>::iterator slotIt;
     };
 
     std::mutex mLock;
     std::thread mThread;
     std::condition_variable mCond;
     bool mStopRequested GUARDED_BY(mLock) = false;
-    // A map to map each callback to its current active CallbackInfo in the mCallbackQueue.
-    std::unordered_map<std::shared_ptr<Callback>, CallbackInfo*> mCallbacks GUARDED_BY(mLock);
-    // A min-heap sorted by nextTime. Note that because we cannot remove arbitrary element from the
-    // heap, a single Callback can have multiple entries in this queue, all but one should be valid.
-    // The rest should be mark as outdated. The valid one is one stored in mCallbacks.
-    std::vector<std::unique_ptr<CallbackInfo>> mCallbackQueue GUARDED_BY(mLock);
+    // Increased each time a callback is registered, so that the timer thread knows it has to
+    // recalculate the time to wake up.
+    uint64_t mScheduleVersion GUARDED_BY(mLock) = 0;
+    // All the registered callbacks. References to the elements are stable, so mSlots could
+    // point to them.
+    std::unordered_map<std::shared_ptr<Callback>, CallbackInfo> mCallbacks GUARDED_BY(mLock);
+    // The timing wheel. A callback is put into the slot for its nextTick modulo WHEEL_SIZE and
+    // stays there until it runs, even if nextTick is more than one revolution away.
+    std::array<std::list<CallbackInfo*>, WHEEL_SIZE> mSlots GUARDED_BY(mLock);
+    // A bitmap for the slots that have at least one callback.
+    std::array<uint64_t, BITMAP_WORD_COUNT> mNonEmptySlots GUARDED_BY(mLock) = {};
+    // The last tick for which the due callbacks have been collected.
+    int64_t mLastProcessedTick GUARDED_BY(mLock);
 
     void loop();
 
-    // Mark the callbackInfo as outdated and should be ignored when popped from the heap.
-    void markOutdatedLocked(CallbackInfo* callback) REQUIRES(mLock);
-    // Remove all outdated callbackInfos from the top of the heap. This function must be called
-    // each time we might introduce outdated elements to the top. We must make sure the heap is
-    // always valid from the top.
-    void removeInvalidCallbackLocked() REQUIRES(mLock);
-    // Gets the next calblack to run (must be valid) from the heap, update its nextTime and put
-    // it back to the heap.
-    std::shared_ptr<Callback> getNextCallbackLocked(int64_t now) REQUIRES(mLock);
+    // Puts the callbackInfo into the slot for its next run.
+    void insertLocked(CallbackInfo* info) REQUIRES(mLock);
+    // Removes the callbackInfo from its slot.
+    void removeLocked(CallbackInfo* info) REQUIRES(mLock);
+    bool isSlotEmptyLocked(size_t slot) REQUIRES(mLock);
+    // Gets the number of ticks after {@code fromTick} until the next non-empty slot, at most
+    // WHEEL_SIZE.
+    int64_t ticksToNextNonEmptySlotLocked(int64_t fromTick) REQUIRES(mLock);
+    // Collects the callbacks due in {@code tick} and schedules their next runs.
+    void collectDueCallbacksLocked(int64_t tick, int64_t now,
+                                   std::vector<std::shared_ptr<Callback>>* callbacks)
+            REQUIRES(mLock);
 };
 
 }  // namespace vehicle
@@ -17,10 +17,13 @@
 #ifndef android_hardware_automotive_vehicle_utils_include_VehicleObjectPool_H_
 #define android_hardware_automotive_vehicle_utils_include_VehicleObjectPool_H_
 
-#include <deque>
-#include <map>
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
 #include <VehicleHalTypes.h>
 
@@ -66,8 +69,140 @@ struct Deleter {
 template <typename T>
 using recyclable_ptr = typename std::unique_ptr<T, Deleter<T>>;
 
+// A bounded multi-producer multi-consumer lock-free queue of object pointers, used as the global
+// free list shared by all threads for one ObjectPool.
+//
+// Each cell carries a sequence number that tells producers and consumers whether the cell is
+// ready for them, so there is no ABA problem even though cells are reused.
+//
+// The cells are only allocated by the first push, a pool that never needs the free list does not
+// pay for it.
+template <typename T>
+class LockFreeFreeList {
+  public:
+    // The capacity is rounded up to a power of 2.
+    explicit LockFreeFreeList(size_t capacity) {
+        size_t cellCount = 1;
+        while (cellCount < capacity) {
+            cellCount <<= 1;
+        }
+        mMask = cellCount - 1;
+    }
+
+    ~LockFreeFreeList() { delete[] mCells.load(std::memory_order_relaxed); }
+
+    // Returns false if the list is full.
+    bool push(T* o) {
+        Cell* cells = getOrCreateCells();
+        Cell* cell;
+        size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells[pos & mMask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->object = o;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns nullptr if the list is empty.
+    T* pop() {
+        Cell* cells = mCells.load(std::memory_order_acquire);
+        if (cells == nullptr) {
+            return nullptr;
+        }
+        Cell* cell;
+        size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells[pos & mMask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (mDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return nullptr;
+            } else {
+                pos = mDequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        T* o = cell->object;
+        cell->seq.store(pos + mMask + 1, std::memory_order_release);
+        return o;
+    }
+
+    LockFreeFreeList& operator=(const LockFreeFreeList&) = delete;
+    LockFreeFreeList(const LockFreeFreeList&) = delete;
+
+  private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T* object;
+    };
+
+    Cell* getOrCreateCells() {
+        Cell* cells = mCells.load(std::memory_order_acquire);
+        if (cells != nullptr) {
+            return cells;
+        }
+        Cell* newCells = new Cell[mMask + 1];
+        for (size_t i = 0; i <= mMask; i++) {
+            newCells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        if (mCells.compare_exchange_strong(cells, newCells, std::memory_order_acq_rel)) {
+            return newCells;
+        }
+        // Another thread created the cells first.
+        delete[] newCells;
+        return cells;
+    }
+
+    std::atomic<Cell*> mCells{nullptr};
+    size_t mMask;
+    // Producers and consumers update different positions, keep them on different cache lines.
+    alignas(64) std::atomic<size_t> mEnqueuePos{0};
+    alignas(64) std::atomic<size_t> mDequeuePos{0};
+};
+
+// The hit and miss counters for an ObjectPool.
+struct ObjectPoolStats {
+    // Objects obtained from the calling thread's cache.
+    uint64_t threadCacheHits = 0;
+    // Objects obtained from the global free list.
+    uint64_t freeListHits = 0;
+    // Objects newly created because the pool was empty.
+    uint64_t misses = 0;
+    // Objects deleted instead of recycled because the pool was full.
+    uint64_t dropped = 0;
+
+    ObjectPoolStats& operator+=(const ObjectPoolStats& other) {
+        threadCacheHits += other.threadCacheHits;
+        freeListHits += other.freeListHits;
+        misses += other.misses;
+        dropped += other.dropped;
+        return *this;
+    }
+};
+
 // Generic abstract object pool class. Users of this class must implement {@Code createObject}.
 //
+// Every thread keeps a small cache of up to {@code THREAD_CACHE_SIZE} recycled objects per pool,
+// for at most {@code THREAD_CACHE_SLOTS} pools of the same type at a time. Objects beyond that go to
+// a lock-free free list shared by all threads. The cached objects and the free list together are
+// bounded by {@code maxPoolObjectsSize}. A pool evicts its objects from all the thread caches when
+// it is destroyed, and a thread moves its cached objects to the free lists when it exits.
+//
 // This class is thread-safe. Concurrent calls to {@Code obtain} from multiple threads is OK, also
 // client can obtain an object in one thread and then move ownership to another thread.
 template <typename T>
@@ -75,22 +210,75 @@ class ObjectPool {
   public:
     using GetSizeFunc = std::function<size_t(const T&)>;
 
-    ObjectPool(size_t maxPoolObjectsSize, GetSizeFunc getSizeFunc)
-        : mMaxPoolObjectsSize(maxPoolObjectsSize), mGetSizeFunc(getSizeFunc){};
-    virtual ~ObjectPool() = default;
+    static constexpr size_t THREAD_CACHE_SIZE = 16;
+    static constexpr size_t THREAD_CACHE_SLOTS = 32;
+
+    // @param maxPoolObjectsCount - The max number of objects in the global free list, defaults to
+    // the number of {@code sizeof(T)} objects that fit into {@code maxPoolObjectsSize}.
+    ObjectPool(size_t maxPoolObjectsSize, GetSizeFunc getSizeFunc, size_t maxPoolObjectsCount = 0)
+        : mMaxPoolObjectsSize(maxPoolObjectsSize),
+          // Consecutive pools use different slots in the thread caches.
+          mSlotIndex(sNextId.fetch_add(1, std::memory_order_relaxed) % THREAD_CACHE_SLOTS),
+          mFreeList(maxPoolObjectsCount == 0 ? maxPoolObjectsSize / sizeof(T) + 1
+                                             : maxPoolObjectsCount),
+          // Created upfront since obtain is called without any lock.
+          mDeleter(std::make_unique<Deleter<T>>(
+                  std::bind(&ObjectPool::recycle, this, std::placeholders::_1))),
+          mGetSizeFunc(getSizeFunc){};
+
+    virtual ~ObjectPool() {
+        {
+            // Holding the registry lock so that no thread moves objects back into this pool while
+            // exiting.
+            std::scoped_lock<std::mutex> registryLockGuard(sRegistryLock);
+            for (ThreadCache* cache : sRegistry) {
+                std::scoped_lock<std::mutex> cacheLockGuard(cache->lock);
+                typename ThreadCache::Slot& slot = cache->slots[mSlotIndex];
+                if (slot.pool != this) {
+                    continue;
+                }
+                for (size_t i = 0; i < slot.count; i++) {
+                    delete slot.objects[i];
+                }
+                slot.pool = nullptr;
+                slot.count = 0;
+            }
+        }
+        while (T* o = mFreeList.pop()) {
+            delete o;
+        }
+    }
 
     virtual recyclable_ptr<T> obtain() {
-        std::scoped_lock<std::mutex> lock(mLock);
         INC_METRIC_IF_DEBUG(Obtained)
-        if (mObjects.empty()) {
-            INC_METRIC_IF_DEBUG(Created)
-            return wrap(createObject());
+        {
+            ThreadCache& cache = getThreadCache();
+            std::scoped_lock<std::mutex> cacheLockGuard(cache.lock);
+            typename ThreadCache::Slot& slot = cache.slots[mSlotIndex];
+            if (slot.pool == this && slot.count > 0) {
+                T* o = slot.objects[--slot.count];
+                mPoolObjectsSize.fetch_sub(mGetSizeFunc(*o), std::memory_order_relaxed);
+                mThreadCacheHits.fetch_add(1, std::memory_order_relaxed);
+                return wrap(o);
+            }
         }
+        if (T* o = mFreeList.pop(); o != nullptr) {
+            mPoolObjectsSize.fetch_sub(mGetSizeFunc(*o), std::memory_order_relaxed);
+            mFreeListHits.fetch_add(1, std::memory_order_relaxed);
+            return wrap(o);
+        }
+        INC_METRIC_IF_DEBUG(Created)
+        mMisses.fetch_add(1, std::memory_order_relaxed);
+        return wrap(createObject());
+    }
 
-        auto o = wrap(mObjects.front().release());
-        mObjects.pop_front();
-        mPoolObjectsSize -= mGetSizeFunc(*o);
-        return o;
+    ObjectPoolStats getStats() const {
+        return {
+                .threadCacheHits = mThreadCacheHits.load(std::memory_order_relaxed),
+                .freeListHits = mFreeListHits.load(std::memory_order_relaxed),
+                .misses = mMisses.load(std::memory_order_relaxed),
+                .dropped = mDropped.load(std::memory_order_relaxed),
+        };
     }
 
     ObjectPool& operator=(const ObjectPool&) = delete;
@@ -100,43 +288,111 @@ class ObjectPool {
     virtual T* createObject() = 0;
 
     virtual void recycle(T* o) {
-        std::scoped_lock<std::mutex> lock(mLock);
         size_t objectSize = mGetSizeFunc(*o);
-
+        size_t poolObjectsSize = mPoolObjectsSize.fetch_add(objectSize, std::memory_order_relaxed);
         if (objectSize > mMaxPoolObjectsSize ||
-            mPoolObjectsSize > mMaxPoolObjectsSize - objectSize) {
-            INC_METRIC_IF_DEBUG(Deleted)
-
+            poolObjectsSize > mMaxPoolObjectsSize - objectSize) {
             // We have no space left in the pool.
-            delete o;
+            drop(o, objectSize);
             return;
         }
 
-        INC_METRIC_IF_DEBUG(Recycled)
+        {
+            ThreadCache& cache = getThreadCache();
+            std::scoped_lock<std::mutex> cacheLockGuard(cache.lock);
+            typename ThreadCache::Slot& slot = cache.slots[mSlotIndex];
+            if (slot.count == 0) {
+                // An empty slot might be taken over from another pool.
+                slot.pool = this;
+            }
+            if (slot.pool == this && slot.count < THREAD_CACHE_SIZE) {
+                INC_METRIC_IF_DEBUG(Recycled)
+                slot.objects[slot.count++] = o;
+                return;
+            }
+        }
+
+        if (!mFreeList.push(o)) {
+            drop(o, objectSize);
+            return;
+        }
 
-        mObjects.push_back(std::unique_ptr<T>{o});
-        mPoolObjectsSize += objectSize;
+        INC_METRIC_IF_DEBUG(Recycled)
     }
 
     const size_t mMaxPoolObjectsSize;
 
   private:
-    const Deleter<T>& getDeleter() {
-        if (!mDeleter.get()) {
-            Deleter<T>* d =
-                    new Deleter<T>(std::bind(&ObjectPool::recycle, this, std::placeholders::_1));
-            mDeleter.reset(d);
+    // The caches of one thread for all the pools of this type. A pool always uses the same slot,
+    // and only takes it over from another pool when it is empty.
+    //
+    // The lock is only contended when a pool is destroyed and evicts its objects from all the
+    // thread caches.
+    struct ThreadCache {
+        struct Slot {
+            ObjectPool* pool = nullptr;
+            size_t count = 0;
+            T* objects[THREAD_CACHE_SIZE];
+        };
+
+        std::mutex lock;
+        Slot slots[THREAD_CACHE_SLOTS] GUARDED_BY(lock);
+
+        ThreadCache() {
+            std::scoped_lock<std::mutex> registryLockGuard(sRegistryLock);
+            sRegistry.insert(this);
+        }
+
+        ~ThreadCache() {
+            // The pools still referenced by a slot are alive, since a pool clears its slots while
+            // holding the registry lock before it is destroyed.
+            std::scoped_lock<std::mutex> registryLockGuard(sRegistryLock);
+            sRegistry.erase(this);
+            std::scoped_lock<std::mutex> cacheLockGuard(lock);
+            for (Slot& slot : slots) {
+                for (size_t i = 0; i < slot.count; i++) {
+                    slot.pool->releaseToFreeList(slot.objects[i]);
+                }
+            }
+        }
+    };
+
+    static inline std::atomic<uint64_t> sNextId{0};
+    // All the thread caches for the pools of this type.
+    static inline std::mutex sRegistryLock;
+    static inline std::unordered_set<ThreadCache*> sRegistry GUARDED_BY(sRegistryLock);
+
+    ThreadCache& getThreadCache() {
+        thread_local ThreadCache threadCache;
+        return threadCache;
+    }
+
+    // Moves an object already counted in mPoolObjectsSize to the free list.
+    void releaseToFreeList(T* o) {
+        if (!mFreeList.push(o)) {
+            drop(o, mGetSizeFunc(*o));
         }
-        return *mDeleter.get();
     }
 
-    recyclable_ptr<T> wrap(T* raw) { return recyclable_ptr<T>{raw, getDeleter()}; }
+    // Deletes an object counted in mPoolObjectsSize.
+    void drop(T* o, size_t objectSize) {
+        INC_METRIC_IF_DEBUG(Deleted)
+        mPoolObjectsSize.fetch_sub(objectSize, std::memory_order_relaxed);
+        mDropped.fetch_add(1, std::memory_order_relaxed);
+        delete o;
+    }
+
+    recyclable_ptr<T> wrap(T* raw) { return recyclable_ptr<T>{raw, *mDeleter}; }
 
-    mutable std::mutex mLock;
-    std::deque<std::unique_ptr<T>> mObjects GUARDED_BY(mLock);
+    const size_t mSlotIndex;
+    LockFreeFreeList<T> mFreeList;
     std::unique_ptr<Deleter<T>> mDeleter;
-    size_t mPoolObjectsSize GUARDED_BY(mLock);
+    std::atomic<size_t> mPoolObjectsSize{0};
     GetSizeFunc mGetSizeFunc;
+    std::atomic<uint64_t> mThreadCacheHits{0};
+    std::atomic<uint64_t> mFreeListHits{0};
+    std::atomic<uint64_t> mMisses{0};
+    std::atomic<uint64_t> mDropped{0};
 };
 
 #undef INC_METRIC_IF_DEBUG
@@ -180,9 +436,7 @@ class VehiclePropValuePool {
     // @param maxPoolObjectsSize - The approximate upper bound of memory each internal recycling
     // pool could take. We have 4 different type pools, each with 4 different vector size, so
     // approximately this pool would at-most take 4 * 4 * 10240 = 160k memory.
-    VehiclePropValuePool(size_t maxRecyclableVectorSize = 4, size_t maxPoolObjectsSize = 10240)
-        : mMaxRecyclableVectorSize(maxRecyclableVectorSize),
-          mMaxPoolObjectsSize(maxPoolObjectsSize){};
+    VehiclePropValuePool(size_t maxRecyclableVectorSize = 4, size_t maxPoolObjectsSize = 10240);
 
     // Obtain a recyclable VehiclePropertyValue object from the pool for the given type. If the
     // given type is not MIXED or STRING, the internal value vector size would be set to 1.
@@ -215,6 +469,12 @@ class VehiclePropValuePool {
     // Obtain a recyclable mixed object.
     RecyclableType obtainComplex();
 
+    // Gets the hit and miss counters summed over all the internal pools.
+    ObjectPoolStats getStats() const;
+
+    // Dumps the hit and miss counters for debugging.
+    std::string dump() const;
+
     VehiclePropValuePool(VehiclePropValuePool&) = delete;
     VehiclePropValuePool& operator=(VehiclePropValuePool&) = delete;
 
@@ -245,21 +505,38 @@ class VehiclePropValuePool {
             aidl::android::hardware::automotive::vehicle::VehiclePropertyType type,
             size_t vectorSize);
 
+    // Gets the index of the recyclable type in mValueTypePools, or -1 if the type is not
+    // recyclable.
+    static int getRecyclableTypeIndex(
+            aidl::android::hardware::automotive::vehicle::VehiclePropertyType type);
+
     class InternalPool
         : public ObjectPool<aidl::android::hardware::automotive::vehicle::VehiclePropValue> {
       public:
         InternalPool(aidl::android::hardware::automotive::vehicle::VehiclePropertyType type,
                      size_t vectorSize, size_t maxPoolObjectsSize,
                      ObjectPool::GetSizeFunc getSizeFunc)
-            : ObjectPool(maxPoolObjectsSize, getSizeFunc),
+            : ObjectPool(maxPoolObjectsSize, getSizeFunc,
+                         getMaxPoolObjectsCount(type, vectorSize, maxPoolObjectsSize)),
               mPropType(type),
               mVectorSize(vectorSize) {}
 
+        aidl::android::hardware::automotive::vehicle::VehiclePropertyType getPropType() const {
+            return mPropType;
+        }
+
+        size_t getVectorSize() const { return mVectorSize; }
+
       protected:
         aidl::android::hardware::automotive::vehicle::VehiclePropValue* createObject() override;
         void recycle(aidl::android::hardware::automotive::vehicle::VehiclePropValue* o) override;
 
       private:
+        // Gets how many objects of this type and vector size fit into maxPoolObjectsSize.
+        static size_t getMaxPoolObjectsCount(
+                aidl::android::hardware::automotive::vehicle::VehiclePropertyType type,
+                size_t vectorSize, size_t maxPoolObjectsSize);
+
         bool check(aidl::android::hardware::automotive::vehicle::RawPropValues* v);
 
         template <typename VecType>
@@ -277,12 +554,13 @@ class VehiclePropValuePool {
                         delete v;
                     }};
 
-    mutable std::mutex mLock;
     const size_t mMaxRecyclableVectorSize;
     const size_t mMaxPoolObjectsSize;
-    // A map with 'property_type' | 'value_vector_size' as key and a recyclable object pool as
-    // value. We would create a recyclable pool for each property type and vector size combination.
-    std::map<int32_t, std::unique_ptr<InternalPool>> mValueTypePools GUARDED_BY(mLock);
+    // The recyclable object pools indexed by
+    // 'recyclable_type_index' * mMaxRecyclableVectorSize + 'value_vector_size' - 1. All the pools
+    // are created in the constructor, so they could be looked up without any lock. Pools for
+    // single value types only exist for vector size 1, the other entries are nullptr.
+    std::vector<std::unique_ptr<InternalPool>> mValueTypePools;
 };
 
 }  // namespace vehicle
@@ -21,6 +21,7 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 
 #include <VehicleHalTypes.h>
@@ -40,7 +41,14 @@ namespace vehicle {
 // VehiclePropertyValues stored in a sorted map thus it makes easier to get range of values, e.g.
 // to get value for all areas for particular property.
 //
-// This class is thread-safe, however it uses blocking synchronization across all methods.
+// This class is thread-safe. The set of registered properties is guarded by a reader-writer lock
+// that is only exclusively held while registering a property, and the values for each property are
+// guarded by a per-property reader-writer lock, so reads and writes of different properties never
+// contend with each other and concurrent reads of the same property proceed in parallel.
+//
+// OnValueChangeCallback is invoked while holding the lock for the updated property, so events for
+// one property are delivered in order, but events for different properties may be delivered
+// concurrently from different threads. The callback must not call back into the store.
 class VehiclePropertyStore final {
   public:
     using ValueResultType = VhalResult<VehiclePropValuePool::RecyclableType>;
@@ -157,27 +165,47 @@ class VehiclePropertyStore final {
         size_t operator()(RecordId const& recordId) const;
     };
 
+    // A scoped shared lock, std::shared_lock is not annotated for the thread safety analysis.
+    class SCOPED_CAPABILITY SharedLock final {
+      public:
+        explicit SharedLock(std::shared_mutex& lock) ACQUIRE_SHARED(lock) : mLock(lock) {
+            mLock.lock_shared();
+        }
+        ~SharedLock() RELEASE() { mLock.unlock_shared(); }
+
+      private:
+        std::shared_mutex& mLock;
+    };
+
     struct Record {
+        // 'propConfig' and 'tokenFunction' are only modified while holding mLock exclusively.
         aidl::android::hardware::automotive::vehicle::VehiclePropConfig propConfig;
         TokenFunction tokenFunction;
-        std::unordered_map<RecordId, VehiclePropValuePool::RecyclableType, RecordIdHash> values;
+        // Must be acquired after mLock.
+        mutable std::shared_mutex lock;
+        std::unordered_map<RecordId, VehiclePropValuePool::RecyclableType, RecordIdHash> values
+                GUARDED_BY(lock);
     };
 
     // {@code VehiclePropValuePool} is thread-safe.
     std::shared_ptr<VehiclePropValuePool> mValuePool;
-    mutable std::mutex mLock;
-    std::unordered_map<int32_t, Record> mRecordsByPropId GUARDED_BY(mLock);
+    // Guards the map structure of mRecordsByPropId and mOnValueChangeCallback. Only held
+    // exclusively while registering a property or setting the callback, all the value operations
+    // hold it shared. Records are heap-allocated so that their addresses are stable.
+    mutable std::shared_mutex mLock;
+    std::unordered_map<int32_t, std::unique_ptr<Record>> mRecordsByPropId GUARDED_BY(mLock);
     OnValueChangeCallback mOnValueChangeCallback GUARDED_BY(mLock);
 
-    const Record* getRecordLocked(int32_t propId) const;
+    const Record* getRecordLocked(int32_t propId) const REQUIRES_SHARED(mLock);
 
-    Record* getRecordLocked(int32_t propId);
+    Record* getRecordLocked(int32_t propId) REQUIRES_SHARED(mLock);
 
-    RecordId getRecordIdLocked(
+    RecordId getRecordId(
             const aidl::android::hardware::automotive::vehicle::VehiclePropValue& propValue,
             const Record& record) const;
 
-    ValueResultType readValueLocked(const RecordId& recId, const Record& record) const;
+    ValueResultType readValueLocked(const RecordId& recId, const Record& record) const
+            REQUIRES_SHARED(record.lock);
 };
 
 }  // namespace vehicle
@@ -20,7 +20,7 @@
 #include <utils/SystemClock.h>
 
 #include <inttypes.h>
-#include <math.h>
+#include <algorithm>
 
 namespace android {
 namespace hardware {
@@ -29,7 +29,7 @@ namespace vehicle {
 
 using ::android::base::ScopedLockAssertion;
 
-RecurrentTimer::RecurrentTimer() {
+RecurrentTimer::RecurrentTimer() : mLastProcessedTick(uptimeNanos() / TICK_IN_NANO) {
     mThread = std::thread(&RecurrentTimer::loop, this);
 }
 
@@ -49,73 +49,97 @@ void RecurrentTimer::registerTimerCallback(int64_t intervalInNano,
     {
         std::scoped_lock<std::mutex> lockGuard(mLock);
 
-        // Aligns the nextTime to multiply of interval.
-        int64_t nextTime = ceil(uptimeNanos() / intervalInNano) * intervalInNano;
+        // Aligns the nextTime to multiply of interval, so callbacks with the same interval run in
+        // the same tick.
+        int64_t nextTime = uptimeNanos() / intervalInNano * intervalInNano;
 
-        std::unique_ptr<CallbackInfo> info = std::make_unique<CallbackInfo>();
-        info->callback = callback;
-        info->interval = intervalInNano;
-        info->nextTime = nextTime;
-
-        auto it = mCallbacks.find(callback);
-        if (it != mCallbacks.end()) {
+        auto [it, inserted] = mCallbacks.try_emplace(callback);
+        CallbackInfo* info = &it->second;
+        if (!inserted) {
             ALOGI("Replacing an existing timer callback with a new interval, current: %" PRId64
                   " ns, new: %" PRId64 " ns",
-                  it->second->interval, intervalInNano);
-            markOutdatedLocked(it->second);
+                  info->interval, intervalInNano);
+            removeLocked(info);
         }
-        mCallbacks[callback] = info.get();
-        mCallbackQueue.push_back(std::move(info));
-        // Insert the last element into the heap.
-        std::push_heap(mCallbackQueue.begin(), mCallbackQueue.end(), CallbackInfo::cmp);
+        info->callback = callback;
+        info->interval = intervalInNano;
+        info->nextTime = nextTime;
+        insertLocked(info);
+        mScheduleVersion++;
     }
     mCond.notify_one();
 }
 
 void RecurrentTimer::unregisterTimerCallback(std::shared_ptr<RecurrentTimer::Callback> callback) {
-    {
-        std::scoped_lock<std::mutex> lockGuard(mLock);
-
-        auto it = mCallbacks.find(callback);
-        if (it == mCallbacks.end()) {
-            ALOGE("No event found to unregister");
-            return;
-        }
+    std::scoped_lock<std::mutex> lockGuard(mLock);
 
-        markOutdatedLocked(it->second);
-        mCallbacks.erase(it);
+    auto it = mCallbacks.find(callback);
+    if (it == mCallbacks.end()) {
+        ALOGE("No event found to unregister");
+        return;
     }
 
-    mCond.notify_one();
+    removeLocked(&it->second);
+    mCallbacks.erase(it);
 }
 
-void RecurrentTimer::markOutdatedLocked(RecurrentTimer::CallbackInfo* info) {
-    info->outdated = true;
-    info->callback = nullptr;
-    // Make sure the first element is always valid.
-    removeInvalidCallbackLocked();
+void RecurrentTimer::insertLocked(RecurrentTimer::CallbackInfo* info) {
+    // Rounds up so that a callback never runs before its scheduled time. A callback scheduled in
+    // an already processed tick runs in the next one.
+    int64_t tick = (info->nextTime + TICK_IN_NANO - 1) / TICK_IN_NANO;
+    info->nextTick = std::max(tick, mLastProcessedTick + 1);
+    size_t slot = info->nextTick & (WHEEL_SIZE - 1);
+    auto& slotList = mSlots[slot];
+    info->slotIt = slotList.insert(slotList.end(), info);
+    mNonEmptySlots[slot / 64] |= (uint64_t{1} << (slot % 64));
 }
 
-void RecurrentTimer::removeInvalidCallbackLocked() {
-    while (mCallbackQueue.size() != 0 && mCallbackQueue[0]->outdated) {
-        std::pop_heap(mCallbackQueue.begin(), mCallbackQueue.end(), CallbackInfo::cmp);
-        mCallbackQueue.pop_back();
+void RecurrentTimer::removeLocked(RecurrentTimer::CallbackInfo* info) {
+    size_t slot = info->nextTick & (WHEEL_SIZE - 1);
+    auto& slotList = mSlots[slot];
+    slotList.erase(info->slotIt);
+    if (slotList.empty()) {
+        mNonEmptySlots[slot / 64] &= ~(uint64_t{1} << (slot % 64));
     }
 }
 
-std::shared_ptr<RecurrentTimer::Callback> RecurrentTimer::getNextCallbackLocked(int64_t now) {
-    std::pop_heap(mCallbackQueue.begin(), mCallbackQueue.end(), CallbackInfo::cmp);
-    auto& callbackInfo = mCallbackQueue[mCallbackQueue.size() - 1];
-    auto nextCallback = callbackInfo->callback;
-    // intervalCount is the number of interval we have to advance until we pass now.
-    size_t intervalCount = (now - callbackInfo->nextTime) / callbackInfo->interval + 1;
-    callbackInfo->nextTime += intervalCount * callbackInfo->interval;
-    std::push_heap(mCallbackQueue.begin(), mCallbackQueue.end(), CallbackInfo::cmp);
+bool RecurrentTimer::isSlotEmptyLocked(size_t slot) {
+    return (mNonEmptySlots[slot / 64] & (uint64_t{1} << (slot % 64))) == 0;
+}
 
-    // Make sure the first element is always valid.
-    removeInvalidCallbackLocked();
+int64_t RecurrentTimer::ticksToNextNonEmptySlotLocked(int64_t fromTick) {
+    size_t i = 1;
+    while (i <= WHEEL_SIZE) {
+        size_t slot = (fromTick + i) & (WHEEL_SIZE - 1);
+        size_t bit = slot % 64;
+        uint64_t bits = mNonEmptySlots[slot / 64] >> bit;
+        if (bits != 0) {
+            return std::min(i + __builtin_ctzll(bits), WHEEL_SIZE);
+        }
+        i += 64 - bit;
+    }
+    return WHEEL_SIZE;
+}
 
-    return nextCallback;
+void RecurrentTimer::collectDueCallbacksLocked(
+        int64_t tick, int64_t now,
+        std::vector<std::shared_ptr<RecurrentTimer::Callback>>* callbacks) {
+    auto& slotList = mSlots[tick & (WHEEL_SIZE - 1)];
+    for (auto it = slotList.begin(); it != slotList.end();) {
+        CallbackInfo* info = *it;
+        // The callback might be re-inserted into the same slot, so move on before removing it.
+        it++;
+        if (info->nextTick > tick) {
+            // Due in a later revolution.
+            continue;
+        }
+        callbacks->push_back(info->callback);
+        // intervalCount is the number of interval we have to advance until we pass now.
+        int64_t intervalCount = (now - info->nextTime) / info->interval + 1;
+        info->nextTime += intervalCount * info->interval;
+        removeLocked(info);
+        insertLocked(info);
+    }
 }
 
 void RecurrentTimer::loop() {
@@ -127,41 +151,48 @@ void RecurrentTimer::loop() {
             // Wait until the timer exits or we have at least one recurrent callback.
             mCond.wait(uniqueLock, [this] {
                 ScopedLockAssertion lockAssertion(mLock);
-                return mStopRequested || mCallbackQueue.size() != 0;
+                return mStopRequested || !mCallbacks.empty();
             });
 
-            int64_t interval;
             if (mStopRequested) {
                 return;
             }
-            // The first element is the nearest next event.
-            int64_t nextTime = mCallbackQueue[0]->nextTime;
             int64_t now = uptimeNanos();
+            int64_t nextTick =
+                    mLastProcessedTick + ticksToNextNonEmptySlotLocked(mLastProcessedTick);
+            int64_t nextTime = nextTick * TICK_IN_NANO;
 
             if (nextTime > now) {
-                interval = nextTime - now;
-            } else {
-                interval = 0;
-            }
-
-            // Wait for the next event or the timer exits.
-            if (mCond.wait_for(uniqueLock, std::chrono::nanoseconds(interval), [this] {
-                    ScopedLockAssertion lockAssertion(mLock);
-                    return mStopRequested;
-                })) {
-                return;
+                uint64_t scheduleVersion = mScheduleVersion;
+                // Wait for the next non-empty slot, a newly registered callback or the timer
+                // exits.
+                mCond.wait_for(uniqueLock, std::chrono::nanoseconds(nextTime - now),
+                               [this, scheduleVersion] {
+                                   ScopedLockAssertion lockAssertion(mLock);
+                                   return mStopRequested || mScheduleVersion != scheduleVersion;
+                               });
+                if (mStopRequested) {
+                    return;
+                }
+                now = uptimeNanos();
+                if (now < nextTime) {
+                    // Woken up by a newly registered callback, recalculate the next tick.
+                    continue;
+                }
             }
 
-            now = uptimeNanos();
+            int64_t nowTick = now / TICK_IN_NANO;
             callbacksToRun.clear();
-            while (mCallbackQueue.size() > 0) {
-                int64_t nextTime = mCallbackQueue[0]->nextTime;
-                if (nextTime > now) {
-                    break;
+            // If we are more than one revolution behind, every slot only needs to be visited
+            // once.
+            int64_t firstTick = std::max(mLastProcessedTick + 1,
+                                         nowTick - static_cast<int64_t>(WHEEL_SIZE) + 1);
+            for (int64_t tick = firstTick; tick <= nowTick; tick++) {
+                if (!isSlotEmptyLocked(tick & (WHEEL_SIZE - 1))) {
+                    collectDueCallbacksLocked(tick, now, &callbacksToRun);
                 }
-
-                callbacksToRun.push_back(getNextCallbackLocked(now));
             }
+            mLastProcessedTick = nowTick;
         }
 
         // Do not execute the callback while holding the lock.
@@ -171,11 +202,6 @@ void RecurrentTimer::loop() {
     }
 }
 
-bool RecurrentTimer::CallbackInfo::cmp(const std::unique_ptr<RecurrentTimer::CallbackInfo>& lhs,
-                                       const std::unique_ptr<RecurrentTimer::CallbackInfo>& rhs) {
-    return lhs->nextTime > rhs->nextTime;
-}
-
 }  // namespace vehicle
 }  // namespace automotive
 }  // namespace hardware
@@ -20,9 +20,14 @@
 
 #include <VehicleUtils.h>
 
+#include <android-base/stringprintf.h>
 #include <assert.h>
 #include <utils/Log.h>
 
+#include <inttypes.h>
+#include <algorithm>
+#include <iterator>
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -32,6 +37,43 @@ using ::aidl::android::hardware::automotive::vehicle::RawPropValues;
 using ::aidl::android::hardware::automotive::vehicle::VehicleProperty;
 using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyType;
 using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
+using ::android::base::StringPrintf;
+
+namespace {
+
+// All the recyclable types, in the order of their recyclable type index.
+constexpr VehiclePropertyType RECYCLABLE_TYPES[] = {
+        VehiclePropertyType::BOOLEAN,   VehiclePropertyType::INT32,
+        VehiclePropertyType::INT64,     VehiclePropertyType::FLOAT,
+        VehiclePropertyType::INT32_VEC, VehiclePropertyType::INT64_VEC,
+        VehiclePropertyType::FLOAT_VEC, VehiclePropertyType::BYTES,
+};
+
+}  // namespace
+
+VehiclePropValuePool::VehiclePropValuePool(size_t maxRecyclableVectorSize,
+                                           size_t maxPoolObjectsSize)
+    : mMaxRecyclableVectorSize(maxRecyclableVectorSize), mMaxPoolObjectsSize(maxPoolObjectsSize) {
+    mValueTypePools.resize(std::size(RECYCLABLE_TYPES) * maxRecyclableVectorSize);
+    for (size_t typeIndex = 0; typeIndex < std::size(RECYCLABLE_TYPES); typeIndex++) {
+        VehiclePropertyType type = RECYCLABLE_TYPES[typeIndex];
+        size_t maxVectorSize = isSingleValueType(type) ? 1 : maxRecyclableVectorSize;
+        for (size_t vectorSize = 1; vectorSize <= maxVectorSize; vectorSize++) {
+            mValueTypePools[typeIndex * maxRecyclableVectorSize + vectorSize - 1] =
+                    std::make_unique<InternalPool>(type, vectorSize, maxPoolObjectsSize,
+                                                   getVehiclePropValueSize);
+        }
+    }
+}
+
+int VehiclePropValuePool::getRecyclableTypeIndex(VehiclePropertyType type) {
+    for (size_t i = 0; i < std::size(RECYCLABLE_TYPES); i++) {
+        if (RECYCLABLE_TYPES[i] == type) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
 
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtain(VehiclePropertyType type) {
     if (isComplexType(type)) {
@@ -103,19 +145,47 @@ VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainComplex() {
 
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainRecyclable(
         VehiclePropertyType type, size_t vectorSize) {
-    std::scoped_lock<std::mutex> lock(mLock);
     assert(vectorSize > 0);
 
-    // VehiclePropertyType is not overlapping with vectorSize.
-    int32_t key = static_cast<int32_t>(type) | static_cast<int32_t>(vectorSize);
-    auto it = mValueTypePools.find(key);
+    int typeIndex = getRecyclableTypeIndex(type);
+    if (typeIndex < 0) {
+        return obtainDisposable(type, vectorSize);
+    }
+    return mValueTypePools[typeIndex * mMaxRecyclableVectorSize + vectorSize - 1]->obtain();
+}
+
+ObjectPoolStats VehiclePropValuePool::getStats() const {
+    ObjectPoolStats stats;
+    for (const auto& pool : mValueTypePools) {
+        if (pool != nullptr) {
+            stats += pool->getStats();
+        }
+    }
+    return stats;
+}
 
-    if (it == mValueTypePools.end()) {
-        auto newPool(std::make_unique<InternalPool>(type, vectorSize, mMaxPoolObjectsSize,
-                                                    getVehiclePropValueSize));
-        it = mValueTypePools.emplace(key, std::move(newPool)).first;
+std::string VehiclePropValuePool::dump() const {
+    ObjectPoolStats total = getStats();
+    std::string msg = StringPrintf(
+            "VehiclePropValuePool: thread cache hits: %" PRIu64 ", free list hits: %" PRIu64
+            ", misses: %" PRIu64 ", dropped: %" PRIu64 "\n",
+            total.threadCacheHits, total.freeListHits, total.misses, total.dropped);
+    for (const auto& pool : mValueTypePools) {
+        if (pool == nullptr) {
+            continue;
+        }
+        ObjectPoolStats stats = pool->getStats();
+        if (stats.threadCacheHits + stats.freeListHits + stats.misses == 0) {
+            continue;
+        }
+        msg += StringPrintf("  type: %d, vector size: %zu, thread cache hits: %" PRIu64
+                            ", free list hits: %" PRIu64 ", misses: %" PRIu64
+                            ", dropped: %" PRIu64 "\n",
+                            toInt(pool->getPropType()), pool->getVectorSize(),
+                            stats.threadCacheHits, stats.freeListHits, stats.misses,
+                            stats.dropped);
     }
-    return it->second->obtain();
+    return msg;
 }
 
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainBoolean(bool value) {
@@ -157,6 +227,13 @@ bool VehiclePropValuePool::InternalPool::check(RawPropValues* v) {
            v->stringValue.size() == 0;
 }
 
+size_t VehiclePropValuePool::InternalPool::getMaxPoolObjectsCount(VehiclePropertyType type,
+                                                                  size_t vectorSize,
+                                                                  size_t maxPoolObjectsSize) {
+    size_t objectSize = getVehiclePropValueSize(*createVehiclePropValueVec(type, vectorSize));
+    return maxPoolObjectsSize / std::max(objectSize, static_cast<size_t>(1)) + 1;
+}
+
 VehiclePropValue* VehiclePropValuePool::InternalPool::createObject() {
     return createVehiclePropValueVec(mPropType, mVectorSize).release();
 }
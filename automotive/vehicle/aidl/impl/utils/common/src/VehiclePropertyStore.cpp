@@ -55,28 +55,25 @@ size_t VehiclePropertyStore::RecordIdHash::operator()(RecordId const& recordId)
 }
 
 VehiclePropertyStore::~VehiclePropertyStore() {
-    std::scoped_lock<std::mutex> lockGuard(mLock);
+    std::scoped_lock<std::shared_mutex> g(mLock);
 
     // Recycling record requires mValuePool, so need to recycle them before destroying mValuePool.
     mRecordsByPropId.clear();
     mValuePool.reset();
 }
 
-const VehiclePropertyStore::Record* VehiclePropertyStore::getRecordLocked(int32_t propId) const
-        REQUIRES(mLock) {
+const VehiclePropertyStore::Record* VehiclePropertyStore::getRecordLocked(int32_t propId) const {
     auto RecordIt = mRecordsByPropId.find(propId);
-    return RecordIt == mRecordsByPropId.end() ? nullptr : &RecordIt->second;
+    return RecordIt == mRecordsByPropId.end() ? nullptr : RecordIt->second.get();
 }
 
-VehiclePropertyStore::Record* VehiclePropertyStore::getRecordLocked(int32_t propId)
-        REQUIRES(mLock) {
+VehiclePropertyStore::Record* VehiclePropertyStore::getRecordLocked(int32_t propId) {
     auto RecordIt = mRecordsByPropId.find(propId);
-    return RecordIt == mRecordsByPropId.end() ? nullptr : &RecordIt->second;
+    return RecordIt == mRecordsByPropId.end() ? nullptr : RecordIt->second.get();
 }
 
-VehiclePropertyStore::RecordId VehiclePropertyStore::getRecordIdLocked(
-        const VehiclePropValue& propValue, const VehiclePropertyStore::Record& record) const
-        REQUIRES(mLock) {
+VehiclePropertyStore::RecordId VehiclePropertyStore::getRecordId(
+        const VehiclePropValue& propValue, const VehiclePropertyStore::Record& record) const {
     VehiclePropertyStore::RecordId recId{
             .area = isGlobalProp(propValue.prop) ? 0 : propValue.areaId, .token = 0};
 
@@ -87,7 +84,7 @@ VehiclePropertyStore::RecordId VehiclePropertyStore::getRecordIdLocked(
 }
 
 VhalResult<VehiclePropValuePool::RecyclableType> VehiclePropertyStore::readValueLocked(
-        const RecordId& recId, const Record& record) const REQUIRES(mLock) {
+        const RecordId& recId, const Record& record) const {
     if (auto it = record.values.find(recId); it != record.values.end()) {
         return mValuePool->obtain(*(it->second));
     }
@@ -97,18 +94,26 @@ VhalResult<VehiclePropValuePool::RecyclableType> VehiclePropertyStore::readValue
 
 void VehiclePropertyStore::registerProperty(const VehiclePropConfig& config,
                                             VehiclePropertyStore::TokenFunction tokenFunc) {
-    std::scoped_lock<std::mutex> g(mLock);
-
-    mRecordsByPropId[config.prop] = Record{
-            .propConfig = config,
-            .tokenFunction = tokenFunc,
-    };
+    std::scoped_lock<std::shared_mutex> g(mLock);
+
+    if (Record* record = getRecordLocked(config.prop); record != nullptr) {
+        // Update the existing record in place so that pointers returned by getConfig stay valid.
+        std::scoped_lock<std::shared_mutex> recordGuard(record->lock);
+        record->propConfig = config;
+        record->tokenFunction = tokenFunc;
+        record->values.clear();
+        return;
+    }
+    auto record = std::make_unique<Record>();
+    record->propConfig = config;
+    record->tokenFunction = tokenFunc;
+    mRecordsByPropId[config.prop] = std::move(record);
 }
 
 VhalResult<void> VehiclePropertyStore::writeValue(VehiclePropValuePool::RecyclableType propValue,
                                                   bool updateStatus,
                                                   VehiclePropertyStore::EventMode eventMode) {
-    std::scoped_lock<std::mutex> g(mLock);
+    SharedLock g(mLock);
 
     int32_t propId = propValue->prop;
 
@@ -122,9 +127,13 @@ VhalResult<void> VehiclePropertyStore::writeValue(VehiclePropValuePool::Recyclab
                << "no config for property: " << propId << " area: " << propValue->areaId;
     }
 
-    VehiclePropertyStore::RecordId recId = getRecordIdLocked(*propValue, *record);
+    VehiclePropertyStore::RecordId recId = getRecordId(*propValue, *record);
+
+    std::scoped_lock<std::shared_mutex> recordGuard(record->lock);
+
     bool valueUpdated = true;
-    if (auto it = record->values.find(recId); it != record->values.end()) {
+    auto it = record->values.find(recId);
+    if (it != record->values.end()) {
         const VehiclePropValue* valueToUpdate = it->second.get();
         int64_t oldTimestamp = valueToUpdate->timestamp;
         VehiclePropertyStatus oldStatus = valueToUpdate->status;
@@ -141,54 +150,60 @@ VhalResult<void> VehiclePropertyStore::writeValue(VehiclePropValuePool::Recyclab
                         valueToUpdate->status != propValue->status ||
                         valueToUpdate->prop != propValue->prop ||
                         valueToUpdate->areaId != propValue->areaId);
-    } else if (!updateStatus) {
-        propValue->status = VehiclePropertyStatus::AVAILABLE;
+        it->second = std::move(propValue);
+    } else {
+        if (!updateStatus) {
+            propValue->status = VehiclePropertyStatus::AVAILABLE;
+        }
+        it = record->values.emplace(recId, std::move(propValue)).first;
     }
 
-    record->values[recId] = std::move(propValue);
-
     if (eventMode == EventMode::NEVER) {
         return {};
     }
 
     if ((eventMode == EventMode::ALWAYS || valueUpdated) && mOnValueChangeCallback != nullptr) {
-        mOnValueChangeCallback(*(record->values[recId]));
+        mOnValueChangeCallback(*(it->second));
     }
     return {};
 }
 
 void VehiclePropertyStore::removeValue(const VehiclePropValue& propValue) {
-    std::scoped_lock<std::mutex> g(mLock);
+    SharedLock g(mLock);
 
     VehiclePropertyStore::Record* record = getRecordLocked(propValue.prop);
     if (record == nullptr) {
         return;
     }
 
-    VehiclePropertyStore::RecordId recId = getRecordIdLocked(propValue, *record);
+    VehiclePropertyStore::RecordId recId = getRecordId(propValue, *record);
+
+    std::scoped_lock<std::shared_mutex> recordGuard(record->lock);
     if (auto it = record->values.find(recId); it != record->values.end()) {
         record->values.erase(it);
     }
 }
 
 void VehiclePropertyStore::removeValuesForProperty(int32_t propId) {
-    std::scoped_lock<std::mutex> g(mLock);
+    SharedLock g(mLock);
 
     VehiclePropertyStore::Record* record = getRecordLocked(propId);
     if (record == nullptr) {
         return;
     }
 
+    std::scoped_lock<std::shared_mutex> recordGuard(record->lock);
     record->values.clear();
 }
 
 std::vector<VehiclePropValuePool::RecyclableType> VehiclePropertyStore::readAllValues() const {
-    std::scoped_lock<std::mutex> g(mLock);
+    SharedLock g(mLock);
 
     std::vector<VehiclePropValuePool::RecyclableType> allValues;
 
     for (auto const& [_, record] : mRecordsByPropId) {
-        for (auto const& [_, value] : record.values) {
+        SharedLock recordGuard(record->lock);
+        for (auto const& [_, value] : record->values) {
             allValues.push_back(std::move(mValuePool->obtain(*value)));
         }
     }
@@ -198,7 +213,7 @@ std::vector<VehiclePropValuePool::RecyclableType> VehiclePropertyStore::readAllV
 
 VehiclePropertyStore::ValuesResultType VehiclePropertyStore::readValuesForProperty(
         int32_t propId) const {
-    std::scoped_lock<std::mutex> g(mLock);
+    SharedLock g(mLock);
 
     std::vector<VehiclePropValuePool::RecyclableType> values;
 
@@ -207,6 +222,7 @@ VehiclePropertyStore::ValuesResultType VehiclePropertyStore::readValuesForProper
         return StatusError(StatusCode::INVALID_ARG) << "property: " << propId << " not registered";
     }
 
+    SharedLock recordGuard(record->lock);
     for (auto const& [_, value] : record->values) {
         values.push_back(std::move(mValuePool->obtain(*value)));
     }
@@ -215,7 +231,7 @@ VehiclePropertyStore::ValuesResultType VehiclePropertyStore::readValuesForProper
 
 VehiclePropertyStore::ValueResultType VehiclePropertyStore::readValue(
         const VehiclePropValue& propValue) const {
-    std::scoped_lock<std::mutex> g(mLock);
+    SharedLock g(mLock);
 
     int32_t propId = propValue.prop;
     const VehiclePropertyStore::Record* record = getRecordLocked(propId);
@@ -223,14 +239,16 @@ VehiclePropertyStore::ValueResultType VehiclePropertyStore::readValue(
         return StatusError(StatusCode::INVALID_ARG) << "property: " << propId << " not registered";
     }
 
-    VehiclePropertyStore::RecordId recId = getRecordIdLocked(propValue, *record);
+    VehiclePropertyStore::RecordId recId = getRecordId(propValue, *record);
+
+    SharedLock recordGuard(record->lock);
     return readValueLocked(recId, *record);
 }
 
 VehiclePropertyStore::ValueResultType VehiclePropertyStore::readValue(int32_t propId,
                                                                       int32_t areaId,
                                                                       int64_t token) const {
-    std::scoped_lock<std::mutex> g(mLock);
+    SharedLock g(mLock);
 
     const VehiclePropertyStore::Record* record = getRecordLocked(propId);
     if (record == nullptr) {
@@ -238,22 +256,24 @@ VehiclePropertyStore::ValueResultType VehiclePropertyStore::readValue(int32_t pr
     }
 
     VehiclePropertyStore::RecordId recId{.area = isGlobalProp(propId) ? 0 : areaId, .token = token};
+
+    SharedLock recordGuard(record->lock);
     return readValueLocked(recId, *record);
 }
 
 std::vector<VehiclePropConfig> VehiclePropertyStore::getAllConfigs() const {
-    std::scoped_lock<std::mutex> g(mLock);
+    SharedLock g(mLock);
 
     std::vector<VehiclePropConfig> configs;
     configs.reserve(mRecordsByPropId.size());
-    for (auto& [_, config] : mRecordsByPropId) {
-        configs.push_back(config.propConfig);
+    for (auto& [_, record] : mRecordsByPropId) {
+        configs.push_back(record->propConfig);
     }
     return configs;
 }
 
 VhalResult<const VehiclePropConfig*> VehiclePropertyStore::getConfig(int32_t propId) const {
-    std::scoped_lock<std::mutex> g(mLock);
+    SharedLock g(mLock);
 
     const VehiclePropertyStore::Record* record = getRecordLocked(propId);
     if (record == nullptr) {
@@ -265,7 +285,7 @@ VhalResult<const VehiclePropConfig*> VehiclePropertyStore::getConfig(int32_t pro
 
 void VehiclePropertyStore::setOnValueChangeCallback(
         const VehiclePropertyStore::OnValueChangeCallback& callback) {
-    std::scoped_lock<std::mutex> g(mLock);
+    std::scoped_lock<std::shared_mutex> g(mLock);
 
     mOnValueChangeCallback = callback;
 }
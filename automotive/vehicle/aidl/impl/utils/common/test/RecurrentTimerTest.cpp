@@ -50,7 +50,11 @@ class RecurrentTimerTest : public testing::Test {
 
     size_t countTimerCallbackQueue(RecurrentTimer* timer) {
         std::scoped_lock<std::mutex> lockGuard(timer->mLock);
-        return timer->mCallbackQueue.size();
+        size_t count = 0;
+        for (const auto& slot : timer->mSlots) {
+            count += slot.size();
+        }
+        return count;
     }
 
   private:
@@ -186,6 +190,43 @@ TEST_F(RecurrentTimerTest, testRegisterSameCallbackMultipleTimes) {
     ASSERT_EQ(countTimerCallbackQueue(&timer), static_cast<size_t>(0));
 }
 
+TEST_F(RecurrentTimerTest, testRegisterCallbackLongerThanOneRevolution) {
+    RecurrentTimer timer;
+    // 2s, longer than one revolution of the timing wheel.
+    int64_t interval = 2'000'000'000;
+
+    auto action = getCallback(0);
+    timer.registerTimerCallback(interval, action);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+
+    timer.unregisterTimerCallback(action);
+
+    // Triggers once immediately and at most once more within the interval, must not trigger
+    // on every revolution.
+    ASSERT_GE(getCalledCallbacks().size(), static_cast<size_t>(1));
+    ASSERT_LE(getCalledCallbacks().size(), static_cast<size_t>(2));
+}
+
+TEST_F(RecurrentTimerTest, testUnregisterManyCallbacks) {
+    RecurrentTimer timer;
+    std::vector<std::shared_ptr<RecurrentTimer::Callback>> actions;
+    for (size_t i = 0; i < 2000; i++) {
+        auto action = getCallback(i);
+        // Intervals from 10ms to ~2s so that the callbacks spread over the whole wheel.
+        timer.registerTimerCallback(10'000'000 + i * 1'000'000, action);
+        actions.push_back(action);
+    }
+
+    ASSERT_EQ(countTimerCallbackQueue(&timer), static_cast<size_t>(2000));
+
+    for (const auto& action : actions) {
+        timer.unregisterTimerCallback(action);
+    }
+
+    ASSERT_EQ(countTimerCallbackQueue(&timer), static_cast<size_t>(0));
+}
+
 TEST_F(RecurrentTimerTest, testRegisterCallbackMultipleTimesNoDeadLock) {
     // We want to avoid the following situation:
     // Caller holds a lock while calling registerTimerCallback, registerTimerCallback will try
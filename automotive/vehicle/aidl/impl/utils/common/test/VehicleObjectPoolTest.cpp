@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 
 #include <gtest/gtest.h>
@@ -361,6 +363,103 @@ TEST_F(VehicleObjectPoolTest, testMultithreaded) {
     ASSERT_LE(mStats->Created, static_cast<uint32_t>(T * O));
 }
 
+TEST_F(VehicleObjectPoolTest, testStats) {
+    auto value = mValuePool->obtain(VehiclePropertyType::INT32);
+    value.reset();
+    value = mValuePool->obtain(VehiclePropertyType::INT32);
+    value.reset();
+
+    ObjectPoolStats stats = mValuePool->getStats();
+    ASSERT_EQ(stats.misses, 1u);
+    ASSERT_EQ(stats.threadCacheHits, 1u);
+    ASSERT_EQ(stats.freeListHits, 0u);
+    ASSERT_EQ(stats.dropped, 0u);
+    ASSERT_NE(mValuePool->dump().find("misses: 1"), std::string::npos);
+}
+
+TEST_F(VehicleObjectPoolTest, testRecycleInAnotherThread) {
+    auto value = mValuePool->obtain(VehiclePropertyType::INT32);
+    void* raw = value.get();
+    void* rawObtainedInThread = nullptr;
+
+    std::thread t([&value, &rawObtainedInThread, this] {
+        // Recycled into this thread's cache.
+        value.reset();
+        auto newValue = mValuePool->obtain(VehiclePropertyType::INT32);
+        rawObtainedInThread = newValue.get();
+    });
+    t.join();
+
+    ASSERT_EQ(rawObtainedInThread, raw);
+}
+
+TEST_F(VehicleObjectPoolTest, testFreeListSharedBetweenThreads) {
+    size_t count = ObjectPool<VehiclePropValue>::THREAD_CACHE_SIZE + 1;
+    std::thread t([count, this] {
+        std::vector<recyclable_ptr<VehiclePropValue>> values;
+        for (size_t i = 0; i < count; i++) {
+            values.push_back(mValuePool->obtain(VehiclePropertyType::INT32));
+        }
+        // The thread cache is full after this, the last value goes to the global free list.
+    });
+    t.join();
+
+    auto value = mValuePool->obtain(VehiclePropertyType::INT32);
+
+    ObjectPoolStats stats = mValuePool->getStats();
+    ASSERT_EQ(stats.freeListHits, 1u);
+    ASSERT_EQ(stats.misses, count);
+}
+
+TEST_F(VehicleObjectPoolTest, testThreadCacheCountsInMemoryLimitation) {
+    auto value = mValuePool->obtain(VehiclePropertyType::INT32);
+    // Only one value fits into the pool.
+    VehiclePropValuePool valuePool(/*maxRecyclableVectorSize=*/4,
+                                   /*maxPoolObjectsSize=*/getVehiclePropValueSize(*value));
+    auto value1 = valuePool.obtain(VehiclePropertyType::INT32);
+    auto value2 = valuePool.obtain(VehiclePropertyType::INT32);
+
+    value1.reset();
+    value2.reset();
+
+    ObjectPoolStats stats = valuePool.getStats();
+    ASSERT_EQ(stats.dropped, 1u);
+}
+
+TEST_F(VehicleObjectPoolTest, testDestroyPoolWithCachedObjectsInAnotherThread) {
+    auto valuePool = std::make_unique<VehiclePropValuePool>();
+    std::mutex lock;
+    std::condition_variable cond;
+    bool cached = false;
+    bool destroyed = false;
+
+    std::thread t([&] {
+        // Recycled into this thread's cache.
+        valuePool->obtain(VehiclePropertyType::INT32).reset();
+        std::unique_lock<std::mutex> uniqueLock(lock);
+        cached = true;
+        cond.notify_all();
+        cond.wait(uniqueLock, [&destroyed] { return destroyed; });
+        // The thread cache must not hand out the objects of the destroyed pool.
+        VehiclePropValuePool newValuePool;
+        auto value = newValuePool.obtain(VehiclePropertyType::INT32);
+        ASSERT_EQ(newValuePool.getStats().misses, 1u);
+    });
+
+    {
+        std::unique_lock<std::mutex> uniqueLock(lock);
+        cond.wait(uniqueLock, [&cached] { return cached; });
+    }
+    // Evicts the cached object from the other thread.
+    valuePool.reset();
+    {
+        std::scoped_lock<std::mutex> lockGuard(lock);
+        destroyed = true;
+    }
+    cond.notify_all();
+    t.join();
+}
+
 TEST_F(VehicleObjectPoolTest, testMemoryLimitation) {
     std::vector<recyclable_ptr<VehiclePropValue>> vec;
     for (size_t i = 0; i < 10000; i++) {
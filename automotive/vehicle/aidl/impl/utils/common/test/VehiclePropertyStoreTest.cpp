@@ -21,6 +21,9 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <thread>
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -509,6 +512,67 @@ TEST_F(VehiclePropertyStoreTest, testPropertyChangeCallbackForceNoUpdate) {
     ASSERT_EQ(updatedValue.prop, INVALID_PROP_ID);
 }
 
+TEST_F(VehiclePropertyStoreTest, testRegisterPropertyKeepsConfigPointer) {
+    VhalResult<const VehiclePropConfig*> result =
+            mStore->getConfig(toInt(VehicleProperty::INFO_FUEL_CAPACITY));
+    ASSERT_RESULT_OK(result);
+    const VehiclePropConfig* configPtr = result.value();
+
+    VehiclePropConfig newConfig = mConfigFuelCapacity;
+    newConfig.configString = "new config";
+    mStore->registerProperty(newConfig);
+
+    ASSERT_EQ(*configPtr, newConfig);
+}
+
+TEST_F(VehiclePropertyStoreTest, testConcurrentReadWriteDifferentProperties) {
+    constexpr int32_t kPropCount = 8;
+    constexpr int32_t kWritesPerProp = 1000;
+    std::atomic<int32_t> callbackCount = 0;
+    for (int32_t i = 0; i < kPropCount; i++) {
+        mStore->registerProperty(VehiclePropConfig{
+                // VehiclePropertyGroup:VENDOR,VehicleArea:GLOBAL,VehiclePropertyType:INT32
+                .prop = 0x21400000 + i,
+        });
+    }
+    mStore->setOnValueChangeCallback(
+            [&callbackCount](const VehiclePropValue&) { callbackCount++; });
+
+    std::vector<std::thread> threads;
+    for (int32_t i = 0; i < kPropCount; i++) {
+        int32_t propId = 0x21400000 + i;
+        threads.emplace_back([this, propId] {
+            for (int32_t j = 0; j < kWritesPerProp; j++) {
+                VehiclePropValue value = {
+                        .timestamp = j,
+                        .prop = propId,
+                        .value.int32Values = {j},
+                };
+                ASSERT_RESULT_OK(mStore->writeValue(mValuePool->obtain(value)));
+            }
+        });
+        threads.emplace_back([this, propId] {
+            for (int32_t j = 0; j < kWritesPerProp; j++) {
+                // The value might not be written yet, only checks that it is never torn.
+                if (auto result = mStore->readValue(propId); result.ok()) {
+                    ASSERT_EQ(result.value()->prop, propId);
+                    ASSERT_EQ(result.value()->value.int32Values.size(), static_cast<size_t>(1));
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(callbackCount, kPropCount * kWritesPerProp);
+    for (int32_t i = 0; i < kPropCount; i++) {
+        auto result = mStore->readValue(0x21400000 + i);
+        ASSERT_RESULT_OK(result);
+        ASSERT_EQ(result.value()->value.int32Values, std::vector<int32_t>({kWritesPerProp - 1}));
+    }
+}
+
 }  // namespace vehicle
 }  // namespace automotive
 }  // namespace hardware
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DefaultVehicleHal.h"
+
+#include <IVehicleHardware.h>
+#include <VehicleHalTypes.h>
+#include <VehicleUtils.h>
+
+#include <aidl/android/hardware/automotive/vehicle/BnVehicleCallback.h>
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+using ::aidl::android::hardware::automotive::vehicle::BnVehicleCallback;
+using ::aidl::android::hardware::automotive::vehicle::GetValueRequest;
+using ::aidl::android::hardware::automotive::vehicle::GetValueRequests;
+using ::aidl::android::hardware::automotive::vehicle::GetValueResult;
+using ::aidl::android::hardware::automotive::vehicle::GetValueResults;
+using ::aidl::android::hardware::automotive::vehicle::IVehicle;
+using ::aidl::android::hardware::automotive::vehicle::IVehicleCallback;
+using ::aidl::android::hardware::automotive::vehicle::SetValueRequest;
+using ::aidl::android::hardware::automotive::vehicle::SetValueRequests;
+using ::aidl::android::hardware::automotive::vehicle::SetValueResult;
+using ::aidl::android::hardware::automotive::vehicle::SetValueResults;
+using ::aidl::android::hardware::automotive::vehicle::StatusCode;
+using ::aidl::android::hardware::automotive::vehicle::VehicleArea;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropConfig;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropErrors;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyAccess;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyChangeMode;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyGroup;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyType;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropValues;
+using ::ndk::ScopedAStatus;
+using ::ndk::SpAIBinder;
+
+namespace {
+
+// The number of properties supported by the hardware, about the size of a real vehicle.
+constexpr int32_t PROPERTY_COUNT = 1000;
+
+int32_t testProp(int32_t i) {
+    return i | toInt(VehiclePropertyGroup::VENDOR) | toInt(VehicleArea::GLOBAL) |
+           toInt(VehiclePropertyType::INT32);
+}
+
+// A hardware that finishes every request immediately, so that the benchmark only measures the
+// validation and bookkeeping done by DefaultVehicleHal.
+class ImmediateVehicleHardware final : public IVehicleHardware {
+  public:
+    std::vector<VehiclePropConfig> getAllPropertyConfigs() const override {
+        std::vector<VehiclePropConfig> configs;
+        for (int32_t i = 0; i < PROPERTY_COUNT; i++) {
+            configs.push_back({
+                    .prop = testProp(i),
+                    .access = VehiclePropertyAccess::READ_WRITE,
+                    .changeMode = VehiclePropertyChangeMode::ON_CHANGE,
+                    .areaConfigs = {{.areaId = 0, .minInt32Value = 0, .maxInt32Value = 100}},
+            });
+        }
+        return configs;
+    }
+
+    StatusCode setValues(std::shared_ptr<const SetValuesCallback> callback,
+                         const std::vector<SetValueRequest>& requests) override {
+        std::vector<SetValueResult> results;
+        results.reserve(requests.size());
+        for (const auto& request : requests) {
+            results.push_back({.requestId = request.requestId, .status = StatusCode::OK});
+        }
+        (*callback)(std::move(results));
+        return StatusCode::OK;
+    }
+
+    StatusCode getValues(std::shared_ptr<const GetValuesCallback> callback,
+                         const std::vector<GetValueRequest>& requests) const override {
+        std::vector<GetValueResult> results;
+        results.reserve(requests.size());
+        for (const auto& request : requests) {
+            results.push_back({
+                    .requestId = request.requestId,
+                    .status = StatusCode::OK,
+                    .prop = request.prop,
+            });
+        }
+        (*callback)(std::move(results));
+        return StatusCode::OK;
+    }
+
+    DumpResult dump(const std::vector<std::string>&) override { return {}; }
+
+    StatusCode checkHealth() override { return StatusCode::OK; }
+
+    void registerOnPropertyChangeEvent(std::unique_ptr<const PropertyChangeCallback>) override {}
+
+    void registerOnPropertySetErrorEvent(
+            std::unique_ptr<const PropertySetErrorCallback>) override {}
+};
+
+class NoOpVehicleCallback final : public BnVehicleCallback {
+  public:
+    ScopedAStatus onGetValues(const GetValueResults&) override { return ScopedAStatus::ok(); }
+    ScopedAStatus onSetValues(const SetValueResults&) override { return ScopedAStatus::ok(); }
+    ScopedAStatus onPropertySetError(const VehiclePropErrors&) override {
+        return ScopedAStatus::ok();
+    }
+    ScopedAStatus onPropertyEvent(const VehiclePropValues&, int32_t) override {
+        return ScopedAStatus::ok();
+    }
+};
+
+}  // namespace
+
+class DefaultVehicleHalBenchmark : public benchmark::Fixture {
+  public:
+    void SetUp(const benchmark::State&) override {
+        mVhal = ndk::SharedRefBase::make<DefaultVehicleHal>(
+                std::make_unique<ImmediateVehicleHardware>());
+        // The callback is a local binder, which could not be linked to death.
+        mVhal->setBinderLifecycleHandler(std::make_unique<AlwaysAliveBinderLifecycleHandler>());
+        mCallback = ndk::SharedRefBase::make<NoOpVehicleCallback>();
+        // Keep the local binder alive.
+        mBinder = mCallback->asBinder();
+        mCallbackClient = IVehicleCallback::fromBinder(mBinder);
+    }
+
+    void TearDown(const benchmark::State&) override {
+        mCallbackClient.reset();
+        mBinder = SpAIBinder();
+        mCallback.reset();
+        mVhal.reset();
+    }
+
+  protected:
+    std::shared_ptr<IVehicle> getClient() { return mVhal; }
+
+    std::shared_ptr<IVehicleCallback> getCallbackClient() { return mCallbackClient; }
+
+    static GetValueRequests getValueRequests(size_t count) {
+        GetValueRequests requests;
+        for (size_t i = 0; i < count; i++) {
+            requests.payloads.push_back({
+                    .requestId = static_cast<int64_t>(i),
+                    .prop = {.prop = testProp(static_cast<int32_t>(i % PROPERTY_COUNT))},
+            });
+        }
+        return requests;
+    }
+
+    static SetValueRequests setValueRequests(size_t count) {
+        SetValueRequests requests;
+        for (size_t i = 0; i < count; i++) {
+            requests.payloads.push_back({
+                    .requestId = static_cast<int64_t>(i),
+                    .value =
+                            {
+                                    .prop = testProp(static_cast<int32_t>(i % PROPERTY_COUNT)),
+                                    .value.int32Values = {1},
+                            },
+            });
+        }
+        return requests;
+    }
+
+  private:
+    class AlwaysAliveBinderLifecycleHandler final
+        : public DefaultVehicleHal::BinderLifecycleInterface {
+      public:
+        binder_status_t linkToDeath(AIBinder*, AIBinder_DeathRecipient*, void*) override {
+            return STATUS_OK;
+        }
+
+        bool isAlive(const AIBinder*) override { return true; }
+    };
+
+    std::shared_ptr<DefaultVehicleHal> mVhal;
+    std::shared_ptr<NoOpVehicleCallback> mCallback;
+    std::shared_ptr<IVehicleCallback> mCallbackClient;
+    SpAIBinder mBinder;
+};
+
+// Measures a getValues call end to end: request validation, pending request bookkeeping and
+// delivering the results to the callback.
+BENCHMARK_DEFINE_F(DefaultVehicleHalBenchmark, BM_getValues)(benchmark::State& state) {
+    GetValueRequests requests = getValueRequests(state.range(0));
+    auto client = getClient();
+    auto callback = getCallbackClient();
+
+    for (auto _ : state) {
+        if (!client->getValues(callback, requests).isOk()) {
+            state.SkipWithError("getValues failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(DefaultVehicleHalBenchmark, BM_getValues)->Arg(1)->Arg(100)->Arg(1000);
+
+// Measures a setValues call end to end, which additionally checks the value against the area
+// config.
+BENCHMARK_DEFINE_F(DefaultVehicleHalBenchmark, BM_setValues)(benchmark::State& state) {
+    SetValueRequests requests = setValueRequests(state.range(0));
+    auto client = getClient();
+    auto callback = getCallbackClient();
+
+    for (auto _ : state) {
+        if (!client->setValues(callback, requests).isOk()) {
+            state.SkipWithError("setValues failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(DefaultVehicleHalBenchmark, BM_setValues)->Arg(1)->Arg(100)->Arg(1000);
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConnectedClient.h"
+
+#include <aidl/android/hardware/automotive/vehicle/BnVehicleCallback.h>
+#include <aidl/android/hardware/automotive/vehicle/IVehicle.h>
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+#include <android/binder_stability.h>
+#include <benchmark/benchmark.h>
+#include <utils/Log.h>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::vehicle::BnVehicleCallback;
+using ::aidl::android::hardware::automotive::vehicle::GetValueResults;
+using ::aidl::android::hardware::automotive::vehicle::IVehicle;
+using ::aidl::android::hardware::automotive::vehicle::IVehicleCallback;
+using ::aidl::android::hardware::automotive::vehicle::SetValueResults;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropErrors;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropValues;
+using ::ndk::ScopedAStatus;
+using ::ndk::SpAIBinder;
+
+constexpr char CALLBACK_SERVICE_NAME[] = "DefaultVehicleHalBenchmark.callback";
+
+// The callback served by the child process, it drops every event it receives.
+class NoOpVehicleCallback final : public BnVehicleCallback {
+  public:
+    ScopedAStatus onGetValues(const GetValueResults&) override { return ScopedAStatus::ok(); }
+    ScopedAStatus onSetValues(const SetValueResults&) override { return ScopedAStatus::ok(); }
+    ScopedAStatus onPropertySetError(const VehiclePropErrors&) override {
+        return ScopedAStatus::ok();
+    }
+    ScopedAStatus onPropertyEvent(const VehiclePropValues&, int32_t) override {
+        return ScopedAStatus::ok();
+    }
+};
+
+// A local callback that forwards the events to the remote callback in the child process, so that
+// the values are written into a parcel and go through binder. It then returns the shared memory
+// file the same way a well behaved client does at the end of onPropertyEvent.
+class ForwardingVehicleCallback final : public BnVehicleCallback {
+  public:
+    explicit ForwardingVehicleCallback(std::shared_ptr<IVehicleCallback> remote)
+        : mRemote(std::move(remote)) {}
+
+    ScopedAStatus onGetValues(const GetValueResults&) override { return ScopedAStatus::ok(); }
+    ScopedAStatus onSetValues(const SetValueResults&) override { return ScopedAStatus::ok(); }
+    ScopedAStatus onPropertySetError(const VehiclePropErrors&) override {
+        return ScopedAStatus::ok();
+    }
+    ScopedAStatus onPropertyEvent(const VehiclePropValues& values,
+                                  int32_t sharedMemoryFileCount) override {
+        ScopedAStatus status = mRemote->onPropertyEvent(values, sharedMemoryFileCount);
+        if (values.sharedMemoryId != IVehicle::INVALID_MEMORY_ID && mClient != nullptr) {
+            (void)mClient->returnSharedMemory(values.sharedMemoryId);
+        }
+        return status;
+    }
+
+    void setClient(SubscriptionClient* client) { mClient = client; }
+
+  private:
+    std::shared_ptr<IVehicleCallback> mRemote;
+    SubscriptionClient* mClient = nullptr;
+};
+
+// The proxy of the callback served by the child process.
+std::shared_ptr<IVehicleCallback> gRemoteCallback;
+
+int runCallbackService() {
+    auto callback = ndk::SharedRefBase::make<NoOpVehicleCallback>();
+    SpAIBinder binder = callback->asBinder();
+    // The benchmark callback is not declared in the VINTF manifest.
+    AIBinder_forceDowngradeToLocalStability(binder.get());
+    if (AServiceManager_addService(binder.get(), CALLBACK_SERVICE_NAME) != STATUS_OK) {
+        ALOGE("failed to register the benchmark callback service");
+        return 1;
+    }
+    ABinderProcess_setThreadPoolMaxThreadCount(1);
+    ABinderProcess_joinThreadPool();
+    return 1;
+}
+
+std::shared_ptr<IVehicleCallback> waitForRemoteCallback() {
+    for (int i = 0; i < 100; i++) {
+        SpAIBinder binder(AServiceManager_checkService(CALLBACK_SERVICE_NAME));
+        if (binder.get() != nullptr) {
+            return IVehicleCallback::fromBinder(binder);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return nullptr;
+}
+
+std::vector<VehiclePropValue> getUpdatedValues(size_t count) {
+    std::vector<VehiclePropValue> values;
+    for (size_t i = 0; i < count; i++) {
+        values.push_back({
+                .prop = static_cast<int32_t>(i),
+                .value.floatValues = {1.0, 2.0, 3.0},
+        });
+    }
+    return values;
+}
+
+// Delivers every value in its own parcel, i.e. the cost of copying all the values through binder.
+void BM_sendUpdatedValuesParcelCopy(benchmark::State& state) {
+    auto callback = ndk::SharedRefBase::make<ForwardingVehicleCallback>(gRemoteCallback);
+    std::shared_ptr<IVehicleCallback> callbackClient =
+            IVehicleCallback::fromBinder(callback->asBinder());
+    std::vector<VehiclePropValue> values = getUpdatedValues(state.range(0));
+
+    for (auto _ : state) {
+        for (const auto& value : values) {
+            std::vector<VehiclePropValue> singleValue = {value};
+            SubscriptionClient::sendUpdatedValues(callbackClient, /*sharedMemoryPool=*/nullptr,
+                                                  std::move(singleValue));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+}
+
+// Delivers all the values in one event, using a pooled shared memory file once the values exceed
+// the binder payload limit.
+void BM_sendUpdatedValuesSharedMemory(benchmark::State& state) {
+    auto callback = ndk::SharedRefBase::make<ForwardingVehicleCallback>(gRemoteCallback);
+    std::shared_ptr<IVehicleCallback> callbackClient =
+            IVehicleCallback::fromBinder(callback->asBinder());
+    auto requestPool = std::make_shared<PendingRequestPool>(/*timeoutInNano=*/1'000'000'000);
+    SubscriptionClient client(requestPool, callbackClient);
+    client.setMaxSharedMemoryFileCount(IVehicle::MAX_SHARED_MEMORY_FILES_PER_CLIENT);
+    callback->setClient(&client);
+    std::vector<VehiclePropValue> values = getUpdatedValues(state.range(0));
+
+    for (auto _ : state) {
+        std::vector<VehiclePropValue> valuesCopy = values;
+        client.sendUpdatedValues(std::move(valuesCopy));
+    }
+    state.SetItemsProcessed(state.iterations() * values.size());
+}
+
+}  // namespace
+
+BENCHMARK(BM_sendUpdatedValuesParcelCopy)->RangeMultiplier(10)->Range(1, 10000);
+BENCHMARK(BM_sendUpdatedValuesSharedMemory)->RangeMultiplier(10)->Range(1, 10000);
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+// The callbacks are served by a child process, forked before any binder use, so that the events
+// go through a real binder proxy instead of being short-circuited to a local object.
+int main(int argc, char** argv) {
+    using ::android::hardware::automotive::vehicle::gRemoteCallback;
+    using ::android::hardware::automotive::vehicle::runCallbackService;
+    using ::android::hardware::automotive::vehicle::waitForRemoteCallback;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        ALOGE("failed to fork the benchmark callback service");
+        return 1;
+    }
+    if (pid == 0) {
+        return runCallbackService();
+    }
+
+    int result = 0;
+    gRemoteCallback = waitForRemoteCallback();
+    if (gRemoteCallback == nullptr) {
+        ALOGE("the benchmark callback service is not available");
+        result = 1;
+    } else {
+        benchmark::Initialize(&argc, argv);
+        benchmark::RunSpecifiedBenchmarks();
+    }
+    gRemoteCallback.reset();
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    return result;
+}
@@ -18,6 +18,7 @@
 #define android_hardware_automotive_vehicle_aidl_impl_vhal_include_ConnectedClient_H_
 
 #include "PendingRequestPool.h"
+#include "SharedMemoryPool.h"
 
 #include <IVehicleHardware.h>
 #include <VehicleHalTypes.h>
@@ -107,10 +108,25 @@ class SubscriptionClient final : public ConnectedClient {
     // Gets the callback to be called when the request for this client has finished.
     std::shared_ptr<const IVehicleHardware::GetValuesCallback> getResultCallback();
 
+    // Sets the max number of shared memory files that could be outstanding for this client.
+    void setMaxSharedMemoryFileCount(int32_t maxSharedMemoryFileCount);
+
+    // Handles a shared memory file returned by the client through
+    // {@code IVehicle.returnSharedMemory}.
+    VhalResult<void> returnSharedMemory(int64_t sharedMemoryId);
+
+    // Marshals the updated values into largeParcelable and sends it through
+    // {@code onPropertyEvent} callback, using this client's shared memory pool.
+    void sendUpdatedValues(
+            std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>&&
+                    updatedValues);
+
     // Marshals the updated values into largeParcelable and sents it through {@code onPropertyEvent}
-    // callback.
+    // callback. If {@code sharedMemoryPool} is not null, a shared memory file would only be used
+    // if the pool has a free slot, otherwise the values would be sent in several parcel sized
+    // chunks.
     static void sendUpdatedValues(
-            CallbackType callback,
+            CallbackType callback, std::shared_ptr<SharedMemoryPool> sharedMemoryPool,
             std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>&&
                     updatedValues);
 
@@ -123,10 +139,13 @@ class SubscriptionClient final : public ConnectedClient {
     std::shared_ptr<const PendingRequestPool::TimeoutCallbackFunc> mTimeoutCallback;
     std::shared_ptr<const IVehicleHardware::GetValuesCallback> mResultCallback;
     std::shared_ptr<const IVehicleHardware::PropertyChangeCallback> mPropertyChangeCallback;
+    // SharedMemoryPool is thread-safe.
+    const std::shared_ptr<SharedMemoryPool> mSharedMemoryPool;
 
     static void onGetValueResults(
             const void* clientId, CallbackType callback,
             std::shared_ptr<PendingRequestPool> requestPool,
+            std::shared_ptr<SharedMemoryPool> sharedMemoryPool,
             std::vector<aidl::android::hardware::automotive::vehicle::GetValueResult> results);
 };
 
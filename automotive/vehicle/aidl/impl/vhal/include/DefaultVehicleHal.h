@@ -20,6 +20,9 @@
 #include <ConnectedClient.h>
 #include <ParcelableUtils.h>
 #include <PendingRequestPool.h>
+#include <PropertyConfigIndex.h>
+#include <PropertyEventBatcher.h>
+#include <PropertyEventDispatcher.h>
 #include <RecurrentTimer.h>
 #include <SubscriptionManager.h>
 
@@ -47,7 +50,22 @@ class DefaultVehicleHal final : public aidl::android::hardware::automotive::vehi
     using CallbackType =
             std::shared_ptr<aidl::android::hardware::automotive::vehicle::IVehicleCallback>;
 
-    explicit DefaultVehicleHal(std::unique_ptr<IVehicleHardware> hardware);
+    static constexpr size_t DEFAULT_MAX_EVENT_BATCH_SIZE = 1000;
+    static constexpr size_t DEFAULT_MAX_EVENT_QUEUE_SIZE_PER_CLIENT = 1000;
+
+    // If {@code eventBatchingWindowInNano} is larger than 0, property change events from the
+    // hardware would be batched for at most that long, or until {@code maxEventBatchSize} events
+    // are pending, before they are sent to the subscribed clients.
+    //
+    // If {@code eventDispatchThreadCount} is larger than 0, property change events would be sent
+    // to each subscribed client asynchronously on that many dispatch threads, with at most
+    // {@code maxEventQueueSizePerClient} events pending for one client. Otherwise, events are
+    // sent synchronously on the thread that reports them.
+    explicit DefaultVehicleHal(
+            std::unique_ptr<IVehicleHardware> hardware, int64_t eventBatchingWindowInNano = 0,
+            size_t maxEventBatchSize = DEFAULT_MAX_EVENT_BATCH_SIZE,
+            size_t eventDispatchThreadCount = 0,
+            size_t maxEventQueueSizePerClient = DEFAULT_MAX_EVENT_QUEUE_SIZE_PER_CLIENT);
 
     ~DefaultVehicleHal();
 
@@ -82,6 +100,8 @@ class DefaultVehicleHal final : public aidl::android::hardware::automotive::vehi
   private:
     // friend class for unit testing.
     friend class DefaultVehicleHalTest;
+    // friend class for benchmarking.
+    friend class DefaultVehicleHalBenchmark;
 
     using GetValuesClient =
             GetSetValuesClient<aidl::android::hardware::automotive::vehicle::GetValueResult,
@@ -171,6 +191,8 @@ class DefaultVehicleHal final : public aidl::android::hardware::automotive::vehi
     // lock guard them.
     std::unordered_map<int32_t, aidl::android::hardware::automotive::vehicle::VehiclePropConfig>
             mConfigsByPropId;
+    // An index into mConfigsByPropId for validating requests, rebuilt whenever it changes.
+    PropertyConfigIndex mConfigIndex;
     // Only modified in constructor, so thread-safe.
     std::unique_ptr<ndk::ScopedFileDescriptor> mConfigFile;
     // PendingRequestPool is thread-safe.
@@ -200,17 +222,24 @@ class DefaultVehicleHal final : public aidl::android::hardware::automotive::vehi
     // ConcurrentQueue is thread-safe.
     ConcurrentQueue<BinderDiedUnlinkedEvent> mBinderEvents;
 
+    // Only initialized once. Null if event batching is disabled. PropertyEventBatcher is
+    // thread-safe.
+    std::shared_ptr<PropertyEventBatcher> mPropertyEventBatcher;
+    // Only initialized once. Null if events are sent synchronously. PropertyEventDispatcher is
+    // thread-safe.
+    std::shared_ptr<PropertyEventDispatcher> mPropertyEventDispatcher;
+
     // A thread to handle onBinderDied or onBinderUnlinked event.
     std::thread mOnBinderDiedUnlinkedHandlerThread;
 
     android::base::Result<void> checkProperty(
             const aidl::android::hardware::automotive::vehicle::VehiclePropValue& propValue);
 
-    android::base::Result<std::vector<int64_t>> checkDuplicateRequests(
+    static android::base::Result<void> checkDuplicateRequests(
             const std::vector<aidl::android::hardware::automotive::vehicle::GetValueRequest>&
                     requests);
 
-    android::base::Result<std::vector<int64_t>> checkDuplicateRequests(
+    static android::base::Result<void> checkDuplicateRequests(
             const std::vector<aidl::android::hardware::automotive::vehicle::SetValueRequest>&
                     requests);
     VhalResult<void> checkSubscribeOptions(
@@ -250,11 +279,21 @@ class DefaultVehicleHal final : public aidl::android::hardware::automotive::vehi
 
     static void onPropertyChangeEvent(
             std::weak_ptr<SubscriptionManager> subscriptionManager,
+            std::weak_ptr<SubscriptionClients> subscriptionClients,
+            std::weak_ptr<PropertyEventDispatcher> propertyEventDispatcher,
             const std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>&
                     updatedValues);
 
+    // Sends the updated values to one subscribed client.
+    static void sendUpdatedValuesToClient(
+            std::weak_ptr<SubscriptionClients> subscriptionClients, const CallbackType& callback,
+            std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>&&
+                    values);
+
     static void checkHealth(IVehicleHardware* hardware,
-                            std::weak_ptr<SubscriptionManager> subscriptionManager);
+                            std::weak_ptr<SubscriptionManager> subscriptionManager,
+                            std::weak_ptr<SubscriptionClients> subscriptionClients,
+                            std::weak_ptr<PropertyEventDispatcher> propertyEventDispatcher);
 
     static void onBinderDied(void* cookie);
 
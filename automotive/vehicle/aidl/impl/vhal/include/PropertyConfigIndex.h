@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_aidl_impl_vhal_include_PropertyConfigIndex_H_
+#define android_hardware_automotive_vehicle_aidl_impl_vhal_include_PropertyConfigIndex_H_
+
+#include <VehicleHalTypes.h>
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+// A read-only index from property ID and area ID to the property config, the access mode and the
+// area config, used to validate get/set requests without hashing into node-based containers.
+//
+// Properties are kept in a flat open-addressing hash table and the area configs of each property
+// are kept next to each other in one array, so a lookup touches a few adjacent cache lines and
+// never allocates.
+//
+// The index points into the configs it is built from, which must outlive it and must not be
+// modified. It is not thread-safe to rebuild the index while it is being read.
+class PropertyConfigIndex final {
+  public:
+    struct PropEntry {
+        int32_t propId = 0;
+        aidl::android::hardware::automotive::vehicle::VehiclePropertyAccess access =
+                aidl::android::hardware::automotive::vehicle::VehiclePropertyAccess::NONE;
+        // The range of this property's area configs in the area array.
+        uint32_t areaBegin = 0;
+        uint32_t areaCount = 0;
+        // Null for an empty slot.
+        const aidl::android::hardware::automotive::vehicle::VehiclePropConfig* config = nullptr;
+    };
+
+    PropertyConfigIndex() = default;
+
+    explicit PropertyConfigIndex(
+            const std::unordered_map<
+                    int32_t, aidl::android::hardware::automotive::vehicle::VehiclePropConfig>&
+                    configsByPropId);
+
+    // Returns the entry for the property, or nullptr if the property is not supported.
+    const PropEntry* getProp(int32_t propId) const;
+
+    // Returns the area config for the area ID, or nullptr if the area is not supported. The same
+    // as {@code getAreaConfig} in VehicleUtils: for global properties the first area config is
+    // returned regardless of the area ID.
+    const aidl::android::hardware::automotive::vehicle::VehicleAreaConfig* getAreaConfig(
+            const PropEntry& prop, int32_t areaId) const;
+
+    size_t size() const { return mSize; }
+
+  private:
+    // Keeps the load factor no more than 1/2 so that probe sequences stay short.
+    static constexpr size_t LOAD_FACTOR_INVERSE = 2;
+
+    std::vector<PropEntry> mSlots;
+    std::vector<std::pair<int32_t,
+                          const aidl::android::hardware::automotive::vehicle::VehicleAreaConfig*>>
+            mAreas;
+    size_t mMask = 0;
+    // 32 minus log2 of the number of slots.
+    uint32_t mShift = 32;
+    size_t mSize = 0;
+
+    size_t getSlot(int32_t propId) const;
+};
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_aidl_impl_vhal_include_PropertyConfigIndex_H_
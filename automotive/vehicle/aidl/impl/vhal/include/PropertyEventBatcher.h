@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_aidl_impl_vhal_include_PropertyEventBatcher_H_
+#define android_hardware_automotive_vehicle_aidl_impl_vhal_include_PropertyEventBatcher_H_
+
+#include <VehicleHalTypes.h>
+#include <VehicleUtils.h>
+
+#include <android-base/thread_annotations.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+// A class to batch property change events from the hardware before they are dispatched to the
+// subscribed clients.
+//
+// Events are collected for at most {@code windowInNano} after the first event of a batch arrives,
+// or until {@code maxBatchSize} events are pending, whichever comes first, and then delivered
+// together through the flush callback on the batcher's own thread.
+//
+// For continuous properties, a newer event for the same [propId, areaId] replaces the pending one
+// in place, since only the latest sample is meaningful. Events for other properties are never
+// coalesced and keep their original order.
+//
+// This class is thread-safe.
+class PropertyEventBatcher final {
+  public:
+    using FlushCallback = std::function<void(
+            std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>)>;
+
+    PropertyEventBatcher(int64_t windowInNano, size_t maxBatchSize,
+                         std::unordered_set<int32_t> continuousPropIds, FlushCallback callback);
+
+    // Flushes the pending events and stops the batcher thread.
+    ~PropertyEventBatcher();
+
+    // Adds the updated values to the current batch.
+    void addValues(
+            const std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>&
+                    values);
+
+    // Gets the total number of events that were coalesced into a pending event. For debugging.
+    size_t getCoalescedCount() const;
+
+    // Gets the total number of batches delivered. For debugging.
+    size_t getBatchCount() const;
+
+  private:
+    const int64_t mWindowInNano;
+    const size_t mMaxBatchSize;
+    const std::unordered_set<int32_t> mContinuousPropIds;
+    const FlushCallback mCallback;
+
+    mutable std::mutex mLock;
+    std::condition_variable mCond;
+    bool mStopped GUARDED_BY(mLock) = false;
+    // The uptime in nanoseconds when the current batch must be delivered.
+    int64_t mBatchDeadlineInNano GUARDED_BY(mLock) = 0;
+    std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue> mPendingValues
+            GUARDED_BY(mLock);
+    // Index into mPendingValues for the pending continuous property events.
+    std::unordered_map<PropIdAreaId, size_t, PropIdAreaIdHash> mPendingIndexByPropIdAreaId
+            GUARDED_BY(mLock);
+    size_t mCoalescedCount GUARDED_BY(mLock) = 0;
+    size_t mBatchCount GUARDED_BY(mLock) = 0;
+    std::thread mThread;
+
+    void loop();
+};
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_aidl_impl_vhal_include_PropertyEventBatcher_H_
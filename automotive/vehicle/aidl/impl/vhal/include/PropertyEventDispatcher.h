@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_aidl_impl_vhal_include_PropertyEventDispatcher_H_
+#define android_hardware_automotive_vehicle_aidl_impl_vhal_include_PropertyEventDispatcher_H_
+
+#include <VehicleHalTypes.h>
+#include <VehicleUtils.h>
+
+#include <aidl/android/hardware/automotive/vehicle/IVehicleCallback.h>
+#include <android-base/thread_annotations.h>
+#include <android/binder_ibinder.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+// A class to deliver property change events to the subscribed clients asynchronously on a pool of
+// dispatch threads, so that a slow client could not delay the events for the other clients or
+// block the hardware callback thread.
+//
+// Every client has its own bounded event queue. Events for one client are always delivered in
+// order by at most one dispatch thread at a time.
+//
+// Dispatch never blocks on a full queue. For continuous properties, a newer event for the same
+// [propId, areaId] replaces the one still pending in the client's queue. If the queue is full:
+// - an on-change event replaces the latest pending event for the same [propId, areaId], so the
+//   client still gets the latest value of every property;
+// - otherwise the oldest pending continuous property event is dropped to make room;
+// - otherwise the queue holds only on-change events for other properties, and the event is queued
+//   past the max size. This adds at most one event per [propId, areaId], so the queue stays
+//   bounded by the max size plus the number of subscribed [propId, areaId]s.
+//
+// This class is thread-safe.
+class PropertyEventDispatcher final {
+  public:
+    using CallbackType =
+            std::shared_ptr<aidl::android::hardware::automotive::vehicle::IVehicleCallback>;
+    using SendFunction = std::function<void(
+            const CallbackType& callback,
+            std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>&& values)>;
+
+    struct ClientStats {
+        // The number of events currently pending in the client's queue.
+        size_t queueDepth = 0;
+        // The largest number of events ever pending in the client's queue.
+        size_t maxQueueDepth = 0;
+        // The number of events dropped because the client's queue was full, including the
+        // on-change events replaced by a newer value of the same property.
+        size_t droppedCount = 0;
+        // The number of continuous property events merged into a pending event.
+        size_t mergedCount = 0;
+        // The number of events queued past the max queue size, because the full queue held only
+        // on-change events for other properties.
+        size_t overflowCount = 0;
+    };
+
+    // {@code maxQueueSizePerClient} must be larger than 0, 0 is treated as 1.
+    PropertyEventDispatcher(size_t threadCount, size_t maxQueueSizePerClient,
+                            std::unordered_set<int32_t> continuousPropIds, SendFunction sendFunc);
+
+    // Stops the dispatch threads. Pending events that are not being delivered are discarded.
+    ~PropertyEventDispatcher();
+
+    // Queues the values to be delivered to the client. Never blocks on the client's queue.
+    void dispatch(
+            const CallbackType& callback,
+            std::vector<aidl::android::hardware::automotive::vehicle::VehiclePropValue>&& values);
+
+    // Discards the queue for the client, e.g. because the client died.
+    void removeClient(const AIBinder* clientId);
+
+    // Gets the queue stats for all the clients. For debugging.
+    std::unordered_map<const AIBinder*, ClientStats> getStats() const;
+
+  private:
+    struct ClientQueue {
+        CallbackType callback;
+        std::deque<aidl::android::hardware::automotive::vehicle::VehiclePropValue> pendingValues;
+        // The sequence number of the value at the front of pendingValues.
+        uint64_t frontSeq = 0;
+        // The sequence number of the latest pending event for each [propId, areaId].
+        std::unordered_map<PropIdAreaId, uint64_t, PropIdAreaIdHash> pendingSeqByPropIdAreaId;
+        // Whether this queue is waiting in mReadyQueues or being drained by a dispatch thread.
+        bool scheduled = false;
+        bool removed = false;
+        ClientStats stats;
+    };
+
+    const size_t mMaxQueueSizePerClient;
+    const std::unordered_set<int32_t> mContinuousPropIds;
+    const SendFunction mSendFunc;
+
+    mutable std::mutex mLock;
+    std::condition_variable mCond;
+    bool mStopped GUARDED_BY(mLock) = false;
+    std::unordered_map<const AIBinder*, std::shared_ptr<ClientQueue>> mQueueByClient
+            GUARDED_BY(mLock);
+    // The client queues that have pending events and are not being drained.
+    std::deque<std::shared_ptr<ClientQueue>> mReadyQueues GUARDED_BY(mLock);
+    std::vector<std::thread> mThreads;
+
+    void enqueueLocked(ClientQueue* queue,
+                       aidl::android::hardware::automotive::vehicle::VehiclePropValue&& value)
+            REQUIRES(mLock);
+
+    // Replaces the latest pending event for the same [propId, areaId], if any.
+    bool replaceLocked(ClientQueue* queue,
+                       aidl::android::hardware::automotive::vehicle::VehiclePropValue* value)
+            REQUIRES(mLock);
+
+    // Drops the oldest pending continuous property event, if any.
+    bool evictContinuousLocked(ClientQueue* queue) REQUIRES(mLock);
+
+    // Drops the pending event at the index.
+    void eraseLocked(ClientQueue* queue, size_t index) REQUIRES(mLock);
+
+    bool isContinuous(int32_t propId) const {
+        return mContinuousPropIds.find(propId) != mContinuousPropIds.end();
+    }
+
+    void scheduleLocked(const std::shared_ptr<ClientQueue>& queue) REQUIRES(mLock);
+
+    void loop();
+};
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_aidl_impl_vhal_include_PropertyEventDispatcher_H_
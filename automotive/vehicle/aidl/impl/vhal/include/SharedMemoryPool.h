@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_aidl_impl_vhal_include_SharedMemoryPool_H_
+#define android_hardware_automotive_vehicle_aidl_impl_vhal_include_SharedMemoryPool_H_
+
+#include <VehicleUtils.h>
+
+#include <android-base/thread_annotations.h>
+#include <android/binder_auto_utils.h>
+
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+// A thread-safe class to manage the shared memory files handed out to one subscription client
+// through {@code IVehicleCallback.onPropertyEvent}.
+//
+// Each shared memory file delivered to the client is identified by a unique sharedMemoryId and
+// occupies one slot in the pool until the client returns it through
+// {@code IVehicle.returnSharedMemory}. The pool holds a reference to every outstanding file so
+// that the memory stays accounted to this client until it is returned.
+//
+// If the max file count is 0, shared memory files are not tracked, every file is assigned
+// {@code INVALID_MEMORY_ID} and the client is not required to return it.
+class SharedMemoryPool final {
+  public:
+    explicit SharedMemoryPool(int32_t maxFileCount = 0);
+
+    // Updates the max number of outstanding shared memory files. Already delivered files stay
+    // outstanding until returned even if the new limit is lower.
+    void setMaxFileCount(int32_t maxFileCount);
+
+    // Reserves a slot for a new shared memory file. Returns the sharedMemoryId to use, or
+    // {@code std::nullopt} if all the slots are occupied by files the client has not returned.
+    // A reservation must be either committed through {@code commit} or released through
+    // {@code cancel}.
+    std::optional<int64_t> reserve();
+
+    // Marks a reserved slot as occupied by the given shared memory file.
+    void commit(int64_t sharedMemoryId, const ndk::ScopedFileDescriptor& fd);
+
+    // Releases a reserved slot that turned out not to be needed, e.g. because the payload fits
+    // into the binder parcel.
+    void cancel(int64_t sharedMemoryId);
+
+    // Handles a shared memory file returned by the client. Returns {@code INVALID_ARG} if the
+    // ID does not match any outstanding file.
+    VhalResult<void> returnFile(int64_t sharedMemoryId);
+
+    // Gets the number of shared memory files currently allocated for this client, including
+    // reserved slots.
+    int32_t getFileCount() const;
+
+  private:
+    mutable std::mutex mLock;
+    int32_t mMaxFileCount GUARDED_BY(mLock);
+    int64_t mNextId GUARDED_BY(mLock);
+    int32_t mReservedCount GUARDED_BY(mLock) = 0;
+    std::unordered_map<int64_t, ndk::ScopedFileDescriptor> mOutstandingFiles GUARDED_BY(mLock);
+};
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_aidl_impl_vhal_include_SharedMemoryPool_H_
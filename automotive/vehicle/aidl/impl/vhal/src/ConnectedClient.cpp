@@ -18,6 +18,7 @@
 #include "ParcelableUtils.h"
 
 #include <VehicleHalTypes.h>
+#include <aidl/android/hardware/automotive/vehicle/IVehicle.h>
 
 #include <utils/Log.h>
 
@@ -34,7 +35,9 @@ namespace {
 
 using ::aidl::android::hardware::automotive::vehicle::GetValueResult;
 using ::aidl::android::hardware::automotive::vehicle::GetValueResults;
+using ::aidl::android::hardware::automotive::vehicle::IVehicle;
 using ::aidl::android::hardware::automotive::vehicle::IVehicleCallback;
+using ::aidl::android::hardware::automotive::vehicle::RawPropValues;
 using ::aidl::android::hardware::automotive::vehicle::SetValueResult;
 using ::aidl::android::hardware::automotive::vehicle::SetValueResults;
 using ::aidl::android::hardware::automotive::vehicle::StatusCode;
@@ -43,6 +46,25 @@ using ::aidl::android::hardware::automotive::vehicle::VehiclePropValues;
 using ::android::base::Result;
 using ::ndk::ScopedAStatus;
 
+// The max estimated size of the values sent in one parcel when no shared memory file is
+// available. It is below the 4096 bytes payload limit of LargeParcelableBase, above which a
+// shared memory file is created, to leave room for the VehiclePropValues header.
+constexpr size_t MAX_PARCEL_CHUNK_SIZE = 4000;
+
+// Gets an upper bound of the size of a value once written into a parcel.
+size_t estimateParcelSize(const VehiclePropValue& value) {
+    const RawPropValues& rawValues = value.value;
+    // The parcelable headers, the fixed size fields and the vector lengths.
+    size_t size = 64;
+    size += rawValues.int32Values.size() * sizeof(int32_t);
+    size += rawValues.floatValues.size() * sizeof(float);
+    size += rawValues.int64Values.size() * sizeof(int64_t);
+    size += (rawValues.byteValues.size() + 3) / 4 * 4;
+    // The string is written as UTF-16 with a null terminator.
+    size += (rawValues.stringValue.size() + 2) * sizeof(char16_t);
+    return size;
+}
+
 // A function to call the specific callback based on results type.
 template <class T>
 ScopedAStatus callCallback(std::shared_ptr<IVehicleCallback> callback, const T& results);
@@ -250,7 +272,8 @@ template class GetSetValuesClient<SetValueResult, SetValueResults>;
 
 SubscriptionClient::SubscriptionClient(std::shared_ptr<PendingRequestPool> requestPool,
                                        std::shared_ptr<IVehicleCallback> callback)
-    : ConnectedClient(requestPool, callback) {
+    : ConnectedClient(requestPool, callback),
+      mSharedMemoryPool(std::make_shared<SharedMemoryPool>()) {
     mTimeoutCallback = std::make_shared<const PendingRequestPool::TimeoutCallbackFunc>(
             [](std::unordered_set<int64_t> timeoutIds) {
                 for (int64_t id : timeoutIds) {
@@ -261,10 +284,13 @@ SubscriptionClient::SubscriptionClient(std::shared_ptr<PendingRequestPool> reque
                 }
             });
     auto requestPoolCopy = mRequestPool;
+    auto sharedMemoryPoolCopy = mSharedMemoryPool;
     const void* clientId = reinterpret_cast<const void*>(this);
     mResultCallback = std::make_shared<const IVehicleHardware::GetValuesCallback>(
-            [clientId, callback, requestPoolCopy](std::vector<GetValueResult> results) {
-                onGetValueResults(clientId, callback, requestPoolCopy, results);
+            [clientId, callback, requestPoolCopy,
+             sharedMemoryPoolCopy](std::vector<GetValueResult> results) {
+                onGetValueResults(clientId, callback, requestPoolCopy, sharedMemoryPoolCopy,
+                                  results);
             });
 }
 
@@ -278,18 +304,60 @@ SubscriptionClient::getTimeoutCallback() {
     return mTimeoutCallback;
 }
 
+void SubscriptionClient::setMaxSharedMemoryFileCount(int32_t maxSharedMemoryFileCount) {
+    mSharedMemoryPool->setMaxFileCount(maxSharedMemoryFileCount);
+}
+
+VhalResult<void> SubscriptionClient::returnSharedMemory(int64_t sharedMemoryId) {
+    return mSharedMemoryPool->returnFile(sharedMemoryId);
+}
+
+void SubscriptionClient::sendUpdatedValues(std::vector<VehiclePropValue>&& updatedValues) {
+    sendUpdatedValues(mCallback, mSharedMemoryPool, std::move(updatedValues));
+}
+
 void SubscriptionClient::sendUpdatedValues(std::shared_ptr<IVehicleCallback> callback,
+                                           std::shared_ptr<SharedMemoryPool> sharedMemoryPool,
                                            std::vector<VehiclePropValue>&& updatedValues) {
     if (updatedValues.empty()) {
         return;
     }
 
-    // TODO(b/205189110): Use memory pool here and fill in sharedMemoryId.
+    int64_t sharedMemoryId = IVehicle::INVALID_MEMORY_ID;
+    if (sharedMemoryPool != nullptr) {
+        std::optional<int64_t> maybeId = sharedMemoryPool->reserve();
+        if (!maybeId.has_value()) {
+            // All the shared memory files are still in use by the client. Send the values in
+            // chunks that fit into the parcel, so that no new file is created. A single value
+            // larger than a chunk is still sent on its own.
+            ALOGW("subscribe: no available shared memory file for client ID: %p, sending %zu "
+                  "values in parcel sized chunks",
+                  callback->asBinder().get(), updatedValues.size());
+            std::vector<VehiclePropValue> chunk;
+            size_t chunkSize = 0;
+            for (auto& value : updatedValues) {
+                size_t valueSize = estimateParcelSize(value);
+                if (!chunk.empty() && chunkSize + valueSize > MAX_PARCEL_CHUNK_SIZE) {
+                    sendUpdatedValues(callback, /*sharedMemoryPool=*/nullptr, std::move(chunk));
+                    chunk.clear();
+                    chunkSize = 0;
+                }
+                chunk.push_back(std::move(value));
+                chunkSize += valueSize;
+            }
+            sendUpdatedValues(callback, /*sharedMemoryPool=*/nullptr, std::move(chunk));
+            return;
+        }
+        sharedMemoryId = *maybeId;
+    }
+
     VehiclePropValues vehiclePropValues;
-    int32_t sharedMemoryFileCount = 0;
     ScopedAStatus status =
             vectorToStableLargeParcelable(std::move(updatedValues), &vehiclePropValues);
     if (!status.isOk()) {
+        if (sharedMemoryPool != nullptr) {
+            sharedMemoryPool->cancel(sharedMemoryId);
+        }
         int statusCode = status.getServiceSpecificError();
         ALOGE("subscribe: failed to marshal result into large parcelable, error: "
               "%s, code: %d",
@@ -297,6 +365,19 @@ void SubscriptionClient::sendUpdatedValues(std::shared_ptr<IVehicleCallback> cal
         return;
     }
 
+    int32_t sharedMemoryFileCount = 0;
+    vehiclePropValues.sharedMemoryId = IVehicle::INVALID_MEMORY_ID;
+    if (sharedMemoryPool != nullptr) {
+        if (vehiclePropValues.sharedMemoryFd.get() != -1) {
+            sharedMemoryPool->commit(sharedMemoryId, vehiclePropValues.sharedMemoryFd);
+            vehiclePropValues.sharedMemoryId = sharedMemoryId;
+        } else {
+            // The values fit into the parcel, the reserved file is not needed.
+            sharedMemoryPool->cancel(sharedMemoryId);
+        }
+        sharedMemoryFileCount = sharedMemoryPool->getFileCount();
+    }
+
     if (ScopedAStatus callbackStatus =
                 callback->onPropertyEvent(vehiclePropValues, sharedMemoryFileCount);
         !callbackStatus.isOk()) {
@@ -304,12 +385,18 @@ void SubscriptionClient::sendUpdatedValues(std::shared_ptr<IVehicleCallback> cal
               "exception: %d, service specific error: %d",
               callback->asBinder().get(), callbackStatus.getMessage(),
               callbackStatus.getExceptionCode(), callbackStatus.getServiceSpecificError());
+        // The client would never see this file, so it would never return it.
+        if (sharedMemoryPool != nullptr &&
+            vehiclePropValues.sharedMemoryId != IVehicle::INVALID_MEMORY_ID) {
+            (void)sharedMemoryPool->returnFile(vehiclePropValues.sharedMemoryId);
+        }
     }
 }
 
 void SubscriptionClient::onGetValueResults(const void* clientId,
                                            std::shared_ptr<IVehicleCallback> callback,
                                            std::shared_ptr<PendingRequestPool> requestPool,
+                                           std::shared_ptr<SharedMemoryPool> sharedMemoryPool,
                                            std::vector<GetValueResult> results) {
     std::unordered_set<int64_t> requestIds;
     for (const auto& result : results) {
@@ -341,7 +428,7 @@ void SubscriptionClient::onGetValueResults(const void* clientId,
         propValues.push_back(std::move(result.prop.value()));
     }
 
-    sendUpdatedValues(callback, std::move(propValues));
+    sendUpdatedValues(callback, sharedMemoryPool, std::move(propValues));
 }
 
 }  // namespace vehicle
@@ -32,7 +32,7 @@
 #include <utils/Trace.h>
 
 #include <inttypes.h>
-#include <set>
+#include <algorithm>
 #include <unordered_set>
 
 namespace android {
@@ -46,6 +46,7 @@ using ::aidl::android::hardware::automotive::vehicle::GetValueRequest;
 using ::aidl::android::hardware::automotive::vehicle::GetValueRequests;
 using ::aidl::android::hardware::automotive::vehicle::GetValueResult;
 using ::aidl::android::hardware::automotive::vehicle::GetValueResults;
+using ::aidl::android::hardware::automotive::vehicle::IVehicle;
 using ::aidl::android::hardware::automotive::vehicle::SetValueRequest;
 using ::aidl::android::hardware::automotive::vehicle::SetValueRequests;
 using ::aidl::android::hardware::automotive::vehicle::SetValueResult;
@@ -90,6 +91,37 @@ float getDefaultSampleRateHz(float sampleRateHz, float minSampleRateHz, float ma
     return sampleRateHz;
 }
 
+// Checks whether there are duplicate property values in the requests. Sorts pointers to the values
+// in a per-thread buffer instead of copying the values into a set, so the check does not allocate
+// once the buffer has grown to the batch size.
+template <class T, class GetPropFn>
+Result<void> checkDuplicateProps(const std::vector<T>& requests, GetPropFn getProp) {
+    if (requests.size() < 2) {
+        return {};
+    }
+    thread_local std::vector<const VehiclePropValue*> props;
+    props.clear();
+    for (const auto& request : requests) {
+        props.push_back(&getProp(request));
+    }
+    std::sort(props.begin(), props.end(), [](const VehiclePropValue* a, const VehiclePropValue* b) {
+        // Compares the property ID and area ID first, which differ for almost all the requests.
+        if (a->prop != b->prop) {
+            return a->prop < b->prop;
+        }
+        if (a->areaId != b->areaId) {
+            return a->areaId < b->areaId;
+        }
+        return *a < *b;
+    });
+    for (size_t i = 1; i < props.size(); i++) {
+        if (*props[i - 1] == *props[i]) {
+            return Error() << "duplicate request for property: " << props[i]->toString();
+        }
+    }
+    return {};
+}
+
 }  // namespace
 
 std::shared_ptr<SubscriptionClient> DefaultVehicleHal::SubscriptionClients::maybeAddClient(
@@ -125,7 +157,10 @@ size_t DefaultVehicleHal::SubscriptionClients::countClients() {
     return mClients.size();
 }
 
-DefaultVehicleHal::DefaultVehicleHal(std::unique_ptr<IVehicleHardware> vehicleHardware)
+DefaultVehicleHal::DefaultVehicleHal(std::unique_ptr<IVehicleHardware> vehicleHardware,
+                                     int64_t eventBatchingWindowInNano, size_t maxEventBatchSize,
+                                     size_t eventDispatchThreadCount,
+                                     size_t maxEventQueueSizePerClient)
     : mVehicleHardware(std::move(vehicleHardware)),
       mPendingRequestPool(std::make_shared<PendingRequestPool>(TIMEOUT_IN_NANO)) {
     if (!getAllPropConfigsFromHardware()) {
@@ -139,16 +174,55 @@ DefaultVehicleHal::DefaultVehicleHal(std::unique_ptr<IVehicleHardware> vehicleHa
     mSubscriptionManager = std::make_shared<SubscriptionManager>(vehicleHardwarePtr);
 
     std::weak_ptr<SubscriptionManager> subscriptionManagerCopy = mSubscriptionManager;
+    std::weak_ptr<SubscriptionClients> subscriptionClientsCopy = mSubscriptionClients;
+    std::unordered_set<int32_t> continuousPropIds;
+    for (const auto& [propId, config] : mConfigsByPropId) {
+        if (config.changeMode == VehiclePropertyChangeMode::CONTINUOUS) {
+            continuousPropIds.insert(propId);
+        }
+    }
+    if (eventDispatchThreadCount > 0) {
+        mPropertyEventDispatcher = std::make_shared<PropertyEventDispatcher>(
+                eventDispatchThreadCount, maxEventQueueSizePerClient, continuousPropIds,
+                [subscriptionClientsCopy](const CallbackType& callback,
+                                          std::vector<VehiclePropValue>&& values) {
+                    sendUpdatedValuesToClient(subscriptionClientsCopy, callback,
+                                              std::move(values));
+                });
+    }
+    std::weak_ptr<PropertyEventDispatcher> propertyEventDispatcherCopy = mPropertyEventDispatcher;
+    if (eventBatchingWindowInNano > 0) {
+        mPropertyEventBatcher = std::make_shared<PropertyEventBatcher>(
+                eventBatchingWindowInNano, maxEventBatchSize, std::move(continuousPropIds),
+                [subscriptionManagerCopy, subscriptionClientsCopy,
+                 propertyEventDispatcherCopy](std::vector<VehiclePropValue> updatedValues) {
+                    onPropertyChangeEvent(subscriptionManagerCopy, subscriptionClientsCopy,
+                                          propertyEventDispatcherCopy, updatedValues);
+                });
+    }
+    std::weak_ptr<PropertyEventBatcher> propertyEventBatcherCopy = mPropertyEventBatcher;
+    bool batchingEnabled = (mPropertyEventBatcher != nullptr);
     mVehicleHardware->registerOnPropertyChangeEvent(
             std::make_unique<IVehicleHardware::PropertyChangeCallback>(
-                    [subscriptionManagerCopy](std::vector<VehiclePropValue> updatedValues) {
-                        onPropertyChangeEvent(subscriptionManagerCopy, updatedValues);
+                    [subscriptionManagerCopy, subscriptionClientsCopy, propertyEventDispatcherCopy,
+                     propertyEventBatcherCopy,
+                     batchingEnabled](std::vector<VehiclePropValue> updatedValues) {
+                        if (!batchingEnabled) {
+                            onPropertyChangeEvent(subscriptionManagerCopy, subscriptionClientsCopy,
+                                                  propertyEventDispatcherCopy, updatedValues);
+                            return;
+                        }
+                        if (auto batcher = propertyEventBatcherCopy.lock(); batcher != nullptr) {
+                            batcher->addValues(updatedValues);
+                        }
                     }));
 
     // Register heartbeat event.
     mRecurrentAction = std::make_shared<std::function<void()>>(
-            [vehicleHardwarePtr, subscriptionManagerCopy]() {
-                checkHealth(vehicleHardwarePtr, subscriptionManagerCopy);
+            [vehicleHardwarePtr, subscriptionManagerCopy, subscriptionClientsCopy,
+             propertyEventDispatcherCopy]() {
+                checkHealth(vehicleHardwarePtr, subscriptionManagerCopy, subscriptionClientsCopy,
+                            propertyEventDispatcherCopy);
             });
     mRecurrentTimer.registerTimerCallback(HEART_BEAT_INTERVAL_IN_NANO, mRecurrentAction);
 
@@ -174,24 +248,54 @@ DefaultVehicleHal::~DefaultVehicleHal() {
     // mVehicleHardware.
     mSubscriptionManager.reset();
     mVehicleHardware.reset();
+    // Flushes the pending events, which would be dropped since mSubscriptionManager is destroyed.
+    mPropertyEventBatcher.reset();
+    mPropertyEventDispatcher.reset();
 }
 
 void DefaultVehicleHal::onPropertyChangeEvent(
         std::weak_ptr<SubscriptionManager> subscriptionManager,
+        std::weak_ptr<SubscriptionClients> subscriptionClients,
+        std::weak_ptr<PropertyEventDispatcher> propertyEventDispatcher,
         const std::vector<VehiclePropValue>& updatedValues) {
     auto manager = subscriptionManager.lock();
     if (manager == nullptr) {
         ALOGW("the SubscriptionManager is destroyed, DefaultVehicleHal is ending");
         return;
     }
+    // Null if events are sent synchronously.
+    auto dispatcher = propertyEventDispatcher.lock();
     auto updatedValuesByClients = manager->getSubscribedClients(updatedValues);
     for (const auto& [callback, valuePtrs] : updatedValuesByClients) {
         std::vector<VehiclePropValue> values;
+        values.reserve(valuePtrs.size());
         for (const VehiclePropValue* valuePtr : valuePtrs) {
             values.push_back(*valuePtr);
         }
-        SubscriptionClient::sendUpdatedValues(callback, std::move(values));
+        if (dispatcher != nullptr) {
+            dispatcher->dispatch(callback, std::move(values));
+            continue;
+        }
+        sendUpdatedValuesToClient(subscriptionClients, callback, std::move(values));
+    }
+}
+
+void DefaultVehicleHal::sendUpdatedValuesToClient(
+        std::weak_ptr<SubscriptionClients> subscriptionClients, const CallbackType& callback,
+        std::vector<VehiclePropValue>&& values) {
+    auto clients = subscriptionClients.lock();
+    if (clients == nullptr) {
+        ALOGW("the SubscriptionClients is destroyed, DefaultVehicleHal is ending");
+        return;
+    }
+    std::shared_ptr<SubscriptionClient> client = clients->getClient(callback);
+    if (client == nullptr) {
+        // The client might have just died, send the values without shared memory tracking.
+        SubscriptionClient::sendUpdatedValues(callback, /*sharedMemoryPool=*/nullptr,
+                                              std::move(values));
+        return;
     }
+    client->sendUpdatedValues(std::move(values));
 }
 
 template <class T>
@@ -245,6 +349,9 @@ void DefaultVehicleHal::onBinderDiedWithContext(const AIBinder* clientId) {
     mGetValuesClients.erase(clientId);
     mSubscriptionClients->removeClient(clientId);
     mSubscriptionManager->unsubscribe(clientId);
+    if (mPropertyEventDispatcher != nullptr) {
+        mPropertyEventDispatcher->removeClient(clientId);
+    }
 }
 
 void DefaultVehicleHal::onBinderUnlinked(void* cookie) {
@@ -296,6 +403,7 @@ bool DefaultVehicleHal::getAllPropConfigsFromHardware() {
     for (auto& config : configs) {
         mConfigsByPropId[config.prop] = config;
     }
+    mConfigIndex = PropertyConfigIndex(mConfigsByPropId);
     VehiclePropConfigs vehiclePropConfigs;
     vehiclePropConfigs.payloads = std::move(configs);
     auto result = LargeParcelableBase::parcelableToStableLargeParcelable(vehiclePropConfigs);
@@ -326,21 +434,21 @@ ScopedAStatus DefaultVehicleHal::getAllPropConfigs(VehiclePropConfigs* output) {
 }
 
 Result<const VehiclePropConfig*> DefaultVehicleHal::getConfig(int32_t propId) const {
-    auto it = mConfigsByPropId.find(propId);
-    if (it == mConfigsByPropId.end()) {
+    const PropertyConfigIndex::PropEntry* prop = mConfigIndex.getProp(propId);
+    if (prop == nullptr) {
         return Error() << "no config for property, ID: " << propId;
     }
-    return &(it->second);
+    return prop->config;
 }
 
 Result<void> DefaultVehicleHal::checkProperty(const VehiclePropValue& propValue) {
     int32_t propId = propValue.prop;
-    auto result = getConfig(propId);
-    if (!result.ok()) {
-        return result.error();
+    const PropertyConfigIndex::PropEntry* prop = mConfigIndex.getProp(propId);
+    if (prop == nullptr) {
+        return Error() << "no config for property, ID: " << propId;
     }
-    const VehiclePropConfig* config = result.value();
-    const VehicleAreaConfig* areaConfig = getAreaConfig(propValue, *config);
+    const VehiclePropConfig* config = prop->config;
+    const VehicleAreaConfig* areaConfig = mConfigIndex.getAreaConfig(*prop, propValue.areaId);
     if (!isGlobalProp(propId) && areaConfig == nullptr) {
         // Ignore areaId for global property. For non global property, check whether areaId is
         // allowed. areaId must appear in areaConfig.
@@ -373,32 +481,40 @@ ScopedAStatus DefaultVehicleHal::getValues(const CallbackType& callback,
     const std::vector<GetValueRequest>& getValueRequests =
             deserializedResults.value().getObject()->payloads;
 
-    auto maybeRequestIds = checkDuplicateRequests(getValueRequests);
-    if (!maybeRequestIds.ok()) {
+    if (auto result = checkDuplicateRequests(getValueRequests); !result.ok()) {
         ALOGE("getValues: duplicate request ID");
-        return toScopedAStatus(maybeRequestIds, StatusCode::INVALID_ARG);
+        return toScopedAStatus(result, StatusCode::INVALID_ARG);
     }
 
     // A list of failed result we already know before sending to hardware.
     std::vector<GetValueResult> failedResults;
-    // The list of requests that we would send to hardware.
-    std::vector<GetValueRequest> hardwareRequests;
+    // The valid requests, only populated if some requests are invalid. Otherwise all the requests
+    // are sent to hardware as is without copying.
+    std::vector<GetValueRequest> validRequests;
 
-    for (const auto& request : getValueRequests) {
+    for (size_t i = 0; i < getValueRequests.size(); i++) {
+        const auto& request = getValueRequests[i];
         if (auto result = checkReadPermission(request.prop); !result.ok()) {
             ALOGW("property does not support reading: %s", getErrorMsg(result).c_str());
+            if (failedResults.empty()) {
+                validRequests.assign(getValueRequests.begin(), getValueRequests.begin() + i);
+            }
             failedResults.push_back(GetValueResult{
                     .requestId = request.requestId,
                     .status = getErrorCode(result),
                     .prop = {},
             });
-        } else {
-            hardwareRequests.push_back(request);
+        } else if (!failedResults.empty()) {
+            validRequests.push_back(request);
         }
     }
+    // The list of requests that we would send to hardware.
+    const std::vector<GetValueRequest>& hardwareRequests =
+            failedResults.empty() ? getValueRequests : validRequests;
 
     // The set of request Ids that we would send to hardware.
     std::unordered_set<int64_t> hardwareRequestIds;
+    hardwareRequestIds.reserve(hardwareRequests.size());
     for (const auto& request : hardwareRequests) {
         hardwareRequestIds.insert(request.requestId);
     }
@@ -462,40 +578,50 @@ ScopedAStatus DefaultVehicleHal::setValues(const CallbackType& callback,
 
     // A list of failed result we already know before sending to hardware.
     std::vector<SetValueResult> failedResults;
-    // The list of requests that we would send to hardware.
-    std::vector<SetValueRequest> hardwareRequests;
+    // The valid requests, only populated if some requests are invalid. Otherwise all the requests
+    // are sent to hardware as is without copying.
+    std::vector<SetValueRequest> validRequests;
 
-    auto maybeRequestIds = checkDuplicateRequests(setValueRequests);
-    if (!maybeRequestIds.ok()) {
+    if (auto result = checkDuplicateRequests(setValueRequests); !result.ok()) {
         ALOGE("setValues: duplicate request ID");
-        return toScopedAStatus(maybeRequestIds, StatusCode::INVALID_ARG);
+        return toScopedAStatus(result, StatusCode::INVALID_ARG);
     }
 
-    for (auto& request : setValueRequests) {
+    for (size_t i = 0; i < setValueRequests.size(); i++) {
+        const auto& request = setValueRequests[i];
         int64_t requestId = request.requestId;
+        std::optional<SetValueResult> failedResult;
         if (auto result = checkWritePermission(request.value); !result.ok()) {
             ALOGW("property does not support writing: %s", getErrorMsg(result).c_str());
-            failedResults.push_back(SetValueResult{
+            failedResult = SetValueResult{
                     .requestId = requestId,
                     .status = getErrorCode(result),
-            });
-            continue;
-        }
-        if (auto result = checkProperty(request.value); !result.ok()) {
+            };
+        } else if (auto result = checkProperty(request.value); !result.ok()) {
             ALOGW("setValues[%" PRId64 "]: property is not valid: %s", requestId,
                   getErrorMsg(result).c_str());
-            failedResults.push_back(SetValueResult{
+            failedResult = SetValueResult{
                     .requestId = requestId,
                     .status = StatusCode::INVALID_ARG,
-            });
-            continue;
+            };
         }
 
-        hardwareRequests.push_back(request);
+        if (failedResult.has_value()) {
+            if (failedResults.empty()) {
+                validRequests.assign(setValueRequests.begin(), setValueRequests.begin() + i);
+            }
+            failedResults.push_back(std::move(*failedResult));
+        } else if (!failedResults.empty()) {
+            validRequests.push_back(request);
+        }
     }
+    // The list of requests that we would send to hardware.
+    const std::vector<SetValueRequest>& hardwareRequests =
+            failedResults.empty() ? setValueRequests : validRequests;
 
     // The set of request Ids that we would send to hardware.
     std::unordered_set<int64_t> hardwareRequestIds;
+    hardwareRequestIds.reserve(hardwareRequests.size());
     for (const auto& request : hardwareRequests) {
         hardwareRequestIds.insert(request.requestId);
     }
@@ -542,34 +668,22 @@ ScopedAStatus DefaultVehicleHal::setValues(const CallbackType& callback,
     return ScopedAStatus::ok();
 }
 
-#define CHECK_DUPLICATE_REQUESTS(PROP_NAME)                                                      \
-    do {                                                                                         \
-        std::vector<int64_t> requestIds;                                                         \
-        std::set<::aidl::android::hardware::automotive::vehicle::VehiclePropValue> requestProps; \
-        for (const auto& request : requests) {                                                   \
-            const auto& prop = request.PROP_NAME;                                                \
-            if (requestProps.count(prop) != 0) {                                                 \
-                return ::android::base::Error()                                                  \
-                       << "duplicate request for property: " << prop.toString();                 \
-            }                                                                                    \
-            requestProps.insert(prop);                                                           \
-            requestIds.push_back(request.requestId);                                             \
-        }                                                                                        \
-        return requestIds;                                                                       \
-    } while (0);
-
-::android::base::Result<std::vector<int64_t>> DefaultVehicleHal::checkDuplicateRequests(
+Result<void> DefaultVehicleHal::checkDuplicateRequests(
         const std::vector<GetValueRequest>& requests) {
-    CHECK_DUPLICATE_REQUESTS(prop);
+    return checkDuplicateProps(requests,
+                               [](const GetValueRequest& request) -> const VehiclePropValue& {
+                                   return request.prop;
+                               });
 }
 
-::android::base::Result<std::vector<int64_t>> DefaultVehicleHal::checkDuplicateRequests(
+Result<void> DefaultVehicleHal::checkDuplicateRequests(
         const std::vector<SetValueRequest>& requests) {
-    CHECK_DUPLICATE_REQUESTS(value);
+    return checkDuplicateProps(requests,
+                               [](const SetValueRequest& request) -> const VehiclePropValue& {
+                                   return request.value;
+                               });
 }
 
-#undef CHECK_DUPLICATE_REQUESTS
-
 ScopedAStatus DefaultVehicleHal::getPropConfigs(const std::vector<int32_t>& props,
                                                 VehiclePropConfigs* output) {
     std::vector<VehiclePropConfig> configs;
@@ -589,11 +703,12 @@ VhalResult<void> DefaultVehicleHal::checkSubscribeOptions(
         const std::vector<SubscribeOptions>& options) {
     for (const auto& option : options) {
         int32_t propId = option.propId;
-        if (mConfigsByPropId.find(propId) == mConfigsByPropId.end()) {
+        const PropertyConfigIndex::PropEntry* prop = mConfigIndex.getProp(propId);
+        if (prop == nullptr) {
             return StatusError(StatusCode::INVALID_ARG)
                    << StringPrintf("no config for property, ID: %" PRId32, propId);
         }
-        const VehiclePropConfig& config = mConfigsByPropId[propId];
+        const VehiclePropConfig& config = *prop->config;
 
         if (config.changeMode != VehiclePropertyChangeMode::ON_CHANGE &&
             config.changeMode != VehiclePropertyChangeMode::CONTINUOUS) {
@@ -631,7 +746,8 @@ VhalResult<void> DefaultVehicleHal::checkSubscribeOptions(
 
         // Non-global property.
         for (int32_t areaId : option.areaIds) {
-            if (auto areaConfig = getAreaConfig(propId, areaId, config); areaConfig == nullptr) {
+            if (auto areaConfig = mConfigIndex.getAreaConfig(*prop, areaId);
+                areaConfig == nullptr) {
                 return StatusError(StatusCode::INVALID_ARG)
                        << StringPrintf("invalid area ID: %" PRId32 " for prop ID: %" PRId32
                                        ", not listed in config",
@@ -644,8 +760,7 @@ VhalResult<void> DefaultVehicleHal::checkSubscribeOptions(
 
 ScopedAStatus DefaultVehicleHal::subscribe(const CallbackType& callback,
                                            const std::vector<SubscribeOptions>& options,
-                                           [[maybe_unused]] int32_t maxSharedMemoryFileCount) {
-    // TODO(b/205189110): Use shared memory file count.
+                                           int32_t maxSharedMemoryFileCount) {
     if (callback == nullptr) {
         return ScopedAStatus::fromExceptionCode(EX_NULL_POINTER);
     }
@@ -653,6 +768,18 @@ ScopedAStatus DefaultVehicleHal::subscribe(const CallbackType& callback,
         ALOGE("subscribe: invalid subscribe options: %s", getErrorMsg(result).c_str());
         return toScopedAStatus(result);
     }
+    if (maxSharedMemoryFileCount < 0) {
+        return ScopedAStatus::fromServiceSpecificErrorWithMessage(
+                toInt(StatusCode::INVALID_ARG),
+                StringPrintf("invalid maxSharedMemoryFileCount: %" PRId32 ", must be >= 0",
+                             maxSharedMemoryFileCount)
+                        .c_str());
+    }
+    if (maxSharedMemoryFileCount > IVehicle::MAX_SHARED_MEMORY_FILES_PER_CLIENT) {
+        ALOGW("maxSharedMemoryFileCount: %" PRId32 " out of range, set to %" PRId32,
+              maxSharedMemoryFileCount, IVehicle::MAX_SHARED_MEMORY_FILES_PER_CLIENT);
+        maxSharedMemoryFileCount = IVehicle::MAX_SHARED_MEMORY_FILES_PER_CLIENT;
+    }
     std::vector<SubscribeOptions> onChangeSubscriptions;
     std::vector<SubscribeOptions> continuousSubscriptions;
     for (const auto& option : options) {
@@ -690,7 +817,8 @@ ScopedAStatus DefaultVehicleHal::subscribe(const CallbackType& callback,
         }
 
         // Create a new SubscriptionClient if there isn't an existing one.
-        mSubscriptionClients->maybeAddClient(callback);
+        mSubscriptionClients->maybeAddClient(callback)->setMaxSharedMemoryFileCount(
+                maxSharedMemoryFileCount);
 
         // Since we have already check the sample rates, the following functions must succeed.
         if (!onChangeSubscriptions.empty()) {
@@ -714,8 +842,20 @@ ScopedAStatus DefaultVehicleHal::unsubscribe(const CallbackType& callback,
     return toScopedAStatus(mSubscriptionManager->unsubscribe(callback->asBinder().get(), propIds));
 }
 
-ScopedAStatus DefaultVehicleHal::returnSharedMemory(const CallbackType&, int64_t) {
-    // TODO(b/200737967): implement this.
+ScopedAStatus DefaultVehicleHal::returnSharedMemory(const CallbackType& callback,
+                                                    int64_t sharedMemoryId) {
+    if (callback == nullptr) {
+        return ScopedAStatus::fromExceptionCode(EX_NULL_POINTER);
+    }
+    std::shared_ptr<SubscriptionClient> client = mSubscriptionClients->getClient(callback);
+    if (client == nullptr) {
+        return ScopedAStatus::fromServiceSpecificErrorWithMessage(
+                toInt(StatusCode::INVALID_ARG), "the client has not subscribed to any property");
+    }
+    if (auto result = client->returnSharedMemory(sharedMemoryId); !result.ok()) {
+        ALOGE("returnSharedMemory: %s", getErrorMsg(result).c_str());
+        return toScopedAStatus(result);
+    }
     return ScopedAStatus::ok();
 }
 
@@ -725,14 +865,13 @@ IVehicleHardware* DefaultVehicleHal::getHardware() {
 
 VhalResult<void> DefaultVehicleHal::checkWritePermission(const VehiclePropValue& value) const {
     int32_t propId = value.prop;
-    auto result = getConfig(propId);
-    if (!result.ok()) {
-        return StatusError(StatusCode::INVALID_ARG) << getErrorMsg(result);
+    const PropertyConfigIndex::PropEntry* prop = mConfigIndex.getProp(propId);
+    if (prop == nullptr) {
+        return StatusError(StatusCode::INVALID_ARG) << "no config for property, ID: " << propId;
     }
-    const VehiclePropConfig* config = result.value();
 
-    if (config->access != VehiclePropertyAccess::WRITE &&
-        config->access != VehiclePropertyAccess::READ_WRITE) {
+    if (prop->access != VehiclePropertyAccess::WRITE &&
+        prop->access != VehiclePropertyAccess::READ_WRITE) {
         return StatusError(StatusCode::ACCESS_DENIED)
                << StringPrintf("Property %" PRId32 " has no write access", propId);
     }
@@ -741,14 +880,13 @@ VhalResult<void> DefaultVehicleHal::checkWritePermission(const VehiclePropValue&
 
 VhalResult<void> DefaultVehicleHal::checkReadPermission(const VehiclePropValue& value) const {
     int32_t propId = value.prop;
-    auto result = getConfig(propId);
-    if (!result.ok()) {
-        return StatusError(StatusCode::INVALID_ARG) << getErrorMsg(result);
+    const PropertyConfigIndex::PropEntry* prop = mConfigIndex.getProp(propId);
+    if (prop == nullptr) {
+        return StatusError(StatusCode::INVALID_ARG) << "no config for property, ID: " << propId;
     }
-    const VehiclePropConfig* config = result.value();
 
-    if (config->access != VehiclePropertyAccess::READ &&
-        config->access != VehiclePropertyAccess::READ_WRITE) {
+    if (prop->access != VehiclePropertyAccess::READ &&
+        prop->access != VehiclePropertyAccess::READ_WRITE) {
         return StatusError(StatusCode::ACCESS_DENIED)
                << StringPrintf("Property %" PRId32 " has no read access", propId);
     }
@@ -756,7 +894,9 @@ VhalResult<void> DefaultVehicleHal::checkReadPermission(const VehiclePropValue&
 }
 
 void DefaultVehicleHal::checkHealth(IVehicleHardware* vehicleHardware,
-                                    std::weak_ptr<SubscriptionManager> subscriptionManager) {
+                                    std::weak_ptr<SubscriptionManager> subscriptionManager,
+                                    std::weak_ptr<SubscriptionClients> subscriptionClients,
+                                    std::weak_ptr<PropertyEventDispatcher> propertyEventDispatcher) {
     StatusCode status = vehicleHardware->checkHealth();
     if (status != StatusCode::OK) {
         ALOGE("VHAL check health returns non-okay status");
@@ -768,7 +908,8 @@ void DefaultVehicleHal::checkHealth(IVehicleHardware* vehicleHardware,
             .status = VehiclePropertyStatus::AVAILABLE,
             .value.int64Values = {uptimeMillis()},
     }};
-    onPropertyChangeEvent(subscriptionManager, values);
+    onPropertyChangeEvent(subscriptionManager, subscriptionClients, propertyEventDispatcher,
+                          values);
     return;
 }
 
@@ -822,6 +963,20 @@ binder_status_t DefaultVehicleHal::dump(int fd, const char** args, uint32_t numA
         dprintf(fd, "Currently have %zu subscription clients\n",
                 mSubscriptionClients->countClients());
     }
+    if (mPropertyEventBatcher != nullptr) {
+        dprintf(fd, "Property event batching: %zu batches delivered, %zu events coalesced\n",
+                mPropertyEventBatcher->getBatchCount(), mPropertyEventBatcher->getCoalescedCount());
+    }
+    if (mPropertyEventDispatcher != nullptr) {
+        dprintf(fd, "Property event dispatch queues:\n");
+        for (const auto& [clientId, stats] : mPropertyEventDispatcher->getStats()) {
+            dprintf(fd,
+                    "  client: %p, queue depth: %zu, max queue depth: %zu, dropped: %zu, "
+                    "merged: %zu, overflow: %zu\n",
+                    clientId, stats.queueDepth, stats.maxQueueDepth, stats.droppedCount,
+                    stats.mergedCount, stats.overflowCount);
+        }
+    }
     return STATUS_OK;
 }
 
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PropertyConfigIndex.h"
+
+#include <VehicleUtils.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+using ::aidl::android::hardware::automotive::vehicle::VehicleAreaConfig;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropConfig;
+
+PropertyConfigIndex::PropertyConfigIndex(
+        const std::unordered_map<int32_t, VehiclePropConfig>& configsByPropId) {
+    size_t capacity = 1;
+    uint32_t capacityBits = 0;
+    while (capacity < configsByPropId.size() * LOAD_FACTOR_INVERSE) {
+        capacity <<= 1;
+        capacityBits++;
+    }
+    mSlots.resize(capacity);
+    mMask = capacity - 1;
+    mShift = 32 - capacityBits;
+
+    size_t areaCount = 0;
+    for (const auto& [_, config] : configsByPropId) {
+        areaCount += config.areaConfigs.size();
+    }
+    mAreas.reserve(areaCount);
+
+    for (const auto& [propId, config] : configsByPropId) {
+        size_t slot = getSlot(propId);
+        mSlots[slot] = PropEntry{
+                .propId = propId,
+                .access = config.access,
+                .areaBegin = static_cast<uint32_t>(mAreas.size()),
+                .areaCount = static_cast<uint32_t>(config.areaConfigs.size()),
+                .config = &config,
+        };
+        for (const auto& areaConfig : config.areaConfigs) {
+            mAreas.push_back({areaConfig.areaId, &areaConfig});
+        }
+        mSize++;
+    }
+}
+
+size_t PropertyConfigIndex::getSlot(int32_t propId) const {
+    // Fibonacci hashing: property IDs share most of their high bits and differ in their low bits,
+    // the high bits of the product mix all of them. Shifted as 64 bits since mShift might be 32.
+    uint64_t product = static_cast<uint32_t>(propId) * 0x9E3779B9u;
+    size_t slot = product >> mShift;
+    while (mSlots[slot].config != nullptr && mSlots[slot].propId != propId) {
+        slot = (slot + 1) & mMask;
+    }
+    return slot;
+}
+
+const PropertyConfigIndex::PropEntry* PropertyConfigIndex::getProp(int32_t propId) const {
+    if (mSlots.empty()) {
+        return nullptr;
+    }
+    const PropEntry& entry = mSlots[getSlot(propId)];
+    return entry.config == nullptr ? nullptr : &entry;
+}
+
+const VehicleAreaConfig* PropertyConfigIndex::getAreaConfig(const PropEntry& prop,
+                                                            int32_t areaId) const {
+    if (prop.areaCount == 0) {
+        return nullptr;
+    }
+    if (isGlobalProp(prop.propId)) {
+        return mAreas[prop.areaBegin].second;
+    }
+    for (uint32_t i = prop.areaBegin; i < prop.areaBegin + prop.areaCount; i++) {
+        if (mAreas[i].first == areaId) {
+            return mAreas[i].second;
+        }
+    }
+    return nullptr;
+}
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
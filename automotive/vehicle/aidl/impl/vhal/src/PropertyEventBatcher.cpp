@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_HAL
+
+#include "PropertyEventBatcher.h"
+
+#include <utils/SystemClock.h>
+#include <utils/Trace.h>
+
+#include <chrono>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
+
+}  // namespace
+
+PropertyEventBatcher::PropertyEventBatcher(int64_t windowInNano, size_t maxBatchSize,
+                                           std::unordered_set<int32_t> continuousPropIds,
+                                           FlushCallback callback)
+    : mWindowInNano(windowInNano),
+      mMaxBatchSize(maxBatchSize),
+      mContinuousPropIds(std::move(continuousPropIds)),
+      mCallback(std::move(callback)) {
+    mThread = std::thread([this] { loop(); });
+}
+
+PropertyEventBatcher::~PropertyEventBatcher() {
+    {
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        mStopped = true;
+    }
+    mCond.notify_one();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void PropertyEventBatcher::addValues(const std::vector<VehiclePropValue>& values) {
+    bool shouldNotify = false;
+    {
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        if (mStopped) {
+            return;
+        }
+        if (mPendingValues.empty()) {
+            mBatchDeadlineInNano = uptimeNanos() + mWindowInNano;
+            shouldNotify = true;
+        }
+        for (const auto& value : values) {
+            if (mContinuousPropIds.find(value.prop) != mContinuousPropIds.end()) {
+                PropIdAreaId propIdAreaId{.propId = value.prop, .areaId = value.areaId};
+                auto [it, inserted] =
+                        mPendingIndexByPropIdAreaId.try_emplace(propIdAreaId, mPendingValues.size());
+                if (!inserted) {
+                    mPendingValues[it->second] = value;
+                    mCoalescedCount++;
+                    continue;
+                }
+            }
+            mPendingValues.push_back(value);
+        }
+        if (mPendingValues.size() >= mMaxBatchSize) {
+            shouldNotify = true;
+        }
+    }
+    if (shouldNotify) {
+        mCond.notify_one();
+    }
+}
+
+void PropertyEventBatcher::loop() {
+    std::unique_lock<std::mutex> uniqueLock(mLock);
+    android::base::ScopedLockAssertion lockAssertion(mLock);
+    while (true) {
+        while (mPendingValues.empty() && !mStopped) {
+            mCond.wait(uniqueLock);
+        }
+        if (mPendingValues.empty() && mStopped) {
+            return;
+        }
+        // Wait until the batch window ends or the batch is full.
+        while (!mStopped && mPendingValues.size() < mMaxBatchSize) {
+            int64_t waitInNano = mBatchDeadlineInNano - uptimeNanos();
+            if (waitInNano <= 0) {
+                break;
+            }
+            mCond.wait_for(uniqueLock, std::chrono::nanoseconds(waitInNano));
+        }
+
+        std::vector<VehiclePropValue> values = std::move(mPendingValues);
+        mPendingValues.clear();
+        mPendingIndexByPropIdAreaId.clear();
+        mBatchCount++;
+
+        uniqueLock.unlock();
+        {
+            ATRACE_NAME("PropertyEventBatcher::flush");
+            mCallback(std::move(values));
+        }
+        uniqueLock.lock();
+    }
+}
+
+size_t PropertyEventBatcher::getCoalescedCount() const {
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+    return mCoalescedCount;
+}
+
+size_t PropertyEventBatcher::getBatchCount() const {
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+    return mBatchCount;
+}
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "PropertyEventDispatcher"
+#define ATRACE_TAG ATRACE_TAG_HAL
+
+#include "PropertyEventDispatcher.h"
+
+#include <utils/Log.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
+
+}  // namespace
+
+PropertyEventDispatcher::PropertyEventDispatcher(size_t threadCount, size_t maxQueueSizePerClient,
+                                                 std::unordered_set<int32_t> continuousPropIds,
+                                                 SendFunction sendFunc)
+    : mMaxQueueSizePerClient(std::max(maxQueueSizePerClient, static_cast<size_t>(1))),
+      mContinuousPropIds(std::move(continuousPropIds)),
+      mSendFunc(std::move(sendFunc)) {
+    for (size_t i = 0; i < threadCount; i++) {
+        mThreads.push_back(std::thread([this] { loop(); }));
+    }
+}
+
+PropertyEventDispatcher::~PropertyEventDispatcher() {
+    {
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        mStopped = true;
+    }
+    mCond.notify_all();
+    for (auto& thread : mThreads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+void PropertyEventDispatcher::dispatch(const CallbackType& callback,
+                                       std::vector<VehiclePropValue>&& values) {
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+    if (mStopped) {
+        return;
+    }
+    const AIBinder* clientId = callback->asBinder().get();
+    std::shared_ptr<ClientQueue> queue = mQueueByClient[clientId];
+    if (queue == nullptr) {
+        queue = std::make_shared<ClientQueue>();
+        queue->callback = callback;
+        mQueueByClient[clientId] = queue;
+    }
+    for (auto& value : values) {
+        enqueueLocked(queue.get(), std::move(value));
+    }
+    scheduleLocked(queue);
+}
+
+void PropertyEventDispatcher::scheduleLocked(const std::shared_ptr<ClientQueue>& queue) {
+    if (queue->scheduled || queue->pendingValues.empty()) {
+        return;
+    }
+    queue->scheduled = true;
+    mReadyQueues.push_back(queue);
+    mCond.notify_one();
+}
+
+void PropertyEventDispatcher::enqueueLocked(ClientQueue* queue, VehiclePropValue&& value) {
+    bool continuous = isContinuous(value.prop);
+    bool full = queue->pendingValues.size() >= mMaxQueueSizePerClient;
+    // Intermediate on-change values are only given up when the client is lagging behind.
+    if ((continuous || full) && replaceLocked(queue, &value)) {
+        if (continuous) {
+            queue->stats.mergedCount++;
+        } else {
+            queue->stats.droppedCount++;
+        }
+        return;
+    }
+    if (full && !evictContinuousLocked(queue)) {
+        if (queue->stats.overflowCount == 0) {
+            ALOGW("event queue for client: %p is full of on-change events, queueing past the max "
+                  "size",
+                  queue->callback->asBinder().get());
+        }
+        queue->stats.overflowCount++;
+    }
+
+    uint64_t seq = queue->frontSeq + queue->pendingValues.size();
+    PropIdAreaId propIdAreaId{.propId = value.prop, .areaId = value.areaId};
+    queue->pendingSeqByPropIdAreaId[propIdAreaId] = seq;
+    queue->pendingValues.push_back(std::move(value));
+    queue->stats.maxQueueDepth = std::max(queue->stats.maxQueueDepth, queue->pendingValues.size());
+}
+
+bool PropertyEventDispatcher::replaceLocked(ClientQueue* queue, VehiclePropValue* value) {
+    auto it = queue->pendingSeqByPropIdAreaId.find(
+            PropIdAreaId{.propId = value->prop, .areaId = value->areaId});
+    if (it == queue->pendingSeqByPropIdAreaId.end()) {
+        return false;
+    }
+    queue->pendingValues[it->second - queue->frontSeq] = std::move(*value);
+    return true;
+}
+
+bool PropertyEventDispatcher::evictContinuousLocked(ClientQueue* queue) {
+    for (size_t i = 0; i < queue->pendingValues.size(); i++) {
+        if (isContinuous(queue->pendingValues[i].prop)) {
+            eraseLocked(queue, i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void PropertyEventDispatcher::eraseLocked(ClientQueue* queue, size_t index) {
+    uint64_t erasedSeq = queue->frontSeq + index;
+    for (auto it = queue->pendingSeqByPropIdAreaId.begin();
+         it != queue->pendingSeqByPropIdAreaId.end();) {
+        if (it->second == erasedSeq) {
+            it = queue->pendingSeqByPropIdAreaId.erase(it);
+            continue;
+        }
+        // The events after the erased one move forward by one.
+        if (it->second > erasedSeq) {
+            it->second--;
+        }
+        it++;
+    }
+    queue->pendingValues.erase(queue->pendingValues.begin() + index);
+    queue->stats.droppedCount++;
+}
+
+void PropertyEventDispatcher::removeClient(const AIBinder* clientId) {
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+    auto it = mQueueByClient.find(clientId);
+    if (it == mQueueByClient.end()) {
+        return;
+    }
+    // The queue might still be referenced by mReadyQueues or a dispatch thread, it would be
+    // skipped there.
+    it->second->removed = true;
+    it->second->pendingValues.clear();
+    it->second->pendingSeqByPropIdAreaId.clear();
+    mQueueByClient.erase(it);
+}
+
+std::unordered_map<const AIBinder*, PropertyEventDispatcher::ClientStats>
+PropertyEventDispatcher::getStats() const {
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+    std::unordered_map<const AIBinder*, ClientStats> statsByClient;
+    for (const auto& [clientId, queue] : mQueueByClient) {
+        ClientStats stats = queue->stats;
+        stats.queueDepth = queue->pendingValues.size();
+        statsByClient[clientId] = stats;
+    }
+    return statsByClient;
+}
+
+void PropertyEventDispatcher::loop() {
+    std::unique_lock<std::mutex> uniqueLock(mLock);
+    android::base::ScopedLockAssertion lockAssertion(mLock);
+    while (true) {
+        while (mReadyQueues.empty() && !mStopped) {
+            mCond.wait(uniqueLock);
+        }
+        if (mStopped) {
+            return;
+        }
+        std::shared_ptr<ClientQueue> queue = std::move(mReadyQueues.front());
+        mReadyQueues.pop_front();
+        if (queue->removed) {
+            continue;
+        }
+
+        std::vector<VehiclePropValue> values(std::make_move_iterator(queue->pendingValues.begin()),
+                                             std::make_move_iterator(queue->pendingValues.end()));
+        queue->frontSeq += queue->pendingValues.size();
+        queue->pendingValues.clear();
+        queue->pendingSeqByPropIdAreaId.clear();
+
+        uniqueLock.unlock();
+        {
+            ATRACE_NAME("PropertyEventDispatcher::send");
+            mSendFunc(queue->callback, std::move(values));
+        }
+        uniqueLock.lock();
+
+        // More events might have arrived while sending, the queue stays scheduled so that no other
+        // thread delivers them out of order.
+        if (!queue->removed && !queue->pendingValues.empty()) {
+            mReadyQueues.push_back(std::move(queue));
+        } else {
+            queue->scheduled = false;
+        }
+    }
+}
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
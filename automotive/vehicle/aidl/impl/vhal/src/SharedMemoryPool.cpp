@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SharedMemoryPool.h"
+
+#include <aidl/android/hardware/automotive/vehicle/IVehicle.h>
+
+#include <unistd.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+namespace {
+
+using ::aidl::android::hardware::automotive::vehicle::IVehicle;
+using ::aidl::android::hardware::automotive::vehicle::StatusCode;
+
+}  // namespace
+
+SharedMemoryPool::SharedMemoryPool(int32_t maxFileCount)
+    : mMaxFileCount(maxFileCount), mNextId(IVehicle::INVALID_MEMORY_ID + 1) {}
+
+void SharedMemoryPool::setMaxFileCount(int32_t maxFileCount) {
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+    mMaxFileCount = maxFileCount;
+}
+
+std::optional<int64_t> SharedMemoryPool::reserve() {
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+    if (mMaxFileCount == 0) {
+        // Files are not tracked, the client does not need to return them.
+        return IVehicle::INVALID_MEMORY_ID;
+    }
+    if (static_cast<int32_t>(mOutstandingFiles.size()) + mReservedCount >= mMaxFileCount) {
+        return std::nullopt;
+    }
+    mReservedCount++;
+    int64_t id = mNextId++;
+    if (mNextId == IVehicle::INVALID_MEMORY_ID) {
+        mNextId++;
+    }
+    return id;
+}
+
+void SharedMemoryPool::commit(int64_t sharedMemoryId, const ndk::ScopedFileDescriptor& fd) {
+    if (sharedMemoryId == IVehicle::INVALID_MEMORY_ID) {
+        return;
+    }
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+    mReservedCount--;
+    // Keep our own reference, the one passed in is owned by the parcelable sent to the client.
+    mOutstandingFiles[sharedMemoryId] = ndk::ScopedFileDescriptor(dup(fd.get()));
+}
+
+void SharedMemoryPool::cancel(int64_t sharedMemoryId) {
+    if (sharedMemoryId == IVehicle::INVALID_MEMORY_ID) {
+        return;
+    }
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+    mReservedCount--;
+}
+
+VhalResult<void> SharedMemoryPool::returnFile(int64_t sharedMemoryId) {
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+    if (mOutstandingFiles.erase(sharedMemoryId) == 0) {
+        return StatusError(StatusCode::INVALID_ARG)
+               << "no outstanding shared memory file with ID: " << sharedMemoryId;
+    }
+    return {};
+}
+
+int32_t SharedMemoryPool::getFileCount() const {
+    std::scoped_lock<std::mutex> lockGuard(mLock);
+    return static_cast<int32_t>(mOutstandingFiles.size()) + mReservedCount;
+}
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -19,13 +19,27 @@
 #include <DefaultVehicleHal.h>
 #include <FakeVehicleHardware.h>
 
+#include <android-base/properties.h>
 #include <android/binder_manager.h>
 #include <android/binder_process.h>
 #include <utils/Log.h>
 
+using ::android::base::GetIntProperty;
+using ::android::base::GetUintProperty;
 using ::android::hardware::automotive::vehicle::DefaultVehicleHal;
 using ::android::hardware::automotive::vehicle::fake::FakeVehicleHardware;
 
+// The window in milliseconds to batch property change events for, 0 disables batching.
+constexpr char EVENT_BATCHING_WINDOW_MS_PROPERTY[] = "ro.vendor.vhal.event_batching_window_ms";
+// The max number of property change events in one batch.
+constexpr char EVENT_BATCHING_MAX_SIZE_PROPERTY[] = "ro.vendor.vhal.event_batching_max_size";
+// The number of threads to send property change events to clients, 0 sends them synchronously.
+// Events are sent synchronously unless the property is set.
+constexpr char EVENT_DISPATCH_THREAD_COUNT_PROPERTY[] =
+        "ro.vendor.vhal.event_dispatch_thread_count";
+// The max number of pending property change events for one client, must be larger than 0.
+constexpr char EVENT_QUEUE_MAX_SIZE_PROPERTY[] = "ro.vendor.vhal.event_queue_max_size";
+
 int main(int /* argc */, char* /* argv */[]) {
     ALOGI("Starting thread pool...");
     if (!ABinderProcess_setThreadPoolMaxThreadCount(4)) {
@@ -35,8 +49,25 @@ int main(int /* argc */, char* /* argv */[]) {
     ABinderProcess_startThreadPool();
 
     std::unique_ptr<FakeVehicleHardware> hardware = std::make_unique<FakeVehicleHardware>();
-    std::shared_ptr<DefaultVehicleHal> vhal =
-            ::ndk::SharedRefBase::make<DefaultVehicleHal>(std::move(hardware));
+    int64_t eventBatchingWindowInNano =
+            GetIntProperty<int64_t>(EVENT_BATCHING_WINDOW_MS_PROPERTY, /*default_value=*/0,
+                                    /*min=*/0) *
+            1'000'000;
+    size_t maxEventBatchSize = GetUintProperty<size_t>(
+            EVENT_BATCHING_MAX_SIZE_PROPERTY, DefaultVehicleHal::DEFAULT_MAX_EVENT_BATCH_SIZE);
+    size_t eventDispatchThreadCount = GetUintProperty<size_t>(
+            EVENT_DISPATCH_THREAD_COUNT_PROPERTY, /*default_value=*/0);
+    size_t maxEventQueueSizePerClient =
+            GetUintProperty<size_t>(EVENT_QUEUE_MAX_SIZE_PROPERTY,
+                                    DefaultVehicleHal::DEFAULT_MAX_EVENT_QUEUE_SIZE_PER_CLIENT);
+    if (maxEventQueueSizePerClient == 0) {
+        ALOGW("%s must be larger than 0, using the default: %zu", EVENT_QUEUE_MAX_SIZE_PROPERTY,
+              DefaultVehicleHal::DEFAULT_MAX_EVENT_QUEUE_SIZE_PER_CLIENT);
+        maxEventQueueSizePerClient = DefaultVehicleHal::DEFAULT_MAX_EVENT_QUEUE_SIZE_PER_CLIENT;
+    }
+    std::shared_ptr<DefaultVehicleHal> vhal = ::ndk::SharedRefBase::make<DefaultVehicleHal>(
+            std::move(hardware), eventBatchingWindowInNano, maxEventBatchSize,
+            eventDispatchThreadCount, maxEventQueueSizePerClient);
 
     ALOGI("Registering as service...");
     binder_exception_t err = AServiceManager_addService(
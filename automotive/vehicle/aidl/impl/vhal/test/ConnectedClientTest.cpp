@@ -17,6 +17,7 @@
 #include "ConnectedClient.h"
 #include "MockVehicleCallback.h"
 
+#include <aidl/android/hardware/automotive/vehicle/IVehicle.h>
 #include <aidl/android/hardware/automotive/vehicle/IVehicleCallback.h>
 
 #include <gtest/gtest.h>
@@ -28,11 +29,13 @@ namespace vehicle {
 
 using ::aidl::android::hardware::automotive::vehicle::GetValueResult;
 using ::aidl::android::hardware::automotive::vehicle::GetValueResults;
+using ::aidl::android::hardware::automotive::vehicle::IVehicle;
 using ::aidl::android::hardware::automotive::vehicle::IVehicleCallback;
 using ::aidl::android::hardware::automotive::vehicle::SetValueResult;
 using ::aidl::android::hardware::automotive::vehicle::SetValueResults;
 using ::aidl::android::hardware::automotive::vehicle::StatusCode;
 using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropValues;
 
 class ConnectedClientTest : public testing::Test {
   public:
@@ -214,6 +217,84 @@ TEST_F(ConnectedClientTest, testSetValuesGetResultCallback) {
     ASSERT_EQ(maybeSetValueResults.value().payloads, results);
 }
 
+namespace {
+
+std::vector<VehiclePropValue> getLargeUpdatedValues() {
+    std::vector<VehiclePropValue> values;
+    for (int32_t i = 0; i < 5000; i++) {
+        values.push_back({
+                .prop = i,
+                .value.int32Values = {i},
+        });
+    }
+    return values;
+}
+
+}  // namespace
+
+TEST_F(ConnectedClientTest, testSendUpdatedValuesSmall) {
+    std::vector<VehiclePropValue> values = {{
+            .prop = 0,
+    }};
+    SubscriptionClient client(getPool(), getCallbackClient());
+    client.setMaxSharedMemoryFileCount(1);
+
+    auto valuesCopy = values;
+    client.sendUpdatedValues(std::move(valuesCopy));
+
+    auto maybeResults = getCallback()->nextOnPropertyEventResults();
+    ASSERT_TRUE(maybeResults.has_value());
+    ASSERT_EQ(maybeResults.value().payloads, values);
+    ASSERT_EQ(maybeResults.value().sharedMemoryId, IVehicle::INVALID_MEMORY_ID);
+}
+
+TEST_F(ConnectedClientTest, testSendUpdatedValuesLargeUntilPoolFull) {
+    std::vector<VehiclePropValue> values = getLargeUpdatedValues();
+    SubscriptionClient client(getPool(), getCallbackClient());
+    client.setMaxSharedMemoryFileCount(1);
+
+    auto valuesCopy = values;
+    client.sendUpdatedValues(std::move(valuesCopy));
+
+    auto maybeResults = getCallback()->nextOnPropertyEventResults();
+    ASSERT_TRUE(maybeResults.has_value());
+    ASSERT_TRUE(maybeResults.value().payloads.empty())
+            << "payload should be empty, shared memory file should be used";
+    int64_t sharedMemoryId = maybeResults.value().sharedMemoryId;
+    ASSERT_NE(sharedMemoryId, IVehicle::INVALID_MEMORY_ID);
+
+    // The only shared memory file is not returned, values must be sent in the parcel, in chunks
+    // of several values.
+    valuesCopy = values;
+    client.sendUpdatedValues(std::move(valuesCopy));
+
+    size_t chunkCount = getCallback()->countOnPropertyEventResults();
+    ASSERT_GT(chunkCount, 1u);
+    ASSERT_LT(chunkCount, values.size() / 10);
+    std::vector<VehiclePropValue> gotValues;
+    for (size_t i = 0; i < chunkCount; i++) {
+        maybeResults = getCallback()->nextOnPropertyEventResults();
+        ASSERT_TRUE(maybeResults.has_value());
+        ASSERT_EQ(maybeResults.value().sharedMemoryId, IVehicle::INVALID_MEMORY_ID);
+        ASSERT_FALSE(maybeResults.value().payloads.empty())
+                << "each chunk must fit into the parcel";
+        gotValues.insert(gotValues.end(), maybeResults.value().payloads.begin(),
+                         maybeResults.value().payloads.end());
+    }
+    ASSERT_EQ(gotValues, values);
+
+    ASSERT_TRUE(client.returnSharedMemory(sharedMemoryId).ok());
+
+    // After returning the file, shared memory must be used again.
+    valuesCopy = values;
+    client.sendUpdatedValues(std::move(valuesCopy));
+
+    maybeResults = getCallback()->nextOnPropertyEventResults();
+    ASSERT_TRUE(maybeResults.has_value());
+    ASSERT_TRUE(maybeResults.value().payloads.empty());
+    ASSERT_NE(maybeResults.value().sharedMemoryId, IVehicle::INVALID_MEMORY_ID);
+}
+
 }  // namespace vehicle
 }  // namespace automotive
 }  // namespace hardware
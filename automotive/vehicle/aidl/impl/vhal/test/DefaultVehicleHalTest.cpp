@@ -1517,6 +1517,39 @@ TEST_F(DefaultVehicleHalTest, testUnsubscribeFailure) {
     ASSERT_EQ(status.getServiceSpecificError(), toInt(StatusCode::INVALID_ARG));
 }
 
+TEST_F(DefaultVehicleHalTest, testSubscribeInvalidSharedMemoryFileCount) {
+    std::vector<SubscribeOptions> options = {{
+            .propId = GLOBAL_ON_CHANGE_PROP,
+    }};
+
+    auto status = getClient()->subscribe(getCallbackClient(), options, -1);
+
+    ASSERT_FALSE(status.isOk()) << "subscribe with negative maxSharedMemoryFileCount must fail";
+    ASSERT_EQ(status.getServiceSpecificError(), toInt(StatusCode::INVALID_ARG));
+}
+
+TEST_F(DefaultVehicleHalTest, testReturnSharedMemoryNotSubscribed) {
+    auto status = getClient()->returnSharedMemory(getCallbackClient(), 1);
+
+    ASSERT_FALSE(status.isOk()) << "returnSharedMemory from a not-subscribed client must fail";
+    ASSERT_EQ(status.getServiceSpecificError(), toInt(StatusCode::INVALID_ARG));
+}
+
+TEST_F(DefaultVehicleHalTest, testReturnSharedMemoryUnknownId) {
+    std::vector<SubscribeOptions> options = {{
+            .propId = GLOBAL_ON_CHANGE_PROP,
+    }};
+
+    auto status = getClient()->subscribe(getCallbackClient(), options, 2);
+
+    ASSERT_TRUE(status.isOk()) << "subscribe failed: " << status.getMessage();
+
+    status = getClient()->returnSharedMemory(getCallbackClient(), 1234);
+
+    ASSERT_FALSE(status.isOk()) << "returnSharedMemory with an unknown ID must fail";
+    ASSERT_EQ(status.getServiceSpecificError(), toInt(StatusCode::INVALID_ARG));
+}
+
 TEST_F(DefaultVehicleHalTest, testHeartbeatEvent) {
     std::vector<SubscribeOptions> options = {{
             .propId = toInt(VehicleProperty::VHAL_HEARTBEAT),
@@ -76,6 +76,7 @@ ScopedAStatus MockVehicleCallback::onPropertyEvent(const VehiclePropValues& resu
         std::scoped_lock<std::mutex> lockGuard(mLock);
         mSharedMemoryFileCount = sharedMemoryFileCount;
         result = storeResults(results, &mOnPropertyEventResults);
+        mOnPropertyEventResults.back().sharedMemoryId = results.sharedMemoryId;
     }
     mCond.notify_all();
     return result;
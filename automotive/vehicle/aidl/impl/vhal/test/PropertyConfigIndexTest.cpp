@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PropertyConfigIndex.h"
+
+#include <VehicleHalTypes.h>
+#include <VehicleUtils.h>
+
+#include <gtest/gtest.h>
+
+#include <unordered_map>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+using ::aidl::android::hardware::automotive::vehicle::VehicleArea;
+using ::aidl::android::hardware::automotive::vehicle::VehicleAreaSeat;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropConfig;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyAccess;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyGroup;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropertyType;
+
+constexpr int32_t GLOBAL_PROP = 0x1 | toInt(VehiclePropertyGroup::VENDOR) |
+                                toInt(VehicleArea::GLOBAL) | toInt(VehiclePropertyType::INT32);
+constexpr int32_t SEAT_PROP = 0x2 | toInt(VehiclePropertyGroup::VENDOR) |
+                              toInt(VehicleArea::SEAT) | toInt(VehiclePropertyType::INT32);
+constexpr int32_t ROW_1_LEFT = toInt(VehicleAreaSeat::ROW_1_LEFT);
+constexpr int32_t ROW_1_RIGHT = toInt(VehicleAreaSeat::ROW_1_RIGHT);
+constexpr int32_t ROW_2_LEFT = toInt(VehicleAreaSeat::ROW_2_LEFT);
+
+class PropertyConfigIndexTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mConfigsByPropId[GLOBAL_PROP] = VehiclePropConfig{
+                .prop = GLOBAL_PROP,
+                .access = VehiclePropertyAccess::READ,
+                .areaConfigs = {{.areaId = 0, .minInt32Value = 0, .maxInt32Value = 10}},
+        };
+        mConfigsByPropId[SEAT_PROP] = VehiclePropConfig{
+                .prop = SEAT_PROP,
+                .access = VehiclePropertyAccess::READ_WRITE,
+                .areaConfigs = {{.areaId = ROW_1_LEFT, .minInt32Value = 0},
+                                {.areaId = ROW_1_RIGHT, .minInt32Value = 1}},
+        };
+    }
+
+    std::unordered_map<int32_t, VehiclePropConfig> mConfigsByPropId;
+};
+
+TEST_F(PropertyConfigIndexTest, testGetProp) {
+    PropertyConfigIndex index(mConfigsByPropId);
+
+    ASSERT_EQ(index.size(), 2u);
+    for (const auto& [propId, config] : mConfigsByPropId) {
+        const PropertyConfigIndex::PropEntry* prop = index.getProp(propId);
+
+        ASSERT_NE(prop, nullptr);
+        EXPECT_EQ(prop->propId, propId);
+        EXPECT_EQ(prop->access, config.access);
+        EXPECT_EQ(prop->config, &config);
+    }
+}
+
+TEST_F(PropertyConfigIndexTest, testGetPropUnknown) {
+    PropertyConfigIndex index(mConfigsByPropId);
+
+    EXPECT_EQ(index.getProp(0), nullptr);
+    EXPECT_EQ(index.getProp(GLOBAL_PROP + 0x10), nullptr);
+}
+
+TEST_F(PropertyConfigIndexTest, testGetPropEmptyIndex) {
+    PropertyConfigIndex index;
+
+    EXPECT_EQ(index.size(), 0u);
+    EXPECT_EQ(index.getProp(GLOBAL_PROP), nullptr);
+}
+
+TEST_F(PropertyConfigIndexTest, testGetAreaConfig) {
+    PropertyConfigIndex index(mConfigsByPropId);
+    const PropertyConfigIndex::PropEntry* prop = index.getProp(SEAT_PROP);
+    ASSERT_NE(prop, nullptr);
+
+    EXPECT_EQ(index.getAreaConfig(*prop, ROW_1_LEFT),
+              &mConfigsByPropId[SEAT_PROP].areaConfigs[0]);
+    EXPECT_EQ(index.getAreaConfig(*prop, ROW_1_RIGHT),
+              &mConfigsByPropId[SEAT_PROP].areaConfigs[1]);
+    EXPECT_EQ(index.getAreaConfig(*prop, ROW_2_LEFT), nullptr);
+}
+
+TEST_F(PropertyConfigIndexTest, testGetAreaConfigGlobalProp) {
+    PropertyConfigIndex index(mConfigsByPropId);
+    const PropertyConfigIndex::PropEntry* prop = index.getProp(GLOBAL_PROP);
+    ASSERT_NE(prop, nullptr);
+
+    // The area ID is ignored for global properties, the same as getAreaConfig in VehicleUtils.
+    EXPECT_EQ(index.getAreaConfig(*prop, 0), &mConfigsByPropId[GLOBAL_PROP].areaConfigs[0]);
+    EXPECT_EQ(index.getAreaConfig(*prop, 1), &mConfigsByPropId[GLOBAL_PROP].areaConfigs[0]);
+}
+
+TEST_F(PropertyConfigIndexTest, testManyProps) {
+    mConfigsByPropId.clear();
+    for (int32_t i = 0; i < 1000; i++) {
+        int32_t propId = GLOBAL_PROP + i;
+        mConfigsByPropId[propId] = VehiclePropConfig{.prop = propId};
+    }
+
+    PropertyConfigIndex index(mConfigsByPropId);
+
+    ASSERT_EQ(index.size(), 1000u);
+    for (const auto& [propId, config] : mConfigsByPropId) {
+        const PropertyConfigIndex::PropEntry* prop = index.getProp(propId);
+        ASSERT_NE(prop, nullptr) << "missing property: " << propId;
+        EXPECT_EQ(prop->config, &config);
+        EXPECT_EQ(index.getAreaConfig(*prop, 0), nullptr);
+    }
+    EXPECT_EQ(index.getProp(GLOBAL_PROP + 1000), nullptr);
+}
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PropertyEventBatcher.h"
+
+#include <android-base/thread_annotations.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
+
+// VehiclePropertyGroup:SYSTEM,VehicleArea:GLOBAL,VehiclePropertyType:INT32
+constexpr int32_t CONTINUOUS_PROP = 10001 + 0x10000000 + 0x01000000 + 0x00400000;
+// VehiclePropertyGroup:SYSTEM,VehicleArea:GLOBAL,VehiclePropertyType:INT32
+constexpr int32_t ON_CHANGE_PROP = 10002 + 0x10000000 + 0x01000000 + 0x00400000;
+// 1 hour, long enough that the window never ends during a test.
+constexpr int64_t LONG_WINDOW_IN_NANO = 3'600'000'000'000;
+
+class PropertyEventBatcherTest : public testing::Test {
+  public:
+    std::unique_ptr<PropertyEventBatcher> createBatcher(int64_t windowInNano,
+                                                        size_t maxBatchSize) {
+        return std::make_unique<PropertyEventBatcher>(
+                windowInNano, maxBatchSize, std::unordered_set<int32_t>({CONTINUOUS_PROP}),
+                [this](std::vector<VehiclePropValue> values) {
+                    {
+                        std::scoped_lock<std::mutex> lockGuard(mLock);
+                        mBatches.push_back(std::move(values));
+                    }
+                    mCond.notify_all();
+                });
+    }
+
+    bool waitForBatches(size_t count) {
+        std::unique_lock<std::mutex> uniqueLock(mLock);
+        return mCond.wait_for(uniqueLock, std::chrono::seconds(5), [this, count] {
+            android::base::ScopedLockAssertion lockAssertion(mLock);
+            return mBatches.size() >= count;
+        });
+    }
+
+    std::vector<std::vector<VehiclePropValue>> getBatches() {
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        return mBatches;
+    }
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::vector<std::vector<VehiclePropValue>> mBatches GUARDED_BY(mLock);
+};
+
+TEST_F(PropertyEventBatcherTest, testBatchOnWindowEnd) {
+    auto batcher = createBatcher(/*windowInNano=*/10'000'000, /*maxBatchSize=*/100);
+    VehiclePropValue value1 = {
+            .prop = ON_CHANGE_PROP,
+            .value.int32Values = {1},
+    };
+    VehiclePropValue value2 = {
+            .prop = ON_CHANGE_PROP,
+            .value.int32Values = {2},
+    };
+
+    batcher->addValues({value1});
+    batcher->addValues({value2});
+
+    ASSERT_TRUE(waitForBatches(1));
+    ASSERT_EQ(getBatches()[0], std::vector<VehiclePropValue>({value1, value2}))
+            << "on-change events must not be coalesced";
+}
+
+TEST_F(PropertyEventBatcherTest, testCoalesceContinuousProperty) {
+    auto batcher = createBatcher(LONG_WINDOW_IN_NANO, /*maxBatchSize=*/100);
+    VehiclePropValue onChangeValue = {
+            .prop = ON_CHANGE_PROP,
+            .value.int32Values = {1},
+    };
+    VehiclePropValue continuousValue1 = {
+            .timestamp = 1,
+            .prop = CONTINUOUS_PROP,
+            .value.int32Values = {1},
+    };
+    VehiclePropValue continuousValue2 = {
+            .timestamp = 2,
+            .prop = CONTINUOUS_PROP,
+            .value.int32Values = {2},
+    };
+
+    batcher->addValues({continuousValue1, onChangeValue});
+    batcher->addValues({continuousValue2});
+    // Destroying the batcher flushes the pending events.
+    batcher.reset();
+
+    auto batches = getBatches();
+    ASSERT_EQ(batches.size(), static_cast<size_t>(1));
+    ASSERT_EQ(batches[0], std::vector<VehiclePropValue>({continuousValue2, onChangeValue}));
+}
+
+TEST_F(PropertyEventBatcherTest, testBatchOnMaxSize) {
+    auto batcher = createBatcher(LONG_WINDOW_IN_NANO, /*maxBatchSize=*/2);
+    VehiclePropValue value1 = {
+            .prop = ON_CHANGE_PROP,
+            .value.int32Values = {1},
+    };
+    VehiclePropValue value2 = {
+            .prop = ON_CHANGE_PROP,
+            .value.int32Values = {2},
+    };
+
+    batcher->addValues({value1});
+    batcher->addValues({value2});
+
+    ASSERT_TRUE(waitForBatches(1)) << "full batch must be delivered before the window ends";
+    ASSERT_EQ(getBatches()[0], std::vector<VehiclePropValue>({value1, value2}));
+}
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
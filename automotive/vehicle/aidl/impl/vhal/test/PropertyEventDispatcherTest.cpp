@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MockVehicleCallback.h"
+#include "PropertyEventDispatcher.h"
+
+#include <android-base/thread_annotations.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+using ::aidl::android::hardware::automotive::vehicle::IVehicleCallback;
+using ::aidl::android::hardware::automotive::vehicle::VehiclePropValue;
+
+// VehiclePropertyGroup:SYSTEM,VehicleArea:GLOBAL,VehiclePropertyType:INT32
+constexpr int32_t CONTINUOUS_PROP = 10001 + 0x10000000 + 0x01000000 + 0x00400000;
+// VehiclePropertyGroup:SYSTEM,VehicleArea:GLOBAL,VehiclePropertyType:INT32
+constexpr int32_t ON_CHANGE_PROP = 10002 + 0x10000000 + 0x01000000 + 0x00400000;
+// VehiclePropertyGroup:SYSTEM,VehicleArea:GLOBAL,VehiclePropertyType:INT32
+constexpr int32_t ON_CHANGE_PROP_2 = 10003 + 0x10000000 + 0x01000000 + 0x00400000;
+// VehiclePropertyGroup:SYSTEM,VehicleArea:GLOBAL,VehiclePropertyType:INT32
+constexpr int32_t ON_CHANGE_PROP_3 = 10004 + 0x10000000 + 0x01000000 + 0x00400000;
+
+class PropertyEventDispatcherTest : public testing::Test {
+  public:
+    void SetUp() override {
+        mCallback1 = ndk::SharedRefBase::make<MockVehicleCallback>();
+        mCallback2 = ndk::SharedRefBase::make<MockVehicleCallback>();
+    }
+
+    std::unique_ptr<PropertyEventDispatcher> createDispatcher(size_t threadCount,
+                                                              size_t maxQueueSizePerClient) {
+        return std::make_unique<PropertyEventDispatcher>(
+                threadCount, maxQueueSizePerClient,
+                std::unordered_set<int32_t>({CONTINUOUS_PROP}),
+                [this](const std::shared_ptr<IVehicleCallback>& callback,
+                       std::vector<VehiclePropValue>&& values) {
+                    std::unique_lock<std::mutex> uniqueLock(mLock);
+                    android::base::ScopedLockAssertion lockAssertion(mLock);
+                    const AIBinder* clientId = callback->asBinder().get();
+                    mSendStarted.insert(clientId);
+                    mCond.notify_all();
+                    // Simulates a slow client until it is unblocked.
+                    mCond.wait(uniqueLock, [this, clientId] {
+                        android::base::ScopedLockAssertion lockAssertion(mLock);
+                        return mBlockedClients.find(clientId) == mBlockedClients.end();
+                    });
+                    auto& received = mReceivedValues[clientId];
+                    received.insert(received.end(), values.begin(), values.end());
+                    mCond.notify_all();
+                });
+    }
+
+    void blockClient(const std::shared_ptr<IVehicleCallback>& callback) {
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        mBlockedClients.insert(callback->asBinder().get());
+    }
+
+    void unblockClient(const std::shared_ptr<IVehicleCallback>& callback) {
+        {
+            std::scoped_lock<std::mutex> lockGuard(mLock);
+            mBlockedClients.erase(callback->asBinder().get());
+        }
+        mCond.notify_all();
+    }
+
+    bool waitForSendStarted(const std::shared_ptr<IVehicleCallback>& callback) {
+        const AIBinder* clientId = callback->asBinder().get();
+        std::unique_lock<std::mutex> uniqueLock(mLock);
+        return mCond.wait_for(uniqueLock, std::chrono::seconds(5), [this, clientId] {
+            android::base::ScopedLockAssertion lockAssertion(mLock);
+            return mSendStarted.find(clientId) != mSendStarted.end();
+        });
+    }
+
+    bool waitForValues(const std::shared_ptr<IVehicleCallback>& callback, size_t count) {
+        const AIBinder* clientId = callback->asBinder().get();
+        std::unique_lock<std::mutex> uniqueLock(mLock);
+        return mCond.wait_for(uniqueLock, std::chrono::seconds(5), [this, clientId, count] {
+            android::base::ScopedLockAssertion lockAssertion(mLock);
+            return mReceivedValues[clientId].size() >= count;
+        });
+    }
+
+    std::vector<VehiclePropValue> getReceivedValues(
+            const std::shared_ptr<IVehicleCallback>& callback) {
+        std::scoped_lock<std::mutex> lockGuard(mLock);
+        return mReceivedValues[callback->asBinder().get()];
+    }
+
+  protected:
+    std::shared_ptr<IVehicleCallback> mCallback1;
+    std::shared_ptr<IVehicleCallback> mCallback2;
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::unordered_set<const AIBinder*> mBlockedClients GUARDED_BY(mLock);
+    std::unordered_set<const AIBinder*> mSendStarted GUARDED_BY(mLock);
+    std::unordered_map<const AIBinder*, std::vector<VehiclePropValue>> mReceivedValues
+            GUARDED_BY(mLock);
+};
+
+VehiclePropValue createValue(int32_t propId, int32_t value) {
+    return {
+            .prop = propId,
+            .value.int32Values = {value},
+    };
+}
+
+TEST_F(PropertyEventDispatcherTest, testDispatchInOrder) {
+    auto dispatcher = createDispatcher(/*threadCount=*/4, /*maxQueueSizePerClient=*/100);
+    std::vector<VehiclePropValue> expectedValues;
+
+    for (int32_t i = 0; i < 10; i++) {
+        expectedValues.push_back(createValue(ON_CHANGE_PROP, i));
+        dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, i)});
+    }
+
+    ASSERT_TRUE(waitForValues(mCallback1, expectedValues.size()));
+    ASSERT_EQ(getReceivedValues(mCallback1), expectedValues);
+}
+
+TEST_F(PropertyEventDispatcherTest, testSlowClientDoesNotBlockOthers) {
+    auto dispatcher = createDispatcher(/*threadCount=*/2, /*maxQueueSizePerClient=*/100);
+    blockClient(mCallback1);
+
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 1)});
+    ASSERT_TRUE(waitForSendStarted(mCallback1));
+    dispatcher->dispatch(mCallback2, {createValue(ON_CHANGE_PROP, 2)});
+
+    ASSERT_TRUE(waitForValues(mCallback2, 1))
+            << "events for other clients must be delivered while one client is blocked";
+    ASSERT_TRUE(getReceivedValues(mCallback1).empty());
+
+    unblockClient(mCallback1);
+    ASSERT_TRUE(waitForValues(mCallback1, 1));
+}
+
+TEST_F(PropertyEventDispatcherTest, testDropContinuousWhenQueueFull) {
+    auto dispatcher = createDispatcher(/*threadCount=*/1, /*maxQueueSizePerClient=*/2);
+    blockClient(mCallback1);
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 0)});
+    ASSERT_TRUE(waitForSendStarted(mCallback1));
+
+    // Queued while the first event is being sent, the continuous sample would be dropped.
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 1)});
+    dispatcher->dispatch(mCallback1, {createValue(CONTINUOUS_PROP, 2)});
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP_2, 3)});
+
+    auto stats = dispatcher->getStats()[mCallback1->asBinder().get()];
+    ASSERT_EQ(stats.queueDepth, static_cast<size_t>(2));
+    ASSERT_EQ(stats.maxQueueDepth, static_cast<size_t>(2));
+    ASSERT_EQ(stats.droppedCount, static_cast<size_t>(1));
+    ASSERT_EQ(stats.overflowCount, static_cast<size_t>(0));
+
+    unblockClient(mCallback1);
+    ASSERT_TRUE(waitForValues(mCallback1, 3));
+    ASSERT_EQ(getReceivedValues(mCallback1),
+              std::vector<VehiclePropValue>({createValue(ON_CHANGE_PROP, 0),
+                                             createValue(ON_CHANGE_PROP, 1),
+                                             createValue(ON_CHANGE_PROP_2, 3)}));
+}
+
+TEST_F(PropertyEventDispatcherTest, testKeepLatestOnChangeValueWhenQueueFull) {
+    auto dispatcher = createDispatcher(/*threadCount=*/1, /*maxQueueSizePerClient=*/2);
+    blockClient(mCallback1);
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 0)});
+    ASSERT_TRUE(waitForSendStarted(mCallback1));
+
+    // None of these calls blocks although the client is stuck.
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 1)});
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP_2, 2)});
+    // The queue is full, the newer value replaces the pending one for the same property.
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 3)});
+    // No pending event to replace or drop, queued past the max size.
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP_3, 4)});
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP_3, 5)});
+
+    auto stats = dispatcher->getStats()[mCallback1->asBinder().get()];
+    ASSERT_EQ(stats.queueDepth, static_cast<size_t>(3));
+    ASSERT_EQ(stats.droppedCount, static_cast<size_t>(2));
+    ASSERT_EQ(stats.overflowCount, static_cast<size_t>(1));
+
+    unblockClient(mCallback1);
+    ASSERT_TRUE(waitForValues(mCallback1, 4));
+    ASSERT_EQ(getReceivedValues(mCallback1),
+              std::vector<VehiclePropValue>({createValue(ON_CHANGE_PROP, 0),
+                                             createValue(ON_CHANGE_PROP, 3),
+                                             createValue(ON_CHANGE_PROP_2, 2),
+                                             createValue(ON_CHANGE_PROP_3, 5)}));
+}
+
+TEST_F(PropertyEventDispatcherTest, testKeepIntermediateOnChangeValuesWhenQueueNotFull) {
+    auto dispatcher = createDispatcher(/*threadCount=*/1, /*maxQueueSizePerClient=*/100);
+    blockClient(mCallback1);
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 0)});
+    ASSERT_TRUE(waitForSendStarted(mCallback1));
+
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 1)});
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 2)});
+
+    unblockClient(mCallback1);
+    ASSERT_TRUE(waitForValues(mCallback1, 3));
+    ASSERT_EQ(getReceivedValues(mCallback1),
+              std::vector<VehiclePropValue>({createValue(ON_CHANGE_PROP, 0),
+                                             createValue(ON_CHANGE_PROP, 1),
+                                             createValue(ON_CHANGE_PROP, 2)}));
+    auto stats = dispatcher->getStats()[mCallback1->asBinder().get()];
+    ASSERT_EQ(stats.droppedCount, static_cast<size_t>(0));
+}
+
+TEST_F(PropertyEventDispatcherTest, testZeroQueueSize) {
+    auto dispatcher = createDispatcher(/*threadCount=*/1, /*maxQueueSizePerClient=*/0);
+
+    dispatcher->dispatch(mCallback1, {createValue(CONTINUOUS_PROP, 0)});
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 1)});
+
+    ASSERT_TRUE(waitForValues(mCallback1, 1));
+}
+
+TEST_F(PropertyEventDispatcherTest, testMergeContinuousProperty) {
+    auto dispatcher = createDispatcher(/*threadCount=*/1, /*maxQueueSizePerClient=*/100);
+    blockClient(mCallback1);
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 0)});
+    ASSERT_TRUE(waitForSendStarted(mCallback1));
+
+    dispatcher->dispatch(mCallback1, {createValue(CONTINUOUS_PROP, 1)});
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 2)});
+    dispatcher->dispatch(mCallback1, {createValue(CONTINUOUS_PROP, 3)});
+
+    auto stats = dispatcher->getStats()[mCallback1->asBinder().get()];
+    ASSERT_EQ(stats.queueDepth, static_cast<size_t>(2));
+    ASSERT_EQ(stats.mergedCount, static_cast<size_t>(1));
+    ASSERT_EQ(stats.droppedCount, static_cast<size_t>(0));
+
+    unblockClient(mCallback1);
+    ASSERT_TRUE(waitForValues(mCallback1, 3));
+    ASSERT_EQ(getReceivedValues(mCallback1),
+              std::vector<VehiclePropValue>({createValue(ON_CHANGE_PROP, 0),
+                                             createValue(CONTINUOUS_PROP, 3),
+                                             createValue(ON_CHANGE_PROP, 2)}));
+}
+
+TEST_F(PropertyEventDispatcherTest, testRemoveClient) {
+    auto dispatcher = createDispatcher(/*threadCount=*/1, /*maxQueueSizePerClient=*/100);
+    blockClient(mCallback1);
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 0)});
+    ASSERT_TRUE(waitForSendStarted(mCallback1));
+    dispatcher->dispatch(mCallback1, {createValue(ON_CHANGE_PROP, 1)});
+
+    dispatcher->removeClient(mCallback1->asBinder().get());
+
+    ASSERT_TRUE(dispatcher->getStats().empty());
+    unblockClient(mCallback1);
+    // Only the event already being sent is delivered.
+    ASSERT_TRUE(waitForValues(mCallback1, 1));
+    dispatcher.reset();
+    ASSERT_EQ(getReceivedValues(mCallback1).size(), static_cast<size_t>(1));
+}
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
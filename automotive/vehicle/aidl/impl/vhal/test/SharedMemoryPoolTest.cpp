@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SharedMemoryPool.h"
+
+#include <aidl/android/hardware/automotive/vehicle/IVehicle.h>
+
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+
+using ::aidl::android::hardware::automotive::vehicle::IVehicle;
+using ::aidl::android::hardware::automotive::vehicle::StatusCode;
+using ::ndk::ScopedFileDescriptor;
+
+class SharedMemoryPoolTest : public testing::Test {
+  public:
+    ScopedFileDescriptor createFile() {
+        return ScopedFileDescriptor(memfd_create("SharedMemoryPoolTest", MFD_CLOEXEC));
+    }
+};
+
+TEST_F(SharedMemoryPoolTest, testNoTrackingIfMaxFileCountIsZero) {
+    SharedMemoryPool pool(0);
+
+    for (int i = 0; i < 10; i++) {
+        auto maybeId = pool.reserve();
+
+        ASSERT_TRUE(maybeId.has_value());
+        ASSERT_EQ(*maybeId, IVehicle::INVALID_MEMORY_ID);
+
+        pool.commit(*maybeId, createFile());
+    }
+
+    ASSERT_EQ(pool.getFileCount(), 0);
+}
+
+TEST_F(SharedMemoryPoolTest, testReserveUntilFull) {
+    SharedMemoryPool pool(2);
+
+    auto id1 = pool.reserve();
+    auto id2 = pool.reserve();
+
+    ASSERT_TRUE(id1.has_value());
+    ASSERT_TRUE(id2.has_value());
+    ASSERT_NE(*id1, IVehicle::INVALID_MEMORY_ID);
+    ASSERT_NE(*id2, IVehicle::INVALID_MEMORY_ID);
+    ASSERT_NE(*id1, *id2);
+    ASSERT_FALSE(pool.reserve().has_value()) << "reserve must fail when the pool is full";
+    ASSERT_EQ(pool.getFileCount(), 2);
+}
+
+TEST_F(SharedMemoryPoolTest, testCancelReleasesSlot) {
+    SharedMemoryPool pool(1);
+
+    auto id = pool.reserve();
+    ASSERT_TRUE(id.has_value());
+
+    pool.cancel(*id);
+
+    ASSERT_EQ(pool.getFileCount(), 0);
+    ASSERT_TRUE(pool.reserve().has_value());
+}
+
+TEST_F(SharedMemoryPoolTest, testReturnFile) {
+    SharedMemoryPool pool(1);
+
+    auto id = pool.reserve();
+    ASSERT_TRUE(id.has_value());
+    pool.commit(*id, createFile());
+
+    ASSERT_EQ(pool.getFileCount(), 1);
+    ASSERT_FALSE(pool.reserve().has_value());
+
+    auto result = pool.returnFile(*id);
+
+    ASSERT_TRUE(result.ok()) << "failed to return file: " << getErrorMsg(result);
+    ASSERT_EQ(pool.getFileCount(), 0);
+    ASSERT_TRUE(pool.reserve().has_value());
+}
+
+TEST_F(SharedMemoryPoolTest, testReturnUnknownFile) {
+    SharedMemoryPool pool(1);
+
+    auto result = pool.returnFile(1234);
+
+    ASSERT_FALSE(result.ok());
+    ASSERT_EQ(getErrorCode(result), StatusCode::INVALID_ARG);
+}
+
+TEST_F(SharedMemoryPoolTest, testReturnFileTwice) {
+    SharedMemoryPool pool(1);
+
+    auto id = pool.reserve();
+    ASSERT_TRUE(id.has_value());
+    pool.commit(*id, createFile());
+
+    ASSERT_TRUE(pool.returnFile(*id).ok());
+    ASSERT_FALSE(pool.returnFile(*id).ok()) << "returning a file twice must fail";
+}
+
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
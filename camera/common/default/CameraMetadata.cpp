@@ -20,6 +20,8 @@
 #include <log/log.h>
 #include <utils/Errors.h>
 
+#include <algorithm>
+
 #include "CameraMetadata.h"
 #include "VendorTagDescriptor.h"
 
@@ -159,6 +161,33 @@ status_t CameraMetadata::sort() {
     return sort_camera_metadata(mBuffer);
 }
 
+status_t CameraMetadata::reserve(size_t entryCapacity, size_t dataCapacity) {
+    if (mLocked) {
+        ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
+        return INVALID_OPERATION;
+    }
+    if (mBuffer != NULL) {
+        entryCapacity = std::max(entryCapacity, get_camera_metadata_entry_capacity(mBuffer));
+        dataCapacity = std::max(dataCapacity, get_camera_metadata_data_capacity(mBuffer));
+        if (entryCapacity == get_camera_metadata_entry_capacity(mBuffer) &&
+            dataCapacity == get_camera_metadata_data_capacity(mBuffer)) {
+            return OK;
+        }
+    }
+
+    camera_metadata_t* newBuffer = allocate_camera_metadata(entryCapacity, dataCapacity);
+    if (newBuffer == NULL) {
+        ALOGE("%s: Can't allocate larger metadata buffer", __FUNCTION__);
+        return NO_MEMORY;
+    }
+    if (mBuffer != NULL) {
+        append_camera_metadata(newBuffer, mBuffer);
+        free_camera_metadata(mBuffer);
+    }
+    mBuffer = newBuffer;
+    return OK;
+}
+
 status_t CameraMetadata::checkType(uint32_t tag, uint8_t expectedType) {
     int tagType = get_local_camera_metadata_tag_type(tag, mBuffer);
     if (CC_UNLIKELY(tagType == -1)) {
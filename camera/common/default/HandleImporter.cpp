@@ -40,6 +40,16 @@ using IMapperV4 = android::hardware::graphics::mapper::V4_0::IMapper;
 
 HandleImporter::HandleImporter() : mInitialized(false) {}
 
+bool HandleImporter::initialize() {
+    if (mInitialized.load(std::memory_order_acquire)) {
+        return true;
+    }
+
+    Mutex::Autolock lock(mLock);
+    initializeLocked();
+    return mInitialized;
+}
+
 void HandleImporter::initializeLocked() {
     if (mInitialized) {
         return;
@@ -176,6 +186,62 @@ std::vector<PlaneLayout> getPlaneLayouts(const sp<IMapperV4> mapper, buffer_hand
     return planeLayouts;
 }
 
+bool HandleImporter::getBufferLayout(const sp<IMapperV4> mapper, buffer_handle_t& buf,
+                                     BufferLayout* layout /*out*/) {
+    {
+        std::lock_guard<std::mutex> lk(mLayoutCacheLock);
+        auto it = mLayoutCache.find(buf);
+        if (it != mLayoutCache.end()) {
+            *layout = it->second;
+            return true;
+        }
+    }
+
+    std::vector<PlaneLayout> planeLayouts = getPlaneLayouts(mapper, buf);
+    if (planeLayouts.empty()) {
+        return false;
+    }
+
+    BufferLayout newLayout;
+    newLayout.planeCount = planeLayouts.size();
+    newLayout.firstPlaneStrideInBytes = planeLayouts[0].strideInBytes;
+    for (const auto& planeLayout : planeLayouts) {
+        for (const auto& planeLayoutComponent : planeLayout.components) {
+            const auto& type = planeLayoutComponent.type;
+
+            if (!gralloc4::isStandardPlaneLayoutComponentType(type)) {
+                continue;
+            }
+
+            int64_t offset = planeLayout.offsetInBytes + planeLayoutComponent.offsetInBits / 8;
+
+            switch (static_cast<PlaneLayoutComponentType>(type.value)) {
+                case PlaneLayoutComponentType::Y:
+                    newLayout.yOffset = offset;
+                    newLayout.yStride = planeLayout.strideInBytes;
+                    break;
+                case PlaneLayoutComponentType::CB:
+                    newLayout.cbOffset = offset;
+                    newLayout.cStride = planeLayout.strideInBytes;
+                    newLayout.chromaStep = planeLayout.sampleIncrementInBits / 8;
+                    break;
+                case PlaneLayoutComponentType::CR:
+                    newLayout.crOffset = offset;
+                    newLayout.cStride = planeLayout.strideInBytes;
+                    newLayout.chromaStep = planeLayout.sampleIncrementInBits / 8;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lk(mLayoutCacheLock);
+    mLayoutCache[buf] = newLayout;
+    *layout = newLayout;
+    return true;
+}
+
 template <>
 YCbCrLayout HandleImporter::lockYCbCrInternal<IMapperV4, MapperErrorV4>(
         const sp<IMapperV4> mapper, buffer_handle_t& buf, uint64_t cpuUsage,
@@ -200,39 +266,24 @@ YCbCrLayout HandleImporter::lockYCbCrInternal<IMapperV4, MapperErrorV4>(
         return layout;
     }
 
-    std::vector<PlaneLayout> planeLayouts = getPlaneLayouts(mapper, buf);
-    for (const auto& planeLayout : planeLayouts) {
-        for (const auto& planeLayoutComponent : planeLayout.components) {
-            const auto& type = planeLayoutComponent.type;
-
-            if (!gralloc4::isStandardPlaneLayoutComponentType(type)) {
-                continue;
-            }
-
-            uint8_t* data = reinterpret_cast<uint8_t*>(mapped);
-            data += planeLayout.offsetInBytes;
-            data += planeLayoutComponent.offsetInBits / 8;
+    BufferLayout bufferLayout;
+    if (!getBufferLayout(mapper, buf, &bufferLayout)) {
+        return layout;
+    }
 
-            switch (static_cast<PlaneLayoutComponentType>(type.value)) {
-                case PlaneLayoutComponentType::Y:
-                    layout.y = data;
-                    layout.yStride = planeLayout.strideInBytes;
-                    break;
-                case PlaneLayoutComponentType::CB:
-                    layout.cb = data;
-                    layout.cStride = planeLayout.strideInBytes;
-                    layout.chromaStep = planeLayout.sampleIncrementInBits / 8;
-                    break;
-                case PlaneLayoutComponentType::CR:
-                    layout.cr = data;
-                    layout.cStride = planeLayout.strideInBytes;
-                    layout.chromaStep = planeLayout.sampleIncrementInBits / 8;
-                    break;
-                default:
-                    break;
-            }
-        }
+    uint8_t* data = reinterpret_cast<uint8_t*>(mapped);
+    if (bufferLayout.yOffset >= 0) {
+        layout.y = data + bufferLayout.yOffset;
+        layout.yStride = bufferLayout.yStride;
+    }
+    if (bufferLayout.cbOffset >= 0) {
+        layout.cb = data + bufferLayout.cbOffset;
     }
+    if (bufferLayout.crOffset >= 0) {
+        layout.cr = data + bufferLayout.crOffset;
+    }
+    layout.cStride = bufferLayout.cStride;
+    layout.chromaStep = bufferLayout.chromaStep;
 
     return layout;
 }
@@ -272,13 +323,20 @@ bool HandleImporter::importBuffer(buffer_handle_t& handle) {
         return true;
     }
 
-    Mutex::Autolock lock(mLock);
-    if (!mInitialized) {
-        initializeLocked();
+    if (!initialize()) {
+        ALOGE("%s: mMapperV4, mMapperV3 and mMapperV2 are all null!", __FUNCTION__);
+        return false;
     }
 
     if (mMapperV4 != nullptr) {
-        return importBufferInternal<IMapperV4, MapperErrorV4>(mMapperV4, handle);
+        if (!importBufferInternal<IMapperV4, MapperErrorV4>(mMapperV4, handle)) {
+            return false;
+        }
+        // A buffer imported here may be freed by another importer, e.g. after a switch to
+        // an offline session, so the new handle may reuse the address of a stale entry.
+        std::lock_guard<std::mutex> lk(mLayoutCacheLock);
+        mLayoutCache.erase(handle);
+        return true;
     }
 
     if (mMapperV3 != nullptr) {
@@ -298,9 +356,14 @@ void HandleImporter::freeBuffer(buffer_handle_t handle) {
         return;
     }
 
-    Mutex::Autolock lock(mLock);
-    if (!mInitialized) {
-        initializeLocked();
+    if (!initialize()) {
+        ALOGE("%s: mMapperV4, mMapperV3 and mMapperV2 are all null!", __FUNCTION__);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(mLayoutCacheLock);
+        mLayoutCache.erase(handle);
     }
 
     if (mMapperV4 != nullptr) {
@@ -351,15 +414,9 @@ void* HandleImporter::lock(buffer_handle_t& buf, uint64_t cpuUsage, size_t size)
 
 void* HandleImporter::lock(buffer_handle_t& buf, uint64_t cpuUsage,
                            const IMapper::Rect& accessRegion) {
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
-    }
-
     void* ret = nullptr;
 
-    if (mMapperV4 == nullptr && mMapperV3 == nullptr && mMapperV2 == nullptr) {
+    if (!initialize()) {
         ALOGE("%s: mMapperV4, mMapperV3 and mMapperV2 are all null!", __FUNCTION__);
         return ret;
     }
@@ -411,10 +468,9 @@ void* HandleImporter::lock(buffer_handle_t& buf, uint64_t cpuUsage,
 
 YCbCrLayout HandleImporter::lockYCbCr(buffer_handle_t& buf, uint64_t cpuUsage,
                                       const IMapper::Rect& accessRegion) {
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
+    if (!initialize()) {
+        ALOGE("%s: mMapperV4, mMapperV3 and mMapperV2 are all null!", __FUNCTION__);
+        return {};
     }
 
     if (mMapperV4 != nullptr) {
@@ -438,20 +494,14 @@ status_t HandleImporter::getMonoPlanarStrideBytes(buffer_handle_t& buf, uint32_t
         return BAD_VALUE;
     }
 
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
-    }
-
-    if (mMapperV4 != nullptr) {
-        std::vector<PlaneLayout> planeLayouts = getPlaneLayouts(mMapperV4, buf);
-        if (planeLayouts.size() != 1) {
-            ALOGE("%s: Unexpected number of planes %zu!", __FUNCTION__, planeLayouts.size());
+    if (initialize() && mMapperV4 != nullptr) {
+        BufferLayout layout;
+        if (!getBufferLayout(mMapperV4, buf, &layout) || layout.planeCount != 1) {
+            ALOGE("%s: Unexpected number of planes %zu!", __FUNCTION__, layout.planeCount);
             return BAD_VALUE;
         }
 
-        *stride = planeLayouts[0].strideInBytes;
+        *stride = layout.firstPlaneStrideInBytes;
     } else {
         ALOGE("%s: mMapperV4 is null! Query not supported!", __FUNCTION__);
         return NO_INIT;
@@ -461,6 +511,10 @@ status_t HandleImporter::getMonoPlanarStrideBytes(buffer_handle_t& buf, uint32_t
 }
 
 int HandleImporter::unlock(buffer_handle_t& buf) {
+    if (!mInitialized.load(std::memory_order_acquire)) {
+        ALOGE("%s: mMapperV4, mMapperV3 and mMapperV2 are all null!", __FUNCTION__);
+        return -1;
+    }
     if (mMapperV4 != nullptr) {
         return unlockInternal<IMapperV4, MapperErrorV4>(mMapperV4, buf);
     }
@@ -476,13 +530,7 @@ int HandleImporter::unlock(buffer_handle_t& buf) {
 }
 
 bool HandleImporter::isSmpte2086Present(const buffer_handle_t& buf) {
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
-    }
-
-    if (mMapperV4 != nullptr) {
+    if (initialize() && mMapperV4 != nullptr) {
         return isMetadataPesent(mMapperV4, buf, gralloc4::MetadataType_Smpte2086);
     } else {
         ALOGE("%s: mMapperV4 is null! Query not supported!", __FUNCTION__);
@@ -492,13 +540,7 @@ bool HandleImporter::isSmpte2086Present(const buffer_handle_t& buf) {
 }
 
 bool HandleImporter::isSmpte2094_10Present(const buffer_handle_t& buf) {
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
-    }
-
-    if (mMapperV4 != nullptr) {
+    if (initialize() && mMapperV4 != nullptr) {
         return isMetadataPesent(mMapperV4, buf, gralloc4::MetadataType_Smpte2094_10);
     } else {
         ALOGE("%s: mMapperV4 is null! Query not supported!", __FUNCTION__);
@@ -508,13 +550,7 @@ bool HandleImporter::isSmpte2094_10Present(const buffer_handle_t& buf) {
 }
 
 bool HandleImporter::isSmpte2094_40Present(const buffer_handle_t& buf) {
-    Mutex::Autolock lock(mLock);
-
-    if (!mInitialized) {
-        initializeLocked();
-    }
-
-    if (mMapperV4 != nullptr) {
+    if (initialize() && mMapperV4 != nullptr) {
         return isMetadataPesent(mMapperV4, buf, gralloc4::MetadataType_Smpte2094_40);
     } else {
         ALOGE("%s: mMapperV4 is null! Query not supported!", __FUNCTION__);
@@ -124,6 +124,13 @@ class CameraMetadata {
      */
     status_t sort();
 
+    /**
+     * Grow the buffer to hold at least entryCapacity entries and dataCapacity
+     * bytes of entry data, so that updates within that space do not reallocate
+     * it. Never shrinks the buffer.
+     */
+    status_t reserve(size_t entryCapacity, size_t dataCapacity);
+
     /**
      * Update metadata entry. Will create entry if it doesn't exist already, and
      * will reallocate the buffer if insufficient space exists. Overloaded for
@@ -23,6 +23,10 @@
 #include <cutils/native_handle.h>
 #include <utils/Mutex.h>
 
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
 using android::hardware::graphics::mapper::V2_0::IMapper;
 using android::hardware::graphics::mapper::V2_0::YCbCrLayout;
 
@@ -66,9 +70,29 @@ class HandleImporter {
     bool isSmpte2094_40Present(const buffer_handle_t& buf);
 
   private:
+    // The plane layout of an imported buffer. It cannot change until the buffer is freed, so it
+    // is queried from the mapper once and reused for every lock of the buffer.
+    struct BufferLayout {
+        size_t planeCount = 0;
+        uint32_t firstPlaneStrideInBytes = 0;
+        // Offsets of the first Y/Cb/Cr sample from the locked address, or -1 if not present
+        int64_t yOffset = -1;
+        int64_t cbOffset = -1;
+        int64_t crOffset = -1;
+        uint32_t yStride = 0;
+        uint32_t cStride = 0;
+        uint32_t chromaStep = 0;
+    };
+
+    // Returns true once a mapper is available. mLock is only taken until then, so already
+    // initialized importers can lock buffers from several threads concurrently.
+    bool initialize();
     void initializeLocked();
     void cleanup();
 
+    bool getBufferLayout(const sp<graphics::mapper::V4_0::IMapper> mapper, buffer_handle_t& buf,
+                         BufferLayout* layout /*out*/);
+
     template <class M, class E>
     bool importBufferInternal(const sp<M> mapper, buffer_handle_t& handle);
     template <class M, class E>
@@ -78,10 +102,13 @@ class HandleImporter {
     int unlockInternal(const sp<M> mapper, buffer_handle_t& buf);
 
     Mutex mLock;
-    bool mInitialized;
+    std::atomic<bool> mInitialized;
     sp<IMapper> mMapperV2;
     sp<graphics::mapper::V3_0::IMapper> mMapperV3;
     sp<graphics::mapper::V4_0::IMapper> mMapperV4;
+
+    std::mutex mLayoutCacheLock;
+    std::unordered_map<const native_handle_t*, BufferLayout> mLayoutCache;  // guarded by above
 };
 
 }  // namespace helper
@@ -34,10 +34,14 @@
 #include <aidl/android/hardware/graphics/common/Dataspace.h>
 #include <aidlcommonsupport/NativeHandle.h>
 #include <convert.h>
+#include <fcntl.h>
 #include <linux/videodev2.h>
 #include <sync/sync.h>
+#include <sys/mman.h>
 #include <utils/Trace.h>
+#include <algorithm>
 #include <deque>
+#include <thread>
 
 #define HAVE_JPEG  // required for libyuv.h to export MJPEG decode APIs
 #include <libyuv.h>
@@ -108,6 +112,7 @@ using ::android::hardware::camera::common::V1_0::helper::ExifUtils;
 // Static instances
 const int ExternalCameraDeviceSession::kMaxProcessedStream;
 const int ExternalCameraDeviceSession::kMaxStallStream;
+const size_t ExternalCameraDeviceSession::OutputThread::kMaxJpegEncodeThreads;
 HandleImporter ExternalCameraDeviceSession::sHandleImporter;
 
 ExternalCameraDeviceSession::ExternalCameraDeviceSession(
@@ -231,6 +236,9 @@ void ExternalCameraDeviceSession::closeOutputThreadImpl() {
     if (mOutputThread != nullptr) {
         mOutputThread->flush();
         mOutputThread->requestExitAndWait();
+        // Joined here rather than in ~OutputThread, which might run on the output stage thread
+        // if it drops the last reference to the session.
+        mOutputThread->stopOutputStage();
         mOutputThread.reset();
     }
 }
@@ -415,9 +423,22 @@ ScopedAStatus ExternalCameraDeviceSession::configureStreams(
         return fromStatus(Status::INTERNAL_ERROR);
     }
 
+    // Decode MJPEG frames at a reduced scale when every stream is small enough
+    std::vector<Size> streamSizes;
+    for (const auto& stream : in_requestedConfiguration.streams) {
+        streamSizes.push_back({stream.width, stream.height});
+    }
+    Size decodeSize = v4l2Fmt.fourcc == V4L2_PIX_FMT_MJPEG
+                              ? getMjpegDecodeSize(v4lSize, streamSizes)
+                              : v4lSize;
+    if (!(decodeSize == v4lSize)) {
+        ALOGI("%s: decoding %dx%d MJPEG frames at %dx%d", __FUNCTION__, v4lSize.width,
+              v4lSize.height, decodeSize.width, decodeSize.height);
+    }
+
     mBlobBufferSize = blobBufferSize;
     status = mOutputThread->allocateIntermediateBuffers(
-            v4lSize, mMaxThumbResolution, in_requestedConfiguration.streams, blobBufferSize);
+            decodeSize, mMaxThumbResolution, in_requestedConfiguration.streams, blobBufferSize);
     if (status != Status::OK) {
         ALOGE("%s: allocating intermediate buffers failed!", __FUNCTION__);
         return fromStatus(status);
@@ -1008,7 +1029,8 @@ status_t ExternalCameraDeviceSession::initDefaultRequests() {
 }
 
 status_t ExternalCameraDeviceSession::fillCaptureResult(common::V1_0::helper::CameraMetadata& md,
-                                                        nsecs_t timestamp) {
+                                                        nsecs_t timestamp,
+                                                        std::vector<uint8_t>* out) {
     bool afTrigger = false;
     {
         std::lock_guard<std::mutex> lk(mAfTriggerLock);
@@ -1032,12 +1054,19 @@ status_t ExternalCameraDeviceSession::fillCaptureResult(common::V1_0::helper::Ca
     } else {
         afState = ANDROID_CONTROL_AF_STATE_INACTIVE;
     }
-    UPDATE(md, ANDROID_CONTROL_AF_STATE, &afState, 1);
 
-    camera_metadata_ro_entry activeArraySize =
-            mCameraCharacteristics.find(ANDROID_SENSOR_INFO_ACTIVE_ARRAY_SIZE);
+    // The AF state is the only input to the result besides the settings and the timestamp
+    return mResultMetadataCache.build(
+            md, afState, timestamp,
+            [&](common::V1_0::helper::CameraMetadata& result) {
+                UPDATE(result, ANDROID_CONTROL_AF_STATE, &afState, 1);
 
-    return fillCaptureResultCommon(md, timestamp, activeArraySize);
+                camera_metadata_ro_entry activeArraySize =
+                        mCameraCharacteristics.find(ANDROID_SENSOR_INFO_ACTIVE_ARRAY_SIZE);
+
+                return fillCaptureResultCommon(result, timestamp, activeArraySize);
+            },
+            out);
 }
 
 int ExternalCameraDeviceSession::configureV4l2StreamLocked(const SupportedV4L2Format& v4l2Fmt,
@@ -1146,6 +1175,8 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(const SupportedV4L2Fo
     // VIDIOC_QUERYBUF:  get buffer offset in the V4L2 fd
     // VIDIOC_QBUF: send buffer to driver
     mV4L2BufferCount = req_buffers.count;
+    releaseV4l2BuffersLocked();
+    bool exportBuffers = mCfg.dmabufEnabled;
     for (uint32_t i = 0; i < req_buffers.count; i++) {
         v4l2_buffer buffer = {
                 .index = i, .type = V4L2_BUF_TYPE_VIDEO_CAPTURE, .memory = V4L2_MEMORY_MMAP};
@@ -1155,6 +1186,14 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(const SupportedV4L2Fo
             return -errno;
         }
 
+        // VIDIOC_EXPBUF: export the buffer as a DMABUF, falling back to mapping every frame if
+        // the driver cannot export all of them
+        if (exportBuffers && exportV4l2BufferLocked(buffer) != 0) {
+            ALOGW("%s: cannot export V4L2 buffers, mapping frames instead", __FUNCTION__);
+            releaseV4l2BuffersLocked();
+            exportBuffers = false;
+        }
+
         if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_QBUF, &buffer)) < 0) {
             ALOGE("%s: QBUF %d failed: %s", __FUNCTION__, i, strerror(errno));
             return -errno;
@@ -1198,7 +1237,8 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(const SupportedV4L2Fo
         }
     }
 
-    ALOGI("%s: start V4L2 streaming %dx%d@%ffps", __FUNCTION__, v4l2Fmt.width, v4l2Fmt.height, fps);
+    ALOGI("%s: start V4L2 streaming %dx%d@%ffps%s", __FUNCTION__, v4l2Fmt.width, v4l2Fmt.height,
+          fps, mV4l2BufferMappings.empty() ? "" : " with DMABUF buffers");
     mV4l2StreamingFmt = v4l2Fmt;
     mV4l2Streaming = true;
     return OK;
@@ -1262,11 +1302,50 @@ std::unique_ptr<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(n
         mNumDequeuedV4l2Buffers++;
     }
 
+    if (!mV4l2BufferMappings.empty()) {
+        const V4L2BufferMapping& mapping = mV4l2BufferMappings[buffer.index];
+        return std::make_unique<V4L2Frame>(mV4l2StreamingFmt.width, mV4l2StreamingFmt.height,
+                                           mV4l2StreamingFmt.fourcc, buffer.index,
+                                           mapping.dmabufFd.get(), mapping.data, buffer.bytesused);
+    }
+
     return std::make_unique<V4L2Frame>(mV4l2StreamingFmt.width, mV4l2StreamingFmt.height,
                                        mV4l2StreamingFmt.fourcc, buffer.index, mV4l2Fd.get(),
                                        buffer.bytesused, buffer.m.offset);
 }
 
+int ExternalCameraDeviceSession::exportV4l2BufferLocked(const v4l2_buffer& buffer) {
+    v4l2_exportbuffer expbuf{};
+    expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    expbuf.index = buffer.index;
+    expbuf.flags = O_RDONLY | O_CLOEXEC;
+    if (TEMP_FAILURE_RETRY(ioctl(mV4l2Fd.get(), VIDIOC_EXPBUF, &expbuf)) < 0) {
+        ALOGW("%s: EXPBUF %d failed: %s", __FUNCTION__, buffer.index, strerror(errno));
+        return -errno;
+    }
+
+    V4L2BufferMapping mapping;
+    mapping.dmabufFd.reset(expbuf.fd);
+    void* addr = mmap(nullptr, buffer.length, PROT_READ, MAP_SHARED, expbuf.fd, 0);
+    if (addr == MAP_FAILED) {
+        ALOGW("%s: DMABUF %d map failed: %s", __FUNCTION__, buffer.index, strerror(errno));
+        return -errno;
+    }
+    mapping.data = static_cast<uint8_t*>(addr);
+    mapping.size = buffer.length;
+    mV4l2BufferMappings.push_back(std::move(mapping));
+    return 0;
+}
+
+void ExternalCameraDeviceSession::releaseV4l2BuffersLocked() {
+    for (auto& mapping : mV4l2BufferMappings) {
+        if (munmap(mapping.data, mapping.size) != 0) {
+            ALOGE("%s: DMABUF unmap failed: %s", __FUNCTION__, strerror(errno));
+        }
+    }
+    mV4l2BufferMappings.clear();
+}
+
 void ExternalCameraDeviceSession::enqueueV4l2Frame(const std::shared_ptr<V4L2Frame>& frame) {
     ATRACE_CALL();
     frame->unmap();
@@ -1453,6 +1532,8 @@ ScopedAStatus ExternalCameraDeviceSession::repeatingRequestEnd(
 
 int ExternalCameraDeviceSession::v4l2StreamOffLocked() {
     if (!mV4l2Streaming) {
+        // A failed configureV4l2StreamLocked may have left exported buffers behind
+        releaseV4l2BuffersLocked();
         return OK;
     }
 
@@ -1472,6 +1553,9 @@ int ExternalCameraDeviceSession::v4l2StreamOffLocked() {
         return -errno;
     }
 
+    // The exported buffers are only freed once they are closed and unmapped too
+    releaseV4l2BuffersLocked();
+
     // VIDIOC_REQBUFS: clear buffers
     v4l2_requestbuffers req_buffers{};
     req_buffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -1832,10 +1916,7 @@ Status ExternalCameraDeviceSession::processCaptureResult(std::shared_ptr<HalRequ
     }
 
     // Fill capture result metadata
-    fillCaptureResult(req->setting, req->shutterTs);
-    const camera_metadata_t* rawResult = req->setting.getAndLock();
-    convertToAidl(rawResult, &result.result);
-    req->setting.unlock(rawResult);
+    fillCaptureResult(req->setting, req->shutterTs, &result.result.metadata);
 
     // update inflight records
     {
@@ -1898,6 +1979,7 @@ binder_status_t ExternalCameraDeviceSession::dump(int fd, const char** /*args*/,
 
     bool streaming = false;
     size_t v4L2BufferCount = 0;
+    bool dmabufBuffers = false;
     SupportedV4L2Format streamingFmt;
     {
         bool sessionLocked = tryLock(mLock);
@@ -1907,6 +1989,7 @@ binder_status_t ExternalCameraDeviceSession::dump(int fd, const char** /*args*/,
         streaming = mV4l2Streaming;
         streamingFmt = mV4l2StreamingFmt;
         v4L2BufferCount = mV4L2BufferCount;
+        dmabufBuffers = !mV4l2BufferMappings.empty();
 
         if (sessionLocked) {
             mLock.unlock();
@@ -1942,8 +2025,8 @@ binder_status_t ExternalCameraDeviceSession::dump(int fd, const char** /*args*/,
             std::lock_guard<std::mutex> lk(mV4l2BufferLock);
             numDequeuedV4l2Buffers = mNumDequeuedV4l2Buffers;
         }
-        dprintf(fd, "V4L2 buffer queue size %zu, dequeued %zu\n", v4L2BufferCount,
-                numDequeuedV4l2Buffers);
+        dprintf(fd, "V4L2 buffer queue size %zu (%s), dequeued %zu\n", v4L2BufferCount,
+                dmabufBuffers ? "DMABUF" : "MMAP", numDequeuedV4l2Buffers);
     }
 
     dprintf(fd, "In-flight frames (not sorted):");
@@ -2138,10 +2221,19 @@ ExternalCameraDeviceSession::OutputThread::OutputThread(
       mCameraCharacteristics(chars),
       mBufferRequestThread(bufReqThread) {}
 
-ExternalCameraDeviceSession::OutputThread::~OutputThread() {}
+ExternalCameraDeviceSession::OutputThread::~OutputThread() {
+    stopOutputStage();
+}
+
+void ExternalCameraDeviceSession::OutputThread::stopOutputStage() {
+    if (mOutputStageThread != nullptr) {
+        mOutputStageThread->requestExitAndWait();
+        mOutputStageThread.reset();
+    }
+}
 
 Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
-        const Size& v4lSize, const Size& thumbSize, const std::vector<Stream>& streams,
+        const Size& decodeSize, const Size& thumbSize, const std::vector<Stream>& streams,
         uint32_t blobBufferSize) {
     std::lock_guard<std::mutex> lk(mBufferLock);
     if (!mScaledYu12Frames.empty()) {
@@ -2150,16 +2242,27 @@ Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
         return Status::INTERNAL_ERROR;
     }
 
-    // Allocating intermediate YU12 frame
-    if (mYu12Frame == nullptr || mYu12Frame->mWidth != v4lSize.width ||
-        mYu12Frame->mHeight != v4lSize.height) {
+    // Allocating intermediate YU12 frames
+    if (mYu12Frame == nullptr || mYu12Frame->mWidth != decodeSize.width ||
+        mYu12Frame->mHeight != decodeSize.height) {
         mYu12Frame.reset();
-        mYu12Frame = std::make_shared<AllocatedFrame>(v4lSize.width, v4lSize.height);
+        mYu12Frame = std::make_shared<AllocatedFrame>(decodeSize.width, decodeSize.height);
         int ret = mYu12Frame->allocate(&mYu12FrameLayout);
         if (ret != 0) {
             ALOGE("%s: allocating YU12 frame failed!", __FUNCTION__);
             return Status::INTERNAL_ERROR;
         }
+        mPipelinedYu12Frame.reset();
+        mPipelinedYu12Frame = std::make_shared<AllocatedFrame>(decodeSize.width, decodeSize.height);
+        ret = mPipelinedYu12Frame->allocate();
+        if (ret != 0) {
+            ALOGE("%s: allocating pipelined YU12 frame failed!", __FUNCTION__);
+            return Status::INTERNAL_ERROR;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> frameLk(mFreeYu12FramesLock);
+        mFreeYu12Frames = {mYu12Frame, mPipelinedYu12Frame};
     }
 
     // Allocating intermediate YU12 thumbnail frame
@@ -2177,8 +2280,8 @@ Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
     // Allocating scaled buffers
     for (const auto& stream : streams) {
         Size sz = {stream.width, stream.height};
-        if (sz == v4lSize) {
-            continue;  // Don't need an intermediate buffer same size as v4lBuffer
+        if (sz == decodeSize) {
+            continue;  // Don't need an intermediate buffer same size as the decoded frame
         }
         if (mIntermediateBuffers.count(sz) == 0) {
             // Create new intermediate buffer
@@ -2212,6 +2315,8 @@ Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
         }
     }
 
+    mDecodeSize = decodeSize;
+
     // Allocate mute test pattern frame
     mMuteTestPatternFrame.resize(mYu12Frame->mWidth * mYu12Frame->mHeight * 3);
 
@@ -2239,12 +2344,10 @@ void ExternalCameraDeviceSession::OutputThread::flush() {
     std::unique_lock<std::mutex> lk(mRequestListLock);
     std::list<std::shared_ptr<HalRequest>> reqs = std::move(mRequestList);
     mRequestList.clear();
-    if (mProcessingRequest) {
-        auto timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
-        auto st = mRequestDoneCond.wait_for(lk, timeout);
-        if (st == std::cv_status::timeout) {
-            ALOGE("%s: wait for inflight request finish timeout!", __FUNCTION__);
-        }
+    auto timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
+    if (!mRequestDoneCond.wait_for(lk, timeout,
+                                   [this] { return mProcessingFrameNumbers.empty(); })) {
+        ALOGE("%s: wait for inflight request finish timeout!", __FUNCTION__);
     }
 
     ALOGV("%s: flushing inflight requests", __FUNCTION__);
@@ -2255,9 +2358,13 @@ void ExternalCameraDeviceSession::OutputThread::flush() {
 }
 
 void ExternalCameraDeviceSession::OutputThread::dump(int fd) {
-    std::lock_guard<std::mutex> lk(mRequestListLock);
-    if (mProcessingRequest) {
-        dprintf(fd, "OutputThread processing frame %d\n", mProcessingFrameNumber);
+    std::unique_lock<std::mutex> lk(mRequestListLock);
+    if (!mProcessingFrameNumbers.empty()) {
+        dprintf(fd, "OutputThread processing frame: ");
+        for (const auto& frameNumber : mProcessingFrameNumbers) {
+            dprintf(fd, "%d, ", frameNumber);
+        }
+        dprintf(fd, "\n");
     } else {
         dprintf(fd, "OutputThread not processing any frames\n");
     }
@@ -2266,6 +2373,14 @@ void ExternalCameraDeviceSession::OutputThread::dump(int fd) {
         dprintf(fd, "%d, ", req->frameNumber);
     }
     dprintf(fd, "\n");
+    lk.unlock();
+
+    dprintf(fd, "OutputThread stage latency:\n");
+    mDecodeLatency.dump(fd, "decode");
+    mConvertLatency.dump(fd, "convert");
+    mJpegLatency.dump(fd, "jpeg");
+    mOutputLatency.dump(fd, "output");
+    mRequestLatency.dump(fd, "request");
 }
 
 void ExternalCameraDeviceSession::OutputThread::setExifMakeModel(const std::string& make,
@@ -2286,12 +2401,10 @@ ExternalCameraDeviceSession::OutputThread::switchToOffline() {
     std::unique_lock<std::mutex> lk(mRequestListLock);
     std::list<std::shared_ptr<HalRequest>> reqs = std::move(mRequestList);
     mRequestList.clear();
-    if (mProcessingRequest) {
-        auto timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
-        auto st = mRequestDoneCond.wait_for(lk, timeout);
-        if (st == std::cv_status::timeout) {
-            ALOGE("%s: wait for inflight request finish timeout!", __FUNCTION__);
-        }
+    auto timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
+    if (!mRequestDoneCond.wait_for(lk, timeout,
+                                   [this] { return mProcessingFrameNumbers.empty(); })) {
+        ALOGE("%s: wait for inflight request finish timeout!", __FUNCTION__);
     }
     lk.unlock();
     clearIntermediateBuffers();
@@ -2341,16 +2454,18 @@ void ExternalCameraDeviceSession::OutputThread::waitForNextRequest(
     }
     *out = mRequestList.front();
     mRequestList.pop_front();
-    mProcessingRequest = true;
-    mProcessingFrameNumber = (*out)->frameNumber;
+    mProcessingFrameNumbers.push_back((*out)->frameNumber);
 }
 
-void ExternalCameraDeviceSession::OutputThread::signalRequestDone() {
+void ExternalCameraDeviceSession::OutputThread::signalRequestDone(int32_t frameNumber) {
     std::unique_lock<std::mutex> lk(mRequestListLock);
-    mProcessingRequest = false;
-    mProcessingFrameNumber = 0;
+    auto it = std::find(mProcessingFrameNumbers.begin(), mProcessingFrameNumbers.end(),
+                        frameNumber);
+    if (it != mProcessingFrameNumbers.end()) {
+        mProcessingFrameNumbers.erase(it);
+    }
     lk.unlock();
-    mRequestDoneCond.notify_one();
+    mRequestDoneCond.notify_all();
 }
 
 int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
@@ -2391,18 +2506,21 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
         return 0;
     }
 
-    auto it = mScaledYu12Frames.find(outSz);
     std::shared_ptr<AllocatedFrame> scaledYu12Buf;
-    if (it != mScaledYu12Frames.end()) {
-        scaledYu12Buf = it->second;
-    } else {
-        it = mIntermediateBuffers.find(outSz);
-        if (it == mIntermediateBuffers.end()) {
-            ALOGE("%s: failed to find intermediate buffer size %dx%d", __FUNCTION__, outSz.width,
-                  outSz.height);
-            return -1;
+    {
+        std::lock_guard<std::mutex> lk(mScaledYu12FramesLock);
+        auto it = mScaledYu12Frames.find(outSz);
+        if (it != mScaledYu12Frames.end()) {
+            scaledYu12Buf = it->second;
+        } else {
+            it = mIntermediateBuffers.find(outSz);
+            if (it == mIntermediateBuffers.end()) {
+                ALOGE("%s: failed to find intermediate buffer size %dx%d", __FUNCTION__,
+                      outSz.width, outSz.height);
+                return -1;
+            }
+            scaledYu12Buf = it->second;
         }
-        scaledYu12Buf = it->second;
     }
     // Scale
     YCbCrLayout outLayout;
@@ -2429,6 +2547,7 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
     }
 
     *out = outLayout;
+    std::lock_guard<std::mutex> lk(mScaledYu12FramesLock);
     mScaledYu12Frames.insert({outSz, scaledYu12Buf});
     return 0;
 }
@@ -2558,6 +2677,13 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleThumbLocked(
 
 int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
         HalStreamBuffer& halBuf, const common::V1_0::helper::CameraMetadata& setting) {
+    return createJpegLocked(mYu12Frame, halBuf, setting);
+}
+
+int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
+        std::shared_ptr<AllocatedFrame>& in, HalStreamBuffer& halBuf,
+        const common::V1_0::helper::CameraMetadata& setting, const uint8_t* mjpegData,
+        size_t mjpegDataSize) {
     ATRACE_CALL();
     int ret;
     auto lfail = [&](auto... args) {
@@ -2575,7 +2701,7 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
           static_cast<uint64_t>(halBuf.bufferId), halBuf.width, halBuf.height);
     ALOGV("%s: HAL buffer fmt: %x usage: %" PRIx64 " ptr: %p", __FUNCTION__, halBuf.format,
           static_cast<uint64_t>(halBuf.usage), halBuf.bufPtr);
-    ALOGV("%s: YV12 buffer %d x %d", __FUNCTION__, mYu12Frame->mWidth, mYu12Frame->mHeight);
+    ALOGV("%s: YV12 buffer %d x %d", __FUNCTION__, in->mWidth, in->mHeight);
 
     int jpegQuality, thumbQuality;
     Size thumbSize;
@@ -2628,30 +2754,58 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     /* Temporary thumbnail code buffer */
     std::vector<uint8_t> thumbCode(outputThumbnail ? maxThumbCodeSize : 0);
 
-    YCbCrLayout yu12Thumb;
-    if (outputThumbnail) {
-        ret = cropAndScaleThumbLocked(mYu12Frame, thumbSize, &yu12Thumb);
-
-        if (ret != 0) {
-            return lfail("%s: crop and scale thumbnail failed!", __FUNCTION__);
-        }
-    }
-
     /* Scale and crop main jpeg */
-    ret = cropAndScaleLocked(mYu12Frame, jpegSize, &yu12Main);
+    ret = cropAndScaleLocked(in, jpegSize, &yu12Main);
 
     if (ret != 0) {
         return lfail("%s: crop and scale main failed!", __FUNCTION__);
     }
 
-    /* Encode the thumbnail image */
-    if (outputThumbnail) {
-        ret = encodeJpegYU12(thumbSize, yu12Thumb, thumbQuality, 0, 0, &thumbCode[0],
-                             maxThumbCodeSize, thumbCodeSize);
+    if (mJpegEncoder == nullptr) {
+        size_t numThreads = std::clamp<size_t>(std::thread::hardware_concurrency(), 1,
+                                               kMaxJpegEncodeThreads);
+        mJpegEncoder = std::make_unique<JpegEncoder>(numThreads);
+        mThumbEncoder = std::make_unique<JpegEncoder>(1);
+    }
+
+    /* The thumbnail is cropped, scaled and encoded while the main image is being encoded */
+    auto encodeThumb = [&]() {
+        if (!outputThumbnail) {
+            return 0;
+        }
+
+        YCbCrLayout yu12Thumb;
+        int ret = cropAndScaleThumbLocked(in, thumbSize, &yu12Thumb);
+        if (ret != 0) {
+            ALOGE("%s: crop and scale thumbnail failed!", __FUNCTION__);
+            return ret;
+        }
 
+        ret = mThumbEncoder->encode(thumbSize, yu12Thumb, thumbQuality, nullptr, 0, &thumbCode[0],
+                                    maxThumbCodeSize, thumbCodeSize);
         if (ret != 0) {
-            return lfail("%s: thumbnail encodeJpegYU12 failed with %d", __FUNCTION__, ret);
+            ALOGE("%s: thumbnail encoding failed with %d", __FUNCTION__, ret);
         }
+        return ret;
+    };
+
+    /* If the camera already encoded the main image at the requested size, reuse its MJPEG
+     * frame instead of encoding the decoded frame again. This skips the most expensive step of
+     * a still capture and a second round of compression loss, at the cost of ignoring the
+     * requested JPEG quality. Fall back to encoding if the frame cannot be passed through */
+    bool tryPassthrough = mjpegData != nullptr &&
+                          static_cast<uint32_t>(jpegSize.width) == in->mWidth &&
+                          static_cast<uint32_t>(jpegSize.height) == in->mHeight;
+    ATRACE_BEGIN("encodeJpeg");
+    if (tryPassthrough) {
+        ret = encodeThumb();
+    } else {
+        ret = mJpegEncoder->encodeStripes(jpegSize, yu12Main, jpegQuality, encodeThumb);
+    }
+    ATRACE_END();
+
+    if (ret != 0) {
+        return lfail("%s: JPEG encoding failed with %d", __FUNCTION__, ret);
     }
 
     /* Combine camera characteristics with request settings to form EXIF
@@ -2686,9 +2840,26 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
         return lfail("%s: could not lock %zu bytes", __FUNCTION__, maxJpegCodeSize);
     }
 
-    /* Encode the main jpeg image */
-    ret = encodeJpegYU12(jpegSize, yu12Main, jpegQuality, exifData, exifDataSize, bufPtr,
-                         maxJpegCodeSize, jpegCodeSize);
+    /* The main image goes in front of the CameraBlob trailer */
+    const size_t maxMainCodeSize = maxJpegCodeSize - sizeof(CameraBlob);
+    bool passedThrough = false;
+    ret = 0;
+    if (tryPassthrough) {
+        ATRACE_BEGIN("MJPGPassthrough");
+        passedThrough = convertMjpegToJpeg(mjpegData, mjpegDataSize, jpegSize, exifData,
+                                           exifDataSize, bufPtr, maxMainCodeSize,
+                                           jpegCodeSize) == 0;
+        ATRACE_END();
+        if (!passedThrough) {
+            ALOGV("%s: cannot pass MJPEG frame through, encoding instead", __FUNCTION__);
+            ret = mJpegEncoder->encodeStripes(jpegSize, yu12Main, jpegQuality);
+        }
+    }
+
+    /* Write the encoded main image behind the APP1 segment */
+    if (!passedThrough && ret == 0) {
+        ret = mJpegEncoder->finish(exifData, exifDataSize, bufPtr, maxMainCodeSize, jpegCodeSize);
+    }
 
     /* TODO: Not sure this belongs here, maybe better to pass jpegCodeSize out
      * and do this when returning buffer to parent */
@@ -2705,7 +2876,7 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
 
     /* Check if our JPEG actually succeeded */
     if (ret != 0) {
-        return lfail("%s: encodeJpegYU12 failed with %d", __FUNCTION__, ret);
+        return lfail("%s: JPEG encoding failed with %d", __FUNCTION__, ret);
     }
 
     ALOGV("%s: encoded JPEG (ret:%d) with Q:%d max size: %zu", __FUNCTION__, ret, jpegQuality,
@@ -2717,12 +2888,42 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
 void ExternalCameraDeviceSession::OutputThread::clearIntermediateBuffers() {
     std::lock_guard<std::mutex> lk(mBufferLock);
     mYu12Frame.reset();
+    mPipelinedYu12Frame.reset();
+    {
+        std::lock_guard<std::mutex> frameLk(mFreeYu12FramesLock);
+        mFreeYu12Frames.clear();
+    }
     mYu12ThumbFrame.reset();
     mIntermediateBuffers.clear();
     mMuteTestPatternFrame.clear();
     mBlobBufferSize = 0;
 }
 
+std::shared_ptr<AllocatedFrame> ExternalCameraDeviceSession::OutputThread::acquireYu12Frame() {
+    std::unique_lock<std::mutex> lk(mFreeYu12FramesLock);
+    auto timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
+    if (!mYu12FrameReleasedCond.wait_for(lk, timeout,
+                                         [this] { return !mFreeYu12Frames.empty(); })) {
+        ALOGE("%s: wait for a free YU12 frame timeout!", __FUNCTION__);
+        return nullptr;
+    }
+    std::shared_ptr<AllocatedFrame> frame = mFreeYu12Frames.back();
+    mFreeYu12Frames.pop_back();
+    return frame;
+}
+
+void ExternalCameraDeviceSession::OutputThread::releaseYu12Frame(
+        const std::shared_ptr<AllocatedFrame>& frame) {
+    std::unique_lock<std::mutex> lk(mFreeYu12FramesLock);
+    // Drop frames from before the intermediate buffers were reallocated or cleared
+    if (frame == nullptr || (frame != mYu12Frame && frame != mPipelinedYu12Frame)) {
+        return;
+    }
+    mFreeYu12Frames.push_back(frame);
+    lk.unlock();
+    mYu12FrameReleasedCond.notify_one();
+}
+
 bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
     std::shared_ptr<HalRequest> req;
     auto parent = mParent.lock();
@@ -2731,6 +2932,11 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         return false;
     }
 
+    if (mOutputStageThread == nullptr) {
+        mOutputStageThread = std::make_unique<OutputStageThread>(this);
+        mOutputStageThread->run();
+    }
+
     // TODO: maybe we need to setup a sensor thread to dq/enq v4l frames
     //       regularly to prevent v4l buffer queue filled with stale buffers
     //       when app doesn't program a preview request
@@ -2739,11 +2945,12 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         // No new request, wait again
         return true;
     }
+    nsecs_t startTime = systemTime();
 
     auto onDeviceError = [&](auto... args) {
         ALOGE(args...);
         parent->notifyError(req->frameNumber, /*stream*/ -1, ErrorCode::ERROR_DEVICE);
-        signalRequestDone();
+        signalRequestDone(req->frameNumber);
         return false;
     };
 
@@ -2760,15 +2967,13 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         return onDeviceError("%s: failed to send buffer request!", __FUNCTION__);
     }
 
-    std::unique_lock<std::mutex> lk(mBufferLock);
-    // Convert input V4L2 frame to YU12 of the same size
-    // TODO: see if we can save some computation by converting to YV12 here
     uint8_t* inData;
     size_t inDataSize;
     if (req->frameIn->getData(&inData, &inDataSize) != 0) {
-        lk.unlock();
         return onDeviceError("%s: V4L2 buffer map failed", __FUNCTION__);
     }
+    Size inSize{static_cast<int32_t>(req->frameIn->mWidth),
+                static_cast<int32_t>(req->frameIn->mHeight)};
 
     // Process camera mute state
     auto testPatternMode = req->setting.find(ANDROID_SENSOR_TEST_PATTERN_MODE);
@@ -2794,53 +2999,251 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         }
     }
 
-    // TODO: in some special case maybe we can decode jpg directly to gralloc output?
+    // A request with a single YUV output of the decoded size, typically preview only, has the
+    // MJPEG frame decoded straight into its output buffer, skipping the YU12 frame and the copy
+    // out of it. This needs the output buffer before the decode starts.
+    bool buffersReady = false;
+    if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG && !mCameraMuted && req->buffers.size() == 1 &&
+        (req->buffers[0].format == PixelFormat::YCBCR_420_888 ||
+         req->buffers[0].format == PixelFormat::YV12) &&
+        Size{req->buffers[0].width, req->buffers[0].height} == mDecodeSize) {
+        ATRACE_BEGIN("Wait for BufferRequest done");
+        res = waitForBufferRequestDone(&req->buffers);
+        ATRACE_END();
+        if (res != 0) {
+            ALOGE("%s: wait for BufferRequest done failed! res %d", __FUNCTION__, res);
+            return onDeviceError("%s: failed to process buffer request error!", __FUNCTION__);
+        }
+        buffersReady = true;
+
+        if (decodeToOutputBuffer(req->buffers[0], inData, inDataSize, inSize) == 0) {
+            DecodedRequest decoded{req, nullptr, startTime};
+            decoded.decodedToOutput = true;
+            if (!submitDecodedRequest(std::move(decoded))) {
+                return onDeviceError("%s: output stage stopped after a device error",
+                                     __FUNCTION__);
+            }
+            return true;
+        }
+        // Otherwise decode into a YU12 frame as usual, the output stage reports a missing buffer
+        ALOGV("%s: cannot decode into the output buffer directly", __FUNCTION__);
+    }
+
+    // Blocks until the output stage is done with one of the YU12 frames, which bounds the number
+    // of decoded requests waiting for the output stage.
+    ATRACE_BEGIN("Wait for free YU12 frame");
+    std::shared_ptr<AllocatedFrame> yu12Frame = acquireYu12Frame();
+    ATRACE_END();
+    if (yu12Frame == nullptr) {
+        return onDeviceError("%s: no YU12 frame to decode into", __FUNCTION__);
+    }
+
+    // Convert input V4L2 frame to YU12, scaled down to mDecodeSize
     if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG) {
+        YCbCrLayout yu12Layout;
+        yu12Frame->getLayout(&yu12Layout);
         ATRACE_BEGIN("MJPGtoI420");
+        nsecs_t decodeStart = systemTime();
         res = 0;
         if (mCameraMuted) {
             res = libyuv::ConvertToI420(
                     mMuteTestPatternFrame.data(), mMuteTestPatternFrame.size(),
-                    static_cast<uint8_t*>(mYu12FrameLayout.y), mYu12FrameLayout.yStride,
-                    static_cast<uint8_t*>(mYu12FrameLayout.cb), mYu12FrameLayout.cStride,
-                    static_cast<uint8_t*>(mYu12FrameLayout.cr), mYu12FrameLayout.cStride, 0, 0,
-                    mYu12Frame->mWidth, mYu12Frame->mHeight, mYu12Frame->mWidth,
-                    mYu12Frame->mHeight, libyuv::kRotate0, libyuv::FOURCC_RAW);
+                    static_cast<uint8_t*>(yu12Layout.y), yu12Layout.yStride,
+                    static_cast<uint8_t*>(yu12Layout.cb), yu12Layout.cStride,
+                    static_cast<uint8_t*>(yu12Layout.cr), yu12Layout.cStride, 0, 0,
+                    yu12Frame->mWidth, yu12Frame->mHeight, yu12Frame->mWidth, yu12Frame->mHeight,
+                    libyuv::kRotate0, libyuv::FOURCC_RAW);
         } else {
-            res = libyuv::MJPGToI420(
-                    inData, inDataSize, static_cast<uint8_t*>(mYu12FrameLayout.y),
-                    mYu12FrameLayout.yStride, static_cast<uint8_t*>(mYu12FrameLayout.cb),
-                    mYu12FrameLayout.cStride, static_cast<uint8_t*>(mYu12FrameLayout.cr),
-                    mYu12FrameLayout.cStride, mYu12Frame->mWidth, mYu12Frame->mHeight,
-                    mYu12Frame->mWidth, mYu12Frame->mHeight);
+            res = decodeMjpeg(inData, inDataSize, inSize,
+                              Size{static_cast<int32_t>(yu12Frame->mWidth),
+                                   static_cast<int32_t>(yu12Frame->mHeight)},
+                              yu12Layout);
         }
+        mDecodeLatency.record(systemTime() - decodeStart);
         ATRACE_END();
 
         if (res != 0) {
             // For some webcam, the first few V4L2 frames might be malformed...
             ALOGE("%s: Convert V4L2 frame to YU12 failed! res %d", __FUNCTION__, res);
-            lk.unlock();
-            Status st = parent->processCaptureRequestError(req);
-            if (st != Status::OK) {
-                return onDeviceError("%s: failed to process capture request error!", __FUNCTION__);
+            releaseYu12Frame(yu12Frame);
+            DecodedRequest decoded{req, nullptr, startTime};
+            decoded.decodeFailed = true;
+            if (!submitDecodedRequest(std::move(decoded))) {
+                return onDeviceError("%s: output stage stopped after a device error",
+                                     __FUNCTION__);
             }
-            signalRequestDone();
             return true;
         }
     }
 
-    ATRACE_BEGIN("Wait for BufferRequest done");
-    res = waitForBufferRequestDone(&req->buffers);
-    ATRACE_END();
+    if (!buffersReady) {
+        ATRACE_BEGIN("Wait for BufferRequest done");
+        res = waitForBufferRequestDone(&req->buffers);
+        ATRACE_END();
 
-    if (res != 0) {
-        ALOGE("%s: wait for BufferRequest done failed! res %d", __FUNCTION__, res);
-        lk.unlock();
-        return onDeviceError("%s: failed to process buffer request error!", __FUNCTION__);
+        if (res != 0) {
+            ALOGE("%s: wait for BufferRequest done failed! res %d", __FUNCTION__, res);
+            releaseYu12Frame(yu12Frame);
+            return onDeviceError("%s: failed to process buffer request error!", __FUNCTION__);
+        }
+    }
+
+    // JPEG outputs can only reuse MJPEG frames decoded at full scale
+    bool mjpegPassthrough = req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG && !mCameraMuted &&
+                            yu12Frame->mWidth == req->frameIn->mWidth &&
+                            yu12Frame->mHeight == req->frameIn->mHeight;
+    if (!submitDecodedRequest({req, yu12Frame, startTime, mjpegPassthrough})) {
+        releaseYu12Frame(yu12Frame);
+        return onDeviceError("%s: output stage stopped after a device error", __FUNCTION__);
+    }
+    return true;
+}
+
+bool ExternalCameraDeviceSession::OutputThread::submitDecodedRequest(DecodedRequest&& decoded) {
+    std::unique_lock<std::mutex> lk(mOutputStageLock);
+    if (mOutputStageFailed) {
+        return false;
+    }
+    mDecodedRequests.push_back(std::move(decoded));
+    lk.unlock();
+    mDecodedRequestCond.notify_one();
+    return true;
+}
+
+void ExternalCameraDeviceSession::OutputThread::failOutputStage(
+        const std::shared_ptr<OutputThreadInterface>& parent) {
+    std::unique_lock<std::mutex> lk(mOutputStageLock);
+    mOutputStageFailed = true;
+    std::deque<DecodedRequest> decodedRequests = std::move(mDecodedRequests);
+    mDecodedRequests.clear();
+    lk.unlock();
+
+    for (auto& decoded : decodedRequests) {
+        releaseYu12Frame(decoded.yu12Frame);
+        parent->processCaptureRequestError(decoded.request);
+        signalRequestDone(decoded.request->frameNumber);
+    }
+}
+
+bool ExternalCameraDeviceSession::OutputThread::outputStageThreadLoop() {
+    DecodedRequest decoded;
+    {
+        std::unique_lock<std::mutex> lk(mOutputStageLock);
+        // Time out regularly so that the exit request is noticed
+        auto timeout = std::chrono::milliseconds(kReqWaitTimeoutMs);
+        if (!mDecodedRequestCond.wait_for(lk, timeout,
+                                          [this] { return !mDecodedRequests.empty(); })) {
+            return true;
+        }
+        decoded = std::move(mDecodedRequests.front());
+        mDecodedRequests.pop_front();
+    }
+
+    std::shared_ptr<HalRequest>& req = decoded.request;
+    auto parent = mParent.lock();
+    if (parent == nullptr) {
+        ALOGE("%s: session has been disconnected!", __FUNCTION__);
+        releaseYu12Frame(decoded.yu12Frame);
+        signalRequestDone(req->frameNumber);
+        return false;
+    }
+
+    auto onDeviceError = [&](auto... args) {
+        ALOGE(args...);
+        parent->notifyError(req->frameNumber, /*stream*/ -1, ErrorCode::ERROR_DEVICE);
+        signalRequestDone(req->frameNumber);
+        failOutputStage(parent);
+        return false;
+    };
+
+    if (decoded.decodeFailed) {
+        Status st = parent->processCaptureRequestError(req);
+        if (st != Status::OK) {
+            return onDeviceError("%s: failed to process capture request error!", __FUNCTION__);
+        }
+        signalRequestDone(req->frameNumber);
+        return true;
     }
 
     ALOGV("%s processing new request", __FUNCTION__);
-    const int kSyncWaitTimeoutMs = 500;
+    int ret = processOutputBuffers(decoded);
+    releaseYu12Frame(decoded.yu12Frame);
+    if (ret != 0) {
+        return onDeviceError("%s: failed to process output buffers with %d", __FUNCTION__, ret);
+    }
+
+    Status st = parent->processCaptureResult(req);
+    if (st != Status::OK) {
+        return onDeviceError("%s: failed to process capture result!", __FUNCTION__);
+    }
+    mRequestLatency.record(systemTime() - decoded.startTime);
+    signalRequestDone(req->frameNumber);
+    return true;
+}
+
+int ExternalCameraDeviceSession::OutputThread::decodeToOutputBuffer(HalStreamBuffer& halBuf,
+                                                                    uint8_t* inData,
+                                                                    size_t inDataSize,
+                                                                    const Size& inSize) {
+    ATRACE_CALL();
+    if (*(halBuf.bufPtr) == nullptr) {
+        return -1;
+    }
+    if (halBuf.acquireFence >= 0) {
+        if (sync_wait(halBuf.acquireFence, kSyncWaitTimeoutMs) != 0) {
+            return -1;
+        }
+        ::close(halBuf.acquireFence);
+        halBuf.acquireFence = -1;
+    }
+
+    nsecs_t decodeStart = systemTime();
+    IMapper::Rect outRect{0, 0, static_cast<int32_t>(halBuf.width),
+                          static_cast<int32_t>(halBuf.height)};
+    YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
+            *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), outRect);
+    if (outLayout.y == nullptr) {
+        ALOGE("%s: failed to lock output buffer", __FUNCTION__);
+        return -1;
+    }
+
+    ATRACE_BEGIN("MJPGtoOutput");
+    int ret = decodeMjpeg(inData, inDataSize, inSize, Size{halBuf.width, halBuf.height},
+                          outLayout);
+    ATRACE_END();
+
+    int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+    if (relFence >= 0) {
+        halBuf.acquireFence = relFence;
+    }
+    mDecodeLatency.record(systemTime() - decodeStart);
+    return ret;
+}
+
+int ExternalCameraDeviceSession::OutputThread::processOutputBuffers(DecodedRequest& decoded) {
+    ATRACE_CALL();
+    if (decoded.decodedToOutput) {
+        // The only output buffer was filled by the decode stage
+        return 0;
+    }
+
+    nsecs_t outputStart = systemTime();
+
+    std::shared_ptr<AllocatedFrame>& in = decoded.yu12Frame;
+    std::shared_ptr<HalRequest>& req = decoded.request;
+    const bool mjpegPassthrough = decoded.mjpegPassthrough;
+    std::lock_guard<std::mutex> lk(mBufferLock);
+
+    uint8_t* inData;
+    size_t inDataSize;
+    if (req->frameIn->getData(&inData, &inDataSize) != 0) {
+        ALOGE("%s: V4L2 buffer map failed", __FUNCTION__);
+        return -1;
+    }
+
+    // Output buffers of the same size share one intermediate scaled buffer, so they are filled
+    // one after another by the same job. Buffers of different sizes are filled in parallel.
+    std::vector<std::vector<HalStreamBuffer*>> buffersBySize;
     for (auto& halBuf : req->buffers) {
         if (*(halBuf.bufPtr) == nullptr) {
             ALOGW("%s: buffer for stream %d missing", __FUNCTION__, halBuf.streamId);
@@ -2859,81 +3262,121 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
             continue;
         }
 
-        // Gralloc lockYCbCr the buffer
-        switch (halBuf.format) {
-            case PixelFormat::BLOB: {
-                int ret = createJpegLocked(halBuf, req->setting);
+        auto it = std::find_if(buffersBySize.begin(), buffersBySize.end(), [&](const auto& bufs) {
+            return bufs[0]->width == halBuf.width && bufs[0]->height == halBuf.height;
+        });
+        if (it == buffersBySize.end()) {
+            buffersBySize.push_back({&halBuf});
+        } else {
+            it->push_back(&halBuf);
+        }
+    }
 
+    std::vector<std::function<int()>> jobs;
+    for (const auto& bufs : buffersBySize) {
+        jobs.push_back([&, bufs]() {
+            for (HalStreamBuffer* halBuf : bufs) {
+                int ret = processOutputBufferLocked(in, *halBuf, req->setting, inData, inDataSize,
+                                                    mjpegPassthrough);
                 if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: createJpegLocked failed with %d", __FUNCTION__, ret);
+                    return ret;
                 }
-            } break;
-            case PixelFormat::Y16: {
-                void* outLayout = sHandleImporter.lock(
-                        *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), inDataSize);
+            }
+            return 0;
+        });
+    }
 
-                std::memcpy(outLayout, inData, inDataSize);
+    int ret = 0;
+    if (jobs.size() == 1) {
+        ret = jobs[0]();
+    } else if (!jobs.empty()) {
+        if (mOutputWorkers == nullptr) {
+            mOutputWorkers = std::make_unique<WorkerPool>(kNumOutputWorkers);
+        }
+        ret = mOutputWorkers->run(jobs);
+    }
 
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
-                if (relFence >= 0) {
-                    halBuf.acquireFence = relFence;
-                }
-            } break;
-            case PixelFormat::YCBCR_420_888:
-            case PixelFormat::YV12: {
-                IMapper::Rect outRect{0, 0, static_cast<int32_t>(halBuf.width),
-                                      static_cast<int32_t>(halBuf.height)};
-                YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
-                        *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), outRect);
-                ALOGV("%s: outLayout y %p cb %p cr %p y_str %d c_str %d c_step %d", __FUNCTION__,
-                      outLayout.y, outLayout.cb, outLayout.cr, outLayout.yStride, outLayout.cStride,
-                      outLayout.chromaStep);
-
-                // Convert to output buffer size/format
-                uint32_t outputFourcc = getFourCcFromLayout(outLayout);
-                ALOGV("%s: converting to format %c%c%c%c", __FUNCTION__, outputFourcc & 0xFF,
-                      (outputFourcc >> 8) & 0xFF, (outputFourcc >> 16) & 0xFF,
-                      (outputFourcc >> 24) & 0xFF);
-
-                YCbCrLayout cropAndScaled;
-                ATRACE_BEGIN("cropAndScaleLocked");
-                int ret = cropAndScaleLocked(mYu12Frame, Size{halBuf.width, halBuf.height},
-                                             &cropAndScaled);
-                ATRACE_END();
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: crop and scale failed!", __FUNCTION__);
-                }
+    {
+        std::lock_guard<std::mutex> scaledLk(mScaledYu12FramesLock);
+        mScaledYu12Frames.clear();
+    }
+    mOutputLatency.record(systemTime() - outputStart);
+    return ret;
+}
 
-                Size sz{halBuf.width, halBuf.height};
-                ATRACE_BEGIN("formatConvert");
-                ret = formatConvert(cropAndScaled, outLayout, sz, outputFourcc);
-                ATRACE_END();
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: format conversion failed!", __FUNCTION__);
-                }
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
-                if (relFence >= 0) {
-                    halBuf.acquireFence = relFence;
-                }
-            } break;
-            default:
-                lk.unlock();
-                return onDeviceError("%s: unknown output format %x", __FUNCTION__, halBuf.format);
-        }
-    }  // for each buffer
-    mScaledYu12Frames.clear();
+int ExternalCameraDeviceSession::OutputThread::processOutputBufferLocked(
+        std::shared_ptr<AllocatedFrame>& in, HalStreamBuffer& halBuf,
+        const common::V1_0::helper::CameraMetadata& setting, uint8_t* inData, size_t inDataSize,
+        bool mjpegPassthrough) {
+    // Gralloc lockYCbCr the buffer
+    switch (halBuf.format) {
+        case PixelFormat::BLOB: {
+            nsecs_t jpegStart = systemTime();
+            int ret = mjpegPassthrough ? createJpegLocked(in, halBuf, setting, inData, inDataSize)
+                                       : createJpegLocked(in, halBuf, setting);
+            mJpegLatency.record(systemTime() - jpegStart);
 
-    // Don't hold the lock while calling back to parent
-    lk.unlock();
-    Status st = parent->processCaptureResult(req);
-    if (st != Status::OK) {
-        return onDeviceError("%s: failed to process capture result!", __FUNCTION__);
+            if (ret != 0) {
+                ALOGE("%s: createJpegLocked failed with %d", __FUNCTION__, ret);
+                return ret;
+            }
+        } break;
+        case PixelFormat::Y16: {
+            void* outLayout = sHandleImporter.lock(*(halBuf.bufPtr),
+                                                   static_cast<uint64_t>(halBuf.usage), inDataSize);
+
+            std::memcpy(outLayout, inData, inDataSize);
+
+            int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+            if (relFence >= 0) {
+                halBuf.acquireFence = relFence;
+            }
+        } break;
+        case PixelFormat::YCBCR_420_888:
+        case PixelFormat::YV12: {
+            nsecs_t convertStart = systemTime();
+            IMapper::Rect outRect{0, 0, static_cast<int32_t>(halBuf.width),
+                                  static_cast<int32_t>(halBuf.height)};
+            YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
+                    *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), outRect);
+            ALOGV("%s: outLayout y %p cb %p cr %p y_str %d c_str %d c_step %d", __FUNCTION__,
+                  outLayout.y, outLayout.cb, outLayout.cr, outLayout.yStride, outLayout.cStride,
+                  outLayout.chromaStep);
+
+            // Convert to output buffer size/format
+            uint32_t outputFourcc = getFourCcFromLayout(outLayout);
+            ALOGV("%s: converting to format %c%c%c%c", __FUNCTION__, outputFourcc & 0xFF,
+                  (outputFourcc >> 8) & 0xFF, (outputFourcc >> 16) & 0xFF,
+                  (outputFourcc >> 24) & 0xFF);
+
+            YCbCrLayout cropAndScaled;
+            ATRACE_BEGIN("cropAndScaleLocked");
+            int ret = cropAndScaleLocked(in, Size{halBuf.width, halBuf.height}, &cropAndScaled);
+            ATRACE_END();
+            if (ret != 0) {
+                ALOGE("%s: crop and scale failed!", __FUNCTION__);
+                return ret;
+            }
+
+            Size sz{halBuf.width, halBuf.height};
+            ATRACE_BEGIN("formatConvert");
+            ret = formatConvert(cropAndScaled, outLayout, sz, outputFourcc);
+            ATRACE_END();
+            if (ret != 0) {
+                ALOGE("%s: format conversion failed!", __FUNCTION__);
+                return ret;
+            }
+            int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+            if (relFence >= 0) {
+                halBuf.acquireFence = relFence;
+            }
+            mConvertLatency.record(systemTime() - convertStart);
+        } break;
+        default:
+            ALOGE("%s: unknown output format %x", __FUNCTION__, halBuf.format);
+            return -1;
     }
-    signalRequestDone();
-    return true;
+    return 0;
 }
 
 // End ExternalCameraDeviceSession::OutputThread functions
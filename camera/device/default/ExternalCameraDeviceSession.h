@@ -25,6 +25,7 @@
 #include <aidl/android/hardware/camera/device/Stream.h>
 #include <android-base/unique_fd.h>
 #include <fmq/AidlMessageQueue.h>
+#include <linux/videodev2.h>
 #include <utils/Thread.h>
 #include <deque>
 #include <list>
@@ -164,23 +165,31 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
                      std::shared_ptr<BufferRequestThread> bufReqThread);
         ~OutputThread();
 
-        Status allocateIntermediateBuffers(const Size& v4lSize, const Size& thumbSize,
+        // decodeSize is the size of the YU12 frames V4L2 frames are decoded into
+        Status allocateIntermediateBuffers(const Size& decodeSize, const Size& thumbSize,
                                            const std::vector<Stream>& streams,
                                            uint32_t blobBufferSize);
         Status submitRequest(const std::shared_ptr<HalRequest>&);
         void flush();
         void dump(int fd);
         bool threadLoop() override;
+        // Stops and joins the output stage thread. Called after this thread has exited, as it
+        // starts the output stage thread.
+        void stopOutputStage();
 
         void setExifMakeModel(const std::string& make, const std::string& model);
 
         // The remaining request list is returned for offline processing
         std::list<std::shared_ptr<HalRequest>> switchToOffline();
 
+        // Runs the processing stages on recorded frames without a camera
+        friend class ExternalCameraPipelineBenchmark;
+
       protected:
         static const int kFlushWaitTimeoutSec = 3;  // 3 sec
         static const int kReqWaitTimeoutMs = 33;    // 33ms
         static const int kReqWaitTimesMax = 90;     // 33ms * 90 ~= 3 sec
+        static const int kSyncWaitTimeoutMs = 500;  // 500ms
 
         // Methods to request output buffer in parallel
         int requestBufferStart(const std::vector<HalStreamBuffer>&);
@@ -188,7 +197,7 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
                 /*out*/ std::vector<HalStreamBuffer>*);
 
         void waitForNextRequest(std::shared_ptr<HalRequest>* out);
-        void signalRequestDone();
+        void signalRequestDone(int32_t frameNumber);
 
         int cropAndScaleLocked(std::shared_ptr<AllocatedFrame>& in, const Size& outSize,
                                YCbCrLayout* out);
@@ -198,20 +207,78 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
 
         int createJpegLocked(HalStreamBuffer& halBuf,
                              const common::V1_0::helper::CameraMetadata& settings);
+        // If mjpegData is set, it is the MJPEG frame that 'in' was decoded from. When no cropping
+        // or scaling is needed, it is passed through as the main image instead of encoding 'in'
+        // again.
+        int createJpegLocked(std::shared_ptr<AllocatedFrame>& in, HalStreamBuffer& halBuf,
+                             const common::V1_0::helper::CameraMetadata& settings,
+                             const uint8_t* mjpegData = nullptr, size_t mjpegDataSize = 0);
 
         void clearIntermediateBuffers();
 
+        // The request processing is split into two pipelined stages so that the decode of frame
+        // N+1 overlaps the output processing of frame N:
+        //   - decode stage (this thread, threadLoop): waits for the next request, requests output
+        //     buffers and decodes the V4L2 frame into a free YU12 frame.
+        //   - output stage (mOutputStageThread): fills the output buffers from the decoded frame,
+        //     converting independent buffers in parallel on mOutputWorkers, and returns the
+        //     result. Requests leave the output stage in the order they were submitted.
+        // The offline session reuses this class with its own serial threadLoop and does not start
+        // the output stage.
+        class OutputStageThread : public SimpleThread {
+          public:
+            explicit OutputStageThread(OutputThread* parent) : mParent(parent) {}
+
+          protected:
+            bool threadLoop() override { return mParent->outputStageThreadLoop(); }
+
+          private:
+            OutputThread* const mParent;
+        };
+
+        struct DecodedRequest {
+            std::shared_ptr<HalRequest> request;
+            std::shared_ptr<AllocatedFrame> yu12Frame;
+            nsecs_t startTime = 0;  // when the decode stage picked up the request
+            // The V4L2 frame is an MJPEG image of yu12Frame that JPEG outputs can reuse, i.e. it
+            // is MJPEG, decoded at full scale and the camera is not muted.
+            bool mjpegPassthrough = false;
+            // The only output buffer was decoded into directly, yu12Frame is null.
+            bool decodedToOutput = false;
+            // The V4L2 frame could not be decoded, yu12Frame is null. The output stage errors out
+            // the request, so that results are still returned in order.
+            bool decodeFailed = false;
+        };
+
+        bool outputStageThreadLoop();
+        // Hands a decoded request over to the output stage. Fails if the output stage has stopped.
+        bool submitDecodedRequest(DecodedRequest&& decoded);
+        // Stops the output stage after a device error and errors out all the queued requests.
+        void failOutputStage(const std::shared_ptr<OutputThreadInterface>& parent);
+        // Decodes the MJPEG frame straight into the output buffer, which must have the size of
+        // the decoded frame. Returns non-zero if the buffer is not ready or the decode failed.
+        int decodeToOutputBuffer(HalStreamBuffer& halBuf, uint8_t* inData, size_t inDataSize,
+                                 const Size& inSize);
+        int processOutputBuffers(DecodedRequest& decoded);
+        int processOutputBufferLocked(std::shared_ptr<AllocatedFrame>& in, HalStreamBuffer& halBuf,
+                                      const common::V1_0::helper::CameraMetadata& settings,
+                                      uint8_t* inData, size_t inDataSize, bool mjpegPassthrough);
+
+        // Returns nullptr if no YU12 frame is returned in time
+        std::shared_ptr<AllocatedFrame> acquireYu12Frame();
+        void releaseYu12Frame(const std::shared_ptr<AllocatedFrame>& frame);
+
         const std::weak_ptr<OutputThreadInterface> mParent;
         const CroppingType mCroppingType;
         const common::V1_0::helper::CameraMetadata mCameraCharacteristics;
 
-        mutable std::mutex mRequestListLock;       // Protect access to mRequestList,
-                                                   // mProcessingRequest and mProcessingFrameNumber
+        mutable std::mutex mRequestListLock;       // Protect access to mRequestList and
+                                                   // mProcessingFrameNumbers
         std::condition_variable mRequestCond;      // signaled when a new request is submitted
         std::condition_variable mRequestDoneCond;  // signaled when a request is done processing
         std::list<std::shared_ptr<HalRequest>> mRequestList;
-        bool mProcessingRequest = false;
-        uint32_t mProcessingFrameNumber = 0;
+        // Requests taken off mRequestList and not done yet, in either stage of the pipeline
+        std::list<int32_t> mProcessingFrameNumbers;
 
         // V4L2 frameIn
         // (MJPG decode)-> mYu12Frame
@@ -219,6 +286,16 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
         // (Format convert) -> output gralloc frames
         mutable std::mutex mBufferLock;  // Protect access to intermediate buffers
         std::shared_ptr<AllocatedFrame> mYu12Frame;
+        // The size V4L2 frames are decoded to, smaller than the V4L2 frame if MJPEG frames are
+        // decoded at a reduced scale. Only written when streams are configured.
+        Size mDecodeSize{0, 0};
+        // The second YU12 frame for the decode stage to decode into while the output stage is
+        // still reading mYu12Frame, and vice versa.
+        std::shared_ptr<AllocatedFrame> mPipelinedYu12Frame;
+        std::mutex mFreeYu12FramesLock;  // Protect access to mFreeYu12Frames
+        std::condition_variable mYu12FrameReleasedCond;
+        std::vector<std::shared_ptr<AllocatedFrame>> mFreeYu12Frames;
+        std::mutex mScaledYu12FramesLock;  // Protect mScaledYu12Frames against parallel jobs
         std::shared_ptr<AllocatedFrame> mYu12ThumbFrame;
         std::unordered_map<Size, std::shared_ptr<AllocatedFrame>, SizeHasher> mIntermediateBuffers;
         std::unordered_map<Size, std::shared_ptr<AllocatedFrame>, SizeHasher> mScaledYu12Frames;
@@ -233,6 +310,31 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
         std::string mExifModel;
 
         const std::shared_ptr<BufferRequestThread> mBufferRequestThread;
+
+        // Output buffers of a request are converted by at most this many workers plus the output
+        // stage thread itself, one per stream size.
+        static const int kNumOutputWorkers = kMaxProcessedStream + kMaxStallStream - 1;
+        // Only accessed by the decode stage thread, started on the first threadLoop
+        std::unique_ptr<OutputStageThread> mOutputStageThread;
+        // Only accessed by the output stage thread
+        std::unique_ptr<WorkerPool> mOutputWorkers;
+        // JPEG encoders of the BLOB stream, created on the first capture. Only accessed by the
+        // thread running createJpegLocked.
+        static const size_t kMaxJpegEncodeThreads = 4;
+        std::unique_ptr<JpegEncoder> mJpegEncoder;
+        std::unique_ptr<JpegEncoder> mThumbEncoder;
+
+        std::mutex mOutputStageLock;  // Protect mDecodedRequests and mOutputStageFailed
+        std::condition_variable mDecodedRequestCond;  // signaled when a request is decoded
+        std::deque<DecodedRequest> mDecodedRequests;
+        bool mOutputStageFailed = false;
+
+        // Per-stage latencies, printed in dump()
+        LatencyHistogram mDecodeLatency;
+        LatencyHistogram mConvertLatency;  // crop, scale and format convert of one YUV buffer
+        LatencyHistogram mJpegLatency;     // one BLOB buffer
+        LatencyHistogram mOutputLatency;   // all output buffers of one request
+        LatencyHistogram mRequestLatency;  // from the decode stage picking up to the result
     };
 
   private:
@@ -246,9 +348,16 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
     Status initStatus() const;
     status_t initDefaultRequests();
 
-    status_t fillCaptureResult(common::V1_0::helper::CameraMetadata& md, nsecs_t timestamp);
+    // Writes the serialized result metadata of a request with settings md to out. md may be
+    // turned into the result in place.
+    status_t fillCaptureResult(common::V1_0::helper::CameraMetadata& md, nsecs_t timestamp,
+                               std::vector<uint8_t>* out);
     int configureV4l2StreamLocked(const SupportedV4L2Format& fmt, double fps = 0.0);
     int v4l2StreamOffLocked();
+    // Exports the queried capture buffer as a DMABUF and maps it. Returns non-zero if the driver
+    // cannot export it.
+    int exportV4l2BufferLocked(const v4l2_buffer& buffer);
+    void releaseV4l2BuffersLocked();
 
     int setV4l2FpsLocked(double fps);
 
@@ -344,6 +453,16 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
     size_t mNumDequeuedV4l2Buffers = 0;
     uint32_t mMaxV4L2BufferSize = 0;
 
+    // Capture buffers exported as DMABUFs and mapped for as long as they are allocated, indexed
+    // by V4L2 buffer index. Empty unless mCfg.dmabufEnabled is set and the driver supports
+    // VIDIOC_EXPBUF. Without it every frame is mapped and unmapped on its own.
+    struct V4L2BufferMapping {
+        unique_fd dmabufFd;
+        uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+    std::vector<V4L2BufferMapping> mV4l2BufferMappings;
+
     // Not protected by mLock (but might be used when mLock is locked)
     std::shared_ptr<OutputThread> mOutputThread;
 
@@ -361,6 +480,9 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
     std::mutex mAfTriggerLock;  // protect mAfTrigger
     bool mAfTrigger = false;
 
+    // Only accessed by processCaptureResult, i.e. the output stage thread
+    ResultMetadataCache mResultMetadataCache;
+
     uint32_t mBlobBufferSize = 0;
 
     static HandleImporter sHandleImporter;
@@ -382,7 +382,7 @@ bool ExternalCameraOfflineSession::OutputThread::threadLoop() {
     auto onDeviceError = [&](auto... args) {
         ALOGE(args...);
         parent->notifyError(req->frameNumber, /*stream*/ -1, ErrorCode::ERROR_DEVICE);
-        signalRequestDone();
+        signalRequestDone(req->frameNumber);
         return false;
     };
 
@@ -428,7 +428,7 @@ bool ExternalCameraOfflineSession::OutputThread::threadLoop() {
             if (st != Status::OK) {
                 return onDeviceError("%s: failed to process capture request error!", __FUNCTION__);
             }
-            signalRequestDone();
+            signalRequestDone(req->frameNumber);
             return true;
         }
     }
@@ -536,7 +536,7 @@ bool ExternalCameraOfflineSession::OutputThread::threadLoop() {
     if (st != Status::OK) {
         return onDeviceError("%s: failed to process capture result!", __FUNCTION__);
     }
-    signalRequestDone();
+    signalRequestDone(req->frameNumber);
     return true;
 }
 
@@ -21,11 +21,18 @@
 
 #include <aidlcommonsupport/NativeHandle.h>
 #include <jpeglib.h>
+#include <linux/dma-buf.h>
 #include <linux/videodev2.h>
 #include <log/log.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <algorithm>
 #include <cinttypes>
 #include <cmath>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
 
 #define HAVE_JPEG  // required for libyuv.h to export MJPEG decode APIs
 #include <libyuv.h>
@@ -152,6 +159,13 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
         }
     }
 
+    XMLElement* dmabuf = deviceCfg->FirstChildElement("Dmabuf");
+    if (dmabuf == nullptr) {
+        ALOGI("%s: DMABUF capture is not enabled", __FUNCTION__);
+    } else {
+        ret.dmabufEnabled = dmabuf->BoolAttribute("enabled", false);
+    }
+
     XMLElement* minStreamSize = deviceCfg->FirstChildElement("MinimumStreamSize");
     if (minStreamSize == nullptr) {
         ALOGI("%s: no minimum stream size specified", __FUNCTION__);
@@ -169,9 +183,9 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
     }
 
     ALOGI("%s: external camera cfg loaded: maxJpgBufSize %d,"
-          " num video buffers %d, num still buffers %d, orientation %d",
+          " num video buffers %d, num still buffers %d, orientation %d, dmabuf %d",
           __FUNCTION__, ret.maxJpegBufSize, ret.numVideoBuffers, ret.numStillBuffers,
-          ret.orientation);
+          ret.orientation, ret.dmabufEnabled);
     for (const auto& limit : ret.fpsLimits) {
         ALOGI("%s: fpsLimitList: %dx%d@%f", __FUNCTION__, limit.size.width, limit.size.height,
               limit.fpsUpperBound);
@@ -220,6 +234,7 @@ ExternalCameraConfig::ExternalCameraConfig()
       numVideoBuffers(kDefaultNumVideoBuffer),
       numStillBuffers(kDefaultNumStillBuffer),
       depthEnabled(false),
+      dmabufEnabled(false),
       orientation(kDefaultOrientation) {
     fpsLimits.push_back({/* size */ {/* width */ 640, /* height */ 480}, /* fpsUpperBound */ 30.0});
     fpsLimits.push_back({/* size */ {/* width */ 1280, /* height */ 720}, /* fpsUpperBound */ 7.5});
@@ -246,6 +261,16 @@ V4L2Frame::V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx, int fd
                      uint64_t offset)
     : Frame(w, h, fourcc), mBufferIndex(bufIdx), mFd(fd), mDataSize(dataSize), mOffset(offset) {}
 
+V4L2Frame::V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx, int dmabufFd,
+                     uint8_t* mappedData, uint32_t dataSize)
+    : Frame(w, h, fourcc),
+      mBufferIndex(bufIdx),
+      mFd(dmabufFd),
+      mDataSize(dataSize),
+      mOffset(0),
+      mDmabuf(true),
+      mData(mappedData) {}
+
 V4L2Frame::~V4L2Frame() {
     unmap();
 }
@@ -262,7 +287,15 @@ int V4L2Frame::map(uint8_t** data, size_t* dataSize) {
     }
 
     std::lock_guard<std::mutex> lk(mLock);
-    if (!mMapped) {
+    if (!mMapped && mDmabuf) {
+        // Already mapped, make the buffer coherent for the CPU reads
+        dma_buf_sync sync{.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ};
+        if (TEMP_FAILURE_RETRY(ioctl(mFd, DMA_BUF_IOCTL_SYNC, &sync)) < 0) {
+            ALOGE("%s: DMABUF sync start failed: %s", __FUNCTION__, strerror(errno));
+            return -EINVAL;
+        }
+        mMapped = true;
+    } else if (!mMapped) {
         void* addr = mmap(nullptr, mDataSize, PROT_READ, MAP_SHARED, mFd, mOffset);
         if (addr == MAP_FAILED) {
             ALOGE("%s: V4L2 buffer map failed: %s", __FUNCTION__, strerror(errno));
@@ -279,7 +312,15 @@ int V4L2Frame::map(uint8_t** data, size_t* dataSize) {
 
 int V4L2Frame::unmap() {
     std::lock_guard<std::mutex> lk(mLock);
-    if (mMapped) {
+    if (mMapped && mDmabuf) {
+        // The mapping is owned by the session, only end the CPU access
+        dma_buf_sync sync{.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ};
+        if (TEMP_FAILURE_RETRY(ioctl(mFd, DMA_BUF_IOCTL_SYNC, &sync)) < 0) {
+            ALOGE("%s: DMABUF sync end failed: %s", __FUNCTION__, strerror(errno));
+            return -EINVAL;
+        }
+        mMapped = false;
+    } else if (mMapped) {
         ALOGV("%s: V4L unmap data %p size %zu", __FUNCTION__, mData, mDataSize);
         if (munmap(mData, mDataSize) != 0) {
             ALOGE("%s: V4L2 buffer unmap failed: %s", __FUNCTION__, strerror(errno));
@@ -728,6 +769,373 @@ int encodeJpegYU12(const Size& inSz, const YCbCrLayout& inLayout, int jpegQualit
     return 0;
 }
 
+namespace {
+
+// JPEG markers, see ITU-T T.81 table B.1
+constexpr uint8_t kJpegMarkerTem = 0x01;
+constexpr uint8_t kJpegMarkerSof0 = 0xC0;
+constexpr uint8_t kJpegMarkerSof2 = 0xC2;
+constexpr uint8_t kJpegMarkerDht = 0xC4;
+constexpr uint8_t kJpegMarkerRst0 = 0xD0;
+constexpr uint8_t kJpegMarkerRst7 = 0xD7;
+constexpr uint8_t kJpegMarkerSoi = 0xD8;
+constexpr uint8_t kJpegMarkerEoi = 0xD9;
+constexpr uint8_t kJpegMarkerSos = 0xDA;
+constexpr uint8_t kJpegMarkerDqt = 0xDB;
+constexpr uint8_t kJpegMarkerApp0 = 0xE0;
+constexpr uint8_t kJpegMarkerApp1 = 0xE1;
+constexpr uint8_t kJpegMarkerApp15 = 0xEF;
+
+// Segment lengths are 16 bits and include the length field itself
+constexpr size_t kJpegMaxSegmentLength = 0xFFFF;
+
+// The DHT segment with the Huffman tables of ITU-T T.81 Annex K.3. UVC cameras (USB Video Class
+// MJPEG payload spec) are allowed to leave the tables out of their frames and assume these.
+const uint8_t kJpegDefaultDhtSegment[] = {
+        0xff, 0xc4, 0x01, 0xa2,
+        // DC luminance
+        0x00, 0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+        0x07, 0x08, 0x09, 0x0a, 0x0b,
+        // AC luminance
+        0x10, 0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04,
+        0x04, 0x00, 0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05,
+        0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14,
+        0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1,
+        0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19,
+        0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38,
+        0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54,
+        0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84,
+        0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+        0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa,
+        0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4,
+        0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
+        0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+        0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa,
+        // DC chrominance
+        0x01, 0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+        0x07, 0x08, 0x09, 0x0a, 0x0b,
+        // AC chrominance
+        0x11, 0x00, 0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04, 0x07, 0x05, 0x04,
+        0x04, 0x00, 0x01, 0x02, 0x77, 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05,
+        0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32,
+        0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52,
+        0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1,
+        0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37,
+        0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53,
+        0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67,
+        0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82,
+        0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95,
+        0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8,
+        0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2,
+        0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5,
+        0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8,
+        0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa,
+};
+
+inline size_t readBe16(const uint8_t* p) {
+    return (static_cast<size_t>(p[0]) << 8) | p[1];
+}
+
+}  // anonymous namespace
+
+int convertMjpegToJpeg(const uint8_t* mjpeg, size_t mjpegSize, const Size& expectedSize,
+                       const void* app1Buffer, size_t app1Size, void* out, size_t maxOutSize,
+                       size_t& actualCodeSize) {
+    if (mjpegSize < 4 || mjpeg[0] != 0xFF || mjpeg[1] != kJpegMarkerSoi) {
+        ALOGV("%s: MJPEG frame does not start with SOI", __FUNCTION__);
+        return -1;
+    }
+    if (app1Size + 2 > kJpegMaxSegmentLength) {
+        ALOGE("%s: APP1 data too large (%zu)", __FUNCTION__, app1Size);
+        return -1;
+    }
+
+    /* Walk the header segments up to the start of scan. Every segment other than APPn
+     * (the camera's own JFIF/AVI1/EXIF data, which would conflict with ours) is copied
+     * over in its original order */
+    struct Segment {
+        size_t offset;
+        size_t size;
+    };
+    std::vector<Segment> segments;
+    bool hasSof = false;
+    bool hasDqt = false;
+    bool hasDht = false;
+    size_t scanStart = 0;
+    size_t pos = 2;
+    while (scanStart == 0) {
+        if (pos >= mjpegSize || mjpeg[pos] != 0xFF) {
+            ALOGV("%s: bad marker at offset %zu", __FUNCTION__, pos);
+            return -1;
+        }
+        /* Any number of 0xFF fill bytes may precede a marker */
+        while (pos < mjpegSize && mjpeg[pos] == 0xFF) {
+            pos++;
+        }
+        if (pos >= mjpegSize) {
+            ALOGV("%s: MJPEG frame truncated before SOS", __FUNCTION__);
+            return -1;
+        }
+        const uint8_t marker = mjpeg[pos];
+        const size_t segmentStart = pos - 1;
+        pos++;
+        if (marker == kJpegMarkerTem || (marker >= kJpegMarkerRst0 && marker <= kJpegMarkerRst7)) {
+            /* Standalone markers without a length field */
+            continue;
+        }
+        if (marker == 0x00 || marker == kJpegMarkerSoi || marker == kJpegMarkerEoi) {
+            ALOGV("%s: unexpected marker 0x%x before SOS", __FUNCTION__, marker);
+            return -1;
+        }
+        if (pos + 2 > mjpegSize) {
+            ALOGV("%s: MJPEG frame truncated before SOS", __FUNCTION__);
+            return -1;
+        }
+        const size_t length = readBe16(mjpeg + pos);
+        if (length < 2 || pos + length > mjpegSize) {
+            ALOGV("%s: bad length %zu of segment 0x%x", __FUNCTION__, length, marker);
+            return -1;
+        }
+
+        if (marker >= kJpegMarkerSof0 && marker <= kJpegMarkerSof2) {
+            /* Baseline, extended sequential or progressive Huffman coding, which is what
+             * every JPEG decoder handles */
+            if (length < 8) {
+                ALOGV("%s: SOF segment too short", __FUNCTION__);
+                return -1;
+            }
+            const uint8_t precision = mjpeg[pos + 2];
+            const size_t height = readBe16(mjpeg + pos + 3);
+            const size_t width = readBe16(mjpeg + pos + 5);
+            if (precision != 8 || width != static_cast<size_t>(expectedSize.width) ||
+                height != static_cast<size_t>(expectedSize.height)) {
+                ALOGV("%s: frame is %zux%zu@%u bits, expected %dx%d@8 bits", __FUNCTION__, width,
+                      height, precision, expectedSize.width, expectedSize.height);
+                return -1;
+            }
+            hasSof = true;
+        } else if ((marker & 0xF0) == 0xC0 && marker != kJpegMarkerDht && marker != 0xC8 &&
+                   marker != 0xCC) {
+            /* Lossless, hierarchical or arithmetic coding */
+            ALOGV("%s: unsupported SOF marker 0x%x", __FUNCTION__, marker);
+            return -1;
+        } else if (marker == kJpegMarkerDht) {
+            hasDht = true;
+        } else if (marker == kJpegMarkerDqt) {
+            hasDqt = true;
+        } else if (marker == kJpegMarkerSos) {
+            scanStart = segmentStart;
+        }
+
+        if (scanStart == 0 && !(marker >= kJpegMarkerApp0 && marker <= kJpegMarkerApp15)) {
+            segments.push_back({segmentStart, pos + length - segmentStart});
+        }
+        pos += length;
+    }
+    if (!hasSof || !hasDqt) {
+        ALOGV("%s: MJPEG frame is missing SOF or DQT", __FUNCTION__);
+        return -1;
+    }
+
+    /* The entropy coded data cannot contain an unstuffed 0xFF 0xD9, so the last one is the
+     * EOI. Some cameras pad their payload after it */
+    size_t scanEnd = mjpegSize;
+    while (scanEnd >= scanStart + 2 &&
+           !(mjpeg[scanEnd - 2] == 0xFF && mjpeg[scanEnd - 1] == kJpegMarkerEoi)) {
+        scanEnd--;
+    }
+    if (scanEnd < scanStart + 2) {
+        ALOGV("%s: MJPEG frame is missing EOI", __FUNCTION__);
+        return -1;
+    }
+
+    size_t totalSize = 2 + (scanEnd - scanStart);
+    if (app1Buffer && app1Size) {
+        totalSize += 4 + app1Size;
+    }
+    if (!hasDht) {
+        totalSize += sizeof(kJpegDefaultDhtSegment);
+    }
+    for (const auto& segment : segments) {
+        totalSize += segment.size;
+    }
+    if (totalSize > maxOutSize) {
+        ALOGE("%s: JPEG size %zu exceeds buffer size %zu", __FUNCTION__, totalSize, maxOutSize);
+        return -1;
+    }
+
+    /* SOI, our APP1, the camera's tables and frame header, the default Huffman tables if the
+     * camera assumed them, then the scan as is */
+    uint8_t* dst = static_cast<uint8_t*>(out);
+    *dst++ = 0xFF;
+    *dst++ = kJpegMarkerSoi;
+    if (app1Buffer && app1Size) {
+        *dst++ = 0xFF;
+        *dst++ = kJpegMarkerApp1;
+        *dst++ = static_cast<uint8_t>((app1Size + 2) >> 8);
+        *dst++ = static_cast<uint8_t>((app1Size + 2) & 0xFF);
+        memcpy(dst, app1Buffer, app1Size);
+        dst += app1Size;
+    }
+    for (const auto& segment : segments) {
+        memcpy(dst, mjpeg + segment.offset, segment.size);
+        dst += segment.size;
+    }
+    if (!hasDht) {
+        memcpy(dst, kJpegDefaultDhtSegment, sizeof(kJpegDefaultDhtSegment));
+        dst += sizeof(kJpegDefaultDhtSegment);
+    }
+    memcpy(dst, mjpeg + scanStart, scanEnd - scanStart);
+
+    actualCodeSize = totalSize;
+    return 0;
+}
+
+int decodeMjpeg(const uint8_t* mjpeg, size_t mjpegSize, const Size& inSize, const Size& outSize,
+                const YCbCrLayout& out) {
+    if (outSize.width <= 0 || outSize.height <= 0 || (outSize.width & 1) || (outSize.height & 1)) {
+        ALOGE("%s: bad output size %dx%d", __FUNCTION__, outSize.width, outSize.height);
+        return -1;
+    }
+    if (out.chromaStep != 1 && out.chromaStep != 2) {
+        ALOGE("%s: unsupported chroma step %d", __FUNCTION__, out.chromaStep);
+        return -1;
+    }
+
+    /* libyuv decodes straight to planar output at full size, and is the faster choice then */
+    if (inSize == outSize && out.chromaStep == 1) {
+        return libyuv::MJPGToI420(mjpeg, mjpegSize, static_cast<uint8_t*>(out.y), out.yStride,
+                                  static_cast<uint8_t*>(out.cb), out.cStride,
+                                  static_cast<uint8_t*>(out.cr), out.cStride, inSize.width,
+                                  inSize.height, outSize.width, outSize.height);
+    }
+
+    /* Downscaling is left to libjpeg, which does it in the DCT domain and so skips most of the
+     * IDCT and upsampling work of the full size image */
+    int32_t scaleDenom = inSize.width / outSize.width;
+    if ((scaleDenom != 1 && scaleDenom != 2 && scaleDenom != 4 && scaleDenom != 8) ||
+        inSize.width != outSize.width * scaleDenom ||
+        inSize.height != outSize.height * scaleDenom) {
+        ALOGE("%s: cannot decode %dx%d to %dx%d", __FUNCTION__, inSize.width, inSize.height,
+              outSize.width, outSize.height);
+        return -1;
+    }
+
+    /* Errors in the middle of libjpeg must not return to it, so error_exit jumps back here.
+     * Everything with a destructor is set up before the jump target */
+    struct JpegErrorMgr {
+        struct jpeg_error_mgr mgr;
+        jmp_buf jumpBuffer;
+    } jerr;
+
+    /* Two lines of interleaved YCbCr, one line of 4:2:0 chroma */
+    std::vector<uint8_t> lines(outSize.width * 3 * 2);
+    JSAMPROW linePtrs[2] = {&lines[0], &lines[outSize.width * 3]};
+
+    jpeg_decompress_struct cinfo = {};
+    cinfo.err = jpeg_std_error(&jerr.mgr);
+    jerr.mgr.output_message = [](j_common_ptr cinfo) {
+        char buffer[JMSG_LENGTH_MAX];
+
+        (*cinfo->err->format_message)(cinfo, buffer);
+        ALOGE("libjpeg error: %s", buffer);
+    };
+    jerr.mgr.error_exit = [](j_common_ptr cinfo) {
+        (*cinfo->err->output_message)(cinfo);
+        longjmp(reinterpret_cast<JpegErrorMgr*>(cinfo->err)->jumpBuffer, 1);
+    };
+    /* Webcams commonly send frames with corrupt data warnings, decode them as libyuv does */
+    jerr.mgr.emit_message = [](j_common_ptr, int) {};
+
+    jpeg_create_decompress(&cinfo);
+    if (setjmp(jerr.jumpBuffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return -1;
+    }
+
+    jpeg_mem_src(&cinfo, mjpeg, mjpegSize);
+    jpeg_read_header(&cinfo, TRUE);
+    if (cinfo.image_width != static_cast<JDIMENSION>(inSize.width) ||
+        cinfo.image_height != static_cast<JDIMENSION>(inSize.height) ||
+        cinfo.num_components != 3) {
+        ALOGE("%s: MJPEG frame is %ux%u with %d components, expected %dx%d", __FUNCTION__,
+              cinfo.image_width, cinfo.image_height, cinfo.num_components, inSize.width,
+              inSize.height);
+        jpeg_destroy_decompress(&cinfo);
+        return -1;
+    }
+
+    /* Output YCbCr 4:4:4 without color conversion. Chroma is averaged back down to 4:2:0
+     * below, so the smooth upsampling would be wasted */
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scaleDenom;
+    cinfo.out_color_space = JCS_YCbCr;
+    cinfo.do_fancy_upsampling = FALSE;
+    cinfo.dct_method = JDCT_IFAST;
+    jpeg_start_decompress(&cinfo);
+
+    uint8_t* py = static_cast<uint8_t*>(out.y);
+    uint8_t* pcb = static_cast<uint8_t*>(out.cb);
+    uint8_t* pcr = static_cast<uint8_t*>(out.cr);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        const uint32_t row = cinfo.output_scanline;
+        for (uint32_t read = 0; read < 2;) {
+            JDIMENSION n = jpeg_read_scanlines(&cinfo, &linePtrs[read], 2 - read);
+            if (n == 0) {
+                ALOGE("%s: no scanline decoded at row %u", __FUNCTION__, row + read);
+                jpeg_destroy_decompress(&cinfo);
+                return -1;
+            }
+            read += n;
+        }
+
+        for (uint32_t i = 0; i < 2; i++) {
+            uint8_t* yLine = py + (row + i) * out.yStride;
+            const uint8_t* src = linePtrs[i];
+            for (int32_t x = 0; x < outSize.width; x++) {
+                yLine[x] = src[3 * x];
+            }
+        }
+        uint8_t* cbLine = pcb + (row / 2) * out.cStride;
+        uint8_t* crLine = pcr + (row / 2) * out.cStride;
+        const uint8_t* src0 = linePtrs[0];
+        const uint8_t* src1 = linePtrs[1];
+        for (int32_t x = 0; x < outSize.width / 2; x++) {
+            const int32_t s = 6 * x;
+            cbLine[x * out.chromaStep] =
+                    (src0[s + 1] + src0[s + 4] + src1[s + 1] + src1[s + 4] + 2) >> 2;
+            crLine[x * out.chromaStep] =
+                    (src0[s + 2] + src0[s + 5] + src1[s + 2] + src1[s + 5] + 2) >> 2;
+        }
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return 0;
+}
+
+Size getMjpegDecodeSize(const Size& v4lSize, const std::vector<Size>& streamSizes) {
+    Size decodeSize = v4lSize;
+    for (int32_t denom = 2; denom <= 8; denom *= 2) {
+        if (v4lSize.width % (2 * denom) != 0 || v4lSize.height % (2 * denom) != 0) {
+            break;
+        }
+        Size scaledSize{v4lSize.width / denom, v4lSize.height / denom};
+        bool coversStreams =
+                std::all_of(streamSizes.begin(), streamSizes.end(), [&](const Size& sz) {
+                    return sz.width <= scaledSize.width && sz.height <= scaledSize.height;
+                });
+        if (!coversStreams) {
+            break;
+        }
+        decodeSize = scaledSize;
+    }
+    return decodeSize;
+}
+
 Size getMaxThumbnailResolution(const common::V1_0::helper::CameraMetadata& chars) {
     Size thumbSize{0, 0};
     camera_metadata_ro_entry entry = chars.find(ANDROID_JPEG_AVAILABLE_THUMBNAIL_SIZES);
@@ -827,6 +1235,60 @@ status_t fillCaptureResultCommon(CameraMetadata& md, nsecs_t timestamp,
 #undef ARRAY_SIZE
 #undef UPDATE
 
+status_t ResultMetadataCache::build(CameraMetadata& settings, uint32_t stateKey, nsecs_t timestamp,
+                                    const std::function<status_t(CameraMetadata&)>& fill,
+                                    std::vector<uint8_t>* out) {
+    const camera_metadata_t* raw = settings.getAndLock();
+    const uint8_t* rawBytes = reinterpret_cast<const uint8_t*>(raw);
+    size_t rawSize = raw == nullptr ? 0 : get_camera_metadata_size(raw);
+    bool sameSettings = raw != nullptr && !mResult.empty() && stateKey == mStateKey &&
+                        rawSize == mSettings.size() &&
+                        memcmp(rawBytes, mSettings.data(), rawSize) == 0;
+    if (!sameSettings) {
+        mSettings.assign(rawBytes, rawBytes + rawSize);
+    }
+    settings.unlock(raw);
+
+    if (sameSettings) {
+        out->assign(mResult.begin(), mResult.end());
+        camera_metadata_t* result = reinterpret_cast<camera_metadata_t*>(out->data());
+        camera_metadata_entry_t entry;
+        if (find_camera_metadata_entry(result, ANDROID_SENSOR_TIMESTAMP, &entry) == OK &&
+            update_camera_metadata_entry(result, entry.index, &timestamp, 1, nullptr) == OK) {
+            return OK;
+        }
+        ALOGW("%s: cannot patch the previous result, building it again", __FUNCTION__);
+    }
+
+    // Invalidate the previous result until the new one is built
+    mResult.clear();
+    settings.reserve(mEntryCapacity, mDataCapacity);
+    status_t ret = fill(settings);
+    if (ret != OK) {
+        return ret;
+    }
+
+    raw = settings.getAndLock();
+    if (raw == nullptr) {
+        ALOGE("%s: no result metadata", __FUNCTION__);
+        settings.unlock(raw);
+        return BAD_VALUE;
+    }
+    rawBytes = reinterpret_cast<const uint8_t*>(raw);
+    mResult.assign(rawBytes, rawBytes + get_camera_metadata_size(raw));
+    mEntryCapacity = get_camera_metadata_entry_count(raw);
+    mDataCapacity = get_camera_metadata_data_count(raw);
+    settings.unlock(raw);
+    mStateKey = stateKey;
+    *out = mResult;
+    return OK;
+}
+
+void ResultMetadataCache::clear() {
+    mSettings.clear();
+    mResult.clear();
+}
+
 AllocatedV4L2Frame::AllocatedV4L2Frame(std::shared_ptr<V4L2Frame> frameIn)
     : Frame(frameIn->mWidth, frameIn->mHeight, frameIn->mFourcc) {
     uint8_t* dataIn;
@@ -853,6 +1315,431 @@ int AllocatedV4L2Frame::getData(uint8_t** outData, size_t* dataSize) {
     return 0;
 }
 
+void LatencyHistogram::record(nsecs_t latencyNs) {
+    uint64_t latencyUs = latencyNs > 0 ? static_cast<uint64_t>(ns2us(latencyNs)) : 0;
+    int bucket = 0;
+    while (bucket < kNumBuckets - 1 && (static_cast<uint64_t>(1) << bucket) <= latencyUs) {
+        bucket++;
+    }
+    mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    mTotalUs.fetch_add(latencyUs, std::memory_order_relaxed);
+    uint64_t maxUs = mMaxUs.load(std::memory_order_relaxed);
+    while (latencyUs > maxUs &&
+           !mMaxUs.compare_exchange_weak(maxUs, latencyUs, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::dump(int fd, const char* name) const {
+    uint64_t buckets[kNumBuckets];
+    uint64_t count = 0;
+    for (int i = 0; i < kNumBuckets; i++) {
+        buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+        count += buckets[i];
+    }
+    if (count == 0) {
+        dprintf(fd, "  %s: no samples\n", name);
+        return;
+    }
+
+    // Upper bound of the bucket holding the given percentile
+    auto percentileUs = [&](uint64_t percent) {
+        uint64_t rank = (count * percent + 99) / 100;
+        uint64_t seen = 0;
+        for (int i = 0; i < kNumBuckets; i++) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                return static_cast<uint64_t>(1) << i;
+            }
+        }
+        return static_cast<uint64_t>(1) << (kNumBuckets - 1);
+    };
+
+    dprintf(fd, "  %s: count %" PRIu64 ", mean %" PRIu64 "us, p50 <%" PRIu64 "us, p99 <%" PRIu64
+            "us, max %" PRIu64 "us\n",
+            name, count, mTotalUs.load(std::memory_order_relaxed) / count, percentileUs(50),
+            percentileUs(99), mMaxUs.load(std::memory_order_relaxed));
+}
+
+WorkerPool::WorkerPool(size_t numThreads) {
+    for (size_t i = 0; i < numThreads; i++) {
+        mThreads.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mExit = true;
+    }
+    mJobCond.notify_all();
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+int WorkerPool::run(std::vector<std::function<int()>>& jobs) {
+    if (jobs.empty()) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lk(mLock);
+    mJobs = &jobs;
+    mNextJob = 0;
+    mPendingJobs = jobs.size();
+    mResult = 0;
+    lk.unlock();
+    mJobCond.notify_all();
+
+    // The calling thread takes jobs too instead of idling
+    lk.lock();
+    while (mNextJob < mJobs->size()) {
+        runNextJobLocked(lk);
+    }
+    mDoneCond.wait(lk, [this] { return mPendingJobs == 0; });
+    mJobs = nullptr;
+    return mResult;
+}
+
+void WorkerPool::workerLoop() {
+    std::unique_lock<std::mutex> lk(mLock);
+    while (true) {
+        mJobCond.wait(lk,
+                      [this] { return mExit || (mJobs != nullptr && mNextJob < mJobs->size()); });
+        if (mExit) {
+            return;
+        }
+        runNextJobLocked(lk);
+    }
+}
+
+void WorkerPool::runNextJobLocked(std::unique_lock<std::mutex>& lk) {
+    std::function<int()>& job = (*mJobs)[mNextJob++];
+    lk.unlock();
+    int ret = job();
+    lk.lock();
+    if (ret != 0 && mResult == 0) {
+        mResult = ret;
+    }
+    if (--mPendingJobs == 0) {
+        mDoneCond.notify_all();
+    }
+}
+
+struct JpegEncoder::Stripe {
+    /* libjpeg is a C library so we use C-style "inheritance" by putting libjpeg's structs first
+     * in our own, see encodeJpegYU12 */
+    struct ErrorMgr {
+        struct jpeg_error_mgr mgr;
+        jmp_buf jumpBuffer;
+    };
+    struct DestMgr {
+        struct jpeg_destination_mgr mgr;
+        std::vector<uint8_t>* buffer;
+        size_t encodedSize;
+    };
+
+    jpeg_compress_struct cinfo = {};
+    ErrorMgr err;
+    DestMgr dest;
+    /* Grows to the largest stripe encoded so far and is kept for the next image */
+    std::vector<uint8_t> buffer;
+    std::vector<JSAMPROW> yLines;
+    std::vector<JSAMPROW> cbLines;
+    std::vector<JSAMPROW> crLines;
+};
+
+namespace {
+
+/* Returns the offset of the scan data of a JPEG image written by libjpeg, i.e. the end of its SOS
+ * segment, or 0 if there is none. Sets sofOffset to the offset of the SOF marker */
+size_t findJpegScanData(const uint8_t* jpeg, size_t size, size_t* sofOffset) {
+    size_t pos = 2;
+    while (pos + 4 <= size && jpeg[pos] == 0xFF) {
+        const uint8_t marker = jpeg[pos + 1];
+        const size_t length = readBe16(jpeg + pos + 2);
+        if (marker >= kJpegMarkerSof0 && marker <= kJpegMarkerSof2) {
+            *sofOffset = pos;
+        } else if (marker == kJpegMarkerSos) {
+            return pos + 2 + length <= size ? pos + 2 + length : 0;
+        }
+        pos += 2 + length;
+    }
+    return 0;
+}
+
+}  // anonymous namespace
+
+JpegEncoder::JpegEncoder(size_t numThreads) {
+    numThreads = std::max<size_t>(numThreads, 1);
+    if (numThreads > 1) {
+        mWorkers = std::make_unique<WorkerPool>(numThreads - 1);
+    }
+
+    for (size_t i = 0; i < numThreads; i++) {
+        auto stripe = std::make_unique<Stripe>();
+        jpeg_compress_struct& cinfo = stripe->cinfo;
+
+        cinfo.err = jpeg_std_error(&stripe->err.mgr);
+        stripe->err.mgr.output_message = [](j_common_ptr cinfo) {
+            char buffer[JMSG_LENGTH_MAX];
+
+            (*cinfo->err->format_message)(cinfo, buffer);
+            ALOGE("libjpeg error: %s", buffer);
+        };
+        /* libjpeg cannot continue after an error, jump back to encodeStripe */
+        stripe->err.mgr.error_exit = [](j_common_ptr cinfo) {
+            (*cinfo->err->output_message)(cinfo);
+            longjmp(reinterpret_cast<Stripe::ErrorMgr*>(cinfo->err)->jumpBuffer, 1);
+        };
+        jpeg_create_compress(&cinfo);
+
+        stripe->dest.buffer = &stripe->buffer;
+        stripe->dest.encodedSize = 0;
+        stripe->dest.mgr.init_destination = [](j_compress_ptr cinfo) {
+            auto& dest = reinterpret_cast<Stripe::DestMgr&>(*cinfo->dest);
+            dest.mgr.next_output_byte = dest.buffer->data();
+            dest.mgr.free_in_buffer = dest.buffer->size();
+        };
+        /* Rather than failing, grow the buffer, which then stays large enough for later images */
+        stripe->dest.mgr.empty_output_buffer = [](j_compress_ptr cinfo) -> boolean {
+            auto& dest = reinterpret_cast<Stripe::DestMgr&>(*cinfo->dest);
+            size_t oldSize = dest.buffer->size();
+            dest.buffer->resize(oldSize * 2);
+            dest.mgr.next_output_byte = dest.buffer->data() + oldSize;
+            dest.mgr.free_in_buffer = oldSize;
+            return TRUE;
+        };
+        stripe->dest.mgr.term_destination = [](j_compress_ptr cinfo) {
+            auto& dest = reinterpret_cast<Stripe::DestMgr&>(*cinfo->dest);
+            dest.encodedSize = dest.buffer->size() - dest.mgr.free_in_buffer;
+        };
+        cinfo.dest = &stripe->dest.mgr;
+
+        mStripes.push_back(std::move(stripe));
+    }
+}
+
+JpegEncoder::~JpegEncoder() {
+    for (auto& stripe : mStripes) {
+        jpeg_destroy_compress(&stripe->cinfo);
+    }
+}
+
+int JpegEncoder::encodeStripes(const Size& inSz, const YCbCrLayout& inLayout, int jpegQuality,
+                               const std::function<int()>& sideJob) {
+    mNumStripes = 0;
+    if (inSz.width <= 0 || inSz.height <= 0) {
+        ALOGE("%s: bad image size %dx%d", __FUNCTION__, inSz.width, inSz.height);
+        return -1;
+    }
+
+    /* YUV420 MCUs are 16x16 pixels. Stripes are whole MCU rows, except for the last one */
+    const uint32_t mcuSize = 2 * DCTSIZE;
+    const uint32_t mcuCols = (inSz.width + mcuSize - 1) / mcuSize;
+    const uint32_t mcuRows = (inSz.height + mcuSize - 1) / mcuSize;
+    size_t numStripes = std::clamp<size_t>(mcuRows / kMinMcuRowsPerStripe, 1, mStripes.size());
+    uint32_t mcuRowsPerStripe = (mcuRows + numStripes - 1) / numStripes;
+    uint32_t restartInterval = 0;
+    if (numStripes > 1) {
+        /* The restart interval is a 16 bit field */
+        restartInterval = mcuCols * mcuRowsPerStripe;
+        if (restartInterval > 0xFFFF) {
+            restartInterval = 0;
+            mcuRowsPerStripe = mcuRows;
+        }
+    }
+    numStripes = (mcuRows + mcuRowsPerStripe - 1) / mcuRowsPerStripe;
+
+    std::vector<std::function<int()>> jobs;
+    for (size_t i = 0; i < numStripes; i++) {
+        uint32_t firstRow = i * mcuRowsPerStripe * mcuSize;
+        uint32_t numRows = std::min<uint32_t>(mcuRowsPerStripe * mcuSize, inSz.height - firstRow);
+        Stripe* stripe = mStripes[i].get();
+        jobs.push_back([=, &inSz, &inLayout]() {
+            return encodeStripe(*stripe, inSz, inLayout, jpegQuality, firstRow, numRows,
+                                restartInterval);
+        });
+    }
+    if (sideJob) {
+        jobs.push_back(sideJob);
+    }
+
+    int ret = 0;
+    if (mWorkers != nullptr) {
+        ret = mWorkers->run(jobs);
+    } else {
+        for (auto& job : jobs) {
+            int jobRet = job();
+            if (jobRet != 0 && ret == 0) {
+                ret = jobRet;
+            }
+        }
+    }
+    if (ret == 0) {
+        mImageSize = inSz;
+        mNumStripes = numStripes;
+    }
+    return ret;
+}
+
+int JpegEncoder::encodeStripe(Stripe& stripe, const Size& inSz, const YCbCrLayout& inLayout,
+                              int jpegQuality, uint32_t firstRow, uint32_t numRows,
+                              uint32_t restartInterval) {
+    jpeg_compress_struct& cinfo = stripe.cinfo;
+
+    /* A quarter of the raw size is plenty for most images, it grows otherwise */
+    if (stripe.buffer.empty()) {
+        stripe.buffer.resize(std::max<size_t>(inSz.width * numRows * 3 / 8, 64 * 1024));
+    }
+
+    /* Same setup as encodeJpegYU12: raw YUV420 input, and the default Huffman tables so that all
+     * stripes share the tables of the first one */
+    const uint32_t mcuV = 2 * DCTSIZE;
+    const uint32_t paddedRows = mcuV * ((numRows + mcuV - 1) / mcuV);
+    stripe.yLines.resize(paddedRows);
+    stripe.cbLines.resize(paddedRows / 2);
+    stripe.crLines.resize(paddedRows / 2);
+    uint8_t* py = static_cast<uint8_t*>(inLayout.y);
+    uint8_t* pcb = static_cast<uint8_t*>(inLayout.cb);
+    uint8_t* pcr = static_cast<uint8_t*>(inLayout.cr);
+    for (uint32_t i = 0; i < paddedRows; i++) {
+        /* Past the bottom of the image the last line is repeated */
+        uint32_t li = std::min<uint32_t>(firstRow + i, inSz.height - 1);
+        stripe.yLines[i] = static_cast<JSAMPROW>(py + li * inLayout.yStride);
+        if (i < paddedRows / 2) {
+            li = std::min<uint32_t>(firstRow / 2 + i, (inSz.height - 1) / 2);
+            stripe.cbLines[i] = static_cast<JSAMPROW>(pcb + li * inLayout.cStride);
+            stripe.crLines[i] = static_cast<JSAMPROW>(pcr + li * inLayout.cStride);
+        }
+    }
+
+    if (setjmp(stripe.err.jumpBuffer)) {
+        /* Resets the compressor for the next image */
+        jpeg_abort_compress(&cinfo);
+        return -1;
+    }
+
+    cinfo.image_width = inSz.width;
+    cinfo.image_height = numRows;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, jpegQuality, TRUE);
+    jpeg_set_colorspace(&cinfo, JCS_YCbCr);
+    cinfo.raw_data_in = TRUE;
+    cinfo.dct_method = JDCT_IFAST;
+    cinfo.write_JFIF_header = FALSE;
+    cinfo.restart_interval = restartInterval;
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 2;
+    cinfo.comp_info[1].h_samp_factor = 1;
+    cinfo.comp_info[1].v_samp_factor = 1;
+    cinfo.comp_info[2].h_samp_factor = 1;
+    cinfo.comp_info[2].v_samp_factor = 1;
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        const uint32_t nl = cinfo.next_scanline;
+        JSAMPARRAY planes[3]{&stripe.yLines[nl], &stripe.cbLines[nl / 2],
+                             &stripe.crLines[nl / 2]};
+        uint32_t done = jpeg_write_raw_data(&cinfo, planes, mcuV);
+        if (done != mcuV) {
+            ALOGE("%s: compressed %u lines, expected %u (total %u/%u)", __FUNCTION__, done, mcuV,
+                  cinfo.next_scanline, cinfo.image_height);
+            jpeg_abort_compress(&cinfo);
+            return -1;
+        }
+    }
+    jpeg_finish_compress(&cinfo);
+    return 0;
+}
+
+int JpegEncoder::finish(const void* app1Buffer, size_t app1Size, void* out, size_t maxOutSize,
+                        size_t& actualCodeSize) {
+    if (mNumStripes == 0) {
+        ALOGE("%s: no image encoded", __FUNCTION__);
+        return -1;
+    }
+    if (app1Size + 2 > kJpegMaxSegmentLength) {
+        ALOGE("%s: APP1 data too large (%zu)", __FUNCTION__, app1Size);
+        return -1;
+    }
+
+    /* The final image is the headers of the first stripe with the full image height, then the
+     * scan data of every stripe, separated by restart markers */
+    std::vector<size_t> scanStarts(mNumStripes);
+    size_t sofOffset = 0;
+    size_t totalSize = 2;
+    if (app1Buffer && app1Size) {
+        totalSize += 4 + app1Size;
+    }
+    for (size_t i = 0; i < mNumStripes; i++) {
+        const Stripe& stripe = *mStripes[i];
+        const uint8_t* data = stripe.buffer.data();
+        const size_t size = stripe.dest.encodedSize;
+        size_t stripeSofOffset = 0;
+        scanStarts[i] = findJpegScanData(data, size, &stripeSofOffset);
+        if (scanStarts[i] == 0 || stripeSofOffset == 0 || size < scanStarts[i] + 2 ||
+            data[size - 2] != 0xFF || data[size - 1] != kJpegMarkerEoi) {
+            ALOGE("%s: stripe %zu is not a complete JPEG image", __FUNCTION__, i);
+            return -1;
+        }
+        if (i == 0) {
+            sofOffset = stripeSofOffset;
+            totalSize += scanStarts[i] - 2;
+        }
+        /* The scan data with either a restart marker or the EOI after it */
+        totalSize += size - scanStarts[i];
+    }
+    if (totalSize > maxOutSize) {
+        ALOGE("%s: JPEG size %zu exceeds buffer size %zu", __FUNCTION__, totalSize, maxOutSize);
+        return -1;
+    }
+
+    uint8_t* dst = static_cast<uint8_t*>(out);
+    *dst++ = 0xFF;
+    *dst++ = kJpegMarkerSoi;
+    if (app1Buffer && app1Size) {
+        *dst++ = 0xFF;
+        *dst++ = kJpegMarkerApp1;
+        *dst++ = static_cast<uint8_t>((app1Size + 2) >> 8);
+        *dst++ = static_cast<uint8_t>((app1Size + 2) & 0xFF);
+        memcpy(dst, app1Buffer, app1Size);
+        dst += app1Size;
+    }
+
+    const uint8_t* headers = mStripes[0]->buffer.data();
+    memcpy(dst, headers + 2, scanStarts[0] - 2);
+    /* The SOF segment is marker, length, precision, then the 16 bit image height */
+    uint8_t* height = dst + (sofOffset - 2) + 5;
+    height[0] = static_cast<uint8_t>(mImageSize.height >> 8);
+    height[1] = static_cast<uint8_t>(mImageSize.height & 0xFF);
+    dst += scanStarts[0] - 2;
+
+    for (size_t i = 0; i < mNumStripes; i++) {
+        const Stripe& stripe = *mStripes[i];
+        const size_t scanSize = stripe.dest.encodedSize - 2 - scanStarts[i];
+        memcpy(dst, stripe.buffer.data() + scanStarts[i], scanSize);
+        dst += scanSize;
+        *dst++ = 0xFF;
+        *dst++ = i + 1 < mNumStripes ? static_cast<uint8_t>(kJpegMarkerRst0 + i % 8)
+                                     : kJpegMarkerEoi;
+    }
+
+    actualCodeSize = totalSize;
+    return 0;
+}
+
+int JpegEncoder::encode(const Size& inSz, const YCbCrLayout& inLayout, int jpegQuality,
+                        const void* app1Buffer, size_t app1Size, void* out, size_t maxOutSize,
+                        size_t& actualCodeSize) {
+    int ret = encodeStripes(inSz, inLayout, jpegQuality);
+    if (ret != 0) {
+        return ret;
+    }
+    return finish(app1Buffer, app1Size, out, maxOutSize, actualCodeSize);
+}
+
 }  // namespace implementation
 }  // namespace device
 }  // namespace camera
@@ -26,8 +26,15 @@
 #include <aidl/android/hardware/graphics/common/BufferUsage.h>
 #include <aidl/android/hardware/graphics/common/PixelFormat.h>
 #include <tinyxml2.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 using ::aidl::android::hardware::camera::common::Status;
 using ::aidl::android::hardware::camera::device::CaptureResult;
@@ -88,6 +95,10 @@ struct ExternalCameraConfig {
     // Indication that the device connected supports depth output
     bool depthEnabled;
 
+    // Export V4L2 capture buffers as DMABUFs and keep them mapped while streaming, instead of
+    // mapping every frame
+    bool dmabufEnabled;
+
     struct FpsLimitation {
         Size size;
         double fpsUpperBound;
@@ -147,6 +158,10 @@ class V4L2Frame : public Frame {
   public:
     V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx, int fd, uint32_t dataSize,
               uint64_t offset);
+    // A frame in a capture buffer exported as a DMABUF that stays mapped at mappedData for the
+    // whole streaming session. map() and unmap() only begin and end CPU access to the buffer.
+    V4L2Frame(uint32_t w, uint32_t h, uint32_t fourcc, int bufIdx, int dmabufFd,
+              uint8_t* mappedData, uint32_t dataSize);
     virtual ~V4L2Frame();
 
     virtual int getData(uint8_t** outData, size_t* dataSize) override;
@@ -160,6 +175,7 @@ class V4L2Frame : public Frame {
     const int mFd;  // used for mmap but doesn't claim ownership
     const size_t mDataSize;
     const uint64_t mOffset;  // used for mmap
+    const bool mDmabuf = false;
     uint8_t* mData = nullptr;
     bool mMapped = false;
 };
@@ -245,6 +261,25 @@ int encodeJpegYU12(const Size& inSz, const YCbCrLayout& inLayout, int jpegQualit
                    const void* app1Buffer, size_t app1Size, void* out, size_t maxOutSize,
                    size_t& actualCodeSize);
 
+// Repackages an MJPEG frame from a V4L2 camera into a JPEG file without re-encoding it: the
+// camera's APPn segments are replaced by the APP1 data passed in, and the default Huffman tables
+// are inserted if the camera left them out. Returns -1 if the frame is not a complete 8-bit
+// Huffman coded JPEG image of expectedSize, in which case the caller should decode and encode
+// the frame instead.
+int convertMjpegToJpeg(const uint8_t* mjpeg, size_t mjpegSize, const Size& expectedSize,
+                       const void* app1Buffer, size_t app1Size, void* out, size_t maxOutSize,
+                       size_t& actualCodeSize);
+
+// Decodes an MJPEG frame of inSize into a planar or semi-planar YUV 4:2:0 layout of outSize, which
+// must be inSize divided by 1, 2, 4 or 8.
+int decodeMjpeg(const uint8_t* mjpeg, size_t mjpegSize, const Size& inSize, const Size& outSize,
+                const YCbCrLayout& out);
+
+// Returns the size to decode MJPEG frames of v4lSize to: the smallest of the 1/2, 1/4 and 1/8
+// scales decodeMjpeg supports that is still at least as large as every stream, so no stream is
+// upscaled. Only scales that give exact, even sizes are used.
+Size getMjpegDecodeSize(const Size& v4lSize, const std::vector<Size>& streamSizes);
+
 Size getMaxThumbnailResolution(const common::V1_0::helper::CameraMetadata&);
 
 void freeReleaseFences(std::vector<CaptureResult>&);
@@ -252,6 +287,31 @@ void freeReleaseFences(std::vector<CaptureResult>&);
 status_t fillCaptureResultCommon(common::V1_0::helper::CameraMetadata& md, nsecs_t timestamp,
                                  camera_metadata_ro_entry& activeArraySize);
 
+// Builds the result metadata of consecutive frames. Repeating requests usually carry the same
+// settings every frame, so the result only differs from the previous frame's by the sensor
+// timestamp. The previous result is then copied and patched instead of being built tag by tag, and
+// when it does have to be built, the settings buffer is grown once to the size of the previous
+// result rather than reallocated as tags are added.
+class ResultMetadataCache {
+  public:
+    // Writes the serialized result metadata of a frame with the given request settings to out.
+    // fill turns the settings into the result in place. It is only called if the settings, or
+    // stateKey standing for any other state fill depends on, differ from the previous frame.
+    status_t build(common::V1_0::helper::CameraMetadata& settings, uint32_t stateKey,
+                   nsecs_t timestamp,
+                   const std::function<status_t(common::V1_0::helper::CameraMetadata&)>& fill,
+                   std::vector<uint8_t>* out);
+
+    void clear();
+
+  private:
+    std::vector<uint8_t> mSettings;  // serialized settings of the previous frame
+    uint32_t mStateKey = 0;
+    std::vector<uint8_t> mResult;  // serialized result of the previous frame
+    size_t mEntryCapacity = 0;
+    size_t mDataCapacity = 0;
+};
+
 // Interface for OutputThread calling back to parent
 struct OutputThreadInterface {
     virtual ~OutputThreadInterface() {}
@@ -291,6 +351,93 @@ class AllocatedV4L2Frame : public Frame {
     std::vector<uint8_t> mData;
 };
 
+// Latency histogram of one processing stage, with power-of-two microsecond buckets. record() is
+// lock-free so it can be called for every frame from any thread.
+class LatencyHistogram {
+  public:
+    void record(nsecs_t latencyNs);
+
+    // Prints the sample count and the mean, p50, p99 and max latency in microseconds. Percentiles
+    // are reported as the upper bound of the bucket they fall into.
+    void dump(int fd, const char* name) const;
+
+  private:
+    static const int kNumBuckets = 24;  // the last bucket holds everything above ~8 seconds
+
+    std::atomic<uint64_t> mBuckets[kNumBuckets] = {};
+    std::atomic<uint64_t> mTotalUs = 0;
+    std::atomic<uint64_t> mMaxUs = 0;
+};
+
+// A small fixed pool of threads running batches of independent jobs, e.g. filling the output
+// buffers of one capture request in parallel.
+class WorkerPool {
+  public:
+    explicit WorkerPool(size_t numThreads);
+    ~WorkerPool();
+
+    // Runs all the jobs on the worker threads and the calling thread, and returns once all of them
+    // are done. Returns 0 if every job returned 0, otherwise the result of a failed job.
+    // Must not be called from more than one thread at a time.
+    int run(std::vector<std::function<int()>>& jobs);
+
+  private:
+    void workerLoop();
+    // Runs the next job of the current batch with mLock released.
+    void runNextJobLocked(std::unique_lock<std::mutex>& lk);
+
+    std::mutex mLock;
+    std::condition_variable mJobCond;   // signaled when a batch is posted or the pool exits
+    std::condition_variable mDoneCond;  // signaled when the last job of a batch is done
+    std::vector<std::function<int()>>* mJobs = nullptr;
+    size_t mNextJob = 0;
+    size_t mPendingJobs = 0;
+    int mResult = 0;
+    bool mExit = false;
+    std::vector<std::thread> mThreads;
+};
+
+// Encodes YU12 images to JPEG, keeping the libjpeg compressors and their output buffers across
+// images. Large images are cut into horizontal stripes that are encoded in parallel, each stripe
+// being one restart interval of the final image, and stitched together without re-encoding.
+class JpegEncoder {
+  public:
+    // Up to numThreads stripes are encoded at a time, on numThreads - 1 worker threads and the
+    // calling thread.
+    explicit JpegEncoder(size_t numThreads);
+    ~JpegEncoder();
+
+    // Encodes the image into the internal buffers, running sideJob (if any) in parallel with the
+    // stripes. The image is complete once finish() is called.
+    int encodeStripes(const Size& inSz, const YCbCrLayout& inLayout, int jpegQuality,
+                      const std::function<int()>& sideJob = nullptr);
+
+    // Writes the last image encoded by encodeStripes() to out, with the APP1 data if any.
+    int finish(const void* app1Buffer, size_t app1Size, void* out, size_t maxOutSize,
+               size_t& actualCodeSize);
+
+    // encodeStripes() and finish() in one go, a drop-in for encodeJpegYU12().
+    int encode(const Size& inSz, const YCbCrLayout& inLayout, int jpegQuality,
+               const void* app1Buffer, size_t app1Size, void* out, size_t maxOutSize,
+               size_t& actualCodeSize);
+
+  private:
+    struct Stripe;
+
+    // Stripes shorter than this many MCU rows are not worth a thread
+    static const uint32_t kMinMcuRowsPerStripe = 8;
+
+    int encodeStripe(Stripe& stripe, const Size& inSz, const YCbCrLayout& inLayout,
+                     int jpegQuality, uint32_t firstRow, uint32_t numRows,
+                     uint32_t restartInterval);
+
+    std::vector<std::unique_ptr<Stripe>> mStripes;
+    std::unique_ptr<WorkerPool> mWorkers;
+    // The last image encoded by encodeStripes()
+    Size mImageSize = {0, 0};
+    size_t mNumStripes = 0;
+};
+
 }  // namespace implementation
 }  // namespace device
 }  // namespace camera
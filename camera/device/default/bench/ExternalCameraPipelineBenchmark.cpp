@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the per-frame processing of the external camera HAL without a camera: MJPEG decode,
+// crop and scale, format conversion to the output layout, and thumbnail plus JPEG encode for still
+// captures. These are the stages OutputThread runs for every request.
+//
+// Frames are synthesized by default. To use frames recorded from a real camera, which compress
+// differently from a synthetic pattern, set EXTERNAL_CAMERA_BENCHMARK_FRAMES to a directory with
+// one MJPEG frame per V4L2 size, named <width>x<height>.jpg.
+
+#include "ExternalCameraDeviceSession.h"
+#include "ExternalCameraUtils.h"
+
+#include <Exif.h>
+#include <benchmark/benchmark.h>
+#include <utils/Timers.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace implementation {
+
+using ::aidl::android::hardware::graphics::common::PixelFormat;
+using ::android::hardware::camera::common::V1_0::helper::ExifUtils;
+using ::android::hardware::camera::external::common::Size;
+
+namespace {
+
+constexpr int kJpegQuality = 95;
+constexpr int kThumbQuality = 85;
+// The quality webcams typically encode their MJPEG frames with
+constexpr int kMjpegQuality = 85;
+constexpr Size kThumbSize = {320, 240};
+
+// The V4L2 frame sizes, selected by the first benchmark argument
+const std::vector<Size> kV4l2Sizes = {{1280, 720}, {1920, 1080}};
+
+struct StreamSpec {
+    // A zero size means the V4L2 frame size
+    Size size;
+    PixelFormat format;
+};
+
+// The configured streams, selected by the second benchmark argument
+const std::vector<std::vector<StreamSpec>> kStreamCombinations = {
+        // Preview only
+        {{{640, 360}, PixelFormat::YCBCR_420_888}},
+        // Preview and video recording
+        {{{640, 360}, PixelFormat::YCBCR_420_888}, {{1280, 720}, PixelFormat::YCBCR_420_888}},
+        // Preview and a full size still capture
+        {{{640, 360}, PixelFormat::YCBCR_420_888}, {{0, 0}, PixelFormat::BLOB}},
+};
+
+// A frame of color bars over a gradient, so the encoder sees both flat areas and edges
+std::vector<uint8_t> synthesizeMjpegFrame(const Size& size) {
+    AllocatedFrame frame(size.width, size.height);
+    YCbCrLayout layout;
+    if (frame.allocate(&layout) != 0) {
+        return {};
+    }
+    const uint8_t barY[] = {235, 210, 170, 145, 106, 81, 41, 16};
+    for (int32_t y = 0; y < size.height; y++) {
+        uint8_t* row = static_cast<uint8_t*>(layout.y) + y * layout.yStride;
+        for (int32_t x = 0; x < size.width; x++) {
+            row[x] = (barY[x * 8 / size.width] + (x + y) % 32) & 0xFF;
+        }
+    }
+    for (int32_t y = 0; y < size.height / 2; y++) {
+        uint8_t* cb = static_cast<uint8_t*>(layout.cb) + y * layout.cStride;
+        uint8_t* cr = static_cast<uint8_t*>(layout.cr) + y * layout.cStride;
+        for (int32_t x = 0; x < size.width / 2; x++) {
+            cb[x] = (x * 2 * 256 / size.width) & 0xFF;
+            cr[x] = (y * 2 * 256 / size.height) & 0xFF;
+        }
+    }
+
+    std::vector<uint8_t> mjpeg(size.width * size.height * 3 / 2);
+    size_t mjpegSize = 0;
+    if (encodeJpegYU12(size, layout, kMjpegQuality, nullptr, 0, mjpeg.data(), mjpeg.size(),
+                       mjpegSize) != 0) {
+        return {};
+    }
+    mjpeg.resize(mjpegSize);
+    return mjpeg;
+}
+
+std::vector<uint8_t> loadMjpegFrame(const Size& size) {
+    const char* dir = getenv("EXTERNAL_CAMERA_BENCHMARK_FRAMES");
+    if (dir != nullptr) {
+        std::string path = std::string(dir) + "/" + std::to_string(size.width) + "x" +
+                           std::to_string(size.height) + ".jpg";
+        std::ifstream file(path, std::ios::binary);
+        if (file) {
+            return std::vector<uint8_t>(std::istreambuf_iterator<char>(file),
+                                        std::istreambuf_iterator<char>());
+        }
+    }
+    return synthesizeMjpegFrame(size);
+}
+
+// Collects the latency of one stage for every processed frame
+class StageLatency final {
+  public:
+    explicit StageLatency(const char* name) : mName(name) {}
+
+    void record(nsecs_t latency) { mLatencies.push_back(latency); }
+
+    void clear() { mLatencies.clear(); }
+
+    // Reports the stage throughput and latency percentiles as benchmark counters
+    void report(benchmark::State& state) {
+        if (mLatencies.empty()) {
+            return;
+        }
+        std::sort(mLatencies.begin(), mLatencies.end());
+        double total = 0;
+        for (nsecs_t latency : mLatencies) {
+            total += latency;
+        }
+        double meanNs = total / mLatencies.size();
+        state.counters[mName + "_fps"] = 1e9 / meanNs;
+        state.counters[mName + "_p50_us"] = percentile(50) / 1000.0;
+        state.counters[mName + "_p99_us"] = percentile(99) / 1000.0;
+    }
+
+  private:
+    nsecs_t percentile(size_t p) const {
+        return mLatencies[std::min(mLatencies.size() - 1, mLatencies.size() * p / 100)];
+    }
+
+    const std::string mName;
+    std::vector<nsecs_t> mLatencies;
+};
+
+// A host memory stand-in for an NV21 gralloc buffer, the layout most gralloc implementations
+// return for YCBCR_420_888
+struct OutputBuffer {
+    Size size;
+    PixelFormat format;
+    std::vector<uint8_t> data;
+    YCbCrLayout layout;
+};
+
+}  // namespace
+
+class ExternalCameraPipelineBenchmark : public benchmark::Fixture {
+  public:
+    void SetUp(const benchmark::State& state) override {
+        mV4l2Size = kV4l2Sizes[state.range(0)];
+        mMjpegFrame = loadMjpegFrame(mV4l2Size);
+
+        std::vector<Stream> streams;
+        std::vector<Size> streamSizes;
+        mOutputBuffers.clear();
+        for (const auto& spec : kStreamCombinations[state.range(1)]) {
+            Size size = spec.size.width == 0 ? mV4l2Size : spec.size;
+            Stream stream;
+            stream.id = static_cast<int32_t>(streams.size());
+            stream.width = size.width;
+            stream.height = size.height;
+            stream.format = spec.format;
+            streams.push_back(stream);
+            streamSizes.push_back(size);
+            mOutputBuffers.push_back(allocateOutputBuffer(size, spec.format));
+        }
+        mDecodeSize = getMjpegDecodeSize(mV4l2Size, streamSizes);
+
+        for (StageLatency* latency : {&mDecodeLatency, &mCropAndScaleLatency,
+                                      &mFormatConvertLatency, &mThumbnailLatency,
+                                      &mJpegEncodeLatency}) {
+            latency->clear();
+        }
+
+        mThread = std::make_unique<ExternalCameraDeviceSession::OutputThread>(
+                std::weak_ptr<OutputThreadInterface>(), VERTICAL, mCameraCharacteristics,
+                /*bufReqThread=*/nullptr);
+        // The same encoder setup as createJpegLocked
+        mJpegEncoder = std::make_unique<JpegEncoder>(std::clamp<size_t>(
+                std::thread::hardware_concurrency(), 1,
+                ExternalCameraDeviceSession::OutputThread::kMaxJpegEncodeThreads));
+        mSetUpSucceeded = !mMjpegFrame.empty() &&
+                          mThread->allocateIntermediateBuffers(mDecodeSize, kThumbSize, streams,
+                                                               /*blobBufferSize=*/0) == Status::OK;
+    }
+
+    void TearDown(const benchmark::State&) override {
+        mThread.reset();
+        mJpegEncoder.reset();
+        mOutputBuffers.clear();
+        mMjpegFrame.clear();
+    }
+
+  protected:
+    bool setUpSucceeded() const { return mSetUpSucceeded; }
+
+    // Processes one frame the way the decode and output stages do, minus gralloc and the
+    // callbacks to the framework
+    bool processFrame() {
+        std::lock_guard<std::mutex> lk(mThread->mBufferLock);
+        std::shared_ptr<AllocatedFrame> yu12Frame = mThread->mYu12Frame;
+        YCbCrLayout yu12Layout;
+        yu12Frame->getLayout(&yu12Layout);
+
+        nsecs_t start = systemTime();
+        if (decodeMjpeg(mMjpegFrame.data(), mMjpegFrame.size(), mV4l2Size, mDecodeSize,
+                        yu12Layout) != 0) {
+            return false;
+        }
+        mDecodeLatency.record(systemTime() - start);
+
+        for (auto& buffer : mOutputBuffers) {
+            bool ok = buffer.format == PixelFormat::BLOB ? encodeJpeg(yu12Frame, buffer)
+                                                         : convertYuv(yu12Frame, buffer);
+            if (!ok) {
+                return false;
+            }
+        }
+
+        std::lock_guard<std::mutex> scaledLk(mThread->mScaledYu12FramesLock);
+        mThread->mScaledYu12Frames.clear();
+        return true;
+    }
+
+    void report(benchmark::State& state) {
+        mDecodeLatency.report(state);
+        mCropAndScaleLatency.report(state);
+        mFormatConvertLatency.report(state);
+        mThumbnailLatency.report(state);
+        mJpegEncodeLatency.report(state);
+        state.SetItemsProcessed(state.iterations());
+        state.SetLabel(std::to_string(mV4l2Size.width) + "x" + std::to_string(mV4l2Size.height) +
+                       " decoded at " + std::to_string(mDecodeSize.width) + "x" +
+                       std::to_string(mDecodeSize.height));
+    }
+
+  private:
+    static OutputBuffer allocateOutputBuffer(const Size& size, PixelFormat format) {
+        OutputBuffer buffer{.size = size, .format = format};
+        if (format == PixelFormat::BLOB) {
+            // The JPEG buffer size for a poorly compressed image, see getJpegBufferSize
+            buffer.data.resize(size.width * size.height * 3 / 2 + 64 * 1024);
+            return buffer;
+        }
+        buffer.data.resize(size.width * size.height * 3 / 2);
+        uint8_t* y = buffer.data.data();
+        uint8_t* vu = y + size.width * size.height;
+        buffer.layout = {.y = y,
+                         .cb = vu + 1,
+                         .cr = vu,
+                         .yStride = static_cast<uint32_t>(size.width),
+                         .cStride = static_cast<uint32_t>(size.width),
+                         .chromaStep = 2};
+        return buffer;
+    }
+
+    bool convertYuv(std::shared_ptr<AllocatedFrame>& in, OutputBuffer& buffer) {
+        nsecs_t start = systemTime();
+        YCbCrLayout scaled;
+        if (mThread->cropAndScaleLocked(in, buffer.size, &scaled) != 0) {
+            return false;
+        }
+        nsecs_t scaleEnd = systemTime();
+        mCropAndScaleLatency.record(scaleEnd - start);
+
+        if (formatConvert(scaled, buffer.layout, buffer.size, getFourCcFromLayout(buffer.layout)) !=
+            0) {
+            return false;
+        }
+        mFormatConvertLatency.record(systemTime() - scaleEnd);
+        return true;
+    }
+
+    bool encodeJpeg(std::shared_ptr<AllocatedFrame>& in, OutputBuffer& buffer) {
+        nsecs_t start = systemTime();
+        YCbCrLayout thumb;
+        if (mThread->cropAndScaleThumbLocked(in, kThumbSize, &thumb) != 0) {
+            return false;
+        }
+        std::vector<uint8_t> thumbCode(64 * 1024);
+        size_t thumbCodeSize = 0;
+        if (encodeJpegYU12(kThumbSize, thumb, kThumbQuality, nullptr, 0, thumbCode.data(),
+                           thumbCode.size(), thumbCodeSize) != 0) {
+            return false;
+        }
+        std::unique_ptr<ExifUtils> utils(ExifUtils::create());
+        utils->initialize();
+        utils->setFromMetadata(mCameraCharacteristics, buffer.size.width, buffer.size.height);
+        if (!utils->generateApp1(thumbCode.data(), thumbCodeSize)) {
+            return false;
+        }
+        nsecs_t thumbEnd = systemTime();
+        mThumbnailLatency.record(thumbEnd - start);
+
+        YCbCrLayout main;
+        if (mThread->cropAndScaleLocked(in, buffer.size, &main) != 0) {
+            return false;
+        }
+        size_t jpegCodeSize = 0;
+        if (mJpegEncoder->encode(buffer.size, main, kJpegQuality, utils->getApp1Buffer(),
+                                 utils->getApp1Length(), buffer.data.data(), buffer.data.size(),
+                                 jpegCodeSize) != 0) {
+            return false;
+        }
+        mJpegEncodeLatency.record(systemTime() - thumbEnd);
+        return true;
+    }
+
+    const common::V1_0::helper::CameraMetadata mCameraCharacteristics;
+    Size mV4l2Size;
+    Size mDecodeSize;
+    std::vector<uint8_t> mMjpegFrame;
+    std::vector<OutputBuffer> mOutputBuffers;
+    std::unique_ptr<ExternalCameraDeviceSession::OutputThread> mThread;
+    std::unique_ptr<JpegEncoder> mJpegEncoder;
+    bool mSetUpSucceeded = false;
+
+    StageLatency mDecodeLatency{"decode"};
+    StageLatency mCropAndScaleLatency{"crop_scale"};
+    StageLatency mFormatConvertLatency{"format_convert"};
+    StageLatency mThumbnailLatency{"thumbnail"};
+    StageLatency mJpegEncodeLatency{"jpeg_encode"};
+};
+
+// Measures processing one MJPEG frame into every output buffer of a stream combination. The
+// per-stage counters show where the time goes.
+BENCHMARK_DEFINE_F(ExternalCameraPipelineBenchmark, BM_processFrame)(benchmark::State& state) {
+    if (!setUpSucceeded()) {
+        state.SkipWithError("failed to set up the pipeline");
+        return;
+    }
+    for (auto _ : state) {
+        if (!processFrame()) {
+            state.SkipWithError("failed to process frame");
+            break;
+        }
+    }
+    report(state);
+}
+BENCHMARK_REGISTER_F(ExternalCameraPipelineBenchmark, BM_processFrame)
+        ->ArgNames({"v4l2_size", "streams"})
+        ->ArgsProduct({{0, 1}, {0, 1, 2}})
+        ->Unit(benchmark::kMillisecond);
+
+}  // namespace implementation
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures building the result metadata of one frame from its request settings, which
+// processCaptureResult does for every frame: copying the settings, adding the result tags and
+// serializing the result for the callback.
+// Built into ExternalCameraPipelineBenchmark, whose source defines main().
+
+#include "ExternalCameraUtils.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace implementation {
+
+namespace {
+
+constexpr int32_t kActiveArraySize[] = {0, 0, 1920, 1080};
+
+// Request settings like those of the preview template of the external camera
+CameraMetadata makeSettings() {
+    CameraMetadata md;
+    const uint8_t aberrationMode = ANDROID_COLOR_CORRECTION_ABERRATION_MODE_OFF;
+    md.update(ANDROID_COLOR_CORRECTION_ABERRATION_MODE, &aberrationMode, 1);
+    const int32_t exposureCompensation = 0;
+    md.update(ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION, &exposureCompensation, 1);
+    const uint8_t videoStabilizationMode = ANDROID_CONTROL_VIDEO_STABILIZATION_MODE_OFF;
+    md.update(ANDROID_CONTROL_VIDEO_STABILIZATION_MODE, &videoStabilizationMode, 1);
+    const uint8_t awbMode = ANDROID_CONTROL_AWB_MODE_AUTO;
+    md.update(ANDROID_CONTROL_AWB_MODE, &awbMode, 1);
+    const uint8_t aeMode = ANDROID_CONTROL_AE_MODE_ON;
+    md.update(ANDROID_CONTROL_AE_MODE, &aeMode, 1);
+    const uint8_t aePrecaptureTrigger = ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER_IDLE;
+    md.update(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER, &aePrecaptureTrigger, 1);
+    const uint8_t afMode = ANDROID_CONTROL_AF_MODE_AUTO;
+    md.update(ANDROID_CONTROL_AF_MODE, &afMode, 1);
+    const uint8_t afTrigger = ANDROID_CONTROL_AF_TRIGGER_IDLE;
+    md.update(ANDROID_CONTROL_AF_TRIGGER, &afTrigger, 1);
+    const uint8_t sceneMode = ANDROID_CONTROL_SCENE_MODE_DISABLED;
+    md.update(ANDROID_CONTROL_SCENE_MODE, &sceneMode, 1);
+    const uint8_t effectMode = ANDROID_CONTROL_EFFECT_MODE_OFF;
+    md.update(ANDROID_CONTROL_EFFECT_MODE, &effectMode, 1);
+    const uint8_t flashMode = ANDROID_FLASH_MODE_OFF;
+    md.update(ANDROID_FLASH_MODE, &flashMode, 1);
+    const int32_t thumbnailSize[] = {240, 180};
+    md.update(ANDROID_JPEG_THUMBNAIL_SIZE, thumbnailSize, 2);
+    const uint8_t jpegQuality = 90;
+    md.update(ANDROID_JPEG_QUALITY, &jpegQuality, 1);
+    md.update(ANDROID_JPEG_THUMBNAIL_QUALITY, &jpegQuality, 1);
+    const int32_t jpegOrientation = 0;
+    md.update(ANDROID_JPEG_ORIENTATION, &jpegOrientation, 1);
+    const uint8_t oisMode = ANDROID_LENS_OPTICAL_STABILIZATION_MODE_OFF;
+    md.update(ANDROID_LENS_OPTICAL_STABILIZATION_MODE, &oisMode, 1);
+    const uint8_t nrMode = ANDROID_NOISE_REDUCTION_MODE_OFF;
+    md.update(ANDROID_NOISE_REDUCTION_MODE, &nrMode, 1);
+    const int32_t testPatternMode = ANDROID_SENSOR_TEST_PATTERN_MODE_OFF;
+    md.update(ANDROID_SENSOR_TEST_PATTERN_MODE, &testPatternMode, 1);
+    const uint8_t fdMode = ANDROID_STATISTICS_FACE_DETECT_MODE_OFF;
+    md.update(ANDROID_STATISTICS_FACE_DETECT_MODE, &fdMode, 1);
+    const uint8_t hotpixelMode = ANDROID_STATISTICS_HOT_PIXEL_MAP_MODE_OFF;
+    md.update(ANDROID_STATISTICS_HOT_PIXEL_MAP_MODE, &hotpixelMode, 1);
+    const int32_t fpsRange[] = {15, 30};
+    md.update(ANDROID_CONTROL_AE_TARGET_FPS_RANGE, fpsRange, 2);
+    const uint8_t antibandingMode = ANDROID_CONTROL_AE_ANTIBANDING_MODE_AUTO;
+    md.update(ANDROID_CONTROL_AE_ANTIBANDING_MODE, &antibandingMode, 1);
+    const uint8_t controlMode = ANDROID_CONTROL_MODE_AUTO;
+    md.update(ANDROID_CONTROL_MODE, &controlMode, 1);
+    const uint8_t intent = ANDROID_CONTROL_CAPTURE_INTENT_PREVIEW;
+    md.update(ANDROID_CONTROL_CAPTURE_INTENT, &intent, 1);
+    return md;
+}
+
+CameraMetadata makeCharacteristics() {
+    CameraMetadata chars;
+    chars.update(ANDROID_SENSOR_INFO_ACTIVE_ARRAY_SIZE, kActiveArraySize, 4);
+    return chars;
+}
+
+// What ExternalCameraDeviceSession::fillCaptureResult adds to the settings
+status_t fillResult(CameraMetadata& md, nsecs_t timestamp) {
+    static const CameraMetadata chars = makeCharacteristics();
+    camera_metadata_ro_entry activeArraySize = chars.find(ANDROID_SENSOR_INFO_ACTIVE_ARRAY_SIZE);
+    const uint8_t afState = ANDROID_CONTROL_AF_STATE_INACTIVE;
+    if (md.update(ANDROID_CONTROL_AF_STATE, &afState, 1) != OK) {
+        return BAD_VALUE;
+    }
+    return fillCaptureResultCommon(md, timestamp, activeArraySize);
+}
+
+}  // namespace
+
+// Copies the settings, adds the result tags and serializes the result for every frame
+static void BM_buildResultMetadata(benchmark::State& state) {
+    const CameraMetadata settings = makeSettings();
+    nsecs_t timestamp = 0;
+    for (auto _ : state) {
+        CameraMetadata md = settings;  // what every HalRequest carries
+        if (fillResult(md, timestamp++) != OK) {
+            state.SkipWithError("failed to fill the result");
+            break;
+        }
+        const camera_metadata_t* raw = md.getAndLock();
+        const uint8_t* rawBytes = reinterpret_cast<const uint8_t*>(raw);
+        std::vector<uint8_t> result(rawBytes, rawBytes + get_camera_metadata_size(raw));
+        md.unlock(raw);
+        benchmark::DoNotOptimize(result.data());
+    }
+}
+BENCHMARK(BM_buildResultMetadata);
+
+// Builds the result through ResultMetadataCache. With the first argument set, the settings change
+// every frame like during a manual control sweep, so the previous result can never be reused.
+static void BM_buildResultMetadataCached(benchmark::State& state) {
+    const bool settingsChange = state.range(0) != 0;
+    CameraMetadata settings = makeSettings();
+    ResultMetadataCache cache;
+    nsecs_t timestamp = 0;
+    int32_t exposureCompensation = 0;
+    for (auto _ : state) {
+        if (settingsChange) {
+            exposureCompensation = (exposureCompensation + 1) % 4;
+            settings.update(ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION, &exposureCompensation, 1);
+        }
+        CameraMetadata md = settings;
+        std::vector<uint8_t> result;
+        nsecs_t frameTimestamp = timestamp++;
+        if (cache.build(
+                    md, /*stateKey*/ 0, frameTimestamp,
+                    [&](CameraMetadata& resultMd) { return fillResult(resultMd, frameTimestamp); },
+                    &result) != OK) {
+            state.SkipWithError("failed to build the result");
+            break;
+        }
+        benchmark::DoNotOptimize(result.data());
+    }
+}
+BENCHMARK(BM_buildResultMetadataCached)->ArgName("settings_change")->Arg(0)->Arg(1);
+
+}  // namespace implementation
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
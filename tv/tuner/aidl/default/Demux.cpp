@@ -21,6 +21,7 @@
 #include <aidl/android/hardware/tv/tuner/Result.h>
 
 #include <utils/Log.h>
+#include <algorithm>
 #include "Demux.h"
 
 namespace aidl {
@@ -181,8 +182,15 @@ Demux::~Demux() {
     for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
         mDvrPlayback->removePlaybackFilter(*it);
     }
-    mPlaybackFilterIds.clear();
-    mRecordFilterIds.clear();
+    {
+        std::lock_guard<std::mutex> lock(mPidTableLock);
+        for (auto& filters : mPidTable) {
+            filters.clear();
+        }
+        mFilterTpids.clear();
+        mPlaybackFilterIds.clear();
+        mRecordFilterIds.clear();
+    }
     mFilters.clear();
     mLastUsedFilterId = -1;
     if (mTuner != nullptr) {
@@ -268,42 +276,74 @@ Demux::~Demux() {
     if (mDvrPlayback != nullptr) {
         mDvrPlayback->removePlaybackFilter(filterId);
     }
-    mPlaybackFilterIds.erase(filterId);
-    mRecordFilterIds.erase(filterId);
+    {
+        std::lock_guard<std::mutex> lock(mPidTableLock);
+        unindexFilterLocked(filterId);
+        mFilterTpids.erase(filterId);
+        mPlaybackFilterIds.erase(filterId);
+        mRecordFilterIds.erase(filterId);
+    }
     mFilters.erase(filterId);
 
     return ::ndk::ScopedAStatus::ok();
 }
 
-void Demux::startBroadcastTsFilter(vector<int8_t> data) {
-    set<int64_t>::iterator it;
-    uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
-    if (DEBUG_DEMUX) {
-        ALOGW("[Demux] start ts filter pid: %d", pid);
+static uint16_t getTsPid(const int8_t* packet) {
+    return ((packet[1] & 0x1f) << 8) | ((packet[2] & 0xff));
+}
+
+void Demux::startBroadcastTsFilter(const vector<int8_t>& data) {
+    startBroadcastTsFilter(data.data(), data.size(), data.size());
+}
+
+void Demux::startBroadcastTsFilter(const int8_t* packets, size_t size, size_t packetSize) {
+    if (packetSize < 3) {
+        return;
     }
-    for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
-        if (pid == mFilters[*it]->getTpid()) {
-            mFilters[*it]->updateFilterOutput(data);
+    std::lock_guard<std::mutex> lock(mPidTableLock);
+    size_t runStart = 0;
+    while (runStart + packetSize <= size) {
+        uint16_t pid = getTsPid(packets + runStart);
+        size_t runEnd = runStart + packetSize;
+        while (runEnd + packetSize <= size && getTsPid(packets + runEnd) == pid) {
+            runEnd += packetSize;
+        }
+        if (DEBUG_DEMUX) {
+            ALOGW("[Demux] start ts filter pid: %d", pid);
+        }
+        for (const auto& filter : mPidTable[pid]) {
+            if (!filter->isRecordFilter()) {
+                filter->updateFilterOutput(packets + runStart, runEnd - runStart);
+            }
         }
+        runStart = runEnd;
     }
 }
 
-void Demux::sendFrontendInputToRecord(vector<int8_t> data) {
+void Demux::sendFrontendInputToRecord(const vector<int8_t>& data) {
+    sendFrontendInputToRecord(data.data(), data.size());
+}
+
+void Demux::sendFrontendInputToRecord(const int8_t* data, size_t size) {
     set<int64_t>::iterator it;
     if (DEBUG_DEMUX) {
         ALOGW("[Demux] update record filter output");
     }
+    std::lock_guard<std::mutex> lock(mPidTableLock);
     for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        mFilters[*it]->updateRecordOutput(data);
+        mFilters[*it]->updateRecordOutput(data, size);
     }
 }
 
-void Demux::sendFrontendInputToRecord(vector<int8_t> data, uint16_t pid, uint64_t pts) {
+void Demux::sendFrontendInputToRecord(const vector<int8_t>& data, uint16_t pid, uint64_t pts) {
     sendFrontendInputToRecord(data);
-    set<int64_t>::iterator it;
-    for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        if (pid == mFilters[*it]->getTpid()) {
-            mFilters[*it]->updatePts(pts);
+    if (pid >= TS_PID_COUNT) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mPidTableLock);
+    for (const auto& filter : mPidTable[pid]) {
+        if (filter->isRecordFilter()) {
+            filter->updatePts(pts);
         }
     }
 }
@@ -350,6 +390,40 @@ uint16_t Demux::getFilterTpid(int64_t filterId) {
     return mFilters[filterId]->getTpid();
 }
 
+void Demux::setFilterTpid(int64_t filterId, uint16_t tpid) {
+    std::lock_guard<std::mutex> lock(mPidTableLock);
+    unindexFilterLocked(filterId);
+    if (tpid >= TS_PID_COUNT) {
+        // Can't match the PID of any TS packet.
+        mFilterTpids.erase(filterId);
+        return;
+    }
+    mFilterTpids[filterId] = tpid;
+    indexFilterLocked(filterId);
+}
+
+void Demux::indexFilterLocked(int64_t filterId) {
+    map<int64_t, uint16_t>::iterator tpid = mFilterTpids.find(filterId);
+    map<int64_t, std::shared_ptr<Filter>>::iterator filter = mFilters.find(filterId);
+    if (tpid == mFilterTpids.end() || filter == mFilters.end()) {
+        return;
+    }
+    // Record filters only receive data once they are attached to the DVR.
+    if (mPlaybackFilterIds.count(filterId) || mRecordFilterIds.count(filterId)) {
+        mPidTable[tpid->second].push_back(filter->second);
+    }
+}
+
+void Demux::unindexFilterLocked(int64_t filterId) {
+    map<int64_t, uint16_t>::iterator tpid = mFilterTpids.find(filterId);
+    map<int64_t, std::shared_ptr<Filter>>::iterator filter = mFilters.find(filterId);
+    if (tpid == mFilterTpids.end() || filter == mFilters.end()) {
+        return;
+    }
+    vector<std::shared_ptr<Filter>>& filters = mPidTable[tpid->second];
+    filters.erase(std::remove(filters.begin(), filters.end(), filter->second), filters.end());
+}
+
 int32_t Demux::getDemuxId() {
     return mDemuxId;
 }
@@ -471,7 +545,12 @@ bool Demux::attachRecordFilter(int64_t filterId) {
         return false;
     }
 
-    mRecordFilterIds.insert(filterId);
+    {
+        std::lock_guard<std::mutex> lock(mPidTableLock);
+        unindexFilterLocked(filterId);
+        mRecordFilterIds.insert(filterId);
+        indexFilterLocked(filterId);
+    }
     mFilters[filterId]->attachFilterToRecord(mDvrRecord);
 
     return true;
@@ -482,7 +561,11 @@ bool Demux::detachRecordFilter(int64_t filterId) {
         return false;
     }
 
-    mRecordFilterIds.erase(filterId);
+    {
+        std::lock_guard<std::mutex> lock(mPidTableLock);
+        unindexFilterLocked(filterId);
+        mRecordFilterIds.erase(filterId);
+    }
     mFilters[filterId]->detachFilterFromRecord();
 
     return true;
@@ -20,9 +20,13 @@
 
 #include <fmq/AidlMessageQueue.h>
 #include <math.h>
+#include <array>
 #include <atomic>
+#include <map>
+#include <mutex>
 #include <set>
 #include <thread>
+#include <vector>
 
 #include "Dvr.h"
 #include "Filter.h"
@@ -45,6 +49,9 @@ using ::android::hardware::EventFlag;
 
 using FilterMQ = AidlMessageQueue<int8_t, SynchronizedReadWrite>;
 
+// Number of distinct PIDs, which are 13 bits long in a TS packet header.
+const uint16_t TS_PID_COUNT = 0x2000;
+
 class Dvr;
 class Filter;
 class Frontend;
@@ -82,6 +89,7 @@ class Demux : public BnDemux {
     void updateFilterOutput(int64_t filterId, vector<int8_t> data);
     void updateMediaFilterOutput(int64_t filterId, vector<int8_t> data, uint64_t pts);
     uint16_t getFilterTpid(int64_t filterId);
+    void setFilterTpid(int64_t filterId, uint16_t tpid);
     void setIsRecording(bool isRecording);
     bool isRecording();
     void startFrontendInputLoop();
@@ -92,10 +100,16 @@ class Demux : public BnDemux {
      * Note that recording filters are not included.
      */
     bool startBroadcastFilterDispatcher();
-    void startBroadcastTsFilter(vector<int8_t> data);
+    void startBroadcastTsFilter(const vector<int8_t>& data);
+    /**
+     * Dispatch a batch of consecutive TS packets of packetSize bytes each.
+     * A run of packets with the same PID is appended to each filter output at once.
+     */
+    void startBroadcastTsFilter(const int8_t* packets, size_t size, size_t packetSize);
 
-    void sendFrontendInputToRecord(vector<int8_t> data);
-    void sendFrontendInputToRecord(vector<int8_t> data, uint16_t pid, uint64_t pts);
+    void sendFrontendInputToRecord(const vector<int8_t>& data);
+    void sendFrontendInputToRecord(const int8_t* data, size_t size);
+    void sendFrontendInputToRecord(const vector<int8_t>& data, uint16_t pid, uint64_t pts);
     bool startRecordFilterDispatcher();
 
     void getDemuxInfo(DemuxInfo* demuxInfo);
@@ -130,6 +144,13 @@ class Demux : public BnDemux {
     void deleteEventFlag();
     bool readDataFromMQ();
 
+    /**
+     * Add or remove a filter in the PID table entry of its tpid.
+     * Need to be called with mPidTableLock held.
+     */
+    void indexFilterLocked(int64_t filterId);
+    void unindexFilterLocked(int64_t filterId);
+
     int32_t mDemuxId = -1;
     int32_t mCiCamId;
     set<int64_t> mPcrFilterIds;
@@ -153,6 +174,21 @@ class Demux : public BnDemux {
      * The array number is the filter ID.
      */
     std::map<int64_t, std::shared_ptr<Filter>> mFilters;
+    /**
+     * The tpid of each configured TS filter.
+     */
+    std::map<int64_t, uint16_t> mFilterTpids;
+    /**
+     * The playback filters and the attached record filters, indexed by tpid. Each TS packet is
+     * dispatched with one lookup in this table instead of a scan of all the filters.
+     * Kept in sync with mFilterTpids, mPlaybackFilterIds and mRecordFilterIds.
+     */
+    std::array<std::vector<std::shared_ptr<Filter>>, TS_PID_COUNT> mPidTable;
+    /**
+     * Lock to protect mFilterTpids and mPidTable, which the input threads read while the filters
+     * are configured or closed.
+     */
+    std::mutex mPidTableLock;
 
     /**
      * Local reference to the opened Timer Filter instance.
@@ -267,27 +267,62 @@ PlaybackStatus Dvr::checkPlaybackStatusChange(uint32_t availableToWrite, uint32_
 
 bool Dvr::readPlaybackFMQ(bool isVirtualFrontend, bool isRecording) {
     // Read playback data from the input FMQ
-    size_t size = mDvrMQ->availableToRead();
     int64_t playbackPacketSize = mDvrSettings.get<DvrSettings::Tag::playback>().packetSize;
-    vector<int8_t> dataOutputBuffer;
-    dataOutputBuffer.resize(playbackPacketSize);
-    // Dispatch the packet to the PID matching filter output buffer
-    for (int i = 0; i < size / playbackPacketSize; i++) {
-        if (!mDvrMQ->read(dataOutputBuffer.data(), playbackPacketSize)) {
-            return false;
-        }
-        if (isVirtualFrontend) {
-            if (isRecording) {
-                mDemux->sendFrontendInputToRecord(dataOutputBuffer);
-            } else {
-                mDemux->startBroadcastTsFilter(dataOutputBuffer);
-            }
+    if (playbackPacketSize <= 0) {
+        ALOGE("[Dvr] Invalid playback packet size %" PRId64, playbackPacketSize);
+        return false;
+    }
+    size_t packetSize = static_cast<size_t>(playbackPacketSize);
+    size_t size = mDvrMQ->availableToRead() / packetSize * packetSize;
+    if (size == 0) {
+        return true;
+    }
+
+    // Dispatch the packets in place in the FMQ, one batch per contiguous region. The data is only
+    // copied when appended to the output buffers of the filters.
+    DvrMQ::MemTransaction tx;
+    if (!mDvrMQ->beginRead(size, &tx)) {
+        return false;
+    }
+    const DvrMQ::MemRegion& first = tx.getFirstRegion();
+    const DvrMQ::MemRegion& second = tx.getSecondRegion();
+    size_t firstSize = first.getLength() / packetSize * packetSize;
+    size_t secondOffset = 0;
+    dispatchPlaybackPackets(first.getAddress(), firstSize, packetSize, isVirtualFrontend,
+                            isRecording);
+    if (first.getLength() > firstSize) {
+        // A packet wraps around the end of the FMQ, dispatch it from a copy.
+        size_t headSize = first.getLength() - firstSize;
+        secondOffset = packetSize - headSize;
+        vector<int8_t> packet(packetSize);
+        memcpy(packet.data(), first.getAddress() + firstSize, headSize);
+        memcpy(packet.data() + headSize, second.getAddress(), secondOffset);
+        dispatchPlaybackPackets(packet.data(), packetSize, packetSize, isVirtualFrontend,
+                                isRecording);
+    }
+    if (second.getLength() > secondOffset) {
+        dispatchPlaybackPackets(second.getAddress() + secondOffset,
+                                second.getLength() - secondOffset, packetSize, isVirtualFrontend,
+                                isRecording);
+    }
+
+    return mDvrMQ->commitRead(size);
+}
+
+void Dvr::dispatchPlaybackPackets(const int8_t* packets, size_t size, size_t packetSize,
+                                  bool isVirtualFrontend, bool isRecording) {
+    if (size == 0) {
+        return;
+    }
+    if (isVirtualFrontend) {
+        if (isRecording) {
+            mDemux->sendFrontendInputToRecord(packets, size);
         } else {
-            startTpidFilter(dataOutputBuffer);
+            mDemux->startBroadcastTsFilter(packets, size, packetSize);
         }
+    } else {
+        startTpidFilter(packets, size, packetSize);
     }
-
-    return true;
 }
 
 bool Dvr::processEsDataOnPlayback(bool isVirtualFrontend, bool isRecording) {
@@ -410,17 +445,13 @@ void Dvr::getMetaDataValue(int& index, int8_t* dataOutputBuffer, int& value) {
     }
 }
 
-void Dvr::startTpidFilter(vector<int8_t> data) {
-    map<int64_t, std::shared_ptr<IFilter>>::iterator it;
-    for (it = mFilters.begin(); it != mFilters.end(); it++) {
-        uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
-        if (DEBUG_DVR) {
-            ALOGW("[Dvr] start ts filter pid: %d", pid);
-        }
-        if (pid == mDemux->getFilterTpid(it->first)) {
-            mDemux->updateFilterOutput(it->first, data);
-        }
+void Dvr::startTpidFilter(const int8_t* packets, size_t size, size_t packetSize) {
+    if (DEBUG_DVR) {
+        ALOGW("[Dvr] start ts filter on %zu packets", size / packetSize);
     }
+    // The playback filters of the DVR are the playback filters of its demux, which dispatches
+    // the packets through its PID table.
+    mDemux->startBroadcastTsFilter(packets, size, packetSize);
 }
 
 bool Dvr::startFilterDispatcher(bool isVirtualFrontend, bool isRecording) {
@@ -111,7 +111,12 @@ class Dvr : public BnDvr {
      * A dispatcher to read and dispatch input data to all the started filters.
      * Each filter handler handles the data filtering/output writing/filterEvent updating.
      */
-    void startTpidFilter(vector<int8_t> data);
+    void startTpidFilter(const int8_t* packets, size_t size, size_t packetSize);
+    /**
+     * Send a batch of whole playback packets to the filters the current input mode routes them to.
+     */
+    void dispatchPlaybackPackets(const int8_t* packets, size_t size, size_t packetSize,
+                                 bool isVirtualFrontend, bool isRecording);
     void playbackThreadLoop();
 
     unique_ptr<DvrMQ> mDvrMQ;
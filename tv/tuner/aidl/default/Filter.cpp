@@ -305,6 +305,8 @@ Filter::~Filter() {
     switch (mType.mainType) {
         case DemuxFilterMainType::TS:
             mTpid = in_settings.get<DemuxFilterSettings::Tag::ts>().tpid;
+            mDemux->setFilterTpid(mFilterId, mTpid);
+            configureSection(in_settings.get<DemuxFilterSettings::Tag::ts>().filterSettings);
             break;
         case DemuxFilterMainType::MMTP:
             break;
@@ -322,6 +324,31 @@ Filter::~Filter() {
     return ::ndk::ScopedAStatus::ok();
 }
 
+void Filter::configureSection(const DemuxTsFilterSettingsFilterSettings& filterSettings) {
+    if (filterSettings.getTag() != DemuxTsFilterSettingsFilterSettings::Tag::section) {
+        return;
+    }
+    const DemuxFilterSectionSettings& settings =
+            filterSettings.get<DemuxTsFilterSettingsFilterSettings::Tag::section>();
+    std::lock_guard<std::mutex> lock(mFilterOutputLock);
+    // Without isRepeat, a section is only output once per version
+    mSectionAssembler.configure(settings.isCheckCrc, !settings.isRepeat);
+    mHasTableCondition = settings.condition.getTag() ==
+                         DemuxFilterSectionSettingsCondition::Tag::tableInfo;
+    if (mHasTableCondition) {
+        const DemuxFilterSectionSettingsConditionTableInfo& tableInfo =
+                settings.condition.get<DemuxFilterSectionSettingsCondition::Tag::tableInfo>();
+        mTableId = tableInfo.tableId;
+        mTableVersion = tableInfo.version;
+    }
+    mHasBitsCondition = settings.condition.getTag() ==
+                        DemuxFilterSectionSettingsCondition::Tag::sectionBits;
+    if (mHasBitsCondition) {
+        mSectionBits =
+                settings.condition.get<DemuxFilterSectionSettingsCondition::Tag::sectionBits>();
+    }
+}
+
 ::ndk::ScopedAStatus Filter::start() {
     ALOGV("%s", __FUNCTION__);
     mFilterThreadRunning = true;
@@ -665,6 +692,15 @@ binder_status_t Filter::dump(int fd, const char** /* args */, uint32_t /* numArg
     dprintf(fd, "      mIsRecordFilter: %d\n", mIsRecordFilter);
     dprintf(fd, "      mIsUsingFMQ: %d\n", mIsUsingFMQ);
     dprintf(fd, "      mFilterThreadRunning: %d\n", (bool)mFilterThreadRunning);
+    if (mType.mainType == DemuxFilterMainType::TS &&
+        mType.subType.get<DemuxFilterSubType::Tag::tsFilterType>() == DemuxTsFilterType::SECTION) {
+        std::lock_guard<std::mutex> lock(mFilterOutputLock);
+        SectionAssembler::Stats stats = mSectionAssembler.getStats();
+        dprintf(fd, "      Sections: %" PRIu64 "\n", stats.sections);
+        dprintf(fd, "      Continuity errors: %" PRIu64 "\n", stats.continuityErrors);
+        dprintf(fd, "      CRC errors: %" PRIu64 "\n", stats.crcErrors);
+        dprintf(fd, "      Repeated sections: %" PRIu64 "\n", stats.repeatedSections);
+    }
     return STATUS_OK;
 }
 
@@ -704,9 +740,13 @@ uint16_t Filter::getTpid() {
     return mTpid;
 }
 
-void Filter::updateFilterOutput(vector<int8_t>& data) {
+void Filter::updateFilterOutput(const vector<int8_t>& data) {
+    updateFilterOutput(data.data(), data.size());
+}
+
+void Filter::updateFilterOutput(const int8_t* data, size_t size) {
     std::lock_guard<std::mutex> lock(mFilterOutputLock);
-    mFilterOutput.insert(mFilterOutput.end(), data.begin(), data.end());
+    mFilterOutput.insert(mFilterOutput.end(), data, data + size);
 }
 
 void Filter::updatePts(uint64_t pts) {
@@ -714,9 +754,13 @@ void Filter::updatePts(uint64_t pts) {
     mPts = pts;
 }
 
-void Filter::updateRecordOutput(vector<int8_t>& data) {
+void Filter::updateRecordOutput(const vector<int8_t>& data) {
+    updateRecordOutput(data.data(), data.size());
+}
+
+void Filter::updateRecordOutput(const int8_t* data, size_t size) {
     std::lock_guard<std::mutex> lock(mRecordFilterOutputLock);
-    mRecordFilterOutput.insert(mRecordFilterOutput.end(), data.begin(), data.end());
+    mRecordFilterOutput.insert(mRecordFilterOutput.end(), data, data + size);
 }
 
 ::ndk::ScopedAStatus Filter::startFilterHandler() {
@@ -997,51 +1041,43 @@ void Filter::updateRecordOutput(vector<int8_t>& data) {
 // Read PSI (Program Specific Information) Sections from TransportStreams
 // as defined in ISO/IEC 13818-1 Section 2.4.4
 bool Filter::writeSectionsAndCreateEvent(vector<int8_t>& data) {
-    // TODO check how many sections has been read
     ALOGD("[Filter] section handler");
 
     // Transport Stream Packets are 188 bytes long, as defined in the
     // Introduction of ISO/IEC 13818-1
-    for (int i = 0; i < data.size(); i += 188) {
-        if (mSectionSizeLeft == 0) {
-            // Location for sectionSize as defined by Section 2.4.4
-            // Note that the first 4 bytes skipped are the TsHeader
-            mSectionSizeLeft = ((static_cast<uint8_t>(data[i + 5]) & 0x0f) << 8) |
-                               static_cast<uint8_t>(data[i + 6]);
-            mSectionSizeLeft += 3;
-            if (DEBUG_FILTER) {
-                ALOGD("[Filter] section data length %d", mSectionSizeLeft);
-            }
-        }
-
-        // 184 bytes per packet is derived by subtracting the 4 byte length of
-        // the TsHeader from its 188 byte packet size
-        uint32_t endPoint = min(184u, mSectionSizeLeft);
-        // append data and check size
-        vector<int8_t>::const_iterator first = data.begin() + i + 4;
-        vector<int8_t>::const_iterator last = data.begin() + i + 4 + endPoint;
-        mSectionOutput.insert(mSectionOutput.end(), first, last);
-        // size does not match then continue
-        mSectionSizeLeft -= endPoint;
-        if (DEBUG_FILTER) {
-            ALOGD("[Filter] section data left %d", mSectionSizeLeft);
+    vector<vector<int8_t>> sections;
+    for (size_t i = 0; i + 188 <= data.size(); i += 188) {
+        mSectionAssembler.pushPacket(data.data() + i, 188, &sections);
+    }
+
+    for (auto&& section : sections) {
+        int32_t tableId = static_cast<uint8_t>(section[0]);
+        // The long form sections, with section_syntax_indicator set, have a version and a number
+        bool isLongForm = section.size() >= 8 && (section[1] & 0x80);
+        int32_t version = isLongForm ? (section[5] >> 1) & 0x1f : 0;
+        int32_t sectionNum = isLongForm ? static_cast<uint8_t>(section[6]) : 0;
+        if (mHasTableCondition &&
+            (tableId != mTableId ||
+             (mTableVersion != static_cast<int32_t>(Constant::INVALID_TABINFO_VERSION) &&
+              version != mTableVersion))) {
+            continue;
         }
-        if (mSectionSizeLeft > 0) {
+        if (mHasBitsCondition &&
+            !SectionAssembler::matchBits(section, mSectionBits.filter, mSectionBits.mask,
+                                         mSectionBits.mode)) {
             continue;
         }
 
-        if (!writeDataToFilterMQ(mSectionOutput)) {
-            mSectionOutput.clear();
+        if (!writeDataToFilterMQ(section)) {
             return false;
         }
 
         DemuxFilterSectionEvent secEvent;
         secEvent = {
-                // temp dump meta data
-                .tableId = 0,
-                .version = 1,
-                .sectionNum = 1,
-                .dataLength = static_cast<int32_t>(mSectionOutput.size()),
+                .tableId = tableId,
+                .version = version,
+                .sectionNum = sectionNum,
+                .dataLength = static_cast<int64_t>(section.size()),
         };
         if (DEBUG_FILTER) {
             ALOGD("[Filter] assembled section data length %" PRIu64, secEvent.dataLength);
@@ -1052,7 +1088,6 @@ bool Filter::writeSectionsAndCreateEvent(vector<int8_t>& data) {
             mFilterEvents.push_back(
                     DemuxFilterEvent::make<DemuxFilterEvent::Tag::section>(secEvent));
         }
-        mSectionOutput.clear();
     }
 
     return true;
@@ -34,6 +34,7 @@
 #include "Demux.h"
 #include "Dvr.h"
 #include "Frontend.h"
+#include "SectionAssembler.h"
 
 using namespace std;
 
@@ -136,8 +137,10 @@ class Filter : public BnFilter {
      */
     bool createFilterMQ();
     uint16_t getTpid();
-    void updateFilterOutput(vector<int8_t>& data);
-    void updateRecordOutput(vector<int8_t>& data);
+    void updateFilterOutput(const vector<int8_t>& data);
+    void updateFilterOutput(const int8_t* data, size_t size);
+    void updateRecordOutput(const vector<int8_t>& data);
+    void updateRecordOutput(const int8_t* data, size_t size);
     void updatePts(uint64_t pts);
     ::ndk::ScopedAStatus startFilterHandler();
     ::ndk::ScopedAStatus startRecordFilterHandler();
@@ -206,6 +209,7 @@ class Filter : public BnFilter {
     ::ndk::ScopedAStatus startPcrFilterHandler();
     ::ndk::ScopedAStatus startTemiFilterHandler();
     ::ndk::ScopedAStatus startFilterLoop();
+    void configureSection(const DemuxTsFilterSettingsFilterSettings& filterSettings);
 
     void deleteEventFlag();
     bool writeDataToFilterMQ(const std::vector<int8_t>& data);
@@ -257,9 +261,13 @@ class Filter : public BnFilter {
     std::mutex mFilterOutputLock;
     std::mutex mRecordFilterOutputLock;
 
-    // handle single Section filter
-    uint32_t mSectionSizeLeft = 0;
-    vector<int8_t> mSectionOutput;
+    // Section filter reassembly and table or bits condition
+    SectionAssembler mSectionAssembler;
+    bool mHasTableCondition = false;
+    int32_t mTableId = 0;
+    int32_t mTableVersion = static_cast<int32_t>(Constant::INVALID_TABINFO_VERSION);
+    bool mHasBitsCondition = false;
+    DemuxFilterSectionBits mSectionBits;
 
     // temp handle single PES filter
     // TODO handle mulptiple Pes filters
@@ -0,0 +1,266 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "SectionAssembler.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+namespace {
+
+const uint8_t TS_SYNC_BYTE = 0x47;
+const size_t TS_HEADER_SIZE = 4;
+const uint8_t STUFFING_BYTE = 0xff;
+// table_id and the 12 bits section_length
+const size_t SECTION_HEADER_SIZE = 3;
+// The section_length of a private section is at most 4093
+const size_t MAX_SECTION_SIZE = 4096;
+// Header up to last_section_number, and CRC_32
+const size_t MIN_LONG_SECTION_SIZE = 12;
+
+const uint32_t CRC32_POLYNOMIAL = 0x04c11db7;
+
+struct Crc32Tables {
+    uint32_t table[8][256];
+};
+
+// table[k][i] is the CRC of the byte i followed by k zero bytes.
+constexpr Crc32Tables makeCrc32Tables() {
+    Crc32Tables tables = {};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ CRC32_POLYNOMIAL : crc << 1;
+        }
+        tables.table[0][i] = crc;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            uint32_t crc = tables.table[k - 1][i];
+            tables.table[k][i] = (crc << 8) ^ tables.table[0][crc >> 24];
+        }
+    }
+    return tables;
+}
+
+constexpr Crc32Tables CRC32_TABLES = makeCrc32Tables();
+
+}  // namespace
+
+uint32_t SectionAssembler::crc32(const uint8_t* data, size_t size) {
+    const auto& t = CRC32_TABLES.table;
+    uint32_t crc = 0xffffffff;
+    // Slicing-by-8: the 8 table lookups of each 8 bytes don't depend on each other.
+    while (size >= 8) {
+        uint32_t high = crc ^ (static_cast<uint32_t>(data[0]) << 24 |
+                               static_cast<uint32_t>(data[1]) << 16 |
+                               static_cast<uint32_t>(data[2]) << 8 | data[3]);
+        crc = t[7][high >> 24] ^ t[6][(high >> 16) & 0xff] ^ t[5][(high >> 8) & 0xff] ^
+              t[4][high & 0xff] ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+    }
+    return crc;
+}
+
+bool SectionAssembler::matchBits(const vector<int8_t>& section, const vector<int8_t>& filter,
+                                 const vector<int8_t>& mask, const vector<int8_t>& mode) {
+    bool hasNegativeBits = false;
+    bool negativeMismatch = false;
+    for (size_t i = 0; i < mask.size(); i++) {
+        uint8_t maskByte = mask[i];
+        if (maskByte == 0) {
+            continue;
+        }
+        size_t sectionIndex = i == 0 ? 0 : i + 2;
+        if (sectionIndex >= section.size()) {
+            return false;
+        }
+        uint8_t filterByte = i < filter.size() ? filter[i] : 0;
+        uint8_t modeByte = i < mode.size() ? mode[i] : 0;
+        uint8_t diff = (section[sectionIndex] ^ filterByte) & maskByte;
+        if (diff & ~modeByte) {
+            return false;
+        }
+        hasNegativeBits |= (maskByte & modeByte) != 0;
+        negativeMismatch |= (diff & modeByte) != 0;
+    }
+    return !hasNegativeBits || negativeMismatch;
+}
+
+void SectionAssembler::configure(bool checkCrc, bool skipRepeatedVersions) {
+    mCheckCrc = checkCrc;
+    mSkipRepeatedVersions = skipRepeatedVersions;
+    reset();
+}
+
+void SectionAssembler::reset() {
+    dropSection();
+    mContinuityCounter = -1;
+    mVersions.clear();
+}
+
+void SectionAssembler::pushPacket(const int8_t* packet, size_t size,
+                                  vector<vector<int8_t>>* sections) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(packet);
+    // Drop the packets flagged with transport_error_indicator
+    if (size < TS_HEADER_SIZE || data[0] != TS_SYNC_BYTE || (data[1] & 0x80)) {
+        dropSection();
+        mContinuityCounter = -1;
+        return;
+    }
+
+    bool payloadUnitStart = data[1] & 0x40;
+    uint8_t adaptationFieldControl = (data[3] >> 4) & 0x03;
+    int continuityCounter = data[3] & 0x0f;
+    if (!(adaptationFieldControl & 0x01)) {
+        // No payload, the continuity counter doesn't change
+        return;
+    }
+    size_t payloadStart = TS_HEADER_SIZE;
+    bool discontinuity = false;
+    if (adaptationFieldControl & 0x02) {
+        size_t adaptationFieldLength = data[TS_HEADER_SIZE];
+        if (adaptationFieldLength > 0 && TS_HEADER_SIZE + 1 < size) {
+            discontinuity = data[TS_HEADER_SIZE + 1] & 0x80;
+        }
+        payloadStart += 1 + adaptationFieldLength;
+    }
+    if (payloadStart > size) {
+        dropSection();
+        return;
+    }
+
+    if (mContinuityCounter >= 0 && !discontinuity) {
+        if (continuityCounter == mContinuityCounter) {
+            // Duplicate packet
+            return;
+        }
+        if (continuityCounter != ((mContinuityCounter + 1) & 0x0f)) {
+            mStats.continuityErrors++;
+            dropSection();
+        }
+    }
+    mContinuityCounter = continuityCounter;
+
+    const uint8_t* payload = data + payloadStart;
+    size_t payloadSize = size - payloadStart;
+    if (!payloadUnitStart) {
+        appendPayload(payload, payloadSize, false /*canStartSection*/, sections);
+        return;
+    }
+
+    size_t pointer = payloadSize > 0 ? payload[0] : 0;
+    if (payloadSize == 0 || 1 + pointer > payloadSize) {
+        dropSection();
+        return;
+    }
+    // The bytes up to the pointed one end the previous section
+    appendPayload(payload + 1, pointer, false /*canStartSection*/, sections);
+    if (mAssembling) {
+        // The previous section is truncated
+        dropSection();
+    }
+    mAssembling = true;
+    appendPayload(payload + 1 + pointer, payloadSize - 1 - pointer, true /*canStartSection*/,
+                  sections);
+}
+
+void SectionAssembler::appendPayload(const uint8_t* payload, size_t size, bool canStartSection,
+                                     vector<vector<int8_t>>* sections) {
+    while (mAssembling && size > 0) {
+        if (mSection.empty() && payload[0] == STUFFING_BYTE) {
+            // Stuffing up to the end of the packet
+            mAssembling = false;
+            return;
+        }
+
+        size_t needed = mSection.size() < SECTION_HEADER_SIZE
+                                ? SECTION_HEADER_SIZE - mSection.size()
+                                : mSectionSize - mSection.size();
+        size_t length = std::min(needed, size);
+        mSection.insert(mSection.end(), payload, payload + length);
+        payload += length;
+        size -= length;
+
+        if (mSectionSize == 0 && mSection.size() == SECTION_HEADER_SIZE) {
+            mSectionSize = SECTION_HEADER_SIZE + (((mSection[1] & 0x0f) << 8) |
+                                                  static_cast<uint8_t>(mSection[2]));
+            if (mSectionSize > MAX_SECTION_SIZE) {
+                dropSection();
+                return;
+            }
+        }
+        if (mSectionSize > 0 && mSection.size() == mSectionSize) {
+            outputSection(sections);
+            // Only a packet with payload_unit_start_indicator carries the start of a section
+            mAssembling = canStartSection;
+        }
+    }
+}
+
+void SectionAssembler::outputSection(vector<vector<int8_t>>* sections) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(mSection.data());
+    size_t size = mSection.size();
+    // Only the long form sections, with section_syntax_indicator set, have a version and a CRC
+    if (data[1] & 0x80) {
+        if (mCheckCrc && (size < MIN_LONG_SECTION_SIZE || crc32(data, size) != 0)) {
+            mStats.crcErrors++;
+            mSection.clear();
+            mSectionSize = 0;
+            return;
+        }
+        if (mSkipRepeatedVersions && size >= MIN_LONG_SECTION_SIZE) {
+            uint32_t key = static_cast<uint32_t>(data[0]) << 24 |
+                           static_cast<uint32_t>(data[3]) << 16 |
+                           static_cast<uint32_t>(data[4]) << 8 | data[6];
+            uint8_t version = (data[5] >> 1) & 0x1f;
+            map<uint32_t, uint8_t>::iterator it = mVersions.find(key);
+            if (it != mVersions.end() && it->second == version) {
+                mStats.repeatedSections++;
+                mSection.clear();
+                mSectionSize = 0;
+                return;
+            }
+            mVersions[key] = version;
+        }
+    }
+
+    mStats.sections++;
+    sections->push_back(std::move(mSection));
+    mSection.clear();
+    mSectionSize = 0;
+}
+
+void SectionAssembler::dropSection() {
+    mAssembling = false;
+    mSection.clear();
+    mSectionSize = 0;
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
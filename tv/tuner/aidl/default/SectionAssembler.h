@@ -0,0 +1,112 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+/**
+ * Reassembles the PSI/SI sections carried by the TS packets of one PID,
+ * as defined in ISO/IEC 13818-1 Section 2.4.4.
+ *
+ * Sections may span several packets, and several sections may share a packet.
+ * The pointer_field of a packet starting a section locates the first new section.
+ * A continuity counter error or a corrupted packet drops the section being assembled,
+ * and the assembly resumes at the next packet starting a section.
+ */
+class SectionAssembler {
+  public:
+    struct Stats {
+        uint64_t sections = 0;
+        uint64_t continuityErrors = 0;
+        uint64_t crcErrors = 0;
+        uint64_t repeatedSections = 0;
+    };
+
+    /**
+     * checkCrc: drop the long form sections with a wrong CRC_32.
+     * skipRepeatedVersions: drop the long form sections already output with the same
+     * table_id, table_id_extension, section_number and version_number.
+     * Also resets the assembly.
+     */
+    void configure(bool checkCrc, bool skipRepeatedVersions);
+    void reset();
+
+    /**
+     * Feed a TS packet of the PID. The complete sections are appended to sections,
+     * each one from its table_id to its last byte.
+     */
+    void pushPacket(const int8_t* packet, size_t size, vector<vector<int8_t>>* sections);
+
+    Stats getStats() { return mStats; }
+
+    /**
+     * CRC_32 of the MPEG-2 systems, as defined in ISO/IEC 13818-1 Annex A.
+     * The CRC_32 of a whole section including its CRC_32 field is 0.
+     */
+    static uint32_t crc32(const uint8_t* data, size_t size);
+
+    /**
+     * Whether the section matches the filter, mask and mode bytes of DemuxFilterSectionBits.
+     * As for the Linux DVB section filters, the first byte applies to the table_id and the
+     * next bytes to the section from its fourth byte on, skipping the section_length.
+     * All the masked bits with a mode bit of 0 must be equal to the filter, and when some
+     * masked bits have a mode bit of 1, at least one of them must differ from the filter.
+     */
+    static bool matchBits(const vector<int8_t>& section, const vector<int8_t>& filter,
+                          const vector<int8_t>& mask, const vector<int8_t>& mode);
+
+  private:
+    // Append the payload bytes to the section being assembled.
+    void appendPayload(const uint8_t* payload, size_t size, bool canStartSection,
+                       vector<vector<int8_t>>* sections);
+    void outputSection(vector<vector<int8_t>>* sections);
+    void dropSection();
+
+    bool mCheckCrc = false;
+    bool mSkipRepeatedVersions = false;
+
+    // The section being assembled, valid when mAssembling is true
+    bool mAssembling = false;
+    vector<int8_t> mSection;
+    size_t mSectionSize = 0;
+
+    // Continuity counter of the last packet with payload, -1 if none
+    int mContinuityCounter = -1;
+
+    // The version_number of the sections already output, indexed by table_id,
+    // table_id_extension and section_number
+    std::map<uint32_t, uint8_t> mVersions;
+
+    Stats mStats;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of dispatching TS packets to the filters of a demux, depending on the number
+// of opened filters. The packets carry PIDs which no filter selects, like most of the packets of
+// a multiplex, so that the filter outputs don't grow while the benchmark runs.
+
+#include <aidl/android/hardware/tv/tuner/BnFilterCallback.h>
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+#include "Demux.h"
+
+namespace aidl::android::hardware::tv::tuner {
+namespace {
+
+constexpr int kTsPacketSize = 188;
+constexpr int kPacketCount = 64;
+constexpr uint16_t kFirstFilterPid = 0x100;
+constexpr uint16_t kFirstPacketPid = 0x1000;
+
+class FilterCallback : public BnFilterCallback {
+  public:
+    ::ndk::ScopedAStatus onFilterEvent(const std::vector<DemuxFilterEvent>&) override {
+        return ::ndk::ScopedAStatus::ok();
+    }
+    ::ndk::ScopedAStatus onFilterStatus(DemuxFilterStatus) override {
+        return ::ndk::ScopedAStatus::ok();
+    }
+};
+
+std::vector<int8_t> makePacket(uint16_t pid) {
+    std::vector<int8_t> packet(kTsPacketSize, static_cast<int8_t>(0xff));
+    packet[0] = 0x47;
+    packet[1] = static_cast<int8_t>((pid >> 8) & 0x1f);
+    packet[2] = static_cast<int8_t>(pid & 0xff);
+    packet[3] = 0x10;
+    return packet;
+}
+
+// A demux with 'filterCount' TS section filters, each on its own PID.
+class DemuxWithFilters {
+  public:
+    explicit DemuxWithFilters(int filterCount) {
+        mDemux = ::ndk::SharedRefBase::make<Demux>(0, 0);
+        std::shared_ptr<IFilterCallback> callback = ::ndk::SharedRefBase::make<FilterCallback>();
+        DemuxFilterType type = {
+                .mainType = DemuxFilterMainType::TS,
+                .subType = DemuxFilterSubType::make<DemuxFilterSubType::Tag::tsFilterType>(
+                        DemuxTsFilterType::SECTION),
+        };
+        for (int i = 0; i < filterCount; i++) {
+            std::shared_ptr<IFilter> filter;
+            if (!mDemux->openFilter(type, 4096, callback, &filter).isOk()) {
+                return;
+            }
+            DemuxTsFilterSettings settings = {.tpid = kFirstFilterPid + i};
+            filter->configure(DemuxFilterSettings::make<DemuxFilterSettings::Tag::ts>(settings));
+            mFilters.push_back(filter);
+        }
+    }
+    ~DemuxWithFilters() {
+        for (auto& filter : mFilters) {
+            filter->close();
+        }
+        mDemux->close();
+    }
+    bool isValid(int filterCount) const {
+        return mFilters.size() == static_cast<size_t>(filterCount);
+    }
+    Demux* get() const { return mDemux.get(); }
+
+  private:
+    std::shared_ptr<Demux> mDemux;
+    std::vector<std::shared_ptr<IFilter>> mFilters;
+};
+
+}  // namespace
+
+// One call per packet.
+static void BM_BroadcastTsDispatch(benchmark::State& state) {
+    DemuxWithFilters demux(state.range(0));
+    if (!demux.isValid(state.range(0))) {
+        state.SkipWithError("failed to open the filters");
+        return;
+    }
+    std::vector<std::vector<int8_t>> packets;
+    for (int i = 0; i < kPacketCount; i++) {
+        packets.push_back(makePacket(kFirstPacketPid + i));
+    }
+
+    for (auto _ : state) {
+        for (const auto& packet : packets) {
+            demux.get()->startBroadcastTsFilter(packet);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kPacketCount);
+    state.SetBytesProcessed(state.iterations() * kPacketCount * kTsPacketSize);
+}
+BENCHMARK(BM_BroadcastTsDispatch)->ArgName("filters")->Arg(1)->Arg(8)->Arg(32)->Arg(128);
+
+// One call per batch of contiguous packets, as read from the playback FMQ.
+static void BM_BroadcastTsBatchDispatch(benchmark::State& state) {
+    DemuxWithFilters demux(state.range(0));
+    if (!demux.isValid(state.range(0))) {
+        state.SkipWithError("failed to open the filters");
+        return;
+    }
+    std::vector<int8_t> batch;
+    for (int i = 0; i < kPacketCount; i++) {
+        std::vector<int8_t> packet = makePacket(kFirstPacketPid + i);
+        batch.insert(batch.end(), packet.begin(), packet.end());
+    }
+
+    for (auto _ : state) {
+        demux.get()->startBroadcastTsFilter(batch.data(), batch.size(), kTsPacketSize);
+    }
+    state.SetItemsProcessed(state.iterations() * kPacketCount);
+    state.SetBytesProcessed(state.iterations() * kPacketCount * kTsPacketSize);
+}
+BENCHMARK(BM_BroadcastTsBatchDispatch)->ArgName("filters")->Arg(1)->Arg(8)->Arg(32)->Arg(128);
+
+}  // namespace aidl::android::hardware::tv::tuner
+
+BENCHMARK_MAIN();
@@ -0,0 +1,295 @@
+/*
+ * Copyright 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "SectionAssembler.h"
+
+namespace {
+
+using aidl::android::hardware::tv::tuner::SectionAssembler;
+
+const size_t kPacketSize = 188;
+const size_t kHeaderSize = 4;
+
+// Bit by bit CRC_32 of ISO/IEC 13818-1 Annex A, to check the table driven one.
+uint32_t referenceCrc32(const std::vector<uint8_t>& data) {
+    uint32_t crc = 0xffffffff;
+    for (uint8_t byte : data) {
+        crc ^= static_cast<uint32_t>(byte) << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// A long form section with payloadSize bytes between last_section_number and CRC_32.
+std::vector<uint8_t> makeSection(uint8_t tableId, uint16_t extension, uint8_t version,
+                                 uint8_t sectionNumber, size_t payloadSize) {
+    // table_id_extension up to last_section_number, the payload and CRC_32
+    size_t sectionLength = 5 + payloadSize + 4;
+    std::vector<uint8_t> section = {tableId,
+                                    static_cast<uint8_t>(0xb0 | (sectionLength >> 8)),
+                                    static_cast<uint8_t>(sectionLength & 0xff),
+                                    static_cast<uint8_t>(extension >> 8),
+                                    static_cast<uint8_t>(extension & 0xff),
+                                    static_cast<uint8_t>(0xc1 | (version << 1)),
+                                    sectionNumber,
+                                    sectionNumber};
+    for (size_t i = 0; i < payloadSize; i++) {
+        section.push_back(static_cast<uint8_t>(i * 7 + tableId));
+    }
+    uint32_t crc = referenceCrc32(section);
+    section.push_back(crc >> 24);
+    section.push_back((crc >> 16) & 0xff);
+    section.push_back((crc >> 8) & 0xff);
+    section.push_back(crc & 0xff);
+    return section;
+}
+
+// A TS packet carrying payload, padded with stuffing bytes.
+std::vector<int8_t> makePacket(bool payloadUnitStart, int continuityCounter,
+                               const std::vector<uint8_t>& payload) {
+    std::vector<int8_t> packet(kPacketSize, static_cast<int8_t>(0xff));
+    packet[0] = 0x47;
+    packet[1] = payloadUnitStart ? 0x40 : 0x00;
+    packet[2] = 0x12;
+    packet[3] = static_cast<int8_t>(0x10 | (continuityCounter & 0x0f));
+    EXPECT_LE(kHeaderSize + payload.size(), kPacketSize);
+    std::copy(payload.begin(), payload.end(), packet.begin() + kHeaderSize);
+    return packet;
+}
+
+// Splits a section over packets, the first one starting with a zero pointer_field.
+std::vector<std::vector<int8_t>> packetize(const std::vector<uint8_t>& section,
+                                           int firstContinuityCounter) {
+    std::vector<std::vector<int8_t>> packets;
+    size_t offset = 0;
+    int continuityCounter = firstContinuityCounter;
+    while (offset < section.size()) {
+        bool first = offset == 0;
+        std::vector<uint8_t> payload;
+        if (first) {
+            payload.push_back(0);  // pointer_field
+        }
+        size_t length =
+                std::min(section.size() - offset, kPacketSize - kHeaderSize - payload.size());
+        payload.insert(payload.end(), section.begin() + offset, section.begin() + offset + length);
+        offset += length;
+        packets.push_back(makePacket(first, continuityCounter++, payload));
+    }
+    return packets;
+}
+
+std::vector<int8_t> toSigned(const std::vector<uint8_t>& data) {
+    return std::vector<int8_t>(data.begin(), data.end());
+}
+
+class SectionAssemblerTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mAssembler.configure(true /*checkCrc*/, true /*skipRepeatedVersions*/);
+    }
+
+    void push(const std::vector<int8_t>& packet) {
+        mAssembler.pushPacket(packet.data(), packet.size(), &mSections);
+    }
+
+    void push(const std::vector<std::vector<int8_t>>& packets) {
+        for (const auto& packet : packets) {
+            push(packet);
+        }
+    }
+
+    SectionAssembler mAssembler;
+    std::vector<std::vector<int8_t>> mSections;
+};
+
+TEST_F(SectionAssemblerTest, Crc32MatchesReference) {
+    std::vector<uint8_t> check = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    EXPECT_EQ(SectionAssembler::crc32(check.data(), check.size()), 0x0376e6e7u);
+
+    std::vector<uint8_t> data;
+    for (size_t size = 0; size < 40; size++) {
+        EXPECT_EQ(SectionAssembler::crc32(data.data(), data.size()), referenceCrc32(data))
+                << "size " << size;
+        data.push_back(static_cast<uint8_t>(size * 37 + 11));
+    }
+
+    auto section = makeSection(0x42, 1, 0, 0, 100);
+    EXPECT_EQ(SectionAssembler::crc32(section.data(), section.size()), 0u);
+}
+
+TEST_F(SectionAssemblerTest, SectionSplitAcrossPackets) {
+    auto section = makeSection(0x4e, 0x1234, 3, 0, 400);
+    auto packets = packetize(section, 0);
+    ASSERT_EQ(packets.size(), 3u);
+
+    push(packets);
+
+    ASSERT_EQ(mSections.size(), 1u);
+    EXPECT_EQ(mSections[0], toSigned(section));
+    EXPECT_EQ(mAssembler.getStats().sections, 1u);
+}
+
+TEST_F(SectionAssemblerTest, SeveralSectionsInOnePacketWithStuffing) {
+    auto first = makeSection(0x42, 1, 0, 0, 40);
+    auto second = makeSection(0x42, 1, 0, 1, 60);
+    std::vector<uint8_t> payload = {0};  // pointer_field
+    payload.insert(payload.end(), first.begin(), first.end());
+    payload.insert(payload.end(), second.begin(), second.end());
+
+    // makePacket fills the rest of the packet with stuffing bytes.
+    push(makePacket(true, 0, payload));
+
+    ASSERT_EQ(mSections.size(), 2u);
+    EXPECT_EQ(mSections[0], toSigned(first));
+    EXPECT_EQ(mSections[1], toSigned(second));
+
+    // The stuffing doesn't start a section, the next packet does.
+    auto third = makeSection(0x42, 1, 0, 2, 20);
+    push(packetize(third, 1));
+    ASSERT_EQ(mSections.size(), 3u);
+    EXPECT_EQ(mSections[2], toSigned(third));
+}
+
+TEST_F(SectionAssemblerTest, PointerFieldEndsPreviousSection) {
+    auto first = makeSection(0x42, 1, 0, 0, 250);
+    auto second = makeSection(0x42, 1, 0, 1, 30);
+    size_t firstPart = kPacketSize - kHeaderSize - 1;
+    size_t rest = first.size() - firstPart;
+
+    std::vector<uint8_t> payload = {0};
+    payload.insert(payload.end(), first.begin(), first.begin() + firstPart);
+    push(makePacket(true, 0, payload));
+    EXPECT_TRUE(mSections.empty());
+
+    payload = {static_cast<uint8_t>(rest)};
+    payload.insert(payload.end(), first.begin() + firstPart, first.end());
+    payload.insert(payload.end(), second.begin(), second.end());
+    push(makePacket(true, 1, payload));
+
+    ASSERT_EQ(mSections.size(), 2u);
+    EXPECT_EQ(mSections[0], toSigned(first));
+    EXPECT_EQ(mSections[1], toSigned(second));
+}
+
+TEST_F(SectionAssemblerTest, ContinuityCounterGapDropsSection) {
+    auto section = makeSection(0x4e, 1, 0, 0, 400);
+    auto packets = packetize(section, 0);
+    ASSERT_EQ(packets.size(), 3u);
+
+    // The second packet is lost.
+    push(packets[0]);
+    push(packets[2]);
+
+    EXPECT_TRUE(mSections.empty());
+    EXPECT_EQ(mAssembler.getStats().continuityErrors, 1u);
+
+    // The assembly resumes at the next section start.
+    auto next = makeSection(0x4e, 1, 0, 1, 20);
+    push(packetize(next, 3));
+    ASSERT_EQ(mSections.size(), 1u);
+    EXPECT_EQ(mSections[0], toSigned(next));
+}
+
+TEST_F(SectionAssemblerTest, DuplicatePacketIsIgnored) {
+    auto section = makeSection(0x4e, 1, 0, 0, 400);
+    auto packets = packetize(section, 14);
+    ASSERT_EQ(packets.size(), 3u);
+
+    push(packets[0]);
+    push(packets[1]);
+    push(packets[1]);
+    push(packets[2]);
+
+    ASSERT_EQ(mSections.size(), 1u);
+    EXPECT_EQ(mSections[0], toSigned(section));
+    EXPECT_EQ(mAssembler.getStats().continuityErrors, 0u);
+}
+
+TEST_F(SectionAssemblerTest, BadCrcIsDropped) {
+    auto section = makeSection(0x42, 1, 0, 0, 100);
+    section[50] ^= 0x01;
+
+    push(packetize(section, 0));
+
+    EXPECT_TRUE(mSections.empty());
+    EXPECT_EQ(mAssembler.getStats().crcErrors, 1u);
+
+    mAssembler.configure(false /*checkCrc*/, true /*skipRepeatedVersions*/);
+    push(packetize(section, 0));
+    ASSERT_EQ(mSections.size(), 1u);
+    EXPECT_EQ(mSections[0], toSigned(section));
+}
+
+TEST_F(SectionAssemblerTest, RepeatedVersionIsSkipped) {
+    auto section = makeSection(0x42, 1, 5, 0, 100);
+    auto otherSection = makeSection(0x42, 1, 5, 1, 100);
+    auto newVersion = makeSection(0x42, 1, 6, 0, 100);
+
+    push(packetize(section, 0));
+    push(packetize(section, 1));
+    push(packetize(otherSection, 2));
+    push(packetize(newVersion, 3));
+
+    ASSERT_EQ(mSections.size(), 3u);
+    EXPECT_EQ(mSections[0], toSigned(section));
+    EXPECT_EQ(mSections[1], toSigned(otherSection));
+    EXPECT_EQ(mSections[2], toSigned(newVersion));
+    EXPECT_EQ(mAssembler.getStats().repeatedSections, 1u);
+
+    // Without the check, the repetitions are output.
+    mAssembler.configure(true /*checkCrc*/, false /*skipRepeatedVersions*/);
+    push(packetize(newVersion, 0));
+    push(packetize(newVersion, 1));
+    EXPECT_EQ(mSections.size(), 5u);
+}
+
+TEST_F(SectionAssemblerTest, MatchBitsPositive) {
+    std::vector<uint8_t> bytes = makeSection(0x42, 0x1234, 3, 0, 4);
+    std::vector<int8_t> section(bytes.begin(), bytes.end());
+    // table_id, then table_id_extension after skipping section_length
+    EXPECT_TRUE(SectionAssembler::matchBits(section, {0x42, 0x12, 0x34}, {-1, -1, -1}, {}));
+    EXPECT_FALSE(SectionAssembler::matchBits(section, {0x42, 0x12, 0x35}, {-1, -1, -1}, {}));
+    // Only the masked bits are compared
+    EXPECT_TRUE(SectionAssembler::matchBits(section, {0x42, 0x12, 0x35}, {-1, -1, 0x0e}, {}));
+    EXPECT_TRUE(SectionAssembler::matchBits(section, {}, {}, {}));
+    // Masked bytes past the end of the section do not match
+    std::vector<int8_t> mask(section.size(), 0);
+    mask.back() = 1;
+    EXPECT_FALSE(SectionAssembler::matchBits(section, {}, mask, {}));
+}
+
+TEST_F(SectionAssemblerTest, MatchBitsNegative) {
+    std::vector<uint8_t> bytes = makeSection(0x42, 0x1234, 3, 0, 4);
+    std::vector<int8_t> section(bytes.begin(), bytes.end());
+    // A version_number other than 3, with the table_id 0x42
+    std::vector<int8_t> filter = {0x42, 0, 0, 3 << 1};
+    std::vector<int8_t> mask = {-1, 0, 0, 0x3e};
+    std::vector<int8_t> mode = {0, 0, 0, 0x3e};
+    EXPECT_FALSE(SectionAssembler::matchBits(section, filter, mask, mode));
+    filter[3] = 4 << 1;
+    EXPECT_TRUE(SectionAssembler::matchBits(section, filter, mask, mode));
+    filter[0] = 0x43;
+    EXPECT_FALSE(SectionAssembler::matchBits(section, filter, mask, mode));
+}
+
+}  // namespace